@@ -0,0 +1,511 @@
+#ifndef ___AUGMENTED_SKIP_LIST_HPP
+#define ___AUGMENTED_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+// Monoids for AugmentedSkipList. Each names its Aggregate type and gives
+// the aggregate of one value (lift), the aggregate of nothing (identity)
+// and an associative combine of two aggregates, left to right in key
+// order. combine need not be commutative.
+
+// Sum of the values.
+template<typename T>
+struct SumMonoid
+{
+	using Aggregate = T;
+	static Aggregate identity() { return T(); }
+	static Aggregate lift(const T & value) { return value; }
+	static Aggregate combine(const Aggregate & a, const Aggregate & b) { return a + b; }
+};
+
+// Number of keys.
+template<typename T>
+struct CountMonoid
+{
+	using Aggregate = size_t;
+	static Aggregate identity() { return 0; }
+	static Aggregate lift(const T &) { return 1; }
+	static Aggregate combine(const Aggregate & a, const Aggregate & b) { return a + b; }
+};
+
+// Smallest value; the identity is the largest T (infinity where there is one).
+template<typename T>
+struct MinMonoid
+{
+	using Aggregate = T;
+	static Aggregate identity()
+	{
+		return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+	}
+	static Aggregate lift(const T & value) { return value; }
+	static Aggregate combine(const Aggregate & a, const Aggregate & b) { return std::min(a, b); }
+};
+
+// Largest value; the identity is the smallest T (-infinity where there is one).
+template<typename T>
+struct MaxMonoid
+{
+	using Aggregate = T;
+	static Aggregate identity()
+	{
+		return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+	}
+	static Aggregate lift(const T & value) { return value; }
+	static Aggregate combine(const Aggregate & a, const Aggregate & b) { return std::max(a, b); }
+};
+
+// Count, sum, min and max at once. min and max are meaningless while
+// count is 0.
+template<typename T>
+struct ValueSummary
+{
+	size_t count = 0;
+	T sum = T();
+	T min = T();
+	T max = T();
+};
+
+template<typename T>
+struct SummaryMonoid
+{
+	using Aggregate = ValueSummary<T>;
+
+	static Aggregate identity() { return Aggregate(); }
+
+	static Aggregate lift(const T & value)
+	{
+		Aggregate a;
+		a.count = 1;
+		a.sum = value;
+		a.min = value;
+		a.max = value;
+		return a;
+	}
+
+	static Aggregate combine(const Aggregate & a, const Aggregate & b)
+	{
+		if(a.count == 0)
+		{
+			return b;
+		}
+		if(b.count == 0)
+		{
+			return a;
+		}
+		Aggregate c;
+		c.count = a.count + b.count;
+		c.sum = a.sum + b.sum;
+		c.min = std::min(a.min, b.min);
+		c.max = std::max(a.max, b.max);
+		return c;
+	}
+};
+
+/**
+ * @brief A skip list whose links cache an aggregate of the values they
+ * skip, answering range aggregates in O(log n).
+ *
+ * The link of node x on layer L leads to the next node y of height above L and caches the aggregate of the values of every key in
+ * (x.key, y.key], or of everything after x when there is no such y. On
+ * S_0 that is just y's value; above, it is the combine of the layer-below
+ * links from x up to y. This is the same bookkeeping as SkipList's node
+ * widths, with the width replaced by any monoid (see SumMonoid and its
+ * neighbours above).
+ *
+ * insert(), update() and erase() touch only the links on the key's search
+ * path and recompute each from the layer below, bottom-up, which costs
+ * O(log n) expected. aggregate(from, to) finds the last node before
+ * `from` and then combines cached links up and back down towards `to`,
+ * the way a finger search moves, so it also costs O(log n) instead of a
+ * walk over every key in the range.
+ *
+ * Those bounds rest on every layer holding about half the keys of the
+ * one below, sequential keys included; see towerHeight() for the key sets
+ * that break this. Not thread-safe.
+ *
+ *   AugmentedSkipList<unsigned, double, SummaryMonoid<double>> metrics;
+ *   metrics.insert(timestamp, latency);
+ *   ValueSummary<double> s = metrics.aggregate(from, to);
+ */
+template<typename Key, typename Value, typename Monoid = SumMonoid<Value>>
+class AugmentedSkipList
+{
+public:
+	using Aggregate = typename Monoid::Aggregate;
+
+	// Layers available to towers, S_0 included.
+	static const unsigned maxLevel = 32;
+
+private:
+	struct Node;
+
+	struct Link
+	{
+		Node * next = nullptr;
+		Aggregate aggregate = Monoid::identity();
+	};
+
+	// The tower of links is allocated right behind the node.
+	struct Node
+	{
+		Key key;
+		Value value;
+		unsigned height;
+
+		Node(const Key & k, const Value & v, unsigned h) : key(k), value(v), height(h)
+		{
+		}
+
+		static size_t linksOffset()
+		{
+			return (sizeof(Node) + alignof(Link) - 1) / alignof(Link) * alignof(Link);
+		}
+
+		Link * links()
+		{
+			return reinterpret_cast<Link *>(reinterpret_cast<char *>(this) + linksOffset());
+		}
+
+		static Node * create(const Key & k, const Value & v, unsigned height)
+		{
+			void * memory = ::operator new(linksOffset() + height * sizeof(Link));
+			Node * node = new(memory) Node(k, v, height);
+			for(unsigned level = 0; level < height; level++)
+			{
+				new(&node->links()[level]) Link();
+			}
+			return node;
+		}
+
+		static void destroy(Node * node)
+		{
+			for(unsigned level = 0; level < node->height; level++)
+			{
+				node->links()[level].~Link();
+			}
+			node->~Node();
+			::operator delete(node);
+		}
+	};
+
+	// Sentinel before every key, with a full tower.
+	Node * head;
+	// Layers holding at least one key, at least 1.
+	unsigned levels = 1;
+	size_t listSize = 0;
+
+	// Fills preds with the last node before k on every layer in use and
+	// returns the node holding k, or nullptr.
+	Node * search(const Key & k, Node ** preds) const;
+
+	// Recomputes the aggregate of x's link on `level` from the layer below.
+	static void refresh(Node * x, unsigned level);
+
+	// Refreshes the links of preds on every layer in use, bottom-up.
+	void refreshPath(Node ** preds);
+
+public:
+	AugmentedSkipList();
+
+	~AugmentedSkipList();
+
+	AugmentedSkipList(const AugmentedSkipList &) = delete;
+	AugmentedSkipList & operator=(const AugmentedSkipList &) = delete;
+
+	size_t size() const noexcept
+	{
+		return listSize;
+	}
+
+	bool isEmpty() const noexcept
+	{
+		return listSize == 0;
+	}
+
+	// Inserts k with value v. Returns false, leaving the list unchanged, if
+	// k is already present.
+	bool insert(const Key & k, const Value & v);
+
+	// Replaces the value of k. Returns false if k is not in the list.
+	bool update(const Key & k, const Value & v);
+
+	// Removes k. Returns false if k was not in the list.
+	bool erase(const Key & k);
+
+	bool contains(const Key & k) const;
+
+	// Copies the value of k into out and returns true, or returns false.
+	bool find(const Key & k, Value & out) const;
+
+	// The value of k; throws a RuntimeException if k is absent.
+	const Value & find(const Key & k) const;
+
+	// The combine of the values of every key in [from, to), in key order;
+	// the identity if there are none.
+	Aggregate aggregate(const Key & from, const Key & to) const;
+
+	// The combine of every value in the list.
+	Aggregate aggregateAll() const;
+
+	std::vector<Key> allKeysInOrder() const;
+
+	// Calls fn(key, value) for every key in increasing order.
+	template<typename Fn>
+	void forEach(Fn fn) const;
+};
+
+template<typename Key, typename Value, typename Monoid>
+AugmentedSkipList<Key, Value, Monoid>::AugmentedSkipList()
+	: head(Node::create(Key(), Value(), maxLevel))
+{
+}
+
+template<typename Key, typename Value, typename Monoid>
+AugmentedSkipList<Key, Value, Monoid>::~AugmentedSkipList()
+{
+	Node * node = head;
+	while(node != nullptr)
+	{
+		Node * next = node->links()[0].next;
+		Node::destroy(node);
+		node = next;
+	}
+}
+
+template<typename Key, typename Value, typename Monoid>
+typename AugmentedSkipList<Key, Value, Monoid>::Node * AugmentedSkipList<Key, Value, Monoid>::search(const Key & k, Node ** preds) const
+{
+	Node * node = head;
+	for(int level = levels - 1; level >= 0; level--)
+	{
+		Node * next = node->links()[level].next;
+		while(next != nullptr && next->key < k)
+		{
+			node = next;
+			next = node->links()[level].next;
+		}
+		preds[level] = node;
+	}
+	Node * candidate = node->links()[0].next;
+	if(candidate != nullptr && !(k < candidate->key))
+	{
+		return candidate;
+	}
+	return nullptr;
+}
+
+template<typename Key, typename Value, typename Monoid>
+void AugmentedSkipList<Key, Value, Monoid>::refresh(Node * x, unsigned level)
+{
+	Link & link = x->links()[level];
+	if(level == 0)
+	{
+		link.aggregate = link.next != nullptr ? Monoid::lift(link.next->value) : Monoid::identity();
+		return;
+	}
+	Aggregate total = Monoid::identity();
+	Node * node = x;
+	do
+	{
+		const Link & below = node->links()[level - 1];
+		total = Monoid::combine(total, below.aggregate);
+		node = below.next;
+	}
+	while(node != link.next);
+	link.aggregate = total;
+}
+
+template<typename Key, typename Value, typename Monoid>
+void AugmentedSkipList<Key, Value, Monoid>::refreshPath(Node ** preds)
+{
+	for(unsigned level = 0; level < levels; level++)
+	{
+		refresh(preds[level], level);
+	}
+}
+
+template<typename Key, typename Value, typename Monoid>
+bool AugmentedSkipList<Key, Value, Monoid>::insert(const Key & k, const Value & v)
+{
+	Node * preds[maxLevel];
+	if(search(k, preds) != nullptr)
+	{
+		return false;
+	}
+	unsigned height = towerHeight(k, maxLevel);
+	for(unsigned level = levels; level < height; level++)
+	{
+		preds[level] = head;
+	}
+	levels = std::max(levels, height);
+
+	Node * node = Node::create(k, v, height);
+	// Bottom-up, so each layer is recomputed from a finished layer below.
+	for(unsigned level = 0; level < levels; level++)
+	{
+		if(level < height)
+		{
+			Link & predLink = preds[level]->links()[level];
+			node->links()[level].next = predLink.next;
+			predLink.next = node;
+			refresh(node, level);
+		}
+		refresh(preds[level], level);
+	}
+	listSize++;
+	return true;
+}
+
+template<typename Key, typename Value, typename Monoid>
+bool AugmentedSkipList<Key, Value, Monoid>::update(const Key & k, const Value & v)
+{
+	Node * preds[maxLevel];
+	Node * node = search(k, preds);
+	if(node == nullptr)
+	{
+		return false;
+	}
+	node->value = v;
+	// The key's own links cover what follows it, so only the links that
+	// step over or onto it change.
+	refreshPath(preds);
+	return true;
+}
+
+template<typename Key, typename Value, typename Monoid>
+bool AugmentedSkipList<Key, Value, Monoid>::erase(const Key & k)
+{
+	Node * preds[maxLevel];
+	Node * node = search(k, preds);
+	if(node == nullptr)
+	{
+		return false;
+	}
+	for(unsigned level = 0; level < node->height; level++)
+	{
+		preds[level]->links()[level].next = node->links()[level].next;
+	}
+	refreshPath(preds);
+	Node::destroy(node);
+	listSize--;
+	while(levels > 1 && head->links()[levels - 1].next == nullptr)
+	{
+		levels--;
+	}
+	return true;
+}
+
+template<typename Key, typename Value, typename Monoid>
+bool AugmentedSkipList<Key, Value, Monoid>::find(const Key & k, Value & out) const
+{
+	Node * preds[maxLevel];
+	Node * node = search(k, preds);
+	if(node == nullptr)
+	{
+		return false;
+	}
+	out = node->value;
+	return true;
+}
+
+template<typename Key, typename Value, typename Monoid>
+const Value & AugmentedSkipList<Key, Value, Monoid>::find(const Key & k) const
+{
+	Node * preds[maxLevel];
+	Node * node = search(k, preds);
+	if(node == nullptr)
+	{
+		throw RuntimeException("Key not found");
+	}
+	return node->value;
+}
+
+template<typename Key, typename Value, typename Monoid>
+bool AugmentedSkipList<Key, Value, Monoid>::contains(const Key & k) const
+{
+	Node * preds[maxLevel];
+	return search(k, preds) != nullptr;
+}
+
+template<typename Key, typename Value, typename Monoid>
+typename AugmentedSkipList<Key, Value, Monoid>::Aggregate AugmentedSkipList<Key, Value, Monoid>::aggregate(const Key & from, const Key & to) const
+{
+	Aggregate total = Monoid::identity();
+	if(!(from < to))
+	{
+		return total;
+	}
+	Node * preds[maxLevel];
+	search(from, preds);
+	Node * node = preds[0];
+	// A link may be taken when it lands before `to`: everything it covers
+	// then lies in the range.
+	auto fits = [&to](const Link & link)
+	{
+		return link.next != nullptr && link.next->key < to;
+	};
+
+	// Climb: follow each node's top link while it fits. The node it lands
+	// on is at least as tall, so the walk rises towards the top layer.
+	unsigned level;
+	while(true)
+	{
+		level = std::min(node->height, levels) - 1;
+		const Link & top = node->links()[level];
+		if(!fits(top))
+		{
+			break;
+		}
+		total = Monoid::combine(total, top.aggregate);
+		node = top.next;
+	}
+	// Descend: no node before the first link that does not fit is taller
+	// than that link's layer, so each layer is walked at most once.
+	for(int i = static_cast<int>(level) - 1; i >= 0; i--)
+	{
+		while(fits(node->links()[i]))
+		{
+			total = Monoid::combine(total, node->links()[i].aggregate);
+			node = node->links()[i].next;
+		}
+	}
+	return total;
+}
+
+template<typename Key, typename Value, typename Monoid>
+typename AugmentedSkipList<Key, Value, Monoid>::Aggregate AugmentedSkipList<Key, Value, Monoid>::aggregateAll() const
+{
+	Aggregate total = Monoid::identity();
+	for(Node * node = head; node != nullptr; node = node->links()[levels - 1].next)
+	{
+		total = Monoid::combine(total, node->links()[levels - 1].aggregate);
+	}
+	return total;
+}
+
+template<typename Key, typename Value, typename Monoid>
+std::vector<Key> AugmentedSkipList<Key, Value, Monoid>::allKeysInOrder() const
+{
+	std::vector<Key> keys;
+	keys.reserve(listSize);
+	forEach([&keys](const Key & k, const Value &) { keys.push_back(k); });
+	return keys;
+}
+
+template<typename Key, typename Value, typename Monoid>
+template<typename Fn>
+void AugmentedSkipList<Key, Value, Monoid>::forEach(Fn fn) const
+{
+	for(Node * node = head->links()[0].next; node != nullptr; node = node->links()[0].next)
+	{
+		fn(node->key, node->value);
+	}
+}
+
+#endif
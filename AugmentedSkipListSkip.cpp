@@ -0,0 +1,235 @@
+#include "catch_amalgamated.hpp"
+#include "AugmentedSkipList.hpp"
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace{
+
+	// Concatenation is not commutative, so it checks that aggregates combine
+	// in key order.
+	struct ConcatMonoid
+	{
+		using Aggregate = std::string;
+		static Aggregate identity() { return ""; }
+		static Aggregate lift(const std::string & value) { return value; }
+		static Aggregate combine(const Aggregate & a, const Aggregate & b) { return a + b; }
+	};
+
+	// Sums, counting every combine made.
+	struct CountingSumMonoid
+	{
+		using Aggregate = long long;
+		static size_t combines;
+		static Aggregate identity() { return 0; }
+		static Aggregate lift(const long long & value) { return value; }
+		static Aggregate combine(const Aggregate & a, const Aggregate & b)
+		{
+			combines++;
+			return a + b;
+		}
+	};
+	size_t CountingSumMonoid::combines = 0;
+
+	using SummaryList = AugmentedSkipList<unsigned, long long, SummaryMonoid<long long>>;
+
+	ValueSummary<long long> bruteForce(const std::map<unsigned, long long> & model, unsigned from, unsigned to)
+	{
+		ValueSummary<long long> s;
+		for(auto it = model.lower_bound(from); it != model.end() && it->first < to; ++it)
+		{
+			s = SummaryMonoid<long long>::combine(s, SummaryMonoid<long long>::lift(it->second));
+		}
+		return s;
+	}
+
+	void requireSameSummary(const ValueSummary<long long> & a, const ValueSummary<long long> & b)
+	{
+		REQUIRE(a.count == b.count);
+		if(a.count != 0)
+		{
+			REQUIRE(a.sum == b.sum);
+			REQUIRE(a.min == b.min);
+			REQUIRE(a.max == b.max);
+		}
+	}
+
+	TEST_CASE("AugmentedBasicTest", "[AugmentedTests]")
+	{
+		AugmentedSkipList<unsigned, int> sums;
+		REQUIRE(sums.aggregateAll() == 0);
+		REQUIRE(sums.aggregate(0, 100) == 0);
+		for(unsigned i = 1; i <= 100; i++)
+		{
+			REQUIRE(sums.insert(i, static_cast<int>(i)));
+		}
+		REQUIRE_FALSE(sums.insert(5, 1000));
+		REQUIRE(sums.size() == 100);
+		REQUIRE(sums.aggregateAll() == 5050);
+		REQUIRE(sums.aggregate(1, 101) == 5050);
+		REQUIRE(sums.aggregate(10, 20) == 145);
+		REQUIRE(sums.aggregate(20, 10) == 0);
+		REQUIRE(sums.aggregate(10, 10) == 0);
+		REQUIRE(sums.aggregate(0, 1) == 0);
+
+		REQUIRE(sums.update(15, 0));
+		REQUIRE_FALSE(sums.update(1000, 1));
+		REQUIRE(sums.find(15) == 0);
+		REQUIRE(sums.aggregate(10, 20) == 130);
+		REQUIRE(sums.erase(10));
+		REQUIRE_FALSE(sums.erase(10));
+		REQUIRE_FALSE(sums.contains(10));
+		REQUIRE_THROWS_AS(sums.find(10), RuntimeException);
+		REQUIRE(sums.aggregate(10, 20) == 120);
+		REQUIRE(sums.aggregateAll() == 5050 - 15 - 10);
+
+		AugmentedSkipList<unsigned, double, MinMonoid<double>> mins;
+		AugmentedSkipList<unsigned, double, MaxMonoid<double>> maxes;
+		AugmentedSkipList<unsigned, double, CountMonoid<double>> counts;
+		for(unsigned i = 0; i < 50; i++)
+		{
+			double v = (i * 37 % 50) - 25.0;
+			mins.insert(i, v);
+			maxes.insert(i, v);
+			counts.insert(i, v);
+		}
+		REQUIRE(mins.aggregateAll() == -25);
+		REQUIRE(maxes.aggregateAll() == 24);
+		REQUIRE(counts.aggregate(10, 30) == 20);
+		REQUIRE(mins.aggregate(60, 70) == MinMonoid<double>::identity());
+	}
+
+	TEST_CASE("AugmentedKeyOrderTest", "[AugmentedTests]")
+	{
+		AugmentedSkipList<unsigned, std::string, ConcatMonoid> list;
+		std::string letters = "abcdefghijklmnopqrstuvwxyz";
+		for(unsigned i = 0; i < letters.size(); i++)
+		{
+			unsigned position = i * 7 % letters.size();
+			list.insert(position, std::string(1, letters[position]));
+		}
+		REQUIRE(list.aggregateAll() == letters);
+		for(unsigned from = 0; from <= letters.size(); from++)
+		{
+			for(unsigned to = from; to <= letters.size(); to++)
+			{
+				REQUIRE(list.aggregate(from, to) == letters.substr(from, to - from));
+			}
+		}
+	}
+
+	TEST_CASE("AugmentedMatchesModelTest", "[AugmentedTests]")
+	{
+		SummaryList list;
+		std::map<unsigned, long long> model;
+		std::mt19937 rng(5);
+		for(int step = 0; step < 20000; step++)
+		{
+			unsigned key = rng() % 3000;
+			long long value = static_cast<long long>(rng() % 2001) - 1000;
+			switch(rng() % 4)
+			{
+				case 0:
+				case 1:
+					REQUIRE(list.insert(key, value) == model.emplace(key, value).second);
+					break;
+				case 2:
+					REQUIRE(list.update(key, value) == (model.count(key) != 0));
+					if(model.count(key) != 0)
+					{
+						model[key] = value;
+					}
+					break;
+				case 3:
+					REQUIRE(list.erase(key) == (model.erase(key) != 0));
+					break;
+			}
+			if(step % 100 == 0)
+			{
+				unsigned from = rng() % 3100;
+				unsigned to = rng() % 3100;
+				requireSameSummary(list.aggregate(from, to), bruteForce(model, from, to));
+				requireSameSummary(list.aggregateAll(), bruteForce(model, 0, 3100));
+			}
+		}
+		REQUIRE(list.size() == model.size());
+		std::vector<unsigned> keys;
+		for(const auto & entry : model)
+		{
+			keys.push_back(entry.first);
+		}
+		REQUIRE(list.allKeysInOrder() == keys);
+		for(unsigned from = 0; from < 3000; from += 97)
+		{
+			for(unsigned to = from; to < 3100; to += 211)
+			{
+				requireSameSummary(list.aggregate(from, to), bruteForce(model, from, to));
+			}
+		}
+	}
+
+	TEST_CASE("AugmentedUnpromotedKeysTest", "[AugmentedTests]")
+	{
+		// Keys whose bytes XOR to zero never leave S_0, so every aggregate
+		// falls back to the bottom layer; the answers must not change.
+		AugmentedSkipList<unsigned, long long> list;
+		long long total = 0;
+		for(unsigned i = 0; i < 256; i++)
+		{
+			unsigned key = (i << 8) | i;
+			list.insert(key, i);
+			total += i;
+		}
+		REQUIRE(list.aggregateAll() == total);
+		REQUIRE(list.aggregate(0x0a0a, 0x1414) == (10 + 19) * 10 / 2);
+	}
+
+	TEST_CASE("AugmentedLogarithmicTest", "[AugmentedTests]")
+	{
+		AugmentedSkipList<unsigned, long long, CountingSumMonoid> list;
+		const unsigned n = 100000;
+		std::mt19937 rng(3);
+		for(unsigned i = 0; i < n; i++)
+		{
+			list.insert(rng(), 1);
+		}
+		// A range covering most of the list costs a few dozen combines, not
+		// one per key.
+		CountingSumMonoid::combines = 0;
+		long long inRange = list.aggregate(0x10000000u, 0xf0000000u);
+		REQUIRE(inRange > static_cast<long long>(n) / 2);
+		REQUIRE(CountingSumMonoid::combines * 100 < static_cast<size_t>(inRange));
+	}
+
+	TEST_CASE("AugmentedSequentialKeysTest", "[AugmentedTests]")
+	{
+		// Keys inserted in order, the usual case for timestamps, keep every
+		// update and range query logarithmic: no layer is left crowded with
+		// the keys whose first eight tosses all came up heads.
+		AugmentedSkipList<unsigned, long long, CountingSumMonoid> list;
+		const unsigned logN = 16;
+		const unsigned n = 1u << logN;
+		size_t longestInsert = 0;
+		for(unsigned i = 0; i < n; i++)
+		{
+			CountingSumMonoid::combines = 0;
+			list.insert(i, 1);
+			longestInsert = std::max(longestInsert, CountingSumMonoid::combines);
+		}
+		REQUIRE(longestInsert <= 6 * logN);
+
+		std::mt19937 rng(5);
+		size_t longestQuery = 0;
+		for(unsigned t = 0; t < 1000; t++)
+		{
+			unsigned from = rng() % n;
+			unsigned to = from + rng() % (n - from);
+			CountingSumMonoid::combines = 0;
+			REQUIRE(list.aggregate(from, to) == static_cast<long long>(to - from));
+			longestQuery = std::max(longestQuery, CountingSumMonoid::combines);
+		}
+		REQUIRE(longestQuery <= 4 * logN);
+	}
+}
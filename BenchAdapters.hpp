@@ -0,0 +1,426 @@
+#ifndef ___BENCH_ADAPTERS_HPP
+#define ___BENCH_ADAPTERS_HPP
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Benchmark.hpp"
+#include "LazySkipList.hpp"
+#include "ShardedSkipList.hpp"
+#include "SkipList.hpp"
+
+// Thin wrappers that give every container the same interface, so the
+// comparison benchmark can run one workload template against all of them.
+//
+// Each adapter provides:
+//   name()                  label used in the report
+//   ordered                 whether next/prev/scan are supported
+//   build(keys)             load the container from a key set
+//   insert(k, v)            insert a single key
+//   find(k, v)              point lookup, true on a hit
+//   next(k, out)            successor of an existing key
+//   prev(k, out)            predecessor of an existing key
+//   scan()                  visit every key in order, returns the count
+
+template<typename Key>
+struct SkipListAdapter
+{
+	static const bool ordered = true;
+	SkipList<Key, unsigned> list;
+
+	static std::string name() { return "SkipList"; }
+
+	void build(const std::vector<Key> & keys)
+	{
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			list.insert(keys[i], static_cast<unsigned>(i));
+		}
+	}
+
+	bool insert(const Key & k, unsigned v) { return list.insert(k, v); }
+
+	bool find(const Key & k, unsigned & v)
+	{
+		try
+		{
+			v = list.find(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	bool next(const Key & k, Key & out)
+	{
+		try
+		{
+			out = list.nextKey(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	bool prev(const Key & k, Key & out)
+	{
+		try
+		{
+			out = list.previousKey(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	size_t scan() { return list.allKeysInOrder().size(); }
+};
+
+template<typename Key>
+struct MapAdapter
+{
+	static const bool ordered = true;
+	std::map<Key, unsigned> map;
+
+	static std::string name() { return "std::map"; }
+
+	void build(const std::vector<Key> & keys)
+	{
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			map.emplace(keys[i], static_cast<unsigned>(i));
+		}
+	}
+
+	bool insert(const Key & k, unsigned v) { return map.emplace(k, v).second; }
+
+	bool find(const Key & k, unsigned & v)
+	{
+		auto it = map.find(k);
+		if(it == map.end())
+		{
+			return false;
+		}
+		v = it->second;
+		return true;
+	}
+
+	bool next(const Key & k, Key & out)
+	{
+		auto it = map.find(k);
+		if(it == map.end() || ++it == map.end())
+		{
+			return false;
+		}
+		out = it->first;
+		return true;
+	}
+
+	bool prev(const Key & k, Key & out)
+	{
+		auto it = map.find(k);
+		if(it == map.end() || it == map.begin())
+		{
+			return false;
+		}
+		out = std::prev(it)->first;
+		return true;
+	}
+
+	size_t scan()
+	{
+		size_t count = 0;
+		for(const auto & entry : map)
+		{
+			doNotOptimize(entry.first);
+			count++;
+		}
+		return count;
+	}
+};
+
+// Point operations only; next/prev/scan are skipped for unordered containers.
+template<typename Key>
+struct UnorderedMapAdapter
+{
+	static const bool ordered = false;
+	std::unordered_map<Key, unsigned> map;
+
+	static std::string name() { return "std::unordered_map"; }
+
+	void build(const std::vector<Key> & keys)
+	{
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			map.emplace(keys[i], static_cast<unsigned>(i));
+		}
+	}
+
+	bool insert(const Key & k, unsigned v) { return map.emplace(k, v).second; }
+
+	bool find(const Key & k, unsigned & v)
+	{
+		auto it = map.find(k);
+		if(it == map.end())
+		{
+			return false;
+		}
+		v = it->second;
+		return true;
+	}
+
+	bool next(const Key &, Key &) { return false; }
+	bool prev(const Key &, Key &) { return false; }
+	size_t scan() { return 0; }
+};
+
+// A sorted std::vector searched with std::lower_bound. build() sorts once,
+// which is how a sorted vector is loaded in practice; insert() shifts the tail.
+template<typename Key>
+struct SortedVectorAdapter
+{
+	static const bool ordered = true;
+	std::vector<std::pair<Key, unsigned>> entries;
+
+	static std::string name() { return "sorted std::vector"; }
+
+	static bool keyLess(const std::pair<Key, unsigned> & e, const Key & k) { return e.first < k; }
+
+	void build(const std::vector<Key> & keys)
+	{
+		entries.reserve(keys.size());
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			entries.emplace_back(keys[i], static_cast<unsigned>(i));
+		}
+		std::sort(entries.begin(), entries.end());
+		entries.erase(std::unique(entries.begin(), entries.end(),
+			[](const std::pair<Key, unsigned> & a, const std::pair<Key, unsigned> & b) { return a.first == b.first; }),
+			entries.end());
+	}
+
+	bool insert(const Key & k, unsigned v)
+	{
+		auto it = std::lower_bound(entries.begin(), entries.end(), k, keyLess);
+		if(it != entries.end() && it->first == k)
+		{
+			return false;
+		}
+		entries.insert(it, std::make_pair(k, v));
+		return true;
+	}
+
+	bool find(const Key & k, unsigned & v)
+	{
+		auto it = std::lower_bound(entries.begin(), entries.end(), k, keyLess);
+		if(it == entries.end() || it->first != k)
+		{
+			return false;
+		}
+		v = it->second;
+		return true;
+	}
+
+	bool next(const Key & k, Key & out)
+	{
+		auto it = std::lower_bound(entries.begin(), entries.end(), k, keyLess);
+		if(it == entries.end() || it->first != k || it + 1 == entries.end())
+		{
+			return false;
+		}
+		out = (it + 1)->first;
+		return true;
+	}
+
+	bool prev(const Key & k, Key & out)
+	{
+		auto it = std::lower_bound(entries.begin(), entries.end(), k, keyLess);
+		if(it == entries.end() || it->first != k || it == entries.begin())
+		{
+			return false;
+		}
+		out = (it - 1)->first;
+		return true;
+	}
+
+	size_t scan()
+	{
+		for(const auto & entry : entries)
+		{
+			doNotOptimize(entry.first);
+		}
+		return entries.size();
+	}
+};
+
+// The lazy concurrent skip list needs no outer lock: it is shared between
+// threads as is.
+template<typename Key>
+struct LazySkipListAdapter
+{
+	static const bool ordered = true;
+	LazySkipList<Key, unsigned> list;
+
+	static std::string name() { return "LazySkipList"; }
+
+	void build(const std::vector<Key> & keys)
+	{
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			list.insert(keys[i], static_cast<unsigned>(i));
+		}
+	}
+
+	bool insert(const Key & k, unsigned v) { return list.insert(k, v); }
+
+	bool find(const Key & k, unsigned & v) { return list.find(k, v); }
+
+	bool next(const Key & k, Key & out)
+	{
+		try
+		{
+			out = list.nextKey(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	bool prev(const Key & k, Key & out)
+	{
+		try
+		{
+			out = list.previousKey(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	size_t scan() { return list.allKeysInOrder().size(); }
+};
+
+// Range shards, each a SkipList behind its own mutex. Split points are
+// quantiles of the keys passed to build(), which must run first.
+template<typename Key>
+struct ShardedSkipListAdapter
+{
+	static const bool ordered = true;
+	static const size_t shards = 16;
+	std::unique_ptr<ShardedSkipList<Key, unsigned>> list;
+
+	static std::string name() { return "ShardedSkipList"; }
+
+	void build(const std::vector<Key> & keys)
+	{
+		list.reset(new ShardedSkipList<Key, unsigned>(
+			ShardedSkipList<Key, unsigned>::splitPointsFromSample(keys, shards)));
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			list->insert(keys[i], static_cast<unsigned>(i));
+		}
+	}
+
+	bool insert(const Key & k, unsigned v) { return list->insert(k, v); }
+
+	bool find(const Key & k, unsigned & v) { return list->find(k, v); }
+
+	bool next(const Key & k, Key & out)
+	{
+		try
+		{
+			out = list->nextKey(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	bool prev(const Key & k, Key & out)
+	{
+		try
+		{
+			out = list->previousKey(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	size_t scan() { return list->allKeysInOrder().size(); }
+};
+
+// Serializes every call to another adapter with one std::mutex: how the
+// single-threaded containers are shared between threads today.
+template<typename Inner>
+struct LockedAdapter
+{
+	static const bool ordered = Inner::ordered;
+	Inner inner;
+	std::mutex lock;
+
+	static std::string name() { return Inner::name() + "+mutex"; }
+
+	template<typename Key>
+	void build(const std::vector<Key> & keys)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		inner.build(keys);
+	}
+
+	template<typename Key>
+	bool insert(const Key & k, unsigned v)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return inner.insert(k, v);
+	}
+
+	template<typename Key>
+	bool find(const Key & k, unsigned & v)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return inner.find(k, v);
+	}
+
+	template<typename Key>
+	bool next(const Key & k, Key & out)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return inner.next(k, out);
+	}
+
+	template<typename Key>
+	bool prev(const Key & k, Key & out)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return inner.prev(k, out);
+	}
+
+	size_t scan()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return inner.scan();
+	}
+};
+
+#endif
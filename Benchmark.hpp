@@ -0,0 +1,504 @@
+#ifndef ___BENCHMARK_HPP
+#define ___BENCHMARK_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Keeps the compiler from discarding a value computed inside a
+ * timed loop.
+ *
+ * @param value the result that must be treated as observable
+ */
+template<typename T>
+inline void doNotOptimize(const T & value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const T * sink;
+	sink = &value;
+#endif
+}
+
+// The shape of the key set a benchmark is run against.
+//
+// Sequential:  0, 1, 2, ... inserted in increasing order.
+// Uniform:     distinct keys scattered over the whole key space, inserted in random order.
+// Zipfian:     the same key set as Uniform, but lookups follow a Zipfian popularity curve.
+// Adversarial: keys whose bytes XOR to zero, so `flipCoin` never promotes them
+//              and the skip list degenerates into a single linked list.
+enum class Distribution
+{
+	Sequential,
+	Uniform,
+	Zipfian,
+	Adversarial
+};
+
+inline std::string distributionName(Distribution d)
+{
+	switch(d)
+	{
+		case Distribution::Sequential:  return "sequential";
+		case Distribution::Uniform:     return "uniform";
+		case Distribution::Zipfian:     return "zipfian";
+		case Distribution::Adversarial: return "adversarial";
+	}
+	return "unknown";
+}
+
+/**
+ * @brief Maps an index onto a distinct, well scattered 32-bit key.
+ *
+ * Multiplication by an odd constant is a bijection modulo 2^32, so distinct
+ * indices always produce distinct keys.
+ *
+ * @param i index of the key
+ * @return the scattered key
+ */
+inline unsigned scatterKey(std::uint64_t i)
+{
+	return static_cast<unsigned>(i * 2654435761u);
+}
+
+/**
+ * @brief Builds the i-th key whose four bytes XOR to zero.
+ *
+ * The low three bytes come from `i` and the high byte is chosen to cancel
+ * them out, so `flipCoin` returns tails for every layer. Distinct for
+ * every i below 2^24.
+ *
+ * @param i index of the key
+ * @return a key that never gets promoted above S_0
+ */
+inline unsigned adversarialKey(std::uint64_t i)
+{
+	unsigned low = static_cast<unsigned>(i & 0x00FFFFFF);
+	unsigned top = ((low >> 16) ^ (low >> 8) ^ low) & 0xFF;
+	return (top << 24) | low;
+}
+
+/**
+ * @brief Produces the i-th key of a key set for the given distribution.
+ * Indices at or beyond the size of the set are guaranteed to be misses.
+ *
+ * @param d the distribution
+ * @param i index of the key
+ * @return the key
+ */
+inline unsigned makeKey(Distribution d, std::uint64_t i)
+{
+	switch(d)
+	{
+		case Distribution::Sequential:  return static_cast<unsigned>(i);
+		case Distribution::Adversarial: return adversarialKey(i);
+		default:                        return scatterKey(i);
+	}
+}
+
+// String keys are derived from the unsigned ones so both key types see the
+// same ordering and the same hit/miss pattern.
+template<typename Key>
+struct KeyMaker;
+
+template<>
+struct KeyMaker<unsigned>
+{
+	static std::string typeName() { return "unsigned"; }
+	static unsigned make(Distribution d, std::uint64_t i) { return makeKey(d, i); }
+};
+
+template<>
+struct KeyMaker<std::string>
+{
+	static std::string typeName() { return "string"; }
+
+	static std::string make(Distribution d, std::uint64_t i)
+	{
+		unsigned k = makeKey(d, i);
+		char buffer[16];
+		if(d == Distribution::Adversarial)
+		{
+			// Every hex digit appears twice, so all characters cancel out.
+			std::snprintf(buffer, sizeof(buffer), "%08x", k);
+			std::string doubled;
+			for(char c : std::string(buffer))
+			{
+				doubled += c;
+				doubled += c;
+			}
+			return doubled;
+		}
+		std::snprintf(buffer, sizeof(buffer), "k%010u", k);
+		return std::string(buffer);
+	}
+};
+
+/**
+ * @brief Draws ranks in [0, n) following a Zipfian distribution.
+ *
+ * This is the generator from Gray et al., "Quickly Generating Billion-Record
+ * Synthetic Databases", which is also what YCSB uses. Rank 0 is the most
+ * popular item.
+ */
+class ZipfianGenerator
+{
+private:
+	std::uint64_t items;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+	std::mt19937_64 rng;
+	std::uniform_real_distribution<double> uniform{0.0, 1.0};
+
+	static double zeta(std::uint64_t n, double theta)
+	{
+		double sum = 0;
+		for(std::uint64_t i = 1; i <= n; i++)
+		{
+			sum += 1.0 / std::pow(static_cast<double>(i), theta);
+		}
+		return sum;
+	}
+
+public:
+	ZipfianGenerator(std::uint64_t n, double skew = 0.99, std::uint64_t seed = 42)
+		: items(n), theta(skew), rng(seed)
+	{
+		if(items == 0)
+		{
+			items = 1;
+		}
+		double zeta2 = zeta(2, theta);
+		alpha = 1.0 / (1.0 - theta);
+		zetan = zeta(items, theta);
+		eta = (1 - std::pow(2.0 / items, 1 - theta)) / (1 - zeta2 / zetan);
+	}
+
+	std::uint64_t next()
+	{
+		double u = uniform(rng);
+		double uz = u * zetan;
+		if(uz < 1.0)
+		{
+			return 0;
+		}
+		if(uz < 1.0 + std::pow(0.5, theta))
+		{
+			return 1;
+		}
+		std::uint64_t r = static_cast<std::uint64_t>(items * std::pow(eta * u - eta + 1, alpha));
+		return r < items ? r : items - 1;
+	}
+};
+
+/**
+ * @brief Draws `count` indices into a key set of `n` keys, following
+ * the popularity curve of the distribution.
+ *
+ * @param d the distribution
+ * @param n size of the key set
+ * @param count number of indices to draw
+ * @param seed random seed
+ * @return the drawn indices
+ */
+inline std::vector<std::uint64_t> sampleIndices(Distribution d, std::uint64_t n, size_t count, std::uint64_t seed = 7)
+{
+	std::vector<std::uint64_t> indices;
+	indices.reserve(count);
+	if(d == Distribution::Zipfian)
+	{
+		ZipfianGenerator zipf(n, 0.99, seed);
+		for(size_t i = 0; i < count; i++)
+		{
+			indices.push_back(zipf.next());
+		}
+	}
+	else
+	{
+		std::mt19937_64 rng(seed);
+		std::uniform_int_distribution<std::uint64_t> pick(0, n - 1);
+		for(size_t i = 0; i < count; i++)
+		{
+			indices.push_back(pick(rng));
+		}
+	}
+	return indices;
+}
+
+// One measured row of the benchmark report. Modes that measure more than
+// ns/op (percentiles, memory, hardware counters) append to `metrics`.
+struct BenchResult
+{
+	std::string structure;
+	std::string operation;
+	std::string keyType;
+	std::string distribution;
+	size_t size = 0;
+	size_t ops = 0;
+	double nsPerOp = 0;
+	double opsPerSec = 0;
+	std::vector<std::pair<std::string, double>> metrics;
+};
+
+class Stopwatch
+{
+private:
+	std::chrono::steady_clock::time_point start;
+
+public:
+	Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+	void reset() { start = std::chrono::steady_clock::now(); }
+
+	double elapsedNs() const
+	{
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+/**
+ * @brief Fills in the derived fields of a result from a measured duration.
+ *
+ * @param r the result to complete
+ * @param ops number of operations that were timed
+ * @param elapsedNs total duration of those operations
+ */
+inline void finishResult(BenchResult & r, size_t ops, double elapsedNs)
+{
+	r.ops = ops;
+	r.nsPerOp = ops ? elapsedNs / ops : 0;
+	r.opsPerSec = elapsedNs > 0 ? ops * 1e9 / elapsedNs : 0;
+}
+
+/**
+ * @brief Reads a percentile out of a sorted list of samples.
+ *
+ * @param sorted samples in increasing order
+ * @param p percentile in [0, 100]
+ * @return the sample at that percentile, or 0 if there are no samples
+ */
+inline double percentile(const std::vector<double> & sorted, double p)
+{
+	if(sorted.empty())
+	{
+		return 0;
+	}
+	size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+/**
+ * @brief Fills in a result from per-operation latencies, adding the
+ * usual percentiles to its metrics.
+ *
+ * Each sample includes the cost of reading the clock, which is a few
+ * tens of nanoseconds on most machines.
+ *
+ * @param r the result to complete
+ * @param latenciesNs one sample per operation; sorted in place
+ */
+inline void finishLatencyResult(BenchResult & r, std::vector<double> & latenciesNs)
+{
+	std::sort(latenciesNs.begin(), latenciesNs.end());
+	double total = 0;
+	for(double ns : latenciesNs)
+	{
+		total += ns;
+	}
+	finishResult(r, latenciesNs.size(), total);
+	r.metrics.emplace_back("p50_ns", percentile(latenciesNs, 50));
+	r.metrics.emplace_back("p90_ns", percentile(latenciesNs, 90));
+	r.metrics.emplace_back("p99_ns", percentile(latenciesNs, 99));
+	r.metrics.emplace_back("p999_ns", percentile(latenciesNs, 99.9));
+	r.metrics.emplace_back("max_ns", latenciesNs.empty() ? 0 : latenciesNs.back());
+}
+
+/**
+ * @brief A log-linear latency histogram in the style of HdrHistogram.
+ *
+ * Values below 256 ns are recorded exactly. Above that, every power of two
+ * is split into 128 equal buckets, so any recorded value is reproduced to
+ * within 1% using a fixed 58 KB of counters. Recording is O(1) and never
+ * allocates, which keeps it cheap enough to call around every operation.
+ * Histograms from several threads are combined with merge().
+ */
+class LatencyHistogram
+{
+private:
+	static const unsigned SUB_BITS = 7;
+	static const std::uint64_t SUB_BUCKETS = 1u << SUB_BITS;
+	static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+	std::vector<std::uint64_t> counts;
+	std::uint64_t total = 0;
+	std::uint64_t maxValue = 0;
+	double sum = 0;
+
+	static size_t bucketOf(std::uint64_t v)
+	{
+		if(v < 2 * SUB_BUCKETS)
+		{
+			return static_cast<size_t>(v);
+		}
+		unsigned msb = 63;
+		while((v >> msb) == 0)
+		{
+			msb--;
+		}
+		unsigned shift = msb - SUB_BITS;
+		return (shift + 1) * SUB_BUCKETS + ((v >> shift) - SUB_BUCKETS);
+	}
+
+	// The largest value that lands in the given bucket.
+	static std::uint64_t highestIn(size_t bucket)
+	{
+		if(bucket < 2 * SUB_BUCKETS)
+		{
+			return bucket;
+		}
+		unsigned shift = static_cast<unsigned>(bucket / SUB_BUCKETS) - 1;
+		std::uint64_t sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+		return ((sub + 1) << shift) - 1;
+	}
+
+public:
+	LatencyHistogram() : counts(BUCKETS, 0) {}
+
+	void record(std::uint64_t ns)
+	{
+		counts[bucketOf(ns)]++;
+		total++;
+		sum += static_cast<double>(ns);
+		maxValue = std::max(maxValue, ns);
+	}
+
+	void merge(const LatencyHistogram & other)
+	{
+		for(size_t i = 0; i < BUCKETS; i++)
+		{
+			counts[i] += other.counts[i];
+		}
+		total += other.total;
+		sum += other.sum;
+		maxValue = std::max(maxValue, other.maxValue);
+	}
+
+	std::uint64_t count() const { return total; }
+	std::uint64_t max() const { return maxValue; }
+	double mean() const { return total ? sum / total : 0; }
+
+	// The smallest recorded value such that p percent of all values are at
+	// or below it, to within the 1% bucket precision.
+	std::uint64_t percentile(double p) const
+	{
+		if(total == 0)
+		{
+			return 0;
+		}
+		std::uint64_t target = static_cast<std::uint64_t>(std::ceil(p / 100.0 * total));
+		target = std::max<std::uint64_t>(target, 1);
+		std::uint64_t seen = 0;
+		for(size_t i = 0; i < BUCKETS; i++)
+		{
+			seen += counts[i];
+			if(seen >= target)
+			{
+				return std::min(highestIn(i), maxValue);
+			}
+		}
+		return maxValue;
+	}
+};
+
+/**
+ * @brief Fills in a result from a latency histogram.
+ *
+ * @param r the result to complete
+ * @param h latencies of every operation in the row
+ * @param wallNs wall-clock time the operations took; for several threads
+ * this is shorter than the sum of the latencies
+ */
+inline void finishHistogramResult(BenchResult & r, const LatencyHistogram & h, double wallNs)
+{
+	finishResult(r, static_cast<size_t>(h.count()), wallNs);
+	r.metrics.emplace_back("mean_ns", h.mean());
+	r.metrics.emplace_back("p50_ns", static_cast<double>(h.percentile(50)));
+	r.metrics.emplace_back("p99_ns", static_cast<double>(h.percentile(99)));
+	r.metrics.emplace_back("p999_ns", static_cast<double>(h.percentile(99.9)));
+	r.metrics.emplace_back("max_ns", static_cast<double>(h.max()));
+}
+
+// Bytes currently allocated through the global operator new. Only updated
+// by executables that install the counting operator new (see main.cpp).
+inline std::atomic<long long> & liveHeapBytes()
+{
+	static std::atomic<long long> bytes{0};
+	return bytes;
+}
+
+inline std::string jsonEscape(const std::string & s)
+{
+	std::string out;
+	for(char c : s)
+	{
+		if(c == '"' || c == '\\')
+		{
+			out += '\\';
+		}
+		out += c;
+	}
+	return out;
+}
+
+// JSON has no NaN or infinity, so non-finite values are written as null.
+inline void writeJsonNumber(std::ostream & out, double value)
+{
+	if(std::isfinite(value))
+	{
+		out << value;
+	}
+	else
+	{
+		out << "null";
+	}
+}
+
+inline void writeJson(std::ostream & out, const std::vector<BenchResult> & results)
+{
+	out << "{\n  \"results\": [";
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult & r = results[i];
+		out << (i ? ",\n" : "\n");
+		out << "    {\"structure\": \"" << jsonEscape(r.structure) << "\""
+			<< ", \"operation\": \"" << jsonEscape(r.operation) << "\""
+			<< ", \"key_type\": \"" << jsonEscape(r.keyType) << "\""
+			<< ", \"distribution\": \"" << jsonEscape(r.distribution) << "\""
+			<< ", \"size\": " << r.size
+			<< ", \"ops\": " << r.ops
+			<< ", \"ns_per_op\": ";
+		writeJsonNumber(out, r.nsPerOp);
+		out << ", \"ops_per_sec\": ";
+		writeJsonNumber(out, r.opsPerSec);
+		for(const auto & metric : r.metrics)
+		{
+			out << ", \"" << jsonEscape(metric.first) << "\": ";
+			writeJsonNumber(out, metric.second);
+		}
+		out << "}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef ___BUFFERED_SKIP_LIST_HPP
+#define ___BUFFERED_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "SkipList.hpp"
+
+/**
+ * @brief A SkipList fed by many producer threads through private buffers.
+ *
+ * Each producer thread owns a Producer, which appends inserts to its own
+ * buffer. The buffer has a mutex of its own, which only flushOlderThan()
+ * ever contends for. When the buffer reaches its capacity (or on
+ * flush(), or when the Producer is destroyed) it is stably sorted and
+ * folded into the shared list with one SkipList::insertSorted() call
+ * under the list's mutex. Producers thus only contend for the list once
+ * per buffer rather than once per key, and the batch insert resumes each
+ * search where the previous key left off.
+ *
+ * The price is visibility: a key becomes visible to readers only when the
+ * buffer holding it is merged, so at most `capacity` inserts per producer
+ * are pending at any time. A producer that goes quiet would keep them
+ * pending indefinitely, so the owner of the list bounds the delay in time
+ * as well: calling flushOlderThan(age) every `period` merges every buffer
+ * whose oldest insert is older than `age`, from whichever thread calls
+ * it, and no insert waits much longer than age + period. flushAll()
+ * merges every buffer. As with SkipList::insert(), the first insert of a
+ * key wins: within a buffer the earliest copy, across buffers the one
+ * merged first.
+ *
+ *   BufferedSkipList<unsigned, unsigned> shared;
+ *   // on each producer thread:
+ *   BufferedSkipList<unsigned, unsigned>::Producer producer = shared.producer();
+ *   producer.insert(k, v);
+ *   ...
+ *   producer.flush();
+ *   // on a housekeeping thread, every 10 ms:
+ *   shared.flushOlderThan(std::chrono::milliseconds(50));
+ */
+template<typename Key, typename Value>
+class BufferedSkipList
+{
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// A producer's pending inserts, owned by the Producer and registered
+	// with the list so flushOlderThan() can reach them.
+	struct Buffer
+	{
+		std::mutex lock;
+		std::vector<std::pair<Key, Value>> pairs;
+		// When the first of the pending pairs was buffered.
+		Clock::time_point oldest;
+	};
+
+	mutable std::mutex lock;
+	SkipList<Key, Value> list;
+
+	// Buffers of the live producers.
+	std::mutex producersLock;
+	std::vector<Buffer *> buffers;
+
+	// Merges a buffer into the list and empties it; returns the number of
+	// new keys. The caller holds buffer.lock.
+	size_t merge(Buffer & buffer)
+	{
+		if(buffer.pairs.empty())
+		{
+			return 0;
+		}
+		std::stable_sort(buffer.pairs.begin(), buffer.pairs.end(),
+			[](const std::pair<Key, Value> & a, const std::pair<Key, Value> & b) { return a.first < b.first; });
+		size_t inserted;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			inserted = list.insertSorted(buffer.pairs);
+		}
+		buffer.pairs.clear();
+		return inserted;
+	}
+
+	void unregister(Buffer * buffer)
+	{
+		std::lock_guard<std::mutex> guard(producersLock);
+		buffers.erase(std::find(buffers.begin(), buffers.end(), buffer));
+	}
+
+public:
+	// One thread's insert buffer. Movable, not copyable, and not meant to be
+	// shared between threads. Must not outlive the list it feeds.
+	class Producer
+	{
+	private:
+		BufferedSkipList * owner;
+		size_t capacity;
+		std::unique_ptr<Buffer> buffer;
+
+		friend class BufferedSkipList;
+		Producer(BufferedSkipList * o, size_t c) : owner(o), capacity(c == 0 ? 1 : c), buffer(new Buffer())
+		{
+			buffer->pairs.reserve(capacity);
+			std::lock_guard<std::mutex> guard(owner->producersLock);
+			owner->buffers.push_back(buffer.get());
+		}
+
+	public:
+		Producer(Producer && other) noexcept
+			: owner(other.owner), capacity(other.capacity), buffer(std::move(other.buffer))
+		{
+			other.owner = nullptr;
+		}
+
+		Producer(const Producer &) = delete;
+		Producer & operator=(const Producer &) = delete;
+		Producer & operator=(Producer &&) = delete;
+
+		// Merges whatever is still buffered. A destructor cannot report a
+		// failed merge, so if the sort or the insert throws, the pending
+		// inserts are dropped instead.
+		~Producer()
+		{
+			if(owner == nullptr)
+			{
+				return;
+			}
+			owner->unregister(buffer.get());
+			try
+			{
+				owner->merge(*buffer);
+			}
+			catch(...)
+			{
+			}
+		}
+
+		// Buffers the pair, merging the buffer into the list once it holds
+		// `capacity` pairs.
+		void insert(const Key & k, const Value & v)
+		{
+			std::lock_guard<std::mutex> guard(buffer->lock);
+			if(buffer->pairs.empty())
+			{
+				buffer->oldest = Clock::now();
+			}
+			buffer->pairs.emplace_back(k, v);
+			if(buffer->pairs.size() >= capacity)
+			{
+				owner->merge(*buffer);
+			}
+		}
+
+		// Merges the buffer into the list now. Returns how many of its keys
+		// were new.
+		size_t flush()
+		{
+			std::lock_guard<std::mutex> guard(buffer->lock);
+			return owner->merge(*buffer);
+		}
+
+		// Inserts waiting for the next merge.
+		size_t pending() const
+		{
+			std::lock_guard<std::mutex> guard(buffer->lock);
+			return buffer->pairs.size();
+		}
+	};
+
+	BufferedSkipList() = default;
+
+	BufferedSkipList(const BufferedSkipList &) = delete;
+	BufferedSkipList & operator=(const BufferedSkipList &) = delete;
+
+	// A new buffer for the calling thread, merged every `capacity` inserts.
+	Producer producer(size_t capacity = 4096)
+	{
+		return Producer(this, capacity);
+	}
+
+	// Merges the buffer of every producer whose oldest pending insert was
+	// made more than `age` ago. Returns how many keys were new. Call it
+	// periodically from any thread to bound how long an insert can stay
+	// invisible.
+	size_t flushOlderThan(std::chrono::steady_clock::duration age)
+	{
+		Clock::time_point cutoff = Clock::now() - age;
+		size_t inserted = 0;
+		std::lock_guard<std::mutex> guard(producersLock);
+		for(Buffer * buffer : buffers)
+		{
+			std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+			if(!buffer->pairs.empty() && buffer->oldest <= cutoff)
+			{
+				inserted += merge(*buffer);
+			}
+		}
+		return inserted;
+	}
+
+	// Merges the buffer of every producer. Returns how many keys were new.
+	size_t flushAll()
+	{
+		return flushOlderThan(Clock::duration::zero());
+	}
+
+	// Keys merged so far.
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return list.size();
+	}
+
+	// Copies the value of a merged key into out and returns true, or
+	// returns false if k has not been merged.
+	bool find(const Key & k, Value & out) const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		try
+		{
+			out = list.find(k);
+			return true;
+		}
+		catch(RuntimeException &)
+		{
+			return false;
+		}
+	}
+
+	// Runs fn(list) with the list locked, for anything else a reader needs.
+	template<typename Fn>
+	auto withList(Fn fn) const -> decltype(fn(std::declval<const SkipList<Key, Value> &>()))
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return fn(static_cast<const SkipList<Key, Value> &>(list));
+	}
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "catch_amalgamated.hpp"
+#include "BufferedSkipList.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace{
+
+	// A value whose copies throw once armed, to make a merge fail.
+	struct Fragile
+	{
+		static bool armed;
+		unsigned id = 0;
+
+		Fragile() = default;
+		explicit Fragile(unsigned i) : id(i) {}
+		Fragile(const Fragile & other) : id(other.id)
+		{
+			if(armed)
+			{
+				throw RuntimeException("copy failed");
+			}
+		}
+		Fragile & operator=(const Fragile & other)
+		{
+			if(armed)
+			{
+				throw RuntimeException("copy failed");
+			}
+			id = other.id;
+			return *this;
+		}
+	};
+
+	bool Fragile::armed = false;
+
+	TEST_CASE("BufferedVisibilityTest", "[BufferedTests]")
+	{
+		BufferedSkipList<unsigned, unsigned> shared;
+		unsigned value = 0;
+		{
+			BufferedSkipList<unsigned, unsigned>::Producer producer = shared.producer(4);
+			producer.insert(30, 1);
+			producer.insert(10, 2);
+			producer.insert(30, 3);
+			REQUIRE(producer.pending() == 3);
+			REQUIRE_FALSE(shared.find(10, value));
+
+			// The fourth insert fills the buffer and merges it.
+			producer.insert(20, 4);
+			REQUIRE(producer.pending() == 0);
+			REQUIRE(shared.size() == 3);
+			REQUIRE(shared.find(30, value));
+			REQUIRE(value == 1);
+
+			producer.insert(5, 5);
+			REQUIRE(producer.flush() == 1);
+			producer.insert(40, 6);
+		}
+		// Destroying the producer merged its last insert.
+		REQUIRE(shared.find(40, value));
+		REQUIRE(shared.withList([](const SkipList<unsigned, unsigned> & list) { return list.allKeysInOrder(); })
+			== std::vector<unsigned>{5, 10, 20, 30, 40});
+	}
+
+	TEST_CASE("BufferedManyProducersTest", "[BufferedTests]")
+	{
+		BufferedSkipList<unsigned, unsigned> shared;
+		const unsigned threads = 4;
+		const unsigned perThread = 5000;
+		std::vector<std::thread> workers;
+		for(unsigned t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&shared, t]()
+			{
+				BufferedSkipList<unsigned, unsigned>::Producer producer = shared.producer(256);
+				for(unsigned i = 0; i < perThread; i++)
+				{
+					producer.insert(i * threads + t, t);
+				}
+			});
+		}
+		for(std::thread & worker : workers)
+		{
+			worker.join();
+		}
+		REQUIRE(shared.size() == threads * perThread);
+		std::vector<unsigned> keys = shared.withList([](const SkipList<unsigned, unsigned> & list) { return list.allKeysInOrder(); });
+		for(unsigned i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(keys[i] == i);
+		}
+	}
+
+
+	TEST_CASE("BufferedAgeFlushTest", "[BufferedTests]")
+	{
+		using Buffered = BufferedSkipList<unsigned, unsigned>;
+		Buffered shared;
+		unsigned value = 0;
+		Buffered::Producer quiet = shared.producer(4096);
+		Buffered::Producer busy = shared.producer(4096);
+		for(unsigned i = 0; i < 10; i++)
+		{
+			quiet.insert(i, i);
+		}
+		// Nothing is old enough yet.
+		REQUIRE(shared.flushOlderThan(std::chrono::hours(1)) == 0);
+		REQUIRE_FALSE(shared.find(3, value));
+
+		// Once it is, the owner merges the quiet producer's buffer without
+		// that producer doing anything, and leaves the fresh one alone.
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		busy.insert(100, 100);
+		REQUIRE(shared.flushOlderThan(std::chrono::milliseconds(10)) == 10);
+		REQUIRE(quiet.pending() == 0);
+		REQUIRE(busy.pending() == 1);
+		REQUIRE(shared.find(3, value));
+		REQUIRE_FALSE(shared.find(100, value));
+
+		REQUIRE(shared.flushAll() == 1);
+		REQUIRE(shared.find(100, value));
+		REQUIRE(shared.size() == 11);
+	}
+
+	TEST_CASE("BufferedConcurrentFlushTest", "[BufferedTests]")
+	{
+		// Producers that never fill their buffers, and an owner thread that
+		// keeps flushing them by age.
+		BufferedSkipList<unsigned, unsigned> shared;
+		const unsigned threads = 4;
+		const unsigned perThread = 5000;
+		std::atomic<bool> stop{false};
+		std::thread owner([&]()
+		{
+			while(!stop.load())
+			{
+				shared.flushOlderThan(std::chrono::microseconds(100));
+				std::this_thread::yield();
+			}
+		});
+		std::vector<std::thread> workers;
+		std::vector<BufferedSkipList<unsigned, unsigned>::Producer> producers;
+		for(unsigned t = 0; t < threads; t++)
+		{
+			producers.push_back(shared.producer(1 << 20));
+		}
+		for(unsigned t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&producers, t]()
+			{
+				for(unsigned i = 0; i < perThread; i++)
+				{
+					producers[t].insert(i * threads + t, t);
+				}
+			});
+		}
+		for(std::thread & worker : workers)
+		{
+			worker.join();
+		}
+		shared.flushAll();
+		stop = true;
+		owner.join();
+		REQUIRE(shared.size() == threads * perThread);
+	}
+
+	TEST_CASE("BufferedDestructorSwallowsMergeFailureTest", "[BufferedTests]")
+	{
+		BufferedSkipList<unsigned, Fragile> shared;
+		{
+			BufferedSkipList<unsigned, Fragile>::Producer producer = shared.producer(16);
+			producer.insert(1, Fragile(1));
+			producer.insert(2, Fragile(2));
+			Fragile::armed = true;
+		}
+		Fragile::armed = false;
+		// The merge in the destructor failed and was dropped, not rethrown.
+		REQUIRE(shared.size() == 0);
+	}
+
+}
@@ -0,0 +1,218 @@
+#ifndef ___EPOCH_RECLAIMER_HPP
+#define ___EPOCH_RECLAIMER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+/**
+ * @brief Epoch-based reclamation for lock-free readers: frees objects that
+ * were unlinked from a shared structure once no reader can still hold a
+ * pointer to them.
+ *
+ * Readers pin() the current epoch for as long as they follow pointers
+ * into the structure. A writer that has unlinked an object hands it to
+ * retire(), which stamps it with the current epoch. The global epoch only
+ * moves from e to e + 1 when every pinned reader has seen e, so once it
+ * has moved twice past an object's stamp, every reader that could have
+ * reached the object has unpinned, and reclaim() frees it.
+ *
+ * T must have two members for the intrusive list of retired objects:
+ *   T * retiredNext;
+ *   std::uint64_t retiredEpoch;
+ *
+ * Up to `slots` threads can be pinned at once; pin() yields until a slot
+ * frees up beyond that. A reader pinned for a long time (say, a scan of
+ * the whole structure) holds back reclamation, not other readers or
+ * writers. retire() calls reclaim() every `reclaimEvery` objects, so
+ * memory is bounded under steady churn without anyone calling it.
+ *
+ *   EpochReclaimer<Node> reclaimer(&Node::destroy);
+ *   {
+ *       auto guard = reclaimer.pin();
+ *       ... search, read ...
+ *   }
+ *   unlink(node);
+ *   reclaimer.retire(node);
+ */
+template<typename T>
+class EpochReclaimer
+{
+public:
+	static const size_t slots = 64;
+	static const size_t reclaimEvery = 128;
+
+	using Free = void (*)(T *);
+
+private:
+	// Epoch a thread is pinned at, or 0 when the slot is free. Each on its
+	// own cache line, so pinning threads do not share one.
+	struct alignas(64) Slot
+	{
+		std::atomic<std::uint64_t> epoch{0};
+	};
+
+	Free release;
+	Slot pins[slots];
+	std::atomic<std::uint64_t> globalEpoch{1};
+	std::atomic<T *> retired{nullptr};
+	std::atomic<size_t> retiredSinceReclaim{0};
+
+	// Moves the global epoch on by one if every pinned thread has seen it.
+	void tryAdvance()
+	{
+		std::uint64_t current = globalEpoch.load(std::memory_order_seq_cst);
+		for(const Slot & slot : pins)
+		{
+			std::uint64_t pinned = slot.epoch.load(std::memory_order_seq_cst);
+			if(pinned != 0 && pinned != current)
+			{
+				return;
+			}
+		}
+		globalEpoch.compare_exchange_strong(current, current + 1, std::memory_order_seq_cst);
+	}
+
+	void push(T * first, T * last)
+	{
+		T * head = retired.load(std::memory_order_relaxed);
+		do
+		{
+			last->retiredNext = head;
+		}
+		while(!retired.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+public:
+	// Keeps the epoch pinned until destroyed. Movable, not copyable.
+	class Guard
+	{
+	private:
+		Slot * slot;
+
+		friend class EpochReclaimer;
+		explicit Guard(Slot * s) : slot(s) {}
+
+	public:
+		Guard(Guard && other) noexcept : slot(other.slot)
+		{
+			other.slot = nullptr;
+		}
+
+		Guard(const Guard &) = delete;
+		Guard & operator=(const Guard &) = delete;
+		Guard & operator=(Guard &&) = delete;
+
+		~Guard()
+		{
+			if(slot != nullptr)
+			{
+				slot->epoch.store(0, std::memory_order_release);
+			}
+		}
+	};
+
+	explicit EpochReclaimer(Free f) : release(f)
+	{
+	}
+
+	// Frees everything still retired; nothing may be pinned any more.
+	~EpochReclaimer()
+	{
+		T * object = retired.load(std::memory_order_relaxed);
+		while(object != nullptr)
+		{
+			T * next = object->retiredNext;
+			release(object);
+			object = next;
+		}
+	}
+
+	EpochReclaimer(const EpochReclaimer &) = delete;
+	EpochReclaimer & operator=(const EpochReclaimer &) = delete;
+
+	// Pins the current epoch for the calling thread.
+	Guard pin()
+	{
+		size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+		while(true)
+		{
+			for(size_t i = 0; i < slots; i++)
+			{
+				Slot & slot = pins[(start + i) % slots];
+				std::uint64_t epoch = globalEpoch.load(std::memory_order_seq_cst);
+				std::uint64_t free = 0;
+				if(!slot.epoch.compare_exchange_strong(free, epoch, std::memory_order_seq_cst))
+				{
+					continue;
+				}
+				// The epoch may have moved on before the pin was visible;
+				// follow it until it holds still.
+				std::uint64_t now = globalEpoch.load(std::memory_order_seq_cst);
+				while(now != epoch)
+				{
+					epoch = now;
+					slot.epoch.store(epoch, std::memory_order_seq_cst);
+					now = globalEpoch.load(std::memory_order_seq_cst);
+				}
+				return Guard(&slot);
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	// Hands over an object already unlinked from the structure, so no new
+	// reader can reach it. It is freed once the readers that might have
+	// are gone.
+	void retire(T * object)
+	{
+		object->retiredEpoch = globalEpoch.load(std::memory_order_seq_cst);
+		push(object, object);
+		if(retiredSinceReclaim.fetch_add(1, std::memory_order_relaxed) + 1 >= reclaimEvery)
+		{
+			reclaim();
+		}
+	}
+
+	// Frees the retired objects no pinned reader can hold. Returns how
+	// many were freed. Safe to call at any time, pinned or not.
+	size_t reclaim()
+	{
+		retiredSinceReclaim.store(0, std::memory_order_relaxed);
+		tryAdvance();
+		tryAdvance();
+		std::uint64_t safe = globalEpoch.load(std::memory_order_seq_cst);
+		T * object = retired.exchange(nullptr, std::memory_order_acquire);
+		T * keptFirst = nullptr;
+		T * keptLast = nullptr;
+		size_t freed = 0;
+		while(object != nullptr)
+		{
+			T * next = object->retiredNext;
+			if(object->retiredEpoch + 2 <= safe)
+			{
+				release(object);
+				freed++;
+			}
+			else
+			{
+				object->retiredNext = keptFirst;
+				keptFirst = object;
+				if(keptLast == nullptr)
+				{
+					keptLast = object;
+				}
+			}
+			object = next;
+		}
+		if(keptFirst != nullptr)
+		{
+			push(keptFirst, keptLast);
+		}
+		return freed;
+	}
+};
+
+#endif
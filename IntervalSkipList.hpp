@@ -0,0 +1,645 @@
+#ifndef ___INTERVAL_SKIP_LIST_HPP
+#define ___INTERVAL_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief A set of closed intervals [low, high] over ordered points,
+ * answering "which intervals contain p" in O(log n + k): Hanson's interval
+ * skip list.
+ *
+ * The skip list holds every distinct endpoint once. An edge, the link of
+ * node x on layer L to node y, spans the closed segment [x, y]. Each interval is
+ * covered by the maximal edges a walk from its low endpoint to its high
+ * endpoint takes when it always follows the highest link that does not pass
+ * `high`, and it leaves a marker on each of those edges and on every node
+ * the walk stops at. The edges of one interval never overlap, so:
+ *   - a point strictly inside an edge is in exactly the intervals marking
+ *     that edge, and
+ *   - a point at a node is in exactly the intervals marking the node.
+ * stab(p) searches for p and collects the markers of the edge it crosses
+ * on each layer, then those of p's node if there is one. Every containing
+ * interval is met exactly once, so the answer has no duplicates.
+ *
+ * Inserting an endpoint splits the edges around it on the layers its tower
+ * reaches. Only an interval marking one of those edges changes its cover,
+ * and only around the new node, as in Hanson's algorithm: its markers
+ * between the split edge and the highest edges of the new node that still
+ * fit inside it move up onto those edges. Removing an endpoint undoes the
+ * same for the intervals marking its node. Every interval keeps track of
+ * where its O(log n) markers are, so dropping one takes O(1) however many
+ * intervals share the edge, and adjusting an interval costs O(log n) no
+ * matter how many others overlap it. stab() never walks the intervals it
+ * does not return.
+ *
+ * Intervals are named by the Id insert() returns. Ids of erased intervals
+ * are reused. Not thread-safe.
+ *
+ *   IntervalSkipList<unsigned, std::string> bookings;
+ *   auto id = bookings.insert(900, 1030, "standup");
+ *   for(auto hit : bookings.stab(1000)) std::cout << bookings.value(hit);
+ */
+template<typename Point, typename Value>
+class IntervalSkipList
+{
+public:
+	using Id = size_t;
+
+	// Layers available to towers, S_0 included.
+	static const unsigned maxLevel = 32;
+
+private:
+	struct Node;
+
+	// One interval's marker. `slot` is where the interval keeps track of
+	// it, in Interval::places.
+	struct Marker
+	{
+		Id id;
+		size_t slot;
+	};
+
+	using MarkerList = std::vector<Marker>;
+
+	struct Link
+	{
+		Node * next = nullptr;
+		// Intervals covering this edge with it as one of their maximal edges.
+		MarkerList markers;
+	};
+
+	// The tower of links is allocated right behind the node.
+	struct Node
+	{
+		Point key;
+		unsigned height;
+		// Interval endpoints at this point; the node goes when it drops to 0.
+		size_t endpoints = 0;
+		// Intervals whose cover starts, ends or passes through this node.
+		MarkerList markers;
+
+		Node(const Point & k, unsigned h) : key(k), height(h)
+		{
+		}
+
+		static size_t linksOffset()
+		{
+			return (sizeof(Node) + alignof(Link) - 1) / alignof(Link) * alignof(Link);
+		}
+
+		Link * links()
+		{
+			return reinterpret_cast<Link *>(reinterpret_cast<char *>(this) + linksOffset());
+		}
+
+		static Node * create(const Point & k, unsigned height)
+		{
+			void * memory = ::operator new(linksOffset() + height * sizeof(Link));
+			Node * node = new(memory) Node(k, height);
+			for(unsigned level = 0; level < height; level++)
+			{
+				new(&node->links()[level]) Link();
+			}
+			return node;
+		}
+
+		static void destroy(Node * node)
+		{
+			for(unsigned level = 0; level < node->height; level++)
+			{
+				node->links()[level].~Link();
+			}
+			node->~Node();
+			::operator delete(node);
+		}
+	};
+
+	// Where a marker is: on the link of `node` at `level`, or on the node
+	// itself when level is onNode. `index` is its position in that list.
+	struct Place
+	{
+		Node * node;
+		unsigned level;
+		size_t index;
+	};
+
+	static const unsigned onNode = maxLevel;
+
+	struct Interval
+	{
+		Point low;
+		Point high;
+		Value value;
+		bool live = false;
+		// Every marker of the interval, in no particular order.
+		std::vector<Place> places;
+	};
+
+	// Sentinel before every endpoint, with a full tower.
+	Node * head;
+	// Layers holding at least one node, at least 1.
+	unsigned levels = 1;
+	size_t nodeCount = 0;
+	std::vector<Interval> intervals;
+	std::vector<Id> freeIds;
+	size_t liveCount = 0;
+
+	static MarkerList & markersAt(Node * node, unsigned level)
+	{
+		return level == onNode ? node->markers : node->links()[level].markers;
+	}
+
+	// Marks node's link at `level`, or the node itself, with id.
+	void addMarker(Id id, Node * node, unsigned level);
+
+	// Removes the marker id keeps at places[slot]. The last marker of its
+	// list and the last place of the interval fill the holes.
+	void removeMarker(Id id, size_t slot);
+
+	// Fills preds with the last node before k on every layer in use and
+	// returns the node holding k, or nullptr.
+	Node * search(const Point & k, Node ** preds) const;
+
+	// Walks the cover of interval id, from the node of its low endpoint to
+	// the node of its high endpoint, calling visit(node, onNode) for every
+	// node it stops at and visit(node, level) for every edge it takes.
+	template<typename Visit>
+	void walkCover(Id id, Visit visit);
+
+	void place(Id id);
+	void unplace(Id id);
+
+	// For interval id and the node between preds and succs: the highest
+	// layer below the node's top whose edge from preds into the node lies
+	// within the interval, and likewise for the edge out to succs. Layers
+	// up to `from` are known to.
+	void reach(Id id, Node * node, Node * const * preds, Node * const * succs, unsigned from,
+		unsigned & left, unsigned & right) const;
+
+	// Adjusts the cover of interval id to a node just linked between preds
+	// and succs, inside the edge the interval marked on layer `level`. That
+	// marker must already be gone.
+	void splitCover(Id id, unsigned level, Node * node, Node * const * preds, Node * const * succs);
+
+	// Adjusts the cover of interval id, which marks node, to the node being
+	// unlinked, save for the marker on the merged edge. Returns the layer
+	// that edge is on.
+	unsigned mergeCover(Id id, Node * node, Node * const * preds, Node * const * succs);
+
+	// The node for k, created if needed, with one more endpoint counted.
+	Node * acquire(const Point & k);
+
+	// Counts one endpoint less at k, removing the node once none is left.
+	void release(const Point & k);
+
+public:
+	IntervalSkipList();
+
+	~IntervalSkipList();
+
+	IntervalSkipList(const IntervalSkipList &) = delete;
+	IntervalSkipList & operator=(const IntervalSkipList &) = delete;
+
+	// Adds the closed interval [low, high] and returns its Id. Intervals may
+	// repeat and share endpoints. Throws a RuntimeException if high < low.
+	Id insert(const Point & low, const Point & high, const Value & v);
+
+	// Removes an interval. Returns false if id names no interval.
+	bool erase(Id id);
+
+	// The Ids of every interval containing p, in no particular order.
+	std::vector<Id> stab(const Point & p) const;
+
+	bool contains(Id id) const noexcept
+	{
+		return id < intervals.size() && intervals[id].live;
+	}
+
+	// The endpoints and value of an interval. Throw a RuntimeException if
+	// id names no interval.
+	const Point & low(Id id) const;
+	const Point & high(Id id) const;
+	const Value & value(Id id) const;
+
+	// Number of intervals.
+	size_t size() const noexcept
+	{
+		return liveCount;
+	}
+
+	bool isEmpty() const noexcept
+	{
+		return liveCount == 0;
+	}
+
+	// Number of distinct endpoints, one skip list node each.
+	size_t numEndpoints() const noexcept
+	{
+		return nodeCount;
+	}
+};
+
+template<typename Point, typename Value>
+IntervalSkipList<Point, Value>::IntervalSkipList()
+	: head(Node::create(Point(), maxLevel))
+{
+}
+
+template<typename Point, typename Value>
+IntervalSkipList<Point, Value>::~IntervalSkipList()
+{
+	Node * node = head;
+	while(node != nullptr)
+	{
+		Node * next = node->links()[0].next;
+		Node::destroy(node);
+		node = next;
+	}
+}
+
+template<typename Point, typename Value>
+typename IntervalSkipList<Point, Value>::Node * IntervalSkipList<Point, Value>::search(const Point & k, Node ** preds) const
+{
+	Node * node = head;
+	for(int level = levels - 1; level >= 0; level--)
+	{
+		Node * next = node->links()[level].next;
+		while(next != nullptr && next->key < k)
+		{
+			node = next;
+			next = node->links()[level].next;
+		}
+		preds[level] = node;
+	}
+	Node * candidate = node->links()[0].next;
+	if(candidate != nullptr && !(k < candidate->key))
+	{
+		return candidate;
+	}
+	return nullptr;
+}
+
+template<typename Point, typename Value>
+void IntervalSkipList<Point, Value>::addMarker(Id id, Node * node, unsigned level)
+{
+	Interval & interval = intervals[id];
+	MarkerList & markers = markersAt(node, level);
+	markers.push_back(Marker{id, interval.places.size()});
+	interval.places.push_back(Place{node, level, markers.size() - 1});
+}
+
+template<typename Point, typename Value>
+void IntervalSkipList<Point, Value>::removeMarker(Id id, size_t slot)
+{
+	Interval & interval = intervals[id];
+	Place place = interval.places[slot];
+	MarkerList & markers = markersAt(place.node, place.level);
+	markers[place.index] = markers.back();
+	markers.pop_back();
+	if(place.index < markers.size())
+	{
+		const Marker & moved = markers[place.index];
+		intervals[moved.id].places[moved.slot].index = place.index;
+	}
+	interval.places[slot] = interval.places.back();
+	interval.places.pop_back();
+	if(slot < interval.places.size())
+	{
+		const Place & moved = interval.places[slot];
+		markersAt(moved.node, moved.level)[moved.index].slot = slot;
+	}
+}
+
+template<typename Point, typename Value>
+template<typename Visit>
+void IntervalSkipList<Point, Value>::walkCover(Id id, Visit visit)
+{
+	const Interval & interval = intervals[id];
+	Node * preds[maxLevel];
+	Node * node = search(interval.low, preds);
+	visit(node, onNode);
+	// Every node strictly inside the edge just taken is shorter than the
+	// lowest layer that overshot, so starting each scan at the node's own
+	// top keeps the walk at O(log n) like a finger search.
+	while(interval.low < interval.high && node->key < interval.high)
+	{
+		int level = node->height - 1;
+		while(node->links()[level].next == nullptr || interval.high < node->links()[level].next->key)
+		{
+			level--;
+		}
+		visit(node, static_cast<unsigned>(level));
+		node = node->links()[level].next;
+		visit(node, onNode);
+	}
+}
+
+template<typename Point, typename Value>
+void IntervalSkipList<Point, Value>::place(Id id)
+{
+	walkCover(id, [this, id](Node * node, unsigned level) { addMarker(id, node, level); });
+}
+
+template<typename Point, typename Value>
+void IntervalSkipList<Point, Value>::unplace(Id id)
+{
+	while(!intervals[id].places.empty())
+	{
+		removeMarker(id, intervals[id].places.size() - 1);
+	}
+}
+
+template<typename Point, typename Value>
+void IntervalSkipList<Point, Value>::reach(Id id, Node * node, Node * const * preds, Node * const * succs, unsigned from,
+	unsigned & left, unsigned & right) const
+{
+	const Interval & interval = intervals[id];
+	left = from;
+	while(left + 1 < node->height && preds[left + 1] != head && !(preds[left + 1]->key < interval.low))
+	{
+		left++;
+	}
+	right = from;
+	while(right + 1 < node->height && succs[right + 1] != nullptr && !(interval.high < succs[right + 1]->key))
+	{
+		right++;
+	}
+}
+
+template<typename Point, typename Value>
+void IntervalSkipList<Point, Value>::splitCover(Id id, unsigned level, Node * node, Node * const * preds, Node * const * succs)
+{
+	// A cover is the maximal edges inside the interval. Of the node's new
+	// edges, the maximal ones are its highest that fit: in from
+	// preds[left] and out to succs[right]. They replace what the interval
+	// marked from preds[left] up to the node, which are the steps of the
+	// search path on layers `level` to left - 1, and from succs[level] to
+	// succs[right]. No other edge changes parent, so nothing else moves.
+	unsigned left, right;
+	reach(id, node, preds, succs, level, left, right);
+	const Point & leftEnd = preds[left]->key;
+	const Point & rightStart = succs[level]->key;
+	const Point & rightEnd = succs[right]->key;
+	std::vector<Place> & places = intervals[id].places;
+	// Removal fills a slot from the back, which has been looked at already.
+	for(size_t slot = places.size(); slot-- > 0; )
+	{
+		const Place & place = places[slot];
+		const Point & at = place.node->key;
+		bool inLeft = !(at < leftEnd) && at < node->key && (place.level != onNode || leftEnd < at);
+		bool inRight = !(at < rightStart) && at < rightEnd;
+		if(inLeft || inRight)
+		{
+			removeMarker(id, slot);
+		}
+	}
+	addMarker(id, preds[left], left);
+	addMarker(id, node, onNode);
+	addMarker(id, node, right);
+}
+
+template<typename Point, typename Value>
+unsigned IntervalSkipList<Point, Value>::mergeCover(Id id, Node * node, Node * const * preds, Node * const * succs)
+{
+	unsigned left, right;
+	reach(id, node, preds, succs, 0, left, right);
+	unsigned level = std::min(left, right);
+	std::vector<Place> & places = intervals[id].places;
+	for(size_t slot = places.size(); slot-- > 0; )
+	{
+		if(places[slot].node == node || (places[slot].node == preds[left] && places[slot].level == left))
+		{
+			removeMarker(id, slot);
+		}
+	}
+	// The search path steps splitCover would have folded into the node's
+	// edges, on both sides.
+	for(unsigned above = level + 1; above <= left; above++)
+	{
+		for(Node * x = preds[above]; x != preds[above - 1]; )
+		{
+			addMarker(id, x, above - 1);
+			x = x->links()[above - 1].next;
+			addMarker(id, x, onNode);
+		}
+	}
+	for(unsigned above = level + 1; above <= right; above++)
+	{
+		for(Node * x = succs[above - 1]; x != succs[above]; x = x->links()[above - 1].next)
+		{
+			addMarker(id, x, onNode);
+			addMarker(id, x, above - 1);
+		}
+	}
+	return level;
+}
+
+template<typename Point, typename Value>
+typename IntervalSkipList<Point, Value>::Node * IntervalSkipList<Point, Value>::acquire(const Point & k)
+{
+	Node * preds[maxLevel];
+	Node * node = search(k, preds);
+	if(node != nullptr)
+	{
+		node->endpoints++;
+		return node;
+	}
+	unsigned height = towerHeight(k, maxLevel);
+	for(unsigned level = levels; level < height; level++)
+	{
+		preds[level] = head;
+	}
+	levels = std::max(levels, height);
+
+	// The edges about to be split are the only ones whose intervals may be
+	// covered differently afterwards. Each interval crosses k on at most
+	// one of them, and its marker there goes with the edge.
+	std::vector<std::pair<Id, unsigned>> crossing;
+	for(unsigned level = 0; level < height; level++)
+	{
+		MarkerList & markers = preds[level]->links()[level].markers;
+		while(!markers.empty())
+		{
+			crossing.emplace_back(markers.back().id, level);
+			removeMarker(markers.back().id, markers.back().slot);
+		}
+	}
+
+	node = Node::create(k, height);
+	node->endpoints = 1;
+	Node * succs[maxLevel];
+	for(unsigned level = 0; level < height; level++)
+	{
+		Link & predLink = preds[level]->links()[level];
+		succs[level] = predLink.next;
+		node->links()[level].next = predLink.next;
+		predLink.next = node;
+	}
+	nodeCount++;
+
+	for(const std::pair<Id, unsigned> & entry : crossing)
+	{
+		splitCover(entry.first, entry.second, node, preds, succs);
+	}
+	return node;
+}
+
+template<typename Point, typename Value>
+void IntervalSkipList<Point, Value>::release(const Point & k)
+{
+	Node * preds[maxLevel];
+	Node * node = search(k, preds);
+	if(--node->endpoints != 0)
+	{
+		return;
+	}
+	// No interval ends here any more, so the ones marking the node pass
+	// through it; nothing else depends on its edges.
+	Node * succs[maxLevel];
+	for(unsigned level = 0; level < node->height; level++)
+	{
+		succs[level] = node->links()[level].next;
+	}
+	std::vector<std::pair<Id, unsigned>> crossing;
+	while(!node->markers.empty())
+	{
+		Id id = node->markers.back().id;
+		crossing.emplace_back(id, mergeCover(id, node, preds, succs));
+	}
+	for(unsigned level = 0; level < node->height; level++)
+	{
+		preds[level]->links()[level].next = succs[level];
+	}
+	Node::destroy(node);
+	nodeCount--;
+	while(levels > 1 && head->links()[levels - 1].next == nullptr)
+	{
+		levels--;
+	}
+	for(const std::pair<Id, unsigned> & entry : crossing)
+	{
+		addMarker(entry.first, preds[entry.second], entry.second);
+	}
+}
+
+template<typename Point, typename Value>
+typename IntervalSkipList<Point, Value>::Id IntervalSkipList<Point, Value>::insert(const Point & low, const Point & high, const Value & v)
+{
+	if(high < low)
+	{
+		throw RuntimeException("Interval ends before it starts");
+	}
+	Id id;
+	if(!freeIds.empty())
+	{
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else
+	{
+		id = intervals.size();
+		intervals.emplace_back();
+	}
+	Interval & interval = intervals[id];
+	interval.low = low;
+	interval.high = high;
+	interval.value = v;
+	interval.live = true;
+	liveCount++;
+
+	acquire(low);
+	acquire(high);
+	place(id);
+	return id;
+}
+
+template<typename Point, typename Value>
+bool IntervalSkipList<Point, Value>::erase(Id id)
+{
+	if(!contains(id))
+	{
+		return false;
+	}
+	unplace(id);
+	Interval & interval = intervals[id];
+	interval.live = false;
+	release(interval.low);
+	release(interval.high);
+	interval.value = Value();
+	freeIds.push_back(id);
+	liveCount--;
+	return true;
+}
+
+template<typename Point, typename Value>
+std::vector<typename IntervalSkipList<Point, Value>::Id> IntervalSkipList<Point, Value>::stab(const Point & p) const
+{
+	std::vector<Id> found;
+	Node * node = head;
+	for(int level = levels - 1; level >= 0; level--)
+	{
+		Node * next = node->links()[level].next;
+		while(next != nullptr && next->key < p)
+		{
+			node = next;
+			next = node->links()[level].next;
+		}
+		// p strictly inside this edge: its markers are exactly the
+		// intervals covering p on this layer. Edges ending at p are left to
+		// p's node.
+		if(next != nullptr && p < next->key)
+		{
+			for(const Marker & marker : node->links()[level].markers)
+			{
+				found.push_back(marker.id);
+			}
+		}
+	}
+	Node * candidate = node->links()[0].next;
+	if(candidate != nullptr && !(p < candidate->key))
+	{
+		for(const Marker & marker : candidate->markers)
+		{
+			found.push_back(marker.id);
+		}
+	}
+	return found;
+}
+
+template<typename Point, typename Value>
+const Point & IntervalSkipList<Point, Value>::low(Id id) const
+{
+	if(!contains(id))
+	{
+		throw RuntimeException("No such interval");
+	}
+	return intervals[id].low;
+}
+
+template<typename Point, typename Value>
+const Point & IntervalSkipList<Point, Value>::high(Id id) const
+{
+	if(!contains(id))
+	{
+		throw RuntimeException("No such interval");
+	}
+	return intervals[id].high;
+}
+
+template<typename Point, typename Value>
+const Value & IntervalSkipList<Point, Value>::value(Id id) const
+{
+	if(!contains(id))
+	{
+		throw RuntimeException("No such interval");
+	}
+	return intervals[id].value;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "catch_amalgamated.hpp"
+#include "IntervalSkipList.hpp"
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace{
+
+	using Intervals = IntervalSkipList<unsigned, std::string>;
+	using Id = Intervals::Id;
+
+	std::vector<Id> sorted(std::vector<Id> ids)
+	{
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	std::vector<Id> bruteForce(const std::map<Id, std::pair<unsigned, unsigned>> & model, unsigned p)
+	{
+		std::vector<Id> ids;
+		for(const auto & entry : model)
+		{
+			if(entry.second.first <= p && p <= entry.second.second)
+			{
+				ids.push_back(entry.first);
+			}
+		}
+		return ids;
+	}
+
+	TEST_CASE("IntervalBasicTest", "[IntervalTests]")
+	{
+		Intervals list;
+		REQUIRE(list.stab(5).empty());
+		Id standup = list.insert(900, 930, "standup");
+		Id lunch = list.insert(1200, 1300, "lunch");
+		Id day = list.insert(900, 1700, "day");
+		Id instant = list.insert(1200, 1200, "instant");
+		REQUIRE(list.size() == 4);
+		REQUIRE(list.numEndpoints() == 5);
+
+		REQUIRE(sorted(list.stab(915)) == sorted({standup, day}));
+		REQUIRE(sorted(list.stab(900)) == sorted({standup, day}));
+		REQUIRE(sorted(list.stab(930)) == sorted({standup, day}));
+		REQUIRE(sorted(list.stab(931)) == std::vector<Id>{day});
+		REQUIRE(sorted(list.stab(1200)) == sorted({lunch, day, instant}));
+		REQUIRE(sorted(list.stab(1201)) == sorted({lunch, day}));
+		REQUIRE(list.stab(899).empty());
+		REQUIRE(list.stab(1701).empty());
+		REQUIRE(list.value(lunch) == "lunch");
+		REQUIRE(list.low(day) == 900);
+		REQUIRE(list.high(day) == 1700);
+
+		REQUIRE(list.erase(day));
+		REQUIRE_FALSE(list.erase(day));
+		REQUIRE_FALSE(list.contains(day));
+		REQUIRE_THROWS_AS(list.value(day), RuntimeException);
+		REQUIRE(list.stab(1000).empty());
+		REQUIRE(sorted(list.stab(1200)) == sorted({lunch, instant}));
+		REQUIRE(list.numEndpoints() == 4);
+		REQUIRE_THROWS_AS(list.insert(10, 5, "backwards"), RuntimeException);
+		REQUIRE(list.size() == 3);
+	}
+
+	TEST_CASE("IntervalMatchesModelTest", "[IntervalTests]")
+	{
+		Intervals list;
+		std::map<Id, std::pair<unsigned, unsigned>> model;
+		std::mt19937 rng(11);
+		for(int step = 0; step < 6000; step++)
+		{
+			if(model.empty() || rng() % 3 != 0)
+			{
+				// A small domain, so endpoints are shared and nodes come and
+				// go while other intervals pass over them.
+				unsigned a = rng() % 400;
+				unsigned b = a + rng() % (rng() % 4 == 0 ? 400 : 20);
+				Id id = list.insert(a, b, std::to_string(step));
+				REQUIRE(model.count(id) == 0);
+				model[id] = std::make_pair(a, b);
+			}
+			else
+			{
+				auto victim = model.begin();
+				std::advance(victim, rng() % model.size());
+				REQUIRE(list.erase(victim->first));
+				model.erase(victim);
+			}
+			if(step % 50 == 0)
+			{
+				for(unsigned p = 0; p < 820; p += 7)
+				{
+					REQUIRE(sorted(list.stab(p)) == bruteForce(model, p));
+				}
+			}
+		}
+		REQUIRE(list.size() == model.size());
+		for(unsigned p = 0; p < 820; p++)
+		{
+			REQUIRE(sorted(list.stab(p)) == bruteForce(model, p));
+		}
+		for(const auto & entry : model)
+		{
+			REQUIRE(list.low(entry.first) == entry.second.first);
+			REQUIRE(list.high(entry.first) == entry.second.second);
+		}
+
+		while(!model.empty())
+		{
+			REQUIRE(list.erase(model.begin()->first));
+			model.erase(model.begin());
+		}
+		REQUIRE(list.isEmpty());
+		REQUIRE(list.numEndpoints() == 0);
+		REQUIRE(list.stab(100).empty());
+	}
+
+	TEST_CASE("IntervalNestedTest", "[IntervalTests]")
+	{
+		// Every interval contains the centre, so a stab there returns them
+		// all, each once.
+		Intervals list;
+		std::vector<Id> ids;
+		for(unsigned i = 1; i < 500; i++)
+		{
+			ids.push_back(list.insert(10000 - i * 13, 10000 + i * 17, ""));
+		}
+		REQUIRE(sorted(list.stab(10000)) == sorted(ids));
+		REQUIRE(sorted(list.stab(10001)) == sorted(ids));
+		Id point = list.insert(10000, 10000, "");
+		REQUIRE(list.stab(10000).size() == ids.size() + 1);
+		REQUIRE(list.stab(10001).size() == ids.size());
+		REQUIRE(list.erase(point));
+		REQUIRE(list.stab(10000 + 499 * 17 + 1).empty());
+		REQUIRE(list.stab(10000 + 499 * 17) == std::vector<Id>{ids.back()});
+	}
+
+	TEST_CASE("IntervalManyOverlapsTest", "[IntervalTests]")
+	{
+		// Every endpoint added or removed splits or merges the edges all the
+		// wide copies mark. Adjusting each cover locally keeps that linear
+		// in the copies; taking them off and putting them back, scanning the
+		// shared marker lists, made it quadratic.
+		Intervals list;
+		const unsigned copies = 16000;
+		std::vector<Id> wide;
+		for(unsigned i = 0; i < copies; i++)
+		{
+			wide.push_back(list.insert(0, 1000000000u, ""));
+		}
+		std::mt19937 rng(17);
+		std::vector<std::pair<Id, unsigned>> small;
+		for(unsigned i = 0; i < 200; i++)
+		{
+			unsigned a = 1 + rng() % 999990000u;
+			small.emplace_back(list.insert(a, a + rng() % 1000, ""), a);
+		}
+		for(const std::pair<Id, unsigned> & entry : small)
+		{
+			std::vector<Id> hits = list.stab(entry.second);
+			REQUIRE(hits.size() >= copies + 1);
+			REQUIRE(std::count(hits.begin(), hits.end(), entry.first) == 1);
+		}
+		for(unsigned i = 0; i < small.size(); i += 2)
+		{
+			REQUIRE(list.erase(small[i].first));
+		}
+		for(unsigned i = 0; i < copies; i += 2)
+		{
+			REQUIRE(list.erase(wide[i]));
+		}
+		REQUIRE(list.stab(0).size() == copies / 2);
+		REQUIRE(list.stab(small[1].second).size() >= copies / 2 + 1);
+		REQUIRE(list.stab(small[0].second).size() >= copies / 2);
+		REQUIRE(list.numEndpoints() == 2 + 2 * (small.size() / 2));
+	}
+}
@@ -0,0 +1,198 @@
+#ifndef ___KV_CLIENT_HPP
+#define ___KV_CLIENT_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "KvProtocol.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief A blocking client for KvServer that can pipeline requests.
+ *
+ * send() only buffers a request; flush() writes every buffered request at
+ * once, and receive() returns the responses in the order the requests were
+ * sent, flushing first if needed. call() is send() plus receive() for one
+ * request at a time.
+ *
+ *   KvClient client("/tmp/kv.sock");
+ *   for(...) client.send(request);    // one write for the whole batch
+ *   for(...) client.receive();
+ */
+class KvClient
+{
+private:
+	int fd = -1;
+	std::string output;
+	std::string input;
+	// Bytes at the front of input already decoded.
+	size_t inputOffset = 0;
+	// Opcodes of requests not answered yet, oldest first.
+	std::deque<KvOp> waiting;
+
+	static std::string systemError(const std::string & what)
+	{
+		return what + ": " + std::strerror(errno);
+	}
+
+	// Appends whatever the server has sent to input, without blocking.
+	void readAvailable()
+	{
+		char buffer[65536];
+		while(true)
+		{
+			ssize_t got = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+			if(got > 0)
+			{
+				input.append(buffer, static_cast<size_t>(got));
+				continue;
+			}
+			if(got < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				return;
+			}
+			throw RuntimeException("Server closed the connection");
+		}
+	}
+
+public:
+	// Connects to the server's socket. Throws a RuntimeException on failure.
+	explicit KvClient(const std::string & path)
+	{
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if(path.size() >= sizeof(address.sun_path))
+		{
+			throw RuntimeException("Socket path too long: " + path);
+		}
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+		{
+			std::string error = systemError("Cannot connect to " + path);
+			if(fd >= 0)
+			{
+				close(fd);
+			}
+			throw RuntimeException(error);
+		}
+	}
+
+	~KvClient()
+	{
+		close(fd);
+	}
+
+	KvClient(const KvClient &) = delete;
+	KvClient & operator=(const KvClient &) = delete;
+
+	// Buffers a request; nothing is written until flush() or receive().
+	void send(const KvRequest & request)
+	{
+		encodeRequest(output, request);
+		waiting.push_back(request.op);
+	}
+
+	// Writes every buffered request. Responses that arrive meanwhile are
+	// read and kept for receive(): the server stops reading requests while
+	// too many of its answers are unread, so a long pipeline would
+	// otherwise never finish sending.
+	void flush()
+	{
+		size_t written = 0;
+		while(written < output.size())
+		{
+			ssize_t sent = ::send(fd, output.data() + written, output.size() - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if(sent >= 0)
+			{
+				written += static_cast<size_t>(sent);
+				continue;
+			}
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				throw RuntimeException(systemError("Cannot write request"));
+			}
+			pollfd ready;
+			ready.fd = fd;
+			ready.events = POLLIN | POLLOUT;
+			ready.revents = 0;
+			if(poll(&ready, 1, -1) < 0)
+			{
+				if(errno == EINTR)
+				{
+					continue;
+				}
+				throw RuntimeException(systemError("Cannot wait for the server"));
+			}
+			if(ready.revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				readAvailable();
+			}
+		}
+		output.clear();
+	}
+
+	// The response to the oldest unanswered request. Throws a
+	// RuntimeException if nothing is outstanding or the server hung up.
+	KvResponse receive()
+	{
+		if(waiting.empty())
+		{
+			throw RuntimeException("No request is waiting for a response");
+		}
+		flush();
+		KvResponse response;
+		size_t consumed = 0;
+		while(!decodeResponse(input.data() + inputOffset, input.size() - inputOffset, waiting.front(), response, consumed))
+		{
+			if(inputOffset != 0)
+			{
+				input.erase(0, inputOffset);
+				inputOffset = 0;
+			}
+			char buffer[65536];
+			ssize_t got = read(fd, buffer, sizeof(buffer));
+			if(got < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if(got <= 0)
+			{
+				throw RuntimeException("Server closed the connection");
+			}
+			input.append(buffer, static_cast<size_t>(got));
+		}
+		inputOffset += consumed;
+		waiting.pop_front();
+		return response;
+	}
+
+	KvResponse call(const KvRequest & request)
+	{
+		send(request);
+		return receive();
+	}
+
+	// Requests sent but not yet received.
+	size_t pending() const noexcept
+	{
+		return waiting.size();
+	}
+};
+
+#endif
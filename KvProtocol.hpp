@@ -0,0 +1,368 @@
+#ifndef ___KV_PROTOCOL_HPP
+#define ___KV_PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "runtimeexcept.hpp"
+
+// Wire format of the key-value server (see KvServer.hpp).
+//
+// Every message is a frame: a 4-byte little-endian body length, then the
+// body. Clients may send any number of request frames without waiting;
+// the server answers each one with a response frame, in request order.
+//
+// Request body: 1 byte opcode (KvOp), then its arguments. A string is a
+// 4-byte length followed by its bytes, integers are little-endian.
+//   GET   key
+//   PUT   key, value              inserts, or overwrites the value
+//   DEL   key
+//   SCAN  start key, u32 limit    up to `limit` pairs with key >= start
+//   RANK  key                     number of keys smaller than key
+//
+// Frames are at most kv_detail::maxFrameBytes long, so a PUT whose key and
+// value together exceed kv_detail::maxPairBytes is answered with Error. A
+// SCAN returns at most kv_detail::maxScanPairs pairs, and stops early
+// rather than let its response outgrow a frame. Fewer pairs than asked for
+// therefore do not mean the keys ran out; to read on, scan again from just
+// after the last key returned.
+//
+// Response body: 1 byte status (KvStatus), then for Ok responses
+//   GET   value
+//   PUT   u8 1 if the key was new, 0 if it was overwritten
+//   DEL   nothing
+//   SCAN  u32 count, then count (key, value) string pairs
+//   RANK  u64 rank
+// NotFound answers GET, DEL and RANK of a missing key; Error carries a
+// message string.
+enum class KvOp : std::uint8_t
+{
+	Get = 1,
+	Put = 2,
+	Del = 3,
+	Scan = 4,
+	Rank = 5
+};
+
+enum class KvStatus : std::uint8_t
+{
+	Ok = 0,
+	NotFound = 1,
+	Error = 2
+};
+
+struct KvRequest
+{
+	KvOp op = KvOp::Get;
+	std::string key;
+	std::string value;
+	std::uint32_t limit = 0;
+};
+
+struct KvResponse
+{
+	KvStatus status = KvStatus::Ok;
+	// GET: the value. Error: the message.
+	std::string value;
+	// PUT: whether the key was new.
+	bool inserted = false;
+	std::uint64_t rank = 0;
+	std::vector<std::pair<std::string, std::string>> pairs;
+};
+
+namespace kv_detail
+{
+	// Larger frames are rejected rather than buffered.
+	const std::uint32_t maxFrameBytes = 64u << 20;
+
+	// Largest key plus value that still fits in a SCAN response on its own:
+	// a frame less its status, pair count and the two string lengths.
+	const std::uint32_t maxPairBytes = maxFrameBytes - 13;
+
+	// Most pairs one SCAN returns, whatever limit it asks for.
+	const std::uint32_t maxScanPairs = 1u << 16;
+
+	inline void putU32(std::string & out, std::uint32_t v)
+	{
+		for(unsigned i = 0; i < 4; i++)
+		{
+			out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+		}
+	}
+
+	inline void putU64(std::string & out, std::uint64_t v)
+	{
+		for(unsigned i = 0; i < 8; i++)
+		{
+			out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+		}
+	}
+
+	inline void putString(std::string & out, const std::string & s)
+	{
+		putU32(out, static_cast<std::uint32_t>(s.size()));
+		out.append(s);
+	}
+
+	// Reads the fields of one frame body, throwing on anything cut short.
+	class BodyReader
+	{
+	private:
+		const char * data;
+		size_t size;
+		size_t offset = 0;
+
+		const unsigned char * take(size_t bytes)
+		{
+			if(size - offset < bytes)
+			{
+				throw RuntimeException("Truncated key-value frame");
+			}
+			const unsigned char * p = reinterpret_cast<const unsigned char *>(data + offset);
+			offset += bytes;
+			return p;
+		}
+
+	public:
+		BodyReader(const char * d, size_t s) : data(d), size(s) {}
+
+		std::uint8_t u8()
+		{
+			return *take(1);
+		}
+
+		std::uint32_t u32()
+		{
+			const unsigned char * p = take(4);
+			return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+		}
+
+		std::uint64_t u64()
+		{
+			const unsigned char * p = take(8);
+			std::uint64_t v = 0;
+			for(unsigned i = 0; i < 8; i++)
+			{
+				v |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+			}
+			return v;
+		}
+
+		std::string string()
+		{
+			std::uint32_t length = u32();
+			const unsigned char * p = take(length);
+			return std::string(reinterpret_cast<const char *>(p), length);
+		}
+
+		void expectEnd() const
+		{
+			if(offset != size)
+			{
+				throw RuntimeException("Trailing bytes in key-value frame");
+			}
+		}
+	};
+
+	// Writes the body length into the 4 bytes reserved at `start`, once the
+	// body has been appended after them. A body over maxFrameBytes is
+	// removed again and rejected, as the peer would reject it.
+	inline void finishFrame(std::string & out, size_t start)
+	{
+		if(out.size() - start - 4 > maxFrameBytes)
+		{
+			out.resize(start);
+			throw RuntimeException("Key-value frame too large");
+		}
+		std::uint32_t length = static_cast<std::uint32_t>(out.size() - start - 4);
+		for(unsigned i = 0; i < 4; i++)
+		{
+			out[start + i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+		}
+	}
+
+	// Finds the body of the first complete frame in [data, data + size).
+	// Returns false if the frame is not complete yet.
+	inline bool nextFrame(const char * data, size_t size, const char *& body, size_t & bodySize, size_t & consumed)
+	{
+		if(size < 4)
+		{
+			return false;
+		}
+		const unsigned char * p = reinterpret_cast<const unsigned char *>(data);
+		std::uint32_t length = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+		if(length > maxFrameBytes)
+		{
+			throw RuntimeException("Key-value frame too large");
+		}
+		if(size - 4 < length)
+		{
+			return false;
+		}
+		body = data + 4;
+		bodySize = length;
+		consumed = 4 + length;
+		return true;
+	}
+}
+
+/**
+ * @brief Appends the frame of one request to out.
+ */
+inline void encodeRequest(std::string & out, const KvRequest & request)
+{
+	size_t start = out.size();
+	out.append(4, '\0');
+	out.push_back(static_cast<char>(request.op));
+	kv_detail::putString(out, request.key);
+	if(request.op == KvOp::Put)
+	{
+		kv_detail::putString(out, request.value);
+	}
+	else if(request.op == KvOp::Scan)
+	{
+		kv_detail::putU32(out, request.limit);
+	}
+	kv_detail::finishFrame(out, start);
+}
+
+/**
+ * @brief Decodes the first request in a buffer.
+ *
+ * @param consumed set to the bytes the frame took when one was decoded
+ * @return false if the buffer does not hold a complete frame yet
+ * @throws RuntimeException for a malformed or oversized frame
+ */
+inline bool decodeRequest(const char * data, size_t size, KvRequest & request, size_t & consumed)
+{
+	const char * body;
+	size_t bodySize;
+	if(!kv_detail::nextFrame(data, size, body, bodySize, consumed))
+	{
+		return false;
+	}
+	kv_detail::BodyReader in(body, bodySize);
+	std::uint8_t op = in.u8();
+	if(op < static_cast<std::uint8_t>(KvOp::Get) || op > static_cast<std::uint8_t>(KvOp::Rank))
+	{
+		throw RuntimeException("Unknown key-value opcode");
+	}
+	request.op = static_cast<KvOp>(op);
+	request.key = in.string();
+	request.value.clear();
+	request.limit = 0;
+	if(request.op == KvOp::Put)
+	{
+		request.value = in.string();
+	}
+	else if(request.op == KvOp::Scan)
+	{
+		request.limit = in.u32();
+	}
+	in.expectEnd();
+	return true;
+}
+
+/**
+ * @brief Appends the frame of one response to out. `op` is the request
+ * it answers, which decides the payload.
+ */
+inline void encodeResponse(std::string & out, KvOp op, const KvResponse & response)
+{
+	size_t start = out.size();
+	out.append(4, '\0');
+	out.push_back(static_cast<char>(response.status));
+	if(response.status == KvStatus::Error)
+	{
+		kv_detail::putString(out, response.value);
+	}
+	else if(response.status == KvStatus::Ok)
+	{
+		switch(op)
+		{
+			case KvOp::Get:
+				kv_detail::putString(out, response.value);
+				break;
+			case KvOp::Put:
+				out.push_back(response.inserted ? 1 : 0);
+				break;
+			case KvOp::Del:
+				break;
+			case KvOp::Scan:
+				kv_detail::putU32(out, static_cast<std::uint32_t>(response.pairs.size()));
+				for(const std::pair<std::string, std::string> & pair : response.pairs)
+				{
+					kv_detail::putString(out, pair.first);
+					kv_detail::putString(out, pair.second);
+				}
+				break;
+			case KvOp::Rank:
+				kv_detail::putU64(out, response.rank);
+				break;
+		}
+	}
+	kv_detail::finishFrame(out, start);
+}
+
+/**
+ * @brief Decodes the first response in a buffer, as the answer to a
+ * request with opcode `op`.
+ *
+ * @return false if the buffer does not hold a complete frame yet
+ * @throws RuntimeException for a malformed or oversized frame
+ */
+inline bool decodeResponse(const char * data, size_t size, KvOp op, KvResponse & response, size_t & consumed)
+{
+	const char * body;
+	size_t bodySize;
+	if(!kv_detail::nextFrame(data, size, body, bodySize, consumed))
+	{
+		return false;
+	}
+	kv_detail::BodyReader in(body, bodySize);
+	std::uint8_t status = in.u8();
+	if(status > static_cast<std::uint8_t>(KvStatus::Error))
+	{
+		throw RuntimeException("Unknown key-value status");
+	}
+	response = KvResponse();
+	response.status = static_cast<KvStatus>(status);
+	if(response.status == KvStatus::Error)
+	{
+		response.value = in.string();
+	}
+	else if(response.status == KvStatus::Ok)
+	{
+		switch(op)
+		{
+			case KvOp::Get:
+				response.value = in.string();
+				break;
+			case KvOp::Put:
+				response.inserted = in.u8() != 0;
+				break;
+			case KvOp::Del:
+				break;
+			case KvOp::Scan:
+			{
+				std::uint32_t count = in.u32();
+				for(std::uint32_t i = 0; i < count; i++)
+				{
+					std::string key = in.string();
+					std::string value = in.string();
+					response.pairs.emplace_back(std::move(key), std::move(value));
+				}
+				break;
+			}
+			case KvOp::Rank:
+				response.rank = in.u64();
+				break;
+		}
+	}
+	in.expectEnd();
+	return true;
+}
+
+#endif
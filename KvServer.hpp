@@ -0,0 +1,564 @@
+#ifndef ___KV_SERVER_HPP
+#define ___KV_SERVER_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "KvProtocol.hpp"
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+// Counters kept by KvServer::run().
+struct KvServerStats
+{
+	size_t connections = 0;
+	size_t requests = 0;
+	// Reads that produced at least one request; requests / batches is the
+	// average number of requests answered per read.
+	size_t batches = 0;
+	size_t protocolErrors = 0;
+	// Largest backlog of unsent responses any connection reached, in bytes.
+	size_t peakPendingOutput = 0;
+};
+
+/**
+ * @brief A single-threaded key-value server hosting a
+ * SkipList<std::string, std::string> behind a Unix domain socket.
+ *
+ * run() is an epoll event loop over non-blocking sockets. Each readable
+ * connection is drained, every complete request frame in its buffer is
+ * executed in order, and all their responses go out in as few writes as
+ * the socket allows, so a client that pipelines N requests costs one
+ * wake-up rather than N. Output the socket will not take yet waits for
+ * EPOLLOUT. A client that sends faster than it reads its answers is not
+ * read from while maxPendingOutput bytes of responses wait for it, so its
+ * backlog, not the server's memory, absorbs the difference. A malformed
+ * frame closes its connection.
+ *
+ * Only run() touches the list, so it needs no locking. stop() may be
+ * called from another thread or a signal handler.
+ *
+ * See KvProtocol.hpp for the wire format and KvClient.hpp for a client.
+ */
+class KvServer
+{
+private:
+	struct Connection
+	{
+		int fd;
+		std::string input;
+		std::string output;
+		// Bytes of output already written.
+		size_t written = 0;
+		// What the connection is registered for with epoll.
+		std::uint32_t events = EPOLLIN | EPOLLRDHUP;
+
+		size_t pending() const
+		{
+			return output.size() - written;
+		}
+	};
+
+	std::string socketPath;
+	int listenFd = -1;
+	int epollFd = -1;
+	int wakeFd = -1;
+	// Set once bind() has created the socket file, which is then ours to
+	// remove.
+	bool ownsPath = false;
+	SkipList<std::string, std::string> store;
+	std::unordered_map<int, std::unique_ptr<Connection>> connections;
+	KvServerStats counters;
+
+	static std::string systemError(const std::string & what)
+	{
+		return what + ": " + std::strerror(errno);
+	}
+
+	void watch(int fd, std::uint32_t events, int op)
+	{
+		epoll_event event;
+		std::memset(&event, 0, sizeof(event));
+		event.events = events;
+		event.data.fd = fd;
+		if(epoll_ctl(epollFd, op, fd, &event) != 0)
+		{
+			throw RuntimeException(systemError("epoll_ctl"));
+		}
+	}
+
+	// Removes a socket file left behind by a server that has exited. Throws
+	// if the path is anything else, or a socket still accepting connections.
+	static void removeStaleSocket(const std::string & path, const sockaddr_un & address);
+	// Closes every descriptor and removes the socket file if we created it.
+	void closeAll();
+	void acceptAll();
+	void closeConnection(Connection & connection);
+	// Registers for input unless too much output is pending, and for
+	// EPOLLOUT while any is.
+	void updateEvents(Connection & connection);
+	// Reads what is available and answers every complete request. Returns
+	// false once the connection is closed.
+	bool readRequests(Connection & connection);
+	// Writes pending output. Returns false if the connection failed.
+	bool writeResponses(Connection & connection);
+
+public:
+	// Pending output at which a connection stops being read from, until
+	// the client has taken some of it.
+	static const size_t maxPendingOutput = 4u << 20;
+
+	// Binds and listens on `path`, replacing a stale socket file there.
+	// Throws a RuntimeException if the socket cannot be set up, or if
+	// `path` is taken by something other than a dead server's socket.
+	explicit KvServer(const std::string & path);
+
+	~KvServer();
+
+	KvServer(const KvServer &) = delete;
+	KvServer & operator=(const KvServer &) = delete;
+
+	// Serves connections until stop() is called.
+	void run();
+
+	// Makes run() return. Async-signal-safe.
+	void stop() noexcept;
+
+	// Runs one request against the list.
+	KvResponse execute(const KvRequest & request);
+
+	// Read these once run() has returned, or from the run() thread.
+	const KvServerStats & stats() const noexcept
+	{
+		return counters;
+	}
+
+	const SkipList<std::string, std::string> & list() const noexcept
+	{
+		return store;
+	}
+};
+
+inline KvServer::KvServer(const std::string & path) : socketPath(path)
+{
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(address.sun_path))
+	{
+		throw RuntimeException("Socket path too long: " + path);
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(listenFd < 0 || epollFd < 0 || wakeFd < 0)
+	{
+		std::string error = systemError("Cannot set up server");
+		closeAll();
+		throw RuntimeException(error);
+	}
+	try
+	{
+		removeStaleSocket(path, address);
+	}
+	catch(RuntimeException &)
+	{
+		closeAll();
+		throw;
+	}
+	ownsPath = bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+	if(!ownsPath || listen(listenFd, 128) != 0)
+	{
+		std::string error = systemError("Cannot listen on " + path);
+		closeAll();
+		throw RuntimeException(error);
+	}
+	watch(listenFd, EPOLLIN, EPOLL_CTL_ADD);
+	watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+}
+
+inline KvServer::~KvServer()
+{
+	closeAll();
+}
+
+inline void KvServer::removeStaleSocket(const std::string & path, const sockaddr_un & address)
+{
+	struct stat status;
+	if(lstat(path.c_str(), &status) != 0)
+	{
+		if(errno == ENOENT)
+		{
+			return;
+		}
+		throw RuntimeException(systemError("Cannot stat " + path));
+	}
+	if(!S_ISSOCK(status.st_mode))
+	{
+		throw RuntimeException("Not a socket, refusing to replace: " + path);
+	}
+	// A socket file outlives its server; only one nobody answers on is stale.
+	int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(probe < 0)
+	{
+		throw RuntimeException(systemError("Cannot probe " + path));
+	}
+	int connected = connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+	int probeError = errno;
+	close(probe);
+	if(connected == 0)
+	{
+		throw RuntimeException("A server is already listening on " + path);
+	}
+	if(probeError != ECONNREFUSED)
+	{
+		errno = probeError;
+		throw RuntimeException(systemError("Cannot probe " + path));
+	}
+	if(unlink(path.c_str()) != 0 && errno != ENOENT)
+	{
+		throw RuntimeException(systemError("Cannot remove stale socket " + path));
+	}
+}
+
+inline void KvServer::closeAll()
+{
+	for(auto & entry : connections)
+	{
+		close(entry.first);
+	}
+	connections.clear();
+	if(listenFd >= 0)
+	{
+		close(listenFd);
+		listenFd = -1;
+	}
+	if(ownsPath)
+	{
+		unlink(socketPath.c_str());
+		ownsPath = false;
+	}
+	if(epollFd >= 0)
+	{
+		close(epollFd);
+		epollFd = -1;
+	}
+	if(wakeFd >= 0)
+	{
+		close(wakeFd);
+		wakeFd = -1;
+	}
+}
+
+inline void KvServer::stop() noexcept
+{
+	std::uint64_t one = 1;
+	ssize_t ignored = write(wakeFd, &one, sizeof(one));
+	(void)ignored;
+}
+
+inline KvResponse KvServer::execute(const KvRequest & request)
+{
+	KvResponse response;
+	switch(request.op)
+	{
+		case KvOp::Get:
+		{
+			auto it = store.lowerBound(request.key);
+			if(it == store.end() || *it != request.key)
+			{
+				response.status = KvStatus::NotFound;
+			}
+			else
+			{
+				response.value = it.value();
+			}
+			break;
+		}
+		case KvOp::Put:
+			if(request.key.size() + request.value.size() > kv_detail::maxPairBytes)
+			{
+				response.status = KvStatus::Error;
+				response.value = "Key and value too large";
+				break;
+			}
+			response.inserted = store.insert(request.key, request.value);
+			if(!response.inserted)
+			{
+				store.find(request.key) = request.value;
+			}
+			break;
+		case KvOp::Del:
+			if(!store.erase(request.key))
+			{
+				response.status = KvStatus::NotFound;
+			}
+			break;
+		case KvOp::Scan:
+		{
+			// Status and pair count, then two string lengths per pair.
+			size_t bytes = 5;
+			std::uint32_t limit = std::min(request.limit, kv_detail::maxScanPairs);
+			for(auto it = store.lowerBound(request.key); it != store.end() && response.pairs.size() < limit; ++it)
+			{
+				bytes += 8 + it->size() + it.value().size();
+				if(bytes > kv_detail::maxFrameBytes)
+				{
+					break;
+				}
+				response.pairs.emplace_back(*it, it.value());
+			}
+			break;
+		}
+		case KvOp::Rank:
+		{
+			auto it = store.lowerBound(request.key);
+			if(it == store.end() || *it != request.key)
+			{
+				response.status = KvStatus::NotFound;
+			}
+			else
+			{
+				response.rank = store.rank(request.key);
+			}
+			break;
+		}
+	}
+	return response;
+}
+
+inline void KvServer::acceptAll()
+{
+	while(true)
+	{
+		int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0)
+		{
+			return;
+		}
+		std::unique_ptr<Connection> connection(new Connection());
+		connection->fd = fd;
+		watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+		connections[fd] = std::move(connection);
+		counters.connections++;
+	}
+}
+
+inline void KvServer::closeConnection(Connection & connection)
+{
+	int fd = connection.fd;
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	close(fd);
+	connections.erase(fd);
+}
+
+inline void KvServer::updateEvents(Connection & connection)
+{
+	std::uint32_t events = EPOLLOUT;
+	if(connection.pending() < maxPendingOutput)
+	{
+		// A peer that hung up is noticed once reading resumes; watching for
+		// it while paused would only wake the loop for nothing to do.
+		events = EPOLLIN | EPOLLRDHUP | (connection.pending() != 0 ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+	}
+	if(events != connection.events)
+	{
+		watch(connection.fd, events, EPOLL_CTL_MOD);
+		connection.events = events;
+	}
+}
+
+inline bool KvServer::readRequests(Connection & connection)
+{
+	bool peerClosed = false;
+	bool paused = false;
+	size_t answered = 0;
+	char buffer[65536];
+	while(true)
+	{
+		// Answer what is buffered, as long as the client keeps up.
+		size_t offset = 0;
+		KvRequest request;
+		try
+		{
+			size_t consumed = 0;
+			while(connection.pending() < maxPendingOutput
+				&& decodeRequest(connection.input.data() + offset, connection.input.size() - offset, request, consumed))
+			{
+				offset += consumed;
+				encodeResponse(connection.output, request.op, execute(request));
+				answered++;
+				counters.peakPendingOutput = std::max(counters.peakPendingOutput, connection.pending());
+			}
+		}
+		catch(RuntimeException &)
+		{
+			counters.protocolErrors++;
+			peerClosed = true;
+		}
+		connection.input.erase(0, offset);
+		if(peerClosed)
+		{
+			break;
+		}
+		if(connection.pending() >= maxPendingOutput)
+		{
+			// Read no further until the socket takes some of the backlog;
+			// EPOLLOUT resumes from here.
+			if(!writeResponses(connection))
+			{
+				closeConnection(connection);
+				return false;
+			}
+			if(connection.pending() >= maxPendingOutput)
+			{
+				paused = true;
+				break;
+			}
+			continue;
+		}
+
+		ssize_t got = read(connection.fd, buffer, sizeof(buffer));
+		if(got > 0)
+		{
+			connection.input.append(buffer, static_cast<size_t>(got));
+			continue;
+		}
+		if(got == 0)
+		{
+			peerClosed = true;
+		}
+		else if(errno == EINTR)
+		{
+			continue;
+		}
+		else if(errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			peerClosed = true;
+		}
+		break;
+	}
+
+	if(answered != 0)
+	{
+		counters.requests += answered;
+		counters.batches++;
+	}
+
+	// Answer what arrived before the peer closed its end, as far as the
+	// socket takes it, then drop the connection. A paused connection has
+	// just been written to; writing again could unpause it with requests
+	// still buffered, which only the EPOLLOUT path picks up.
+	if((!paused && !writeResponses(connection)) || peerClosed)
+	{
+		closeConnection(connection);
+		return false;
+	}
+	return true;
+}
+
+inline bool KvServer::writeResponses(Connection & connection)
+{
+	while(connection.pending() != 0)
+	{
+		ssize_t sent = send(connection.fd, connection.output.data() + connection.written,
+			connection.pending(), MSG_NOSIGNAL);
+		if(sent > 0)
+		{
+			connection.written += static_cast<size_t>(sent);
+			continue;
+		}
+		if(sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			// Drop what is sent, so a client that reads slowly but steadily
+			// does not keep its whole history in the buffer.
+			if(connection.written >= maxPendingOutput)
+			{
+				connection.output.erase(0, connection.written);
+				connection.written = 0;
+			}
+			updateEvents(connection);
+			return true;
+		}
+		return false;
+	}
+	connection.output.clear();
+	connection.written = 0;
+	updateEvents(connection);
+	return true;
+}
+
+inline void KvServer::run()
+{
+	epoll_event events[64];
+	while(true)
+	{
+		int ready = epoll_wait(epollFd, events, 64, -1);
+		if(ready < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			throw RuntimeException(systemError("epoll_wait"));
+		}
+		for(int i = 0; i < ready; i++)
+		{
+			int fd = events[i].data.fd;
+			if(fd == wakeFd)
+			{
+				std::uint64_t count;
+				ssize_t ignored = read(wakeFd, &count, sizeof(count));
+				(void)ignored;
+				return;
+			}
+			if(fd == listenFd)
+			{
+				acceptAll();
+				continue;
+			}
+			auto found = connections.find(fd);
+			if(found == connections.end())
+			{
+				continue;
+			}
+			Connection & connection = *found->second;
+			bool resumed = false;
+			if(events[i].events & EPOLLOUT)
+			{
+				bool paused = (connection.events & EPOLLIN) == 0;
+				if(!writeResponses(connection))
+				{
+					closeConnection(connection);
+					continue;
+				}
+				// Requests left buffered while paused will not raise
+				// EPOLLIN again, so pick them up here.
+				resumed = paused && (connection.events & EPOLLIN) != 0;
+			}
+			if(resumed || (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+			{
+				readRequests(connection);
+			}
+		}
+	}
+}
+
+#endif
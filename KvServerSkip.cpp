@@ -0,0 +1,450 @@
+#include "catch_amalgamated.hpp"
+#include "KvClient.hpp"
+#include "KvProtocol.hpp"
+#include "KvServer.hpp"
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace{
+
+	// A socket path private to this test process, removed at scope exit.
+	struct SocketPath
+	{
+		std::string path;
+
+		explicit SocketPath(const std::string & test)
+			: path("/tmp/skiplist-kv-" + test + "-" + std::to_string(getpid()) + ".sock")
+		{
+			unlink(path.c_str());
+		}
+
+		~SocketPath()
+		{
+			unlink(path.c_str());
+		}
+	};
+
+	// Runs a server on its own thread until the scope ends.
+	struct RunningServer
+	{
+		KvServer server;
+		std::thread thread;
+
+		explicit RunningServer(const std::string & path) : server(path)
+		{
+			thread = std::thread([this]() { server.run(); });
+		}
+
+		~RunningServer()
+		{
+			server.stop();
+			thread.join();
+		}
+	};
+
+	KvRequest makeRequest(KvOp op, const std::string & key, const std::string & value = "", std::uint32_t limit = 0)
+	{
+		KvRequest request;
+		request.op = op;
+		request.key = key;
+		request.value = value;
+		request.limit = limit;
+		return request;
+	}
+
+	std::string keyOf(unsigned i)
+	{
+		char buffer[16];
+		std::snprintf(buffer, sizeof(buffer), "k%06u", i);
+		return buffer;
+	}
+
+	TEST_CASE("KvProtocolRoundTripTest", "[KvTests]")
+	{
+		std::vector<KvRequest> requests = {
+			makeRequest(KvOp::Get, "alpha"),
+			makeRequest(KvOp::Put, "beta", std::string("v\0al", 4)),
+			makeRequest(KvOp::Del, ""),
+			makeRequest(KvOp::Scan, "gamma", "", 17),
+			makeRequest(KvOp::Rank, "delta")};
+		std::string wire;
+		for(const KvRequest & request : requests)
+		{
+			encodeRequest(wire, request);
+		}
+		size_t offset = 0;
+		for(const KvRequest & expected : requests)
+		{
+			KvRequest decoded;
+			size_t consumed = 0;
+			REQUIRE(decodeRequest(wire.data() + offset, wire.size() - offset, decoded, consumed));
+			REQUIRE(decoded.op == expected.op);
+			REQUIRE(decoded.key == expected.key);
+			REQUIRE(decoded.value == expected.value);
+			REQUIRE(decoded.limit == expected.limit);
+			offset += consumed;
+		}
+		REQUIRE(offset == wire.size());
+
+		KvResponse scan;
+		scan.pairs = {{"a", "1"}, {"b", ""}};
+		KvResponse rank;
+		rank.rank = 1ull << 40;
+		KvResponse missing;
+		missing.status = KvStatus::NotFound;
+		wire.clear();
+		encodeResponse(wire, KvOp::Scan, scan);
+		encodeResponse(wire, KvOp::Rank, rank);
+		encodeResponse(wire, KvOp::Get, missing);
+		KvResponse decoded;
+		size_t consumed = 0;
+		REQUIRE(decodeResponse(wire.data(), wire.size(), KvOp::Scan, decoded, consumed));
+		REQUIRE(decoded.pairs == scan.pairs);
+		offset = consumed;
+		REQUIRE(decodeResponse(wire.data() + offset, wire.size() - offset, KvOp::Rank, decoded, consumed));
+		REQUIRE(decoded.rank == rank.rank);
+		offset += consumed;
+		REQUIRE(decodeResponse(wire.data() + offset, wire.size() - offset, KvOp::Get, decoded, consumed));
+		REQUIRE(decoded.status == KvStatus::NotFound);
+		REQUIRE(offset + consumed == wire.size());
+	}
+
+	TEST_CASE("KvProtocolPartialFrameTest", "[KvTests]")
+	{
+		std::string wire;
+		encodeRequest(wire, makeRequest(KvOp::Put, "key", "value"));
+		KvRequest decoded;
+		size_t consumed = 0;
+		for(size_t prefix = 0; prefix < wire.size(); prefix++)
+		{
+			REQUIRE_FALSE(decodeRequest(wire.data(), prefix, decoded, consumed));
+		}
+		REQUIRE(decodeRequest(wire.data(), wire.size(), decoded, consumed));
+		REQUIRE(consumed == wire.size());
+	}
+
+	TEST_CASE("KvProtocolMalformedFrameTest", "[KvTests]")
+	{
+		KvRequest decoded;
+		size_t consumed = 0;
+
+		// Unknown opcode.
+		std::string wire;
+		encodeRequest(wire, makeRequest(KvOp::Get, "key"));
+		wire[4] = 9;
+		REQUIRE_THROWS_AS(decodeRequest(wire.data(), wire.size(), decoded, consumed), RuntimeException);
+
+		// A key length running past the end of the body.
+		wire.clear();
+		encodeRequest(wire, makeRequest(KvOp::Get, "key"));
+		wire[5] = 100;
+		REQUIRE_THROWS_AS(decodeRequest(wire.data(), wire.size(), decoded, consumed), RuntimeException);
+
+		// Bytes left over after the arguments.
+		wire.clear();
+		encodeRequest(wire, makeRequest(KvOp::Del, "key"));
+		wire[0]++;
+		wire.push_back('x');
+		REQUIRE_THROWS_AS(decodeRequest(wire.data(), wire.size(), decoded, consumed), RuntimeException);
+
+		// A length header beyond the frame limit is rejected before the body
+		// arrives.
+		wire.assign("\xff\xff\xff\xff", 4);
+		REQUIRE_THROWS_AS(decodeRequest(wire.data(), wire.size(), decoded, consumed), RuntimeException);
+	}
+
+	TEST_CASE("KvServerExecuteTest", "[KvTests]")
+	{
+		SocketPath socket("execute");
+		KvServer server(socket.path);
+		for(unsigned i = 0; i < 200; i++)
+		{
+			REQUIRE(server.execute(makeRequest(KvOp::Put, keyOf(i * 7 % 200), "v")).inserted);
+		}
+		KvResponse overwrite = server.execute(makeRequest(KvOp::Put, keyOf(5), "five"));
+		REQUIRE_FALSE(overwrite.inserted);
+		REQUIRE(server.execute(makeRequest(KvOp::Get, keyOf(5))).value == "five");
+		REQUIRE(server.execute(makeRequest(KvOp::Rank, keyOf(5))).rank == 5);
+		REQUIRE(server.execute(makeRequest(KvOp::Del, keyOf(3))).status == KvStatus::Ok);
+		REQUIRE(server.execute(makeRequest(KvOp::Del, keyOf(3))).status == KvStatus::NotFound);
+		REQUIRE(server.execute(makeRequest(KvOp::Get, keyOf(3))).status == KvStatus::NotFound);
+		REQUIRE(server.execute(makeRequest(KvOp::Rank, keyOf(3))).status == KvStatus::NotFound);
+		REQUIRE(server.execute(makeRequest(KvOp::Rank, keyOf(5))).rank == 4);
+
+		KvResponse scan = server.execute(makeRequest(KvOp::Scan, keyOf(2), "", 3));
+		REQUIRE(scan.pairs.size() == 3);
+		REQUIRE(scan.pairs[0].first == keyOf(2));
+		REQUIRE(scan.pairs[1].first == keyOf(4));
+		REQUIRE(scan.pairs[2].first == keyOf(5));
+		REQUIRE(scan.pairs[2].second == "five");
+		REQUIRE(server.execute(makeRequest(KvOp::Scan, keyOf(198), "", 10)).pairs.size() == 2);
+		REQUIRE(server.list().size() == 199);
+	}
+
+	TEST_CASE("KvServerScanCapTest", "[KvTests]")
+	{
+		SocketPath socket("scancap");
+		KvServer server(socket.path);
+
+		// However large the limit, a SCAN answers with at most maxScanPairs.
+		for(unsigned i = 0; i < kv_detail::maxScanPairs + 100; i++)
+		{
+			server.execute(makeRequest(KvOp::Put, keyOf(i), ""));
+		}
+		KvResponse many = server.execute(makeRequest(KvOp::Scan, "", "", 0xFFFFFFFFu));
+		REQUIRE(many.pairs.size() == kv_detail::maxScanPairs);
+
+		// Nor does it outgrow a frame; the rest is read from the last key on.
+		const std::string big(4u << 20, 'v');
+		for(unsigned i = 0; i < 20; i++)
+		{
+			server.execute(makeRequest(KvOp::Put, "big" + keyOf(i), big));
+		}
+		KvResponse first = server.execute(makeRequest(KvOp::Scan, "big", "", 100));
+		REQUIRE(first.pairs.size() > 1);
+		REQUIRE(first.pairs.size() < 20);
+		std::string wire;
+		encodeResponse(wire, KvOp::Scan, first);
+		REQUIRE(wire.size() <= 4 + size_t(kv_detail::maxFrameBytes));
+		KvResponse rest = server.execute(makeRequest(KvOp::Scan, first.pairs.back().first + '\0', "", 100));
+		REQUIRE(rest.pairs.size() > 20 - first.pairs.size());
+		REQUIRE(rest.pairs[20 - first.pairs.size() - 1].first == "big" + keyOf(19));
+
+		// A pair that could not come back from a SCAN is not stored at all.
+		KvResponse tooLarge = server.execute(makeRequest(KvOp::Put, "huge", std::string(kv_detail::maxPairBytes, 'x')));
+		REQUIRE(tooLarge.status == KvStatus::Error);
+		REQUIRE(server.execute(makeRequest(KvOp::Get, "huge")).status == KvStatus::NotFound);
+
+		// Frames over the limit are refused when encoded, leaving the
+		// buffer as it was.
+		std::string out = "x";
+		REQUIRE_THROWS_AS(encodeRequest(out, makeRequest(KvOp::Get, std::string(kv_detail::maxFrameBytes, 'k'))), RuntimeException);
+		REQUIRE(out == "x");
+	}
+
+	TEST_CASE("KvServerPipelineTest", "[KvTests]")
+	{
+		SocketPath socket("pipeline");
+		RunningServer running(socket.path);
+		const unsigned keys = 2000;
+		{
+			KvClient client(socket.path);
+			for(unsigned i = 0; i < keys; i++)
+			{
+				client.send(makeRequest(KvOp::Put, keyOf(i * 7919 % keys), std::to_string(i)));
+			}
+			REQUIRE(client.pending() == keys);
+			for(unsigned i = 0; i < keys; i++)
+			{
+				KvResponse response = client.receive();
+				REQUIRE(response.status == KvStatus::Ok);
+				REQUIRE(response.inserted);
+			}
+			REQUIRE(client.pending() == 0);
+
+			// Responses come back in request order, whatever their types.
+			for(unsigned i = 0; i < keys; i += 10)
+			{
+				client.send(makeRequest(KvOp::Rank, keyOf(i)));
+				client.send(makeRequest(KvOp::Get, keyOf(i * 7919 % keys)));
+				client.send(makeRequest(KvOp::Scan, keyOf(i), "", 2));
+			}
+			for(unsigned i = 0; i < keys; i += 10)
+			{
+				REQUIRE(client.receive().rank == i);
+				REQUIRE(client.receive().value == std::to_string(i));
+				REQUIRE(client.receive().pairs.size() == 2);
+			}
+			REQUIRE(client.call(makeRequest(KvOp::Del, keyOf(0))).status == KvStatus::Ok);
+			REQUIRE(client.call(makeRequest(KvOp::Rank, keyOf(1))).rank == 0);
+		}
+
+		// Two clients at once, each with requests in flight.
+		KvClient first(socket.path);
+		KvClient second(socket.path);
+		for(unsigned i = 1; i < 100; i++)
+		{
+			first.send(makeRequest(KvOp::Get, keyOf(i)));
+			second.send(makeRequest(KvOp::Rank, keyOf(i)));
+		}
+		second.flush();
+		for(unsigned i = 1; i < 100; i++)
+		{
+			REQUIRE(first.receive().status == KvStatus::Ok);
+			REQUIRE(second.receive().rank == i - 1);
+		}
+	}
+
+	TEST_CASE("KvServerBatchingTest", "[KvTests]")
+	{
+		SocketPath socket("batching");
+		KvServer server(socket.path);
+		std::thread thread;
+		{
+			// Queue the whole pipeline before the server starts, so it
+			// arrives in one read.
+			KvClient client(socket.path);
+			for(unsigned i = 0; i < 100; i++)
+			{
+				client.send(makeRequest(KvOp::Put, keyOf(i), "v"));
+			}
+			client.flush();
+			thread = std::thread([&server]() { server.run(); });
+			for(unsigned i = 0; i < 100; i++)
+			{
+				REQUIRE(client.receive().inserted);
+			}
+		}
+		server.stop();
+		thread.join();
+		REQUIRE(server.stats().connections == 1);
+		REQUIRE(server.stats().requests == 100);
+		REQUIRE(server.stats().batches < server.stats().requests);
+	}
+
+	TEST_CASE("KvServerMalformedClientTest", "[KvTests]")
+	{
+		SocketPath socket("malformed");
+		RunningServer running(socket.path);
+
+		// A raw connection that sends one good request and then garbage gets
+		// its answer and is then hung up on.
+		int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, socket.path.c_str(), socket.path.size() + 1);
+		REQUIRE(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+		std::string wire;
+		encodeRequest(wire, makeRequest(KvOp::Put, "key", "value"));
+		wire.append("\x02\x00\x00\x00\x09\x09", 6);
+		REQUIRE(write(fd, wire.data(), wire.size()) == static_cast<ssize_t>(wire.size()));
+		std::string received;
+		char buffer[256];
+		ssize_t got;
+		while((got = read(fd, buffer, sizeof(buffer))) > 0)
+		{
+			received.append(buffer, static_cast<size_t>(got));
+		}
+		close(fd);
+		KvResponse response;
+		size_t consumed = 0;
+		REQUIRE(decodeResponse(received.data(), received.size(), KvOp::Put, response, consumed));
+		REQUIRE(response.inserted);
+		REQUIRE(consumed == received.size());
+
+		// The server itself carries on.
+		KvClient client(socket.path);
+		REQUIRE(client.call(makeRequest(KvOp::Get, "key")).value == "value");
+	}
+
+	TEST_CASE("KvServerSocketPathTest", "[KvTests]")
+	{
+		SocketPath socket("path");
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, socket.path.c_str(), socket.path.size() + 1);
+
+		// A regular file is never removed.
+		{
+			std::FILE * file = std::fopen(socket.path.c_str(), "w");
+			REQUIRE(file != nullptr);
+			std::fclose(file);
+		}
+		REQUIRE_THROWS_AS(KvServer(socket.path), RuntimeException);
+		REQUIRE(access(socket.path.c_str(), F_OK) == 0);
+		unlink(socket.path.c_str());
+
+		// A socket left behind by a server that is gone is replaced.
+		int stale = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		REQUIRE(bind(stale, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+		close(stale);
+		{
+			RunningServer running(socket.path);
+
+			// A live server's socket is left alone, and it keeps serving.
+			REQUIRE_THROWS_AS(KvServer(socket.path), RuntimeException);
+			KvClient client(socket.path);
+			REQUIRE(client.call(makeRequest(KvOp::Put, "key", "value")).inserted);
+		}
+		REQUIRE(access(socket.path.c_str(), F_OK) != 0);
+	}
+
+	TEST_CASE("KvServerBackpressureTest", "[KvTests]")
+	{
+		SocketPath socket("backpressure");
+		KvServer server(socket.path);
+		std::thread thread([&server]() { server.run(); });
+		const std::string value(64u << 10, 'v');
+		{
+			KvClient client(socket.path);
+			for(unsigned i = 0; i < 16; i++)
+			{
+				REQUIRE(client.call(makeRequest(KvOp::Put, keyOf(i), value)).inserted);
+			}
+
+			// Every SCAN answers with a megabyte, and the client sends them
+			// all before reading any. Unchecked, the server would hold all
+			// 128 MiB.
+			const unsigned scans = 128;
+			for(unsigned i = 0; i < scans; i++)
+			{
+				client.send(makeRequest(KvOp::Scan, "", "", 16));
+			}
+			client.flush();
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			for(unsigned i = 0; i < scans; i++)
+			{
+				KvResponse response = client.receive();
+				REQUIRE(response.pairs.size() == 16);
+				REQUIRE(response.pairs.back().second == value);
+			}
+			REQUIRE(client.call(makeRequest(KvOp::Get, keyOf(3))).value == value);
+		}
+		server.stop();
+		thread.join();
+		REQUIRE(server.stats().requests == 16 + 128 + 1);
+		REQUIRE(server.stats().peakPendingOutput < KvServer::maxPendingOutput + (2u << 20));
+	}
+
+	TEST_CASE("KvServerDeepPipelineTest", "[KvTests]")
+	{
+		// More SCAN requests than the socket holds, whose answers go far past
+		// the server's output limit. The server stops reading until the
+		// client takes answers, so the client has to take them while it is
+		// still sending.
+		SocketPath socket("deep");
+		RunningServer running(socket.path);
+		KvClient client(socket.path);
+		const std::string value(100, 'v');
+		for(unsigned i = 0; i < 2000; i++)
+		{
+			client.send(makeRequest(KvOp::Put, keyOf(i), value));
+		}
+		for(unsigned i = 0; i < 2000; i++)
+		{
+			REQUIRE(client.receive().inserted);
+		}
+		const unsigned scans = 60000;
+		for(unsigned i = 0; i < scans; i++)
+		{
+			client.send(makeRequest(KvOp::Scan, keyOf(i % 1990), "", 10));
+		}
+		client.flush();
+		for(unsigned i = 0; i < scans; i++)
+		{
+			KvResponse response = client.receive();
+			REQUIRE(response.pairs.size() == 10);
+			REQUIRE(response.pairs.front().first == keyOf(i % 1990));
+		}
+		REQUIRE(client.pending() == 0);
+	}
+}
@@ -0,0 +1,546 @@
+#ifndef ___LAZY_SKIP_LIST_HPP
+#define ___LAZY_SKIP_LIST_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <vector>
+#include "EpochReclaimer.hpp"
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+// A small test-and-test-and-set lock, one per node. Critical sections in
+// the lazy list are a handful of pointer stores, so spinning beats
+// parking the thread; it yields after a while in case the holder was
+// descheduled.
+class SpinLock
+{
+private:
+	std::atomic<bool> locked{false};
+
+public:
+	void lock() noexcept
+	{
+		unsigned spins = 0;
+		while(locked.exchange(true, std::memory_order_acquire))
+		{
+			while(locked.load(std::memory_order_relaxed))
+			{
+				if(++spins % 64 == 0)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+	}
+
+	void unlock() noexcept
+	{
+		locked.store(false, std::memory_order_release);
+	}
+};
+
+/**
+ * @brief A concurrent skip list with per-node locks: the lazy skip list
+ * of Herlihy, Lev, Luchangco and Shavit.
+ *
+ * Any number of threads may call every member function at once.
+ *
+ * Each key lives in a single node holding its whole tower of next
+ * pointers, together with a spinlock and two flags:
+ *   fullyLinked  set once the node is linked on every layer of its tower;
+ *                until then it is not yet part of the set
+ *   marked       set when erase() starts unlinking it; from then on it is
+ *                no longer part of the set
+ *
+ * find(), contains(), nextKey() and previousKey() take no locks and never
+ * retry a search. insert() and erase() lock only the predecessors of the
+ * key on the layers it spans, validate that nothing changed since the
+ * unlocked search, and start over if it did.
+ *
+ * Unlike SkipList, which caps towers by the size of the list, towers
+ * here are capped at maxLevel. Values are fixed at insertion; find() returns a copy.
+ *
+ * Erased nodes may still be read by concurrent searches, so they are
+ * retired to an EpochReclaimer: every operation pins an epoch while it
+ * walks the list, and a node is freed once everyone pinned when it was
+ * erased has finished. erase() reclaims as it goes; reclaim() does it on
+ * demand.
+ */
+template<typename Key, typename Value>
+class LazySkipList
+{
+public:
+	// Layers available to towers, S_0 included.
+	static const unsigned maxLevel = 32;
+
+private:
+	// The tower of next pointers is allocated right behind the node, so a
+	// search touches one block of memory per node it passes.
+	struct Node
+	{
+		Key key;
+		Value value;
+		unsigned topLevel;
+		std::atomic<bool> marked{false};
+		std::atomic<bool> fullyLinked{false};
+		SpinLock lock;
+		// Link in the list of retired nodes, and the epoch it was retired in.
+		Node * retiredNext = nullptr;
+		std::uint64_t retiredEpoch = 0;
+
+		Node(const Key & k, const Value & v, unsigned height)
+			: key(k), value(v), topLevel(height)
+		{
+		}
+
+		std::atomic<Node *> * next()
+		{
+			return reinterpret_cast<std::atomic<Node *> *>(this + 1);
+		}
+
+		static Node * create(const Key & k, const Value & v, unsigned height)
+		{
+			void * memory = ::operator new(sizeof(Node) + height * sizeof(std::atomic<Node *>));
+			Node * node = new(memory) Node(k, v, height);
+			for(unsigned level = 0; level < height; level++)
+			{
+				new(&node->next()[level]) std::atomic<Node *>(nullptr);
+			}
+			return node;
+		}
+
+		static void destroy(Node * node)
+		{
+			node->~Node();
+			::operator delete(node);
+		}
+	};
+
+	Node * head;
+	Node * tail;
+	std::atomic<size_t> listSize{0};
+	mutable EpochReclaimer<Node> reclaimer{&Node::destroy};
+
+	// Fills preds and succs with the last node before k and the first node
+	// at or after k on every layer. Returns the highest layer on which a
+	// node with key k was found, or -1.
+	int findNode(const Key & k, Node ** preds, Node ** succs) const;
+
+	// The live node holding k, or nullptr.
+	Node * findLive(const Key & k) const;
+
+	// Unlocks the distinct predecessors locked on layers 0..highestLocked.
+	static void unlockPreds(Node ** preds, int highestLocked);
+
+public:
+	LazySkipList();
+
+	~LazySkipList();
+
+	LazySkipList(const LazySkipList &) = delete;
+	LazySkipList & operator=(const LazySkipList &) = delete;
+
+	// How many keys are in the list? Exact when no update is in flight.
+	size_t size() const noexcept;
+
+	bool isEmpty() const noexcept;
+
+	// Is k in the list? Takes no locks.
+	bool contains(const Key & k) const;
+
+	// Copies the value of k into out and returns true, or returns false if
+	// k is not in the list. Takes no locks.
+	bool find(const Key & k, Value & out) const;
+
+	// The value of k. Throws a RuntimeException if k is not in the list.
+	Value find(const Key & k) const;
+
+	// Height of the tower of k, S_0 counting as 1.
+	// Throws a RuntimeException if k is not in the list.
+	unsigned height(const Key & k) const;
+
+	// The next larger key in the list. Throws a RuntimeException if k is
+	// not in the list or is the largest key.
+	Key nextKey(const Key & k) const;
+
+	// The next smaller key in the list. Throws a RuntimeException if k is
+	// not in the list or is the smallest key.
+	Key previousKey(const Key & k) const;
+
+	// Inserts k with value v. Returns false, leaving the list unchanged, if
+	// k is already present.
+	bool insert(const Key & k, const Value & v);
+
+	// Removes k. Returns false if k was not in the list.
+	bool erase(const Key & k);
+
+	// Frees the erased nodes no running operation can still be reading.
+	// Returns how many were freed. erase() already does this every so
+	// often; call it to release memory promptly, for example once the
+	// threads using the list are idle.
+	size_t reclaim();
+
+	// Every key in increasing order. Keys inserted or erased while this runs
+	// may or may not appear.
+	std::vector<Key> allKeysInOrder() const;
+
+	// Calls fn(key, value) for every key in increasing order, with the same
+	// guarantees as allKeysInOrder(). Takes no locks, but holds back
+	// reclaim() while it runs.
+	template<typename Fn>
+	void forEach(Fn fn) const;
+};
+
+template<typename Key, typename Value>
+LazySkipList<Key, Value>::LazySkipList()
+{
+	head = Node::create(Key(), Value(), maxLevel);
+	tail = Node::create(Key(), Value(), maxLevel);
+	for(unsigned level = 0; level < maxLevel; level++)
+	{
+		head->next()[level].store(tail, std::memory_order_relaxed);
+	}
+	head->fullyLinked.store(true, std::memory_order_relaxed);
+	tail->fullyLinked.store(true, std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value>
+LazySkipList<Key, Value>::~LazySkipList()
+{
+	Node * currentNode = head;
+	while(currentNode != nullptr)
+	{
+		Node * temp = currentNode;
+		currentNode = currentNode->next()[0].load(std::memory_order_relaxed);
+		Node::destroy(temp);
+	}
+}
+
+template<typename Key, typename Value>
+int LazySkipList<Key, Value>::findNode(const Key & k, Node ** preds, Node ** succs) const
+{
+	int levelFound = -1;
+	Node * pred = head;
+	for(int level = maxLevel - 1; level >= 0; level--)
+	{
+		Node * current = pred->next()[level].load(std::memory_order_acquire);
+		while(current != tail && current->key < k)
+		{
+			pred = current;
+			current = pred->next()[level].load(std::memory_order_acquire);
+		}
+		if(levelFound == -1 && current != tail && !(k < current->key))
+		{
+			levelFound = level;
+		}
+		preds[level] = pred;
+		succs[level] = current;
+	}
+	return levelFound;
+}
+
+template<typename Key, typename Value>
+typename LazySkipList<Key, Value>::Node * LazySkipList<Key, Value>::findLive(const Key & k) const
+{
+	Node * preds[maxLevel];
+	Node * succs[maxLevel];
+	int levelFound = findNode(k, preds, succs);
+	if(levelFound == -1)
+	{
+		return nullptr;
+	}
+	Node * found = succs[levelFound];
+	if(!found->fullyLinked.load(std::memory_order_acquire) || found->marked.load(std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+	return found;
+}
+
+template<typename Key, typename Value>
+void LazySkipList<Key, Value>::unlockPreds(Node ** preds, int highestLocked)
+{
+	Node * previous = nullptr;
+	for(int level = 0; level <= highestLocked; level++)
+	{
+		if(preds[level] != previous)
+		{
+			preds[level]->lock.unlock();
+			previous = preds[level];
+		}
+	}
+}
+
+template<typename Key, typename Value>
+size_t LazySkipList<Key, Value>::size() const noexcept
+{
+	return listSize.load(std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value>
+bool LazySkipList<Key, Value>::isEmpty() const noexcept
+{
+	return size() == 0;
+}
+
+template<typename Key, typename Value>
+bool LazySkipList<Key, Value>::contains(const Key & k) const
+{
+	auto guard = reclaimer.pin();
+	return findLive(k) != nullptr;
+}
+
+template<typename Key, typename Value>
+bool LazySkipList<Key, Value>::find(const Key & k, Value & out) const
+{
+	auto guard = reclaimer.pin();
+	Node * found = findLive(k);
+	if(found == nullptr)
+	{
+		return false;
+	}
+	out = found->value;
+	return true;
+}
+
+template<typename Key, typename Value>
+Value LazySkipList<Key, Value>::find(const Key & k) const
+{
+	auto guard = reclaimer.pin();
+	Node * found = findLive(k);
+	if(found == nullptr)
+	{
+		throw RuntimeException("Key not found");
+	}
+	return found->value;
+}
+
+template<typename Key, typename Value>
+unsigned LazySkipList<Key, Value>::height(const Key & k) const
+{
+	auto guard = reclaimer.pin();
+	Node * found = findLive(k);
+	if(found == nullptr)
+	{
+		throw RuntimeException("Key not found");
+	}
+	return found->topLevel;
+}
+
+template<typename Key, typename Value>
+Key LazySkipList<Key, Value>::nextKey(const Key & k) const
+{
+	auto guard = reclaimer.pin();
+	Node * found = findLive(k);
+	if(found == nullptr)
+	{
+		throw RuntimeException("Key not found");
+	}
+	Node * current = found->next()[0].load(std::memory_order_acquire);
+	while(current != tail && (current->marked.load(std::memory_order_acquire)
+		|| !current->fullyLinked.load(std::memory_order_acquire)))
+	{
+		current = current->next()[0].load(std::memory_order_acquire);
+	}
+	if(current == tail)
+	{
+		throw RuntimeException("No next key");
+	}
+	return current->key;
+}
+
+template<typename Key, typename Value>
+Key LazySkipList<Key, Value>::previousKey(const Key & k) const
+{
+	auto guard = reclaimer.pin();
+	Node * preds[maxLevel];
+	Node * succs[maxLevel];
+	int levelFound = findNode(k, preds, succs);
+	if(levelFound == -1 || !succs[levelFound]->fullyLinked.load(std::memory_order_acquire)
+		|| succs[levelFound]->marked.load(std::memory_order_acquire))
+	{
+		throw RuntimeException("Key not found");
+	}
+	// preds[0] is the largest key below k at the time of the search; if it
+	// has been erased since, search again for the one below it.
+	Node * pred = preds[0];
+	while(pred != head && pred->marked.load(std::memory_order_acquire))
+	{
+		findNode(pred->key, preds, succs);
+		pred = preds[0];
+	}
+	if(pred == head)
+	{
+		throw RuntimeException("No previous key");
+	}
+	return pred->key;
+}
+
+template<typename Key, typename Value>
+bool LazySkipList<Key, Value>::insert(const Key & k, const Value & v)
+{
+	unsigned topLevel = towerHeight(k, maxLevel);
+	auto guard = reclaimer.pin();
+	Node * preds[maxLevel];
+	Node * succs[maxLevel];
+	while(true)
+	{
+		int levelFound = findNode(k, preds, succs);
+		if(levelFound != -1)
+		{
+			Node * found = succs[levelFound];
+			if(!found->marked.load(std::memory_order_acquire))
+			{
+				// Someone else is inserting k; it is present once linked.
+				while(!found->fullyLinked.load(std::memory_order_acquire))
+				{
+					std::this_thread::yield();
+				}
+				return false;
+			}
+			// k is being erased; retry until it is gone.
+			continue;
+		}
+
+		int highestLocked = -1;
+		bool valid = true;
+		Node * previous = nullptr;
+		for(unsigned level = 0; valid && level < topLevel; level++)
+		{
+			Node * pred = preds[level];
+			Node * succ = succs[level];
+			if(pred != previous)
+			{
+				pred->lock.lock();
+				previous = pred;
+			}
+			highestLocked = static_cast<int>(level);
+			valid = !pred->marked.load(std::memory_order_acquire)
+				&& !succ->marked.load(std::memory_order_acquire)
+				&& pred->next()[level].load(std::memory_order_acquire) == succ;
+		}
+		if(!valid)
+		{
+			unlockPreds(preds, highestLocked);
+			continue;
+		}
+
+		Node * newNode = Node::create(k, v, topLevel);
+		for(unsigned level = 0; level < topLevel; level++)
+		{
+			newNode->next()[level].store(succs[level], std::memory_order_relaxed);
+		}
+		for(unsigned level = 0; level < topLevel; level++)
+		{
+			preds[level]->next()[level].store(newNode, std::memory_order_release);
+		}
+		newNode->fullyLinked.store(true, std::memory_order_release);
+		listSize.fetch_add(1, std::memory_order_relaxed);
+		unlockPreds(preds, highestLocked);
+		return true;
+	}
+}
+
+template<typename Key, typename Value>
+bool LazySkipList<Key, Value>::erase(const Key & k)
+{
+	auto guard = reclaimer.pin();
+	Node * victim = nullptr;
+	bool isMarked = false;
+	int topLevel = -1;
+	Node * preds[maxLevel];
+	Node * succs[maxLevel];
+	while(true)
+	{
+		int levelFound = findNode(k, preds, succs);
+		if(!isMarked)
+		{
+			if(levelFound == -1)
+			{
+				return false;
+			}
+			victim = succs[levelFound];
+			// Only a node found on its own top layer is fully visible to the
+			// search; otherwise it is still being linked or unlinked.
+			if(!victim->fullyLinked.load(std::memory_order_acquire)
+				|| static_cast<int>(victim->topLevel) - 1 != levelFound
+				|| victim->marked.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+			topLevel = static_cast<int>(victim->topLevel);
+			victim->lock.lock();
+			if(victim->marked.load(std::memory_order_acquire))
+			{
+				victim->lock.unlock();
+				return false;
+			}
+			victim->marked.store(true, std::memory_order_release);
+			isMarked = true;
+		}
+
+		int highestLocked = -1;
+		bool valid = true;
+		Node * previous = nullptr;
+		for(int level = 0; valid && level < topLevel; level++)
+		{
+			Node * pred = preds[level];
+			if(pred != previous)
+			{
+				pred->lock.lock();
+				previous = pred;
+			}
+			highestLocked = level;
+			valid = !pred->marked.load(std::memory_order_acquire)
+				&& pred->next()[level].load(std::memory_order_acquire) == victim;
+		}
+		if(!valid)
+		{
+			unlockPreds(preds, highestLocked);
+			continue;
+		}
+
+		for(int level = topLevel - 1; level >= 0; level--)
+		{
+			preds[level]->next()[level].store(victim->next()[level].load(std::memory_order_acquire), std::memory_order_release);
+		}
+		victim->lock.unlock();
+		unlockPreds(preds, highestLocked);
+		listSize.fetch_sub(1, std::memory_order_relaxed);
+		reclaimer.retire(victim);
+		return true;
+	}
+}
+
+template<typename Key, typename Value>
+size_t LazySkipList<Key, Value>::reclaim()
+{
+	return reclaimer.reclaim();
+}
+
+template<typename Key, typename Value>
+std::vector<Key> LazySkipList<Key, Value>::allKeysInOrder() const
+{
+	std::vector<Key> keys;
+	forEach([&keys](const Key & k, const Value &) { keys.push_back(k); });
+	return keys;
+}
+
+template<typename Key, typename Value>
+template<typename Fn>
+void LazySkipList<Key, Value>::forEach(Fn fn) const
+{
+	auto guard = reclaimer.pin();
+	for(Node * current = head->next()[0].load(std::memory_order_acquire); current != tail;
+		current = current->next()[0].load(std::memory_order_acquire))
+	{
+		if(current->fullyLinked.load(std::memory_order_acquire) && !current->marked.load(std::memory_order_acquire))
+		{
+			fn(current->key, current->value);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,284 @@
+#include "catch_amalgamated.hpp"
+#include "LazySkipList.hpp"
+#include "SkipList.hpp"
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace{
+
+	// Counts live instances, so tests can see erased nodes being freed.
+	struct Tracked
+	{
+		static std::atomic<long> live;
+		unsigned id;
+
+		Tracked(unsigned i = 0) : id(i) { live++; }
+		Tracked(const Tracked & other) : id(other.id) { live++; }
+		Tracked & operator=(const Tracked & other) { id = other.id; return *this; }
+		~Tracked() { live--; }
+	};
+
+	std::atomic<long> Tracked::live{0};
+
+	TEST_CASE("LazySequentialTest", "[LazyTests]")
+	{
+		LazySkipList<unsigned, unsigned> lazy;
+		SkipList<unsigned, unsigned> sl;
+		for(unsigned i = 0; i < 200; i++)
+		{
+			unsigned key = i * 7919 % 1000;
+			REQUIRE(lazy.insert(key, i) == sl.insert(key, i));
+		}
+		REQUIRE_FALSE(lazy.insert(0, 5));
+		REQUIRE(lazy.size() == sl.size());
+		REQUIRE(lazy.allKeysInOrder() == sl.allKeysInOrder());
+
+		std::vector<unsigned> keys = sl.allKeysInOrder();
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(lazy.find(keys[i]) == sl.find(keys[i]));
+			// SkipList caps heights by its size, and towerHeight() stops
+			// following flipCoin past 8 heads; below both they agree.
+			unsigned cap = std::min(sl.numLayers() - 1, 9u);
+			REQUIRE(std::min(lazy.height(keys[i]), cap) == std::min(sl.height(keys[i]), cap));
+			if(i + 1 < keys.size())
+			{
+				REQUIRE(lazy.nextKey(keys[i]) == keys[i + 1]);
+			}
+			if(i > 0)
+			{
+				REQUIRE(lazy.previousKey(keys[i]) == keys[i - 1]);
+			}
+		}
+		REQUIRE_THROWS_AS(lazy.nextKey(keys.back()), RuntimeException);
+		REQUIRE_THROWS_AS(lazy.previousKey(keys.front()), RuntimeException);
+		REQUIRE_THROWS_AS(lazy.find(1001), RuntimeException);
+		unsigned value = 0;
+		REQUIRE_FALSE(lazy.find(1001, value));
+	}
+
+	TEST_CASE("LazyEraseTest", "[LazyTests]")
+	{
+		LazySkipList<std::string, unsigned> lazy;
+		for(unsigned i = 0; i < 100; i++)
+		{
+			lazy.insert("key" + std::to_string(i), i);
+		}
+		for(unsigned i = 0; i < 100; i += 2)
+		{
+			REQUIRE(lazy.erase("key" + std::to_string(i)));
+		}
+		REQUIRE_FALSE(lazy.erase("key0"));
+		REQUIRE_FALSE(lazy.erase("missing"));
+		REQUIRE(lazy.size() == 50);
+		for(unsigned i = 0; i < 100; i++)
+		{
+			REQUIRE(lazy.contains("key" + std::to_string(i)) == (i % 2 == 1));
+		}
+		// "key10" was erased, so the neighbours of "key1" close over it.
+		REQUIRE(lazy.nextKey("key1") == "key11");
+		REQUIRE(lazy.previousKey("key11") == "key1");
+
+		// Erased keys can be inserted again.
+		REQUIRE(lazy.insert("key0", 1000));
+		REQUIRE(lazy.find("key0") == 1000);
+	}
+
+	TEST_CASE("LazyConcurrentInsertTest", "[LazyTests]")
+	{
+		LazySkipList<unsigned, unsigned> lazy;
+		const unsigned threads = 4;
+		const unsigned perThread = 2000;
+		std::vector<std::thread> workers;
+		for(unsigned t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&lazy, t]()
+			{
+				// Interleaved keys, so threads keep contending for the same
+				// predecessors; every key is also offered by a second thread.
+				for(unsigned i = 0; i < perThread; i++)
+				{
+					lazy.insert(i * threads + t, t);
+					lazy.insert(i * threads + (t + 1) % threads, t);
+				}
+			});
+		}
+		for(std::thread & worker : workers)
+		{
+			worker.join();
+		}
+		REQUIRE(lazy.size() == threads * perThread);
+		std::vector<unsigned> keys = lazy.allKeysInOrder();
+		REQUIRE(keys.size() == threads * perThread);
+		for(unsigned i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(keys[i] == i);
+		}
+	}
+
+	TEST_CASE("LazyConcurrentInsertEraseTest", "[LazyTests]")
+	{
+		LazySkipList<unsigned, unsigned> lazy;
+		// Even keys are permanent; odd keys are inserted and erased
+		// repeatedly while readers check the even ones never disappear.
+		for(unsigned i = 0; i < 2000; i += 2)
+		{
+			lazy.insert(i, i);
+		}
+		std::atomic<bool> stop{false};
+		std::atomic<unsigned> missing{0};
+		std::vector<std::thread> workers;
+		for(unsigned t = 0; t < 2; t++)
+		{
+			workers.emplace_back([&lazy, t]()
+			{
+				for(unsigned round = 0; round < 5; round++)
+				{
+					for(unsigned i = 1 + 2 * t; i < 2000; i += 4)
+					{
+						lazy.insert(i, i);
+					}
+					for(unsigned i = 1 + 2 * t; i < 2000; i += 4)
+					{
+						lazy.erase(i);
+					}
+				}
+			});
+		}
+		workers.emplace_back([&]()
+		{
+			while(!stop.load())
+			{
+				for(unsigned i = 0; i < 2000; i += 2)
+				{
+					unsigned value = 0;
+					if(!lazy.find(i, value) || value != i)
+					{
+						missing++;
+					}
+				}
+			}
+		});
+		workers[0].join();
+		workers[1].join();
+		stop = true;
+		workers[2].join();
+
+		REQUIRE(missing.load() == 0);
+		REQUIRE(lazy.size() == 1000);
+		std::vector<unsigned> keys = lazy.allKeysInOrder();
+		REQUIRE(keys.size() == 1000);
+		REQUIRE(std::all_of(keys.begin(), keys.end(), [](unsigned k) { return k % 2 == 0; }));
+	}
+
+	TEST_CASE("LazyReclaimTest", "[LazyTests]")
+	{
+		LazySkipList<unsigned, Tracked> lazy;
+		long sentinels = Tracked::live.load();
+		for(unsigned i = 0; i < 10000; i++)
+		{
+			lazy.insert(i, Tracked(i));
+		}
+		for(unsigned i = 0; i < 10000; i += 2)
+		{
+			REQUIRE(lazy.erase(i));
+		}
+		// Nothing is pinned, so one reclaim() frees every erased node.
+		lazy.reclaim();
+		REQUIRE(Tracked::live.load() == sentinels + 5000);
+		REQUIRE(lazy.reclaim() == 0);
+		REQUIRE(lazy.find(3).id == 3);
+	}
+
+	TEST_CASE("LazyConcurrentReclaimTest", "[LazyTests]")
+	{
+		// Insert/erase churn over ever new keys, with readers walking the
+		// same keys: erased nodes are freed along the way, not kept until
+		// the list goes.
+		LazySkipList<unsigned, Tracked> lazy;
+		long sentinels = Tracked::live.load();
+		const unsigned writers = 4;
+		const unsigned rounds = 50000;
+		std::atomic<bool> stop{false};
+		std::atomic<unsigned> wrongValues{0};
+		std::vector<std::thread> threads;
+		for(unsigned t = 0; t < writers; t++)
+		{
+			threads.emplace_back([&, t]()
+			{
+				for(unsigned i = 0; i < rounds; i++)
+				{
+					unsigned key = i * writers + t;
+					lazy.insert(key, Tracked(key));
+					if(i >= 8)
+					{
+						lazy.erase(key - 8 * writers);
+					}
+				}
+			});
+		}
+		threads.emplace_back([&]()
+		{
+			while(!stop.load())
+			{
+				for(unsigned key = 0; key < rounds * writers; key += 997)
+				{
+					Tracked found;
+					if(lazy.find(key, found) && found.id != key)
+					{
+						wrongValues++;
+					}
+				}
+				lazy.forEach([&](const unsigned & k, const Tracked & v)
+				{
+					if(v.id != k)
+					{
+						wrongValues++;
+					}
+				});
+			}
+		});
+		for(unsigned t = 0; t < writers; t++)
+		{
+			threads[t].join();
+		}
+		stop = true;
+		threads.back().join();
+
+		REQUIRE(wrongValues.load() == 0);
+		REQUIRE(lazy.size() == 8 * writers);
+		long pending = Tracked::live.load() - sentinels - static_cast<long>(lazy.size());
+		REQUIRE(pending < static_cast<long>(rounds * writers / 10));
+		lazy.reclaim();
+		REQUIRE(Tracked::live.load() == sentinels + static_cast<long>(lazy.size()));
+	}
+
+	TEST_CASE("TowerHeightDistributionTest", "[LazyTests]")
+	{
+		// Each layer should hold about half the keys of the one below, above
+		// flipCoin's first 8 layers too, and nothing should pile up at the
+		// cap.
+		const unsigned n = 1 << 20;
+		std::vector<unsigned> atLeast(LazySkipList<unsigned, unsigned>::maxLevel + 1, 0);
+		for(unsigned i = 0; i < n; i++)
+		{
+			unsigned height = towerHeight(i * 2654435761u, LazySkipList<unsigned, unsigned>::maxLevel);
+			for(unsigned level = 1; level <= height; level++)
+			{
+				atLeast[level]++;
+			}
+		}
+		REQUIRE(atLeast[1] == n);
+		for(unsigned level = 2; level <= 14; level++)
+		{
+			double expected = static_cast<double>(n) / (1u << (level - 1));
+			REQUIRE(atLeast[level] > expected * 0.8);
+			REQUIRE(atLeast[level] < expected * 1.2);
+		}
+		REQUIRE(atLeast[24] < 4);
+	}
+
+}
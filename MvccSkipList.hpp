@@ -0,0 +1,555 @@
+#ifndef ___MVCC_SKIP_LIST_HPP
+#define ___MVCC_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "EpochReclaimer.hpp"
+#include "LazySkipList.hpp"
+#include "WriteBatch.hpp"
+
+/**
+ * @brief A concurrent map with snapshot isolation, built from a
+ * LazySkipList whose values are version chains.
+ *
+ * Every write gets a commit timestamp from a logical clock and pushes a
+ * new version onto the front of its key's chain; erasing pushes a
+ * tombstone. apply() commits a whole WriteBatch under one timestamp.
+ * Writers are serialized by one commit mutex, which keeps commit order and
+ * timestamp order the same; readers never take it.
+ *
+ * A Snapshot fixes a timestamp and sees, for every key, the newest version
+ * committed at or before it, so a long scan through a Snapshot reads one
+ * point in time while writers carry on. get() reads the newest version of
+ * a single key through a snapshot of its own.
+ *
+ * Versions older than what the oldest open snapshot can see are garbage.
+ * Chains that gained a version are remembered, and once enough of them
+ * pile up a commit prunes them; collectGarbage() prunes on demand. Erasing
+ * leaves a tombstone version; once every snapshot sees the tombstone, the
+ * key is removed from the list and its chain is retired to an
+ * EpochReclaimer, which frees it when no reader can still be reading it.
+ */
+template<typename Key, typename Value>
+class MvccSkipList
+{
+private:
+	struct Version
+	{
+		std::uint64_t commitTs;
+		bool deleted;
+		Value value;
+		std::atomic<Version *> older;
+
+		Version(std::uint64_t ts, bool d, const Value & v, Version * o)
+			: commitTs(ts), deleted(d), value(v), older(o)
+		{
+		}
+	};
+
+	struct Chain
+	{
+		Key key;
+		std::atomic<Version *> newest{nullptr};
+		// Set while the chain is on the list of chains to prune.
+		bool dirty = false;
+		// Link in the list of retired chains, and the epoch it was retired in.
+		Chain * retiredNext = nullptr;
+		std::uint64_t retiredEpoch = 0;
+
+		explicit Chain(const Key & k) : key(k)
+		{
+		}
+
+		static void destroy(Chain * chain)
+		{
+			freeVersions(chain->newest.load(std::memory_order_relaxed));
+			delete chain;
+		}
+	};
+
+	LazySkipList<Key, Chain *> index;
+	// Readers pin it while they hold a Chain from the index.
+	mutable EpochReclaimer<Chain> chains{&Chain::destroy};
+
+	// Serializes writers and garbage collection.
+	std::mutex commitLock;
+	std::uint64_t clock = 0;
+	std::atomic<std::uint64_t> committed{0};
+	std::vector<Chain *> dirtyChains;
+	size_t gcTrigger = 1024;
+
+	// Timestamps of open snapshots.
+	mutable std::mutex snapshotLock;
+	mutable std::multiset<std::uint64_t> openSnapshots;
+
+	static void freeVersions(Version * version)
+	{
+		while(version != nullptr)
+		{
+			Version * older = version->older.load(std::memory_order_relaxed);
+			delete version;
+			version = older;
+		}
+	}
+
+	// Newest version of a chain committed at or before ts, or nullptr.
+	static const Version * visibleAt(const Chain * chain, std::uint64_t ts)
+	{
+		const Version * version = chain->newest.load(std::memory_order_acquire);
+		while(version != nullptr && version->commitTs > ts)
+		{
+			version = version->older.load(std::memory_order_acquire);
+		}
+		return version;
+	}
+
+	// One write of a commit, prepared before anything is published. A new
+	// key's chain is already in the index, holding only the new version;
+	// for an existing chain the version waits to be linked.
+	struct Staged
+	{
+		Chain * chain;
+		Version * version;
+		bool fresh;
+	};
+
+	// Allocates the version of one write stamped ts and, for a new key, its
+	// chain. `staged` must have room reserved for the entry. The caller
+	// holds commitLock.
+	void stageLocked(const Key & k, const Value & v, bool deleted, std::uint64_t ts, std::vector<Staged> & staged);
+
+	// Undoes stageLocked() after a failure, before anything was linked.
+	void discardLocked(std::vector<Staged> & staged);
+
+	// Links the staged versions into their chains. Cannot fail: all the
+	// allocation happened while staging. The caller then publishes ts.
+	void linkLocked(std::vector<Staged> & staged);
+
+	// Stages the writes that fn(ts, staged) adds, then links them and
+	// publishes them under a new timestamp, or leaves no trace if staging
+	// throws. Returns the timestamp. The caller holds commitLock.
+	template<typename Fn>
+	std::uint64_t commitLocked(size_t writes, Fn fn);
+
+	// Prunes the dirty chains. The caller holds commitLock.
+	size_t collectLocked();
+
+	std::uint64_t openSnapshot() const;
+	void closeSnapshot(std::uint64_t ts) const;
+
+public:
+	// A consistent view of the map as of one commit. Movable, not
+	// copyable; the versions it can see are kept until it is destroyed.
+	class Snapshot
+	{
+	private:
+		const MvccSkipList * owner;
+		std::uint64_t ts;
+
+		friend class MvccSkipList;
+		Snapshot(const MvccSkipList * o, std::uint64_t t) : owner(o), ts(t) {}
+
+	public:
+		Snapshot(Snapshot && other) noexcept : owner(other.owner), ts(other.ts)
+		{
+			other.owner = nullptr;
+		}
+
+		Snapshot(const Snapshot &) = delete;
+		Snapshot & operator=(const Snapshot &) = delete;
+		Snapshot & operator=(Snapshot &&) = delete;
+
+		~Snapshot()
+		{
+			if(owner != nullptr)
+			{
+				owner->closeSnapshot(ts);
+			}
+		}
+
+		// The commit timestamp this snapshot reads at.
+		std::uint64_t timestamp() const noexcept
+		{
+			return ts;
+		}
+
+		// Copies the value k had at this snapshot into out and returns true,
+		// or returns false if k did not exist then.
+		bool find(const Key & k, Value & out) const
+		{
+			auto guard = owner->chains.pin();
+			Chain * chain = nullptr;
+			if(!owner->index.find(k, chain))
+			{
+				return false;
+			}
+			const Version * version = visibleAt(chain, ts);
+			if(version == nullptr || version->deleted)
+			{
+				return false;
+			}
+			out = version->value;
+			return true;
+		}
+
+		bool contains(const Key & k) const
+		{
+			Value ignored;
+			return find(k, ignored);
+		}
+
+		// Calls fn(key, value) for every key that existed at this snapshot,
+		// in increasing order.
+		template<typename Fn>
+		void forEach(Fn fn) const
+		{
+			std::uint64_t at = ts;
+			auto guard = owner->chains.pin();
+			owner->index.forEach([&fn, at](const Key & k, Chain * chain)
+			{
+				const Version * version = visibleAt(chain, at);
+				if(version != nullptr && !version->deleted)
+				{
+					fn(k, version->value);
+				}
+			});
+		}
+
+		std::vector<Key> allKeysInOrder() const
+		{
+			std::vector<Key> keys;
+			forEach([&keys](const Key & k, const Value &) { keys.push_back(k); });
+			return keys;
+		}
+	};
+
+	MvccSkipList() = default;
+
+	~MvccSkipList();
+
+	MvccSkipList(const MvccSkipList &) = delete;
+	MvccSkipList & operator=(const MvccSkipList &) = delete;
+
+	// Sets k to v, inserting it if needed. Returns the commit timestamp.
+	std::uint64_t put(const Key & k, const Value & v);
+
+	// Erases k. Returns false, committing nothing, if k does not exist.
+	bool erase(const Key & k);
+
+	// Commits every write of the batch under one timestamp, which it
+	// returns: snapshots see all of the batch or none of it. Erasing a key
+	// that does not exist is skipped. An empty batch commits nothing and
+	// returns lastCommitted().
+	std::uint64_t apply(const WriteBatch<Key, Value> & batch);
+
+	// Copies the newest value of k into out and returns true, or returns
+	// false if k does not exist.
+	bool get(const Key & k, Value & out) const;
+
+	// A view of every commit up to now.
+	Snapshot snapshot() const;
+
+	// Timestamp of the latest commit; 0 before the first one.
+	std::uint64_t lastCommitted() const noexcept;
+
+	// Frees the versions behind the one the oldest open snapshot sees for
+	// each key, and removes the keys whose tombstone every snapshot sees.
+	// Returns how many versions were released. Commits also do this on
+	// their own once enough chains have grown.
+	size_t collectGarbage();
+
+	// Keys held by the list, erased ones included until collected.
+	size_t keyCount() const noexcept;
+
+	// Versions held by the map, for tests and memory accounting. Walks
+	// every chain; call it while no writer runs.
+	size_t versionCount() const;
+};
+
+template<typename Key, typename Value>
+MvccSkipList<Key, Value>::~MvccSkipList()
+{
+	index.forEach([](const Key &, Chain * chain)
+	{
+		Chain::destroy(chain);
+	});
+}
+
+template<typename Key, typename Value>
+void MvccSkipList<Key, Value>::stageLocked(const Key & k, const Value & v, bool deleted, std::uint64_t ts, std::vector<Staged> & staged)
+{
+	Chain * chain = nullptr;
+	if(index.find(k, chain))
+	{
+		staged.push_back(Staged{chain, new Version(ts, deleted, v, nullptr), false});
+		return;
+	}
+	std::unique_ptr<Chain, void (*)(Chain *)> fresh(new Chain(k), &Chain::destroy);
+	fresh->newest.store(new Version(ts, deleted, v, nullptr), std::memory_order_relaxed);
+	// Readers may find the chain from now on, but they skip versions
+	// stamped after the last commit. Writers hold commitLock, so no one
+	// else can insert k meanwhile.
+	index.insert(k, fresh.get());
+	staged.push_back(Staged{fresh.release(), nullptr, true});
+}
+
+template<typename Key, typename Value>
+void MvccSkipList<Key, Value>::discardLocked(std::vector<Staged> & staged)
+{
+	for(const Staged & entry : staged)
+	{
+		if(entry.fresh)
+		{
+			// A reader may have found the chain already; it goes the way
+			// collected chains do.
+			index.erase(entry.chain->key);
+			chains.retire(entry.chain);
+		}
+		else
+		{
+			delete entry.version;
+		}
+	}
+	staged.clear();
+}
+
+template<typename Key, typename Value>
+void MvccSkipList<Key, Value>::linkLocked(std::vector<Staged> & staged)
+{
+	for(const Staged & entry : staged)
+	{
+		if(entry.fresh)
+		{
+			continue;
+		}
+		Chain * chain = entry.chain;
+		entry.version->older.store(chain->newest.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		chain->newest.store(entry.version, std::memory_order_release);
+		if(!chain->dirty)
+		{
+			chain->dirty = true;
+			dirtyChains.push_back(chain);
+		}
+	}
+}
+
+template<typename Key, typename Value>
+template<typename Fn>
+std::uint64_t MvccSkipList<Key, Value>::commitLocked(size_t writes, Fn fn)
+{
+	std::uint64_t ts = clock + 1;
+	std::vector<Staged> staged;
+	try
+	{
+		staged.reserve(writes);
+		// linkLocked() may mark every staged chain dirty.
+		dirtyChains.reserve(dirtyChains.size() + writes);
+		fn(ts, staged);
+	}
+	catch(...)
+	{
+		discardLocked(staged);
+		throw;
+	}
+	linkLocked(staged);
+	clock = ts;
+	// Readers only see versions stamped at or before committed, so the
+	// whole commit becomes visible with this one store.
+	committed.store(ts, std::memory_order_release);
+	if(dirtyChains.size() >= gcTrigger)
+	{
+		collectLocked();
+	}
+	return ts;
+}
+
+template<typename Key, typename Value>
+size_t MvccSkipList<Key, Value>::collectLocked()
+{
+	std::uint64_t horizon = committed.load(std::memory_order_acquire);
+	{
+		std::lock_guard<std::mutex> guard(snapshotLock);
+		if(!openSnapshots.empty())
+		{
+			horizon = std::min(horizon, *openSnapshots.begin());
+		}
+	}
+
+	size_t freed = 0;
+	std::vector<Chain *> stillDirty;
+	for(Chain * chain : dirtyChains)
+	{
+		// Every reader stops at or before the newest version visible at the
+		// horizon, so the versions behind it are unreachable.
+		Version * keep = chain->newest.load(std::memory_order_relaxed);
+		while(keep != nullptr && keep->commitTs > horizon)
+		{
+			keep = keep->older.load(std::memory_order_relaxed);
+		}
+		if(keep != nullptr)
+		{
+			Version * garbage = keep->older.exchange(nullptr, std::memory_order_acq_rel);
+			for(Version * v = garbage; v != nullptr; v = v->older.load(std::memory_order_relaxed))
+			{
+				freed++;
+			}
+			freeVersions(garbage);
+		}
+		Version * newest = chain->newest.load(std::memory_order_relaxed);
+		if(newest->deleted && newest == keep)
+		{
+			// Every snapshot sees the key as erased, and writers are held
+			// off by commitLock, so the key can go. Readers that found the
+			// chain before it was unlinked may still be walking it.
+			index.erase(chain->key);
+			chains.retire(chain);
+			freed++;
+		}
+		else if(newest->older.load(std::memory_order_relaxed) != nullptr)
+		{
+			stillDirty.push_back(chain);
+		}
+		else
+		{
+			chain->dirty = false;
+		}
+	}
+	dirtyChains.swap(stillDirty);
+	chains.reclaim();
+	// Chains pinned by an old snapshot stay dirty; wait until the list has
+	// doubled before scanning them again.
+	gcTrigger = std::max<size_t>(1024, 2 * dirtyChains.size());
+	return freed;
+}
+
+template<typename Key, typename Value>
+std::uint64_t MvccSkipList<Key, Value>::put(const Key & k, const Value & v)
+{
+	std::lock_guard<std::mutex> guard(commitLock);
+	return commitLocked(1, [&](std::uint64_t ts, std::vector<Staged> & staged)
+	{
+		stageLocked(k, v, false, ts, staged);
+	});
+}
+
+template<typename Key, typename Value>
+bool MvccSkipList<Key, Value>::erase(const Key & k)
+{
+	std::lock_guard<std::mutex> guard(commitLock);
+	Chain * chain = nullptr;
+	if(!index.find(k, chain) || chain->newest.load(std::memory_order_relaxed)->deleted)
+	{
+		return false;
+	}
+	commitLocked(1, [&](std::uint64_t ts, std::vector<Staged> & staged)
+	{
+		stageLocked(k, Value(), true, ts, staged);
+	});
+	return true;
+}
+
+template<typename Key, typename Value>
+std::uint64_t MvccSkipList<Key, Value>::apply(const WriteBatch<Key, Value> & batch)
+{
+	// Sort before taking the lock, so writers wait only for the writes.
+	std::vector<typename WriteBatch<Key, Value>::Write> writes = batch.sortedLastWrites();
+	std::lock_guard<std::mutex> guard(commitLock);
+	if(writes.empty())
+	{
+		return committed.load(std::memory_order_relaxed);
+	}
+	// Every version is allocated before any is linked, so a write that
+	// throws leaves nothing of the batch behind for a later commit to
+	// publish.
+	return commitLocked(writes.size(), [&](std::uint64_t ts, std::vector<Staged> & staged)
+	{
+		for(const typename WriteBatch<Key, Value>::Write & write : writes)
+		{
+			if(write.kind == WriteBatch<Key, Value>::Kind::Put)
+			{
+				stageLocked(write.key, write.value, false, ts, staged);
+				continue;
+			}
+			Chain * chain = nullptr;
+			if(index.find(write.key, chain) && !chain->newest.load(std::memory_order_relaxed)->deleted)
+			{
+				stageLocked(write.key, Value(), true, ts, staged);
+			}
+		}
+	});
+}
+
+template<typename Key, typename Value>
+bool MvccSkipList<Key, Value>::get(const Key & k, Value & out) const
+{
+	// The version read could be superseded and collected mid-copy, so even
+	// a single read pins it with a snapshot.
+	Snapshot view = snapshot();
+	return view.find(k, out);
+}
+
+template<typename Key, typename Value>
+std::uint64_t MvccSkipList<Key, Value>::openSnapshot() const
+{
+	// Registering under snapshotLock orders this against collectLocked():
+	// either it sees this snapshot, or its horizon is at most this one.
+	std::lock_guard<std::mutex> guard(snapshotLock);
+	std::uint64_t ts = committed.load(std::memory_order_acquire);
+	openSnapshots.insert(ts);
+	return ts;
+}
+
+template<typename Key, typename Value>
+void MvccSkipList<Key, Value>::closeSnapshot(std::uint64_t ts) const
+{
+	std::lock_guard<std::mutex> guard(snapshotLock);
+	openSnapshots.erase(openSnapshots.find(ts));
+}
+
+template<typename Key, typename Value>
+typename MvccSkipList<Key, Value>::Snapshot MvccSkipList<Key, Value>::snapshot() const
+{
+	return Snapshot(this, openSnapshot());
+}
+
+template<typename Key, typename Value>
+std::uint64_t MvccSkipList<Key, Value>::lastCommitted() const noexcept
+{
+	return committed.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value>
+size_t MvccSkipList<Key, Value>::collectGarbage()
+{
+	std::lock_guard<std::mutex> guard(commitLock);
+	return collectLocked();
+}
+
+template<typename Key, typename Value>
+size_t MvccSkipList<Key, Value>::keyCount() const noexcept
+{
+	return index.size();
+}
+
+template<typename Key, typename Value>
+size_t MvccSkipList<Key, Value>::versionCount() const
+{
+	auto guard = chains.pin();
+	size_t count = 0;
+	index.forEach([&count](const Key &, Chain * chain)
+	{
+		for(Version * v = chain->newest.load(std::memory_order_acquire); v != nullptr;
+			v = v->older.load(std::memory_order_acquire))
+		{
+			count++;
+		}
+	});
+	return count;
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include "catch_amalgamated.hpp"
+#include "MvccSkipList.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace{
+
+	TEST_CASE("MvccPutGetTest", "[MvccTests]")
+	{
+		MvccSkipList<unsigned, std::string> mvcc;
+		std::string value;
+		REQUIRE(mvcc.lastCommitted() == 0);
+		REQUIRE_FALSE(mvcc.get(1, value));
+
+		REQUIRE(mvcc.put(1, "one") == 1);
+		REQUIRE(mvcc.put(2, "two") == 2);
+		REQUIRE(mvcc.put(1, "uno") == 3);
+		REQUIRE(mvcc.lastCommitted() == 3);
+		REQUIRE(mvcc.get(1, value));
+		REQUIRE(value == "uno");
+		REQUIRE(mvcc.get(2, value));
+		REQUIRE(value == "two");
+
+		REQUIRE(mvcc.erase(2));
+		REQUIRE_FALSE(mvcc.erase(2));
+		REQUIRE_FALSE(mvcc.erase(7));
+		REQUIRE(mvcc.lastCommitted() == 4);
+		REQUIRE_FALSE(mvcc.get(2, value));
+		REQUIRE(mvcc.put(2, "dos") == 5);
+		REQUIRE(mvcc.get(2, value));
+		REQUIRE(value == "dos");
+	}
+
+	TEST_CASE("MvccSnapshotTest", "[MvccTests]")
+	{
+		MvccSkipList<unsigned, unsigned> mvcc;
+		for(unsigned i = 0; i < 100; i++)
+		{
+			mvcc.put(i, i);
+		}
+		MvccSkipList<unsigned, unsigned>::Snapshot before = mvcc.snapshot();
+		REQUIRE(before.timestamp() == 100);
+
+		for(unsigned i = 0; i < 100; i += 2)
+		{
+			mvcc.put(i, i + 1000);
+		}
+		for(unsigned i = 1; i < 100; i += 2)
+		{
+			mvcc.erase(i);
+		}
+		for(unsigned i = 100; i < 150; i++)
+		{
+			mvcc.put(i, i);
+		}
+		MvccSkipList<unsigned, unsigned>::Snapshot after = mvcc.snapshot();
+
+		// The old snapshot still sees exactly the first hundred puts.
+		std::vector<unsigned> expected;
+		for(unsigned i = 0; i < 100; i++)
+		{
+			expected.push_back(i);
+		}
+		REQUIRE(before.allKeysInOrder() == expected);
+		unsigned value = 0;
+		for(unsigned i = 0; i < 100; i++)
+		{
+			REQUIRE(before.find(i, value));
+			REQUIRE(value == i);
+		}
+		REQUIRE_FALSE(before.contains(120));
+
+		expected.clear();
+		for(unsigned i = 0; i < 150; i++)
+		{
+			if(i >= 100 || i % 2 == 0)
+			{
+				expected.push_back(i);
+			}
+		}
+		REQUIRE(after.allKeysInOrder() == expected);
+		REQUIRE(after.find(4, value));
+		REQUIRE(value == 1004);
+		REQUIRE_FALSE(after.contains(5));
+
+		unsigned sum = 0;
+		after.forEach([&sum](const unsigned &, const unsigned & v) { sum += v; });
+		unsigned expectedSum = 0;
+		for(unsigned i : expected)
+		{
+			expectedSum += i < 100 ? i + 1000 : i;
+		}
+		REQUIRE(sum == expectedSum);
+	}
+
+	TEST_CASE("MvccGarbageCollectionTest", "[MvccTests]")
+	{
+		MvccSkipList<unsigned, unsigned> mvcc;
+		for(unsigned i = 0; i < 10; i++)
+		{
+			mvcc.put(i, 0);
+		}
+		REQUIRE(mvcc.versionCount() == 10);
+		{
+			MvccSkipList<unsigned, unsigned>::Snapshot pinned = mvcc.snapshot();
+			for(unsigned round = 1; round <= 3; round++)
+			{
+				for(unsigned i = 0; i < 10; i++)
+				{
+					mvcc.put(i, round);
+				}
+			}
+			REQUIRE(mvcc.versionCount() == 40);
+			// The snapshot still reads the first versions, and readers walk
+			// to them through the newer ones, so nothing can go yet.
+			REQUIRE(mvcc.collectGarbage() == 0);
+			REQUIRE(mvcc.versionCount() == 40);
+			unsigned value = 7;
+			REQUIRE(pinned.find(3, value));
+			REQUIRE(value == 0);
+			REQUIRE(mvcc.get(3, value));
+			REQUIRE(value == 3);
+
+			// Moving a snapshot keeps it registered once.
+			MvccSkipList<unsigned, unsigned>::Snapshot moved(std::move(pinned));
+			REQUIRE(mvcc.collectGarbage() == 0);
+			REQUIRE(moved.find(3, value));
+			REQUIRE(value == 0);
+		}
+		REQUIRE(mvcc.collectGarbage() == 30);
+		REQUIRE(mvcc.versionCount() == 10);
+		REQUIRE(mvcc.collectGarbage() == 0);
+
+		// Collection also runs by itself as writes pile up.
+		for(unsigned round = 0; round < 5; round++)
+		{
+			for(unsigned i = 0; i < 2000; i++)
+			{
+				mvcc.put(i, round);
+			}
+		}
+		REQUIRE(mvcc.versionCount() < 2 * 2000 + 1024);
+	}
+
+	TEST_CASE("MvccErasedKeysCollectedTest", "[MvccTests]")
+	{
+		MvccSkipList<unsigned, unsigned> mvcc;
+		for(unsigned i = 0; i < 100; i++)
+		{
+			mvcc.put(i, i);
+		}
+		unsigned value = 0;
+		{
+			MvccSkipList<unsigned, unsigned>::Snapshot before = mvcc.snapshot();
+			for(unsigned i = 0; i < 100; i += 2)
+			{
+				REQUIRE(mvcc.erase(i));
+			}
+			// The snapshot still sees the erased keys, so they stay.
+			REQUIRE(mvcc.collectGarbage() == 0);
+			REQUIRE(mvcc.keyCount() == 100);
+			REQUIRE(before.find(4, value));
+			REQUIRE(value == 4);
+		}
+		// Each erased key releases its old version and its tombstone.
+		REQUIRE(mvcc.collectGarbage() == 100);
+		REQUIRE(mvcc.keyCount() == 50);
+		REQUIRE(mvcc.versionCount() == 50);
+		REQUIRE_FALSE(mvcc.get(4, value));
+		REQUIRE(mvcc.snapshot().allKeysInOrder().size() == 50);
+
+		// An erased and collected key can come back.
+		mvcc.put(4, 44);
+		REQUIRE(mvcc.get(4, value));
+		REQUIRE(value == 44);
+		REQUIRE(mvcc.keyCount() == 51);
+
+		// Churn over ever new keys does not grow the list.
+		for(unsigned i = 1000; i < 50000; i++)
+		{
+			mvcc.put(i, i);
+			mvcc.erase(i);
+		}
+		REQUIRE(mvcc.keyCount() < 51 + 2048);
+		mvcc.collectGarbage();
+		REQUIRE(mvcc.keyCount() == 51);
+	}
+
+	TEST_CASE("MvccConcurrentEraseCollectTest", "[MvccTests]")
+	{
+		// Readers look up keys while the writer keeps inserting and erasing
+		// them, so chains are retired under the readers' feet.
+		MvccSkipList<unsigned, unsigned> mvcc;
+		const unsigned keys = 256;
+		std::atomic<bool> done{false};
+		std::atomic<unsigned> wrongValues{0};
+		std::vector<std::thread> readers;
+		for(unsigned t = 0; t < 3; t++)
+		{
+			readers.emplace_back([&]()
+			{
+				while(!done.load())
+				{
+					for(unsigned i = 0; i < keys; i++)
+					{
+						unsigned value = 0;
+						if(mvcc.get(i, value) && value % keys != i)
+						{
+							wrongValues++;
+						}
+					}
+				}
+			});
+		}
+		for(unsigned round = 0; round < 200; round++)
+		{
+			for(unsigned i = 0; i < keys; i++)
+			{
+				mvcc.put(i, round * keys + i);
+			}
+			for(unsigned i = 0; i < keys; i++)
+			{
+				mvcc.erase(i);
+			}
+			mvcc.collectGarbage();
+		}
+		done = true;
+		for(std::thread & reader : readers)
+		{
+			reader.join();
+		}
+		REQUIRE(wrongValues.load() == 0);
+		mvcc.collectGarbage();
+		REQUIRE(mvcc.keyCount() == 0);
+		REQUIRE(mvcc.versionCount() == 0);
+	}
+
+	TEST_CASE("MvccConcurrentSnapshotTest", "[MvccTests]")
+	{
+		// The writer sweeps the keys in increasing order, setting each to the
+		// sweep number. Any committed state is therefore a prefix of keys at
+		// round r + 1 followed by the rest at round r; a scan that mixed
+		// commits could see a later key ahead of an earlier one.
+		MvccSkipList<unsigned, unsigned> mvcc;
+		const unsigned keys = 64;
+		const unsigned rounds = 200;
+		for(unsigned i = 0; i < keys; i++)
+		{
+			mvcc.put(i, 0);
+		}
+
+		std::atomic<bool> done{false};
+		std::atomic<unsigned> inconsistent{0};
+		std::atomic<unsigned> scans{0};
+		std::vector<std::thread> readers;
+		for(unsigned t = 0; t < 3; t++)
+		{
+			readers.emplace_back([&]()
+			{
+				while(!done.load())
+				{
+					MvccSkipList<unsigned, unsigned>::Snapshot view = mvcc.snapshot();
+					std::vector<unsigned> values;
+					view.forEach([&values](const unsigned &, const unsigned & v) { values.push_back(v); });
+					bool ok = values.size() == keys;
+					for(size_t i = 1; ok && i < values.size(); i++)
+					{
+						ok = values[i] <= values[i - 1] && values[0] - values[i] <= 1;
+					}
+					if(!ok)
+					{
+						inconsistent++;
+					}
+					scans++;
+				}
+			});
+		}
+
+		for(unsigned round = 1; round <= rounds; round++)
+		{
+			for(unsigned i = 0; i < keys; i++)
+			{
+				mvcc.put(i, round);
+			}
+			unsigned value = 0;
+			REQUIRE(mvcc.get(keys - 1, value));
+			REQUIRE(value == round);
+		}
+		while(scans.load() == 0)
+		{
+			std::this_thread::yield();
+		}
+		done = true;
+		for(std::thread & reader : readers)
+		{
+			reader.join();
+		}
+		REQUIRE(inconsistent.load() == 0);
+		mvcc.collectGarbage();
+		REQUIRE(mvcc.versionCount() == keys);
+	}
+
+}
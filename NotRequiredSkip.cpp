@@ -1,5 +1,7 @@
 #include "catch_amalgamated.hpp"
 #include "SkipList.hpp"
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 namespace{
@@ -102,6 +104,313 @@ namespace{
 		// (because the fast lane is not included in the height calculation).
 		REQUIRE(sl.numLayers() == 16);
 	}
+	TEST_CASE("PromotionAfterTallKeyTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 16; i++)
+		{
+			sl.insert(i, i);
+		}
+
+		// 255 reaches the height cap and fills every layer.
+		unsigned const MAGIC_VAL = 255;
+		sl.insert(MAGIC_VAL, MAGIC_VAL);
+		REQUIRE(sl.height(MAGIC_VAL) == 15);
+
+		// Keys inserted afterwards must still be promoted as usual.
+		std::vector<unsigned> heights;
+		for (unsigned i = 16; i < 24; i++)
+		{
+			sl.insert(i, i);
+			heights.push_back(sl.height(i));
+		}
+		std::vector<unsigned> expectedHeights = {1, 2, 1, 3, 1, 2, 1, 4};
+		REQUIRE(heights == expectedHeights);
+	}
+	TEST_CASE("StructureReportTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 10; i++)
+		{
+			sl.insert(i, i);
+		}
+		SkipListStructureReport report = sl.structureReport();
+		REQUIRE(report.keys == 10);
+		REQUIRE(report.layers == 5);
+
+		std::vector<size_t> expectedNodes = {10, 5, 2, 1, 0};
+		REQUIRE(report.nodesPerLevel == expectedNodes);
+
+		std::vector<size_t> expectedHistogram = {0, 5, 3, 1, 1, 0};
+		REQUIRE(report.heightHistogram == expectedHistogram);
+		REQUIRE(report.bytesPerLevel.size() == 5);
+		REQUIRE(report.sampledKeys == 10);
+		REQUIRE(report.maxPathLength >= 1);
+		REQUIRE(report.skewScore < 0.25);
+
+		SkipListStructureReport sampled = sl.structureReport(3);
+		REQUIRE(sampled.sampledKeys == 3);
+	}
+
+	TEST_CASE("StructureReportDegenerateTest", "[SampleTests]")
+	{
+		// The bytes of every key XOR to zero, so nothing is ever promoted.
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 1; i <= 50; i++)
+		{
+			sl.insert((i << 24) | (i << 16), i);
+		}
+		SkipListStructureReport report = sl.structureReport();
+		REQUIRE(report.heightHistogram[1] == 50);
+		REQUIRE(report.skewScore == Catch::Approx(0.5));
+		REQUIRE(report.maxPathLength == 51);
+		REQUIRE(report.averagePathLength > report.expectedPathLength);
+	}
+	TEST_CASE("RebalanceDegenerateTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		std::vector<unsigned> keys;
+		for (unsigned i = 1; i <= 100; i++)
+		{
+			keys.push_back((i << 24) | (i << 16));
+			sl.insert(keys.back(), i);
+		}
+		unsigned & value = sl.find(keys[41]);
+
+		sl.rebalance();
+
+		SkipListStructureReport report = sl.structureReport();
+		REQUIRE(report.layers == 8);
+		std::vector<size_t> expectedNodes = {100, 50, 25, 12, 6, 3, 1, 0};
+		REQUIRE(report.nodesPerLevel == expectedNodes);
+		REQUIRE(report.skewScore < 0.05);
+		REQUIRE(report.maxPathLength <= 20);
+
+		// S_0 is untouched, so references from find() are still valid.
+		value = 1000;
+		REQUIRE(sl.find(keys[41]) == 1000);
+		REQUIRE(sl.allKeysInOrder() == keys);
+		REQUIRE(sl.height(keys[1]) == 2);
+		REQUIRE(sl.height(keys[63]) == 7);
+		REQUIRE(sl.nextKey(keys[10]) == keys[11]);
+		REQUIRE(sl.previousKey(keys[10]) == keys[9]);
+
+		// Inserting after a rebalance keeps working.
+		REQUIRE(sl.insert(3, 3));
+		REQUIRE(sl.isSmallestKey(3));
+		REQUIRE(sl.size() == 101);
+	}
+
+	TEST_CASE("AutoRebalanceTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		sl.setAutoRebalance(0.25);
+		for (unsigned i = 1; i <= 256; i++)
+		{
+			sl.insert((i << 24) | (i << 16), i);
+		}
+		SkipListStructureReport report = sl.structureReport();
+		REQUIRE(report.skewScore < 0.05);
+		REQUIRE(report.maxPathLength <= 24);
+		for (unsigned i = 1; i <= 256; i++)
+		{
+			REQUIRE(sl.find((i << 24) | (i << 16)) == i);
+		}
+	}
+
+	TEST_CASE("MemoryUsageTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for(unsigned i=0; i < 10; i++)
+		{
+			sl.insert(i, i);
+		}
+		// Heights 1, 2, 1, 3, 1, 2, 1, 4, 1, 2 over five layers.
+		SkipListMemoryUsage usage = sl.memoryUsage();
+		REQUIRE(usage.nodeBytesPerLevel.size() == 5);
+		size_t node = usage.nodeBytesPerLevel[0] / 10;
+		REQUIRE(node >= 2 * sizeof(unsigned) + 3 * sizeof(void *));
+		std::vector<size_t> expected = {10 * node, 5 * node, 2 * node, 1 * node, 0};
+		REQUIRE(usage.nodeBytesPerLevel == expected);
+		REQUIRE(usage.sentinelBytes == 10 * node);
+		REQUIRE(usage.keyHeapBytes == 0);
+		REQUIRE(usage.valueHeapBytes == 0);
+		REQUIRE(usage.allocatorSlackBytes == 28 * (allocationSize(node) - node));
+		REQUIRE(usage.totalBytes() == 28 * allocationSize(node));
+	}
+
+	TEST_CASE("MemoryUsageStringTest", "[SampleTests]")
+	{
+		SkipList<std::string, std::string> sl;
+		std::string longKey(40, 'k');
+		sl.insert("a", "short");
+		sl.insert(longKey, std::string(100, 'v'));
+		REQUIRE(heapBytes(std::string("a")) == 0);
+		REQUIRE(heapBytes(longKey) >= 41);
+
+		SkipListMemoryUsage usage = sl.memoryUsage();
+		unsigned height = sl.height(longKey);
+		REQUIRE(usage.keyHeapBytes == height * heapBytes(longKey));
+		REQUIRE(usage.valueHeapBytes >= height * 101);
+		REQUIRE(usage.totalBytes() > usage.nodeBytes() + usage.sentinelBytes + usage.keyHeapBytes);
+	}
+
+	TEST_CASE("IteratorTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		REQUIRE(sl.begin() == sl.end());
+		REQUIRE_THROWS_AS(sl.smallestKey(), RuntimeException);
+		REQUIRE_THROWS_AS(sl.largestKey(), RuntimeException);
+		for(unsigned i = 0; i < 50; i++)
+		{
+			sl.insert((i * 37) % 50, i);
+		}
+		std::vector<unsigned> keys(sl.begin(), sl.end());
+		REQUIRE(keys == sl.allKeysInOrder());
+		for(auto it = sl.begin(); it != sl.end(); ++it)
+		{
+			REQUIRE(it.value() == sl.find(*it));
+		}
+		REQUIRE(sl.smallestKey() == 0);
+		REQUIRE(sl.largestKey() == 49);
+
+		// Inserts and rebalance() leave existing iterators valid.
+		auto it = sl.begin();
+		++it;
+		sl.insert(100, 100);
+		sl.rebalance();
+		REQUIRE(*it == 1);
+		REQUIRE(sl.largestKey() == 100);
+	}
+
+	TEST_CASE("InsertSortedTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> batched;
+		SkipList<unsigned, unsigned> single;
+		for(unsigned i = 0; i < 300; i += 3)
+		{
+			batched.insert(i, i);
+			single.insert(i, i);
+		}
+		// Sorted, interleaved with existing keys, with an in-batch duplicate.
+		std::vector<std::pair<unsigned, unsigned>> batch;
+		for(unsigned i = 1; i < 400; i += 2)
+		{
+			batch.emplace_back(i, i + 1000);
+		}
+		batch.insert(batch.begin() + 10, std::make_pair(21u, 5u));
+		size_t expectedNew = 0;
+		for(const auto & item : batch)
+		{
+			expectedNew += single.insert(item.first, item.second) ? 1 : 0;
+		}
+		REQUIRE(batched.insertSorted(batch) == expectedNew);
+		REQUIRE(batched.allKeysInOrder() == single.allKeysInOrder());
+		REQUIRE(batched.numLayers() == single.numLayers());
+		for(unsigned k : single.allKeysInOrder())
+		{
+			REQUIRE(batched.height(k) == single.height(k));
+			REQUIRE(batched.find(k) == single.find(k));
+		}
+
+		// Unsorted batches are still inserted correctly.
+		std::vector<std::pair<unsigned, unsigned>> shuffled = {{1000, 1}, {500, 2}, {700, 3}, {2, 4}, {999, 5}};
+		REQUIRE(batched.insertSorted(shuffled) == 5);
+		REQUIRE(batched.find(500) == 2);
+		std::vector<unsigned> keys = batched.allKeysInOrder();
+		REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+		REQUIRE(keys.size() == single.size() + 5);
+	}
+
+	TEST_CASE("EraseTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		std::vector<unsigned> expected;
+		for(unsigned i = 0; i < 500; i++)
+		{
+			sl.insert(i * 7919 % 1000, i);
+		}
+		REQUIRE_FALSE(sl.erase(1001));
+		for(unsigned k : sl.allKeysInOrder())
+		{
+			if(k % 3 == 0)
+			{
+				REQUIRE(sl.erase(k));
+			}
+			else
+			{
+				expected.push_back(k);
+			}
+		}
+		REQUIRE_FALSE(sl.erase(0));
+		REQUIRE(sl.size() == expected.size());
+		REQUIRE(sl.allKeysInOrder() == expected);
+		REQUIRE_THROWS_AS(sl.find(3), RuntimeException);
+		for(unsigned k : expected)
+		{
+			REQUIRE(sl.rank(k) == static_cast<size_t>(std::lower_bound(expected.begin(), expected.end(), k) - expected.begin()));
+		}
+
+		// Erasing everything leaves the two layers of an empty list.
+		for(unsigned k : expected)
+		{
+			REQUIRE(sl.erase(k));
+		}
+		REQUIRE(sl.isEmpty());
+		REQUIRE(sl.numLayers() == 2);
+		REQUIRE(sl.begin() == sl.end());
+		REQUIRE(sl.insert(5, 5));
+		REQUIRE(sl.allKeysInOrder() == std::vector<unsigned>{5});
+	}
+
+	TEST_CASE("RankTest", "[SampleTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for(unsigned i = 0; i < 1000; i++)
+		{
+			sl.insert(i * 7919 % 2000, i);
+		}
+		std::vector<std::pair<unsigned, unsigned>> batch;
+		for(unsigned i = 2000; i < 2600; i += 2)
+		{
+			batch.emplace_back(i, i);
+		}
+		sl.insertSorted(batch);
+		std::vector<unsigned> keys = sl.allKeysInOrder();
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(sl.rank(keys[i]) == i);
+		}
+		REQUIRE_THROWS_AS(sl.rank(1), RuntimeException);
+
+		// rebalance() rebuilds the upper layers and their widths.
+		sl.rebalance();
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(sl.rank(keys[i]) == i);
+		}
+
+		REQUIRE(sl.lowerBound(0) == sl.begin());
+		REQUIRE(*sl.lowerBound(1) == keys[1]);
+		REQUIRE(*sl.lowerBound(keys[10]) == keys[10]);
+		REQUIRE(sl.lowerBound(keys.back() + 1) == sl.end());
+
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(*sl.atRank(i) == keys[i]);
+		}
+		REQUIRE(sl.atRank(keys.size()) == sl.end());
+		for(size_t i = 0; i < keys.size(); i += 3)
+		{
+			sl.erase(keys[i]);
+		}
+		keys = sl.allKeysInOrder();
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(*sl.atRank(i) == keys[i]);
+		}
+	}
+
 
 
 
@@ -0,0 +1,120 @@
+#ifndef ___PARALLEL_SCAN_HPP
+#define ___PARALLEL_SCAN_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "SkipList.hpp"
+#include "ThreadPool.hpp"
+
+// Whole-list scans spread over a ThreadPool, map/reduce style.
+//
+// SkipList::partition() cuts S_0 into one segment per pool thread at nodes
+// of an upper layer, so finding the segments costs a walk of a short layer
+// rather than of S_0. Each thread folds its segment into a partial result;
+// the partials are then combined in key order, so results that depend on
+// order (filter, collect) come out sorted.
+//
+// The list must not be modified while a scan runs.
+
+/**
+ * @brief Folds every key/value pair into one result, in parallel.
+ *
+ * @param identity the starting value of every segment's partial result
+ * @param fold called as fold(partial, key, value) for each pair of a segment
+ * @param combine called as combine(left, right) to merge the partial result
+ * of a segment into that of the segments before it
+ * @return the combined result, identity for an empty list
+ */
+template<typename Key, typename Value, typename Result, typename Fold, typename Combine>
+Result parallelReduce(const SkipList<Key, Value> & list, ThreadPool & pool, const Result & identity,
+	Fold fold, Combine combine)
+{
+	std::vector<typename SkipList<Key, Value>::const_iterator> boundaries = list.partition(pool.size());
+	size_t segments = boundaries.size() - 1;
+	std::vector<Result> partials(segments, identity);
+	pool.parallelFor(0, segments, [&](size_t, size_t begin, size_t end)
+	{
+		for(size_t segment = begin; segment < end; segment++)
+		{
+			Result & partial = partials[segment];
+			for(auto it = boundaries[segment]; it != boundaries[segment + 1]; ++it)
+			{
+				fold(partial, *it, it.value());
+			}
+		}
+	});
+	Result result = identity;
+	for(Result & partial : partials)
+	{
+		combine(result, partial);
+	}
+	return result;
+}
+
+/**
+ * @brief Counts the pairs for which pred(key, value) is true.
+ */
+template<typename Key, typename Value, typename Pred>
+size_t parallelCount(const SkipList<Key, Value> & list, ThreadPool & pool, Pred pred)
+{
+	return parallelReduce(list, pool, static_cast<size_t>(0),
+		[&pred](size_t & count, const Key & k, const Value & v) { count += pred(k, v) ? 1 : 0; },
+		[](size_t & total, const size_t & count) { total += count; });
+}
+
+/**
+ * @brief Sums fn(key, value) over every pair.
+ *
+ * @return the sum, as the type fn returns; zero (a value-initialized
+ * result) for an empty list
+ */
+template<typename Key, typename Value, typename Fn>
+auto parallelSum(const SkipList<Key, Value> & list, ThreadPool & pool, Fn fn)
+	-> decltype(fn(std::declval<const Key &>(), std::declval<const Value &>()))
+{
+	using Sum = decltype(fn(std::declval<const Key &>(), std::declval<const Value &>()));
+	return parallelReduce(list, pool, Sum(),
+		[&fn](Sum & sum, const Key & k, const Value & v) { sum += fn(k, v); },
+		[](Sum & total, const Sum & sum) { total += sum; });
+}
+
+/**
+ * @brief The keys, in increasing order, of the pairs for which
+ * pred(key, value) is true.
+ */
+template<typename Key, typename Value, typename Pred>
+std::vector<Key> parallelFilter(const SkipList<Key, Value> & list, ThreadPool & pool, Pred pred)
+{
+	return parallelReduce(list, pool, std::vector<Key>(),
+		[&pred](std::vector<Key> & keys, const Key & k, const Value & v)
+		{
+			if(pred(k, v))
+			{
+				keys.push_back(k);
+			}
+		},
+		[](std::vector<Key> & keys, std::vector<Key> & more)
+		{
+			keys.insert(keys.end(), std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+		});
+}
+
+/**
+ * @brief Every key/value pair in increasing key order: a parallel
+ * allKeysInOrder() that also returns the values.
+ */
+template<typename Key, typename Value>
+std::vector<std::pair<Key, Value>> parallelCollect(const SkipList<Key, Value> & list, ThreadPool & pool)
+{
+	using Pairs = std::vector<std::pair<Key, Value>>;
+	return parallelReduce(list, pool, Pairs(),
+		[](Pairs & pairs, const Key & k, const Value & v) { pairs.emplace_back(k, v); },
+		[](Pairs & pairs, Pairs & more)
+		{
+			pairs.insert(pairs.end(), std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+		});
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "catch_amalgamated.hpp"
+#include "ParallelScan.hpp"
+#include "SkipList.hpp"
+#include "ThreadPool.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace{
+
+	TEST_CASE("PartitionTest", "[ParallelScanTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for(unsigned i = 0; i < 4096; i++)
+		{
+			sl.insert(i * 2654435761u, i);
+		}
+		for(size_t parts : {1, 2, 4, 7, 16})
+		{
+			auto boundaries = sl.partition(parts);
+			REQUIRE(boundaries.front() == sl.begin());
+			REQUIRE(boundaries.back() == sl.end());
+			REQUIRE(boundaries.size() <= parts + 1);
+
+			// The segments cover every key once, and none is far above its share.
+			size_t total = 0;
+			for(size_t i = 0; i + 1 < boundaries.size(); i++)
+			{
+				size_t length = std::distance(boundaries[i], boundaries[i + 1]);
+				REQUIRE(length > 0);
+				REQUIRE(length < 3 * 4096 / parts);
+				total += length;
+			}
+			REQUIRE(total == 4096);
+		}
+
+		SkipList<unsigned, unsigned> empty;
+		REQUIRE(empty.partition(4).size() == 1);
+
+		SkipList<unsigned, unsigned> small;
+		small.insert(1, 1);
+		small.insert(2, 2);
+		auto boundaries = small.partition(8);
+		REQUIRE(boundaries.size() == 3);
+		REQUIRE(*boundaries[1] == 2);
+	}
+
+	TEST_CASE("ParallelAggregatesTest", "[ParallelScanTests]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for(unsigned i = 0; i < 10000; i++)
+		{
+			sl.insert((i * 7919) % 10007, i);
+		}
+		ThreadPool pool(4);
+
+		size_t evens = 0;
+		unsigned long long sum = 0;
+		std::vector<unsigned> evenKeys;
+		std::vector<std::pair<unsigned, unsigned>> pairs;
+		for(auto it = sl.begin(); it != sl.end(); ++it)
+		{
+			if(*it % 2 == 0)
+			{
+				evens++;
+				evenKeys.push_back(*it);
+			}
+			sum += it.value();
+			pairs.emplace_back(*it, it.value());
+		}
+
+		REQUIRE(parallelCount(sl, pool, [](unsigned k, unsigned) { return k % 2 == 0; }) == evens);
+		REQUIRE(parallelSum(sl, pool, [](unsigned, unsigned v) { return static_cast<unsigned long long>(v); }) == sum);
+		REQUIRE(parallelFilter(sl, pool, [](unsigned k, unsigned) { return k % 2 == 0; }) == evenKeys);
+		REQUIRE(parallelCollect(sl, pool) == pairs);
+	}
+
+	TEST_CASE("ParallelScanStringTest", "[ParallelScanTests]")
+	{
+		SkipList<std::string, unsigned> sl;
+		ThreadPool pool(3);
+		REQUIRE(parallelCount(sl, pool, [](const std::string &, unsigned) { return true; }) == 0);
+		REQUIRE(parallelCollect(sl, pool).empty());
+
+		for(unsigned i = 0; i < 300; i++)
+		{
+			sl.insert("item" + std::to_string(i), i);
+		}
+		std::vector<std::string> filtered = parallelFilter(sl, pool,
+			[](const std::string & k, unsigned) { return k.size() == 5; });
+		std::vector<std::string> expected;
+		for(unsigned i = 0; i < 10; i++)
+		{
+			expected.push_back("item" + std::to_string(i));
+		}
+		REQUIRE(filtered == expected);
+		// "item0".."item9", "item10".."item99" and "item100".."item299".
+		REQUIRE(parallelSum(sl, pool, [](const std::string & k, unsigned) { return k.size(); }) == 10 * 5 + 90 * 6 + 200 * 7);
+	}
+
+}
@@ -0,0 +1,146 @@
+#ifndef ___PERF_COUNTERS_HPP
+#define ___PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware performance counters for the calling thread, read through the
+// Linux perf_event_open interface.
+//
+// Counters the kernel refuses to open (no PMU inside a VM, a strict
+// perf_event_paranoid setting, or not running on Linux at all) are simply
+// left out. If none of them open, available() is false and read() returns
+// nothing, so callers can use the class unconditionally.
+//
+//   PerfCounters counters;
+//   counters.start();
+//   ... code under test ...
+//   counters.stop();
+//   for(auto & c : counters.read()) { ... c.first is the name, c.second the count ... }
+class PerfCounters
+{
+private:
+	struct Counter
+	{
+		std::string name;
+		int fd;
+	};
+	std::vector<Counter> counters;
+
+#ifdef __linux__
+	void open(const std::string & name, std::uint32_t type, std::uint64_t config)
+	{
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+		if(fd >= 0)
+		{
+			counters.push_back(Counter{name, fd});
+		}
+	}
+
+	static std::uint64_t cacheEvent(std::uint64_t cache, std::uint64_t op, std::uint64_t result)
+	{
+		return cache | (op << 8) | (result << 16);
+	}
+#endif
+
+public:
+	PerfCounters()
+	{
+#ifdef __linux__
+		open("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		open("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		open("branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+		open("cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		open("l1d_read_misses", PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1D,
+			PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+		open("dtlb_read_misses", PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB,
+			PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+#endif
+	}
+
+	~PerfCounters()
+	{
+#ifdef __linux__
+		for(const Counter & c : counters)
+		{
+			close(c.fd);
+		}
+#endif
+	}
+
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters & operator=(const PerfCounters &) = delete;
+
+	// Did at least one counter open?
+	bool available() const noexcept
+	{
+		return !counters.empty();
+	}
+
+	// Zero every counter and start counting.
+	void start()
+	{
+#ifdef __linux__
+		for(const Counter & c : counters)
+		{
+			ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	void stop()
+	{
+#ifdef __linux__
+		for(const Counter & c : counters)
+		{
+			ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+#endif
+	}
+
+	// Counts since the last start(). When the kernel had to multiplex the
+	// counters, each value is scaled up to the full measured interval.
+	std::vector<std::pair<std::string, std::uint64_t>> read() const
+	{
+		std::vector<std::pair<std::string, std::uint64_t>> values;
+#ifdef __linux__
+		for(const Counter & c : counters)
+		{
+			std::uint64_t data[3] = {0, 0, 0};
+			if(::read(c.fd, data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)))
+			{
+				continue;
+			}
+			std::uint64_t value = data[0];
+			if(data[2] != 0 && data[2] < data[1])
+			{
+				value = static_cast<std::uint64_t>(static_cast<double>(value) * data[1] / data[2]);
+			}
+			values.emplace_back(c.name, value);
+		}
+#endif
+		return values;
+	}
+};
+
+#endif
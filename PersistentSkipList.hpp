@@ -0,0 +1,414 @@
+#ifndef ___PERSISTENT_SKIP_LIST_HPP
+#define ___PERSISTENT_SKIP_LIST_HPP
+
+#include <cstddef>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief An immutable skip list: insert() and erase() return a new version
+ * and leave the old one untouched.
+ *
+ * Versions share every node a change does not touch, so keeping many of
+ * them is cheap, and each one is a consistent view that can be handed to
+ * another thread without locks. Nodes are reference counted and freed
+ * once no version reaches them.
+ *
+ * Path copying needs every node to be reachable through exactly one
+ * pointer, so the links are arranged as a tree: a node on layer L keeps
+ * `next` only up to the end of the range of its parent on layer L + 1,
+ * and the node after that range is reached through the parent's `next`
+ * and then `down`. Searches walk exactly as in SkipList. An update copies
+ * the nodes on its search path, a few per layer in expectation, so a new
+ * version costs O(log n) nodes; everything right of the path is shared.
+ *
+ *   PersistentSkipList<unsigned, unsigned> v0;
+ *   PersistentSkipList<unsigned, unsigned> v1 = v0.insert(1, 10);
+ *   // v0 is still empty
+ */
+template<typename Key, typename Value>
+class PersistentSkipList
+{
+public:
+	// Layers available to towers, S_0 included.
+	static const unsigned maxLevel = 32;
+
+private:
+	struct Node;
+	using Link = std::shared_ptr<const Node>;
+
+	struct Node
+	{
+		Key key;
+		Value value;
+		// Next node of this layer inside the parent's range, or null.
+		Link next;
+		// The node of the same tower one layer down, null on S_0.
+		Link down;
+
+		Node(const Key & k, const Value & v, Link n, Link d)
+			: key(k), value(v), next(std::move(n)), down(std::move(d))
+		{
+		}
+
+		// A long run of nodes freed by the last version reaching them
+		// would otherwise be released recursively, one stack frame per node.
+		~Node()
+		{
+			std::vector<Link> pending;
+			release(pending, next);
+			release(pending, down);
+			while(!pending.empty())
+			{
+				Link node = std::move(pending.back());
+				pending.pop_back();
+				Node & owned = const_cast<Node &>(*node);
+				release(pending, owned.next);
+				release(pending, owned.down);
+			}
+		}
+
+		// Moves link onto pending if this was its last owner, so its
+		// destructor finds nothing left to free.
+		static void release(std::vector<Link> & pending, const Link & link)
+		{
+			Link & owned = const_cast<Link &>(link);
+			if(owned && owned.use_count() == 1)
+			{
+				pending.push_back(std::move(owned));
+			}
+		}
+	};
+
+	// Head of the top layer, which like SkipList's is kept empty.
+	Link root;
+	// Layers below root plus one: root is on layer `layers - 1`.
+	unsigned layers;
+	size_t listSize;
+
+	PersistentSkipList(Link r, unsigned l, size_t s) : root(std::move(r)), layers(l), listSize(s)
+	{
+	}
+
+	static Link copyWith(const Node * node, Link next, Link down)
+	{
+		return std::make_shared<Node>(node->key, node->value, std::move(next), std::move(down));
+	}
+
+	// For every layer from the top, the nodes from the start of the chain
+	// the search enters down to the last node before k. Returns the layer
+	// on which k was found, or -1.
+	int searchPath(const Key & k, std::vector<std::vector<const Node *>> & path) const;
+
+	// Rebuilds the path bottom-up. Layer L gets the copy of its last path
+	// node with `next` from nextOnLayer(L, old node) and the copy of the
+	// layer below as `down`; the nodes before it on the path are copied
+	// to point at it.
+	template<typename NextOnLayer>
+	static Link rebuild(const std::vector<std::vector<const Node *>> & path, NextOnLayer nextOnLayer);
+
+	template<typename Fn>
+	void walkInOrder(Fn fn) const;
+
+public:
+	PersistentSkipList();
+
+	// This version plus k -> v. If k is already present the result shares
+	// everything with this version.
+	PersistentSkipList insert(const Key & k, const Value & v) const;
+
+	// This version without k. If k is absent the result shares everything
+	// with this version.
+	PersistentSkipList erase(const Key & k) const;
+
+	bool contains(const Key & k) const;
+
+	// Copies the value of k into out and returns true, or returns false.
+	bool find(const Key & k, Value & out) const;
+
+	// The value of k; throws a RuntimeException if k is absent.
+	const Value & find(const Key & k) const;
+
+	size_t size() const noexcept
+	{
+		return listSize;
+	}
+
+	bool isEmpty() const noexcept
+	{
+		return listSize == 0;
+	}
+
+	// Layers in use, the empty top layer included.
+	unsigned numLayers() const noexcept
+	{
+		return layers;
+	}
+
+	// Calls fn(key, value) for every key in increasing order.
+	template<typename Fn>
+	void forEach(Fn fn) const;
+
+	std::vector<Key> allKeysInOrder() const;
+
+	// Nodes of this version that `older` does not share: the memory this
+	// version costs while both are kept.
+	size_t nodesNotIn(const PersistentSkipList & older) const;
+};
+
+template<typename Key, typename Value>
+PersistentSkipList<Key, Value>::PersistentSkipList()
+	: root(std::make_shared<Node>(Key(), Value(), nullptr, nullptr)), layers(1), listSize(0)
+{
+}
+
+template<typename Key, typename Value>
+int PersistentSkipList<Key, Value>::searchPath(const Key & k, std::vector<std::vector<const Node *>> & path) const
+{
+	path.assign(layers, std::vector<const Node *>());
+	int found = -1;
+	const Node * node = root.get();
+	for(int layer = layers - 1; layer >= 0; layer--)
+	{
+		std::vector<const Node *> & chain = path[layer];
+		chain.push_back(node);
+		while(node->next && node->next->key < k)
+		{
+			node = node->next.get();
+			chain.push_back(node);
+		}
+		if(found < 0 && node->next && !(k < node->next->key))
+		{
+			found = layer;
+		}
+		node = node->down.get();
+	}
+	return found;
+}
+
+template<typename Key, typename Value>
+template<typename NextOnLayer>
+typename PersistentSkipList<Key, Value>::Link PersistentSkipList<Key, Value>::rebuild(
+	const std::vector<std::vector<const Node *>> & path, NextOnLayer nextOnLayer)
+{
+	Link below;
+	for(unsigned layer = 0; layer < path.size(); layer++)
+	{
+		const std::vector<const Node *> & chain = path[layer];
+		const Node * last = chain.back();
+		Link copy = copyWith(last, nextOnLayer(layer, last), std::move(below));
+		for(size_t i = chain.size() - 1; i-- > 0;)
+		{
+			copy = copyWith(chain[i], std::move(copy), chain[i]->down);
+		}
+		below = std::move(copy);
+	}
+	return below;
+}
+
+template<typename Key, typename Value>
+PersistentSkipList<Key, Value> PersistentSkipList<Key, Value>::insert(const Key & k, const Value & v) const
+{
+	unsigned height = towerHeight(k, maxLevel);
+	// Keep the top layer empty: root must sit above the new tower.
+	Link top = root;
+	unsigned topLayers = layers;
+	while(topLayers <= height)
+	{
+		top = std::make_shared<Node>(Key(), Value(), nullptr, std::move(top));
+		topLayers++;
+	}
+	PersistentSkipList grown(top, topLayers, listSize);
+
+	std::vector<std::vector<const Node *>> path;
+	if(grown.searchPath(k, path) >= 0)
+	{
+		return *this;
+	}
+
+	// Below its top the new tower takes over whatever followed the path on
+	// each layer; on its top layer it is linked in after the path.
+	Link tower;
+	for(unsigned layer = 0; layer < height; layer++)
+	{
+		const Node * last = path[layer].back();
+		tower = std::make_shared<Node>(k, v, last->next, std::move(tower));
+	}
+	Link towerTop = tower;
+	Link newRoot = rebuild(path, [height, &towerTop](unsigned layer, const Node * last) -> Link
+	{
+		if(layer + 1 < height)
+		{
+			return nullptr;
+		}
+		if(layer + 1 == height)
+		{
+			return towerTop;
+		}
+		return last->next;
+	});
+	return PersistentSkipList(std::move(newRoot), topLayers, listSize + 1);
+}
+
+template<typename Key, typename Value>
+PersistentSkipList<Key, Value> PersistentSkipList<Key, Value>::erase(const Key & k) const
+{
+	std::vector<std::vector<const Node *>> path;
+	int top = searchPath(k, path);
+	if(top < 0)
+	{
+		return *this;
+	}
+	// On the top layer of the tower its node follows the path; below, its
+	// node heads the chain under the one above. Either way the path's last
+	// node takes over what came after the removed node.
+	std::vector<const Node *> removed(top + 1);
+	removed[top] = path[top].back()->next.get();
+	for(int layer = top - 1; layer >= 0; layer--)
+	{
+		removed[layer] = removed[layer + 1]->down.get();
+	}
+	Link newRoot = rebuild(path, [top, &removed](unsigned layer, const Node * last) -> Link
+	{
+		if(static_cast<int>(layer) <= top)
+		{
+			return removed[layer]->next;
+		}
+		return last->next;
+	});
+	return PersistentSkipList(std::move(newRoot), layers, listSize - 1);
+}
+
+template<typename Key, typename Value>
+bool PersistentSkipList<Key, Value>::find(const Key & k, Value & out) const
+{
+	const Node * node = root.get();
+	while(node != nullptr)
+	{
+		while(node->next && node->next->key < k)
+		{
+			node = node->next.get();
+		}
+		if(node->next && !(k < node->next->key))
+		{
+			out = node->next->value;
+			return true;
+		}
+		node = node->down.get();
+	}
+	return false;
+}
+
+template<typename Key, typename Value>
+const Value & PersistentSkipList<Key, Value>::find(const Key & k) const
+{
+	const Node * node = root.get();
+	while(node != nullptr)
+	{
+		while(node->next && node->next->key < k)
+		{
+			node = node->next.get();
+		}
+		if(node->next && !(k < node->next->key))
+		{
+			return node->next->value;
+		}
+		node = node->down.get();
+	}
+	throw RuntimeException("Key not found");
+}
+
+template<typename Key, typename Value>
+bool PersistentSkipList<Key, Value>::contains(const Key & k) const
+{
+	Value ignored;
+	return find(k, ignored);
+}
+
+template<typename Key, typename Value>
+template<typename Fn>
+void PersistentSkipList<Key, Value>::walkInOrder(Fn fn) const
+{
+	// Everything under a node's `down` comes before its `next`.
+	std::vector<const Node *> stack{root.get()};
+	while(!stack.empty())
+	{
+		const Node * node = stack.back();
+		stack.pop_back();
+		fn(node);
+		if(node->next)
+		{
+			stack.push_back(node->next.get());
+		}
+		if(node->down)
+		{
+			stack.push_back(node->down.get());
+		}
+	}
+}
+
+template<typename Key, typename Value>
+template<typename Fn>
+void PersistentSkipList<Key, Value>::forEach(Fn fn) const
+{
+	// Every key has exactly one node on S_0; the first S_0 node reached is
+	// the head sentinel's.
+	bool sentinel = true;
+	walkInOrder([&](const Node * node)
+	{
+		if(node->down)
+		{
+			return;
+		}
+		if(sentinel)
+		{
+			sentinel = false;
+			return;
+		}
+		fn(node->key, node->value);
+	});
+}
+
+template<typename Key, typename Value>
+std::vector<Key> PersistentSkipList<Key, Value>::allKeysInOrder() const
+{
+	std::vector<Key> keys;
+	keys.reserve(listSize);
+	forEach([&keys](const Key & k, const Value &) { keys.push_back(k); });
+	return keys;
+}
+
+template<typename Key, typename Value>
+size_t PersistentSkipList<Key, Value>::nodesNotIn(const PersistentSkipList & older) const
+{
+	std::unordered_set<const Node *> shared;
+	older.walkInOrder([&shared](const Node * node) { shared.insert(node); });
+	// A shared node shares everything it reaches, so stop there.
+	size_t count = 0;
+	std::vector<const Node *> stack{root.get()};
+	while(!stack.empty())
+	{
+		const Node * node = stack.back();
+		stack.pop_back();
+		if(shared.count(node) != 0)
+		{
+			continue;
+		}
+		count++;
+		if(node->next)
+		{
+			stack.push_back(node->next.get());
+		}
+		if(node->down)
+		{
+			stack.push_back(node->down.get());
+		}
+	}
+	return count;
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "catch_amalgamated.hpp"
+#include "PersistentSkipList.hpp"
+#include "SkipList.hpp"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace{
+
+	// Counts live copies, to check that unreachable nodes are freed.
+	struct Tracked
+	{
+		static int live;
+		unsigned id;
+
+		Tracked(unsigned i = 0) : id(i) { live++; }
+		Tracked(const Tracked & other) : id(other.id) { live++; }
+		Tracked & operator=(const Tracked & other) { id = other.id; return *this; }
+		~Tracked() { live--; }
+	};
+
+	int Tracked::live = 0;
+
+	TEST_CASE("PersistentVersionsTest", "[PersistentTests]")
+	{
+		std::vector<PersistentSkipList<unsigned, unsigned>> versions(1);
+		std::vector<std::map<unsigned, unsigned>> expected(1);
+		for(unsigned i = 0; i < 300; i++)
+		{
+			unsigned key = i * 7919 % 1000;
+			versions.push_back(versions.back().insert(key, i));
+			expected.push_back(expected.back());
+			expected.back().emplace(key, i);
+		}
+		for(unsigned i = 0; i < 300; i += 3)
+		{
+			unsigned key = i * 7919 % 1000;
+			versions.push_back(versions.back().erase(key));
+			expected.push_back(expected.back());
+			expected.back().erase(key);
+		}
+
+		// Every version still holds exactly what it held when it was made.
+		for(size_t v = 0; v < versions.size(); v++)
+		{
+			REQUIRE(versions[v].size() == expected[v].size());
+			std::vector<unsigned> keys;
+			for(const std::pair<const unsigned, unsigned> & entry : expected[v])
+			{
+				keys.push_back(entry.first);
+				REQUIRE(versions[v].find(entry.first) == entry.second);
+			}
+			REQUIRE(versions[v].allKeysInOrder() == keys);
+		}
+
+		const PersistentSkipList<unsigned, unsigned> & last = versions.back();
+		unsigned value = 0;
+		REQUIRE_FALSE(last.find(0, value));
+		REQUIRE_FALSE(last.contains(1001));
+		REQUIRE_THROWS_AS(last.find(1001), RuntimeException);
+		REQUIRE(versions[0].isEmpty());
+		REQUIRE(versions[0].allKeysInOrder().empty());
+	}
+
+	TEST_CASE("PersistentMatchesSkipListTest", "[PersistentTests]")
+	{
+		PersistentSkipList<std::string, unsigned> persistent;
+		SkipList<std::string, unsigned> sl;
+		for(unsigned i = 0; i < 500; i++)
+		{
+			std::string key = "key" + std::to_string(i * 31 % 500);
+			persistent = persistent.insert(key, i);
+			sl.insert(key, i);
+		}
+		// Duplicates keep the first value and share the whole version.
+		PersistentSkipList<std::string, unsigned> same = persistent.insert("key0", 99);
+		REQUIRE(same.nodesNotIn(persistent) == 0);
+		REQUIRE(same.find("key0") == sl.find("key0"));
+		REQUIRE(persistent.erase("missing").nodesNotIn(persistent) == 0);
+
+		REQUIRE(persistent.allKeysInOrder() == sl.allKeysInOrder());
+		std::vector<std::string> forEachKeys;
+		unsigned sum = 0;
+		persistent.forEach([&](const std::string & k, const unsigned & v)
+		{
+			forEachKeys.push_back(k);
+			sum += v;
+		});
+		REQUIRE(forEachKeys == sl.allKeysInOrder());
+		REQUIRE(sum == 499 * 500 / 2);
+	}
+
+	TEST_CASE("PersistentSharingTest", "[PersistentTests]")
+	{
+		PersistentSkipList<unsigned, unsigned> base;
+		for(unsigned i = 0; i < 5000; i++)
+		{
+			base = base.insert(i * 2654435761u, i);
+		}
+		// A new version copies its search path only: a few nodes per layer.
+		size_t worst = 0;
+		for(unsigned i = 0; i < 50; i++)
+		{
+			unsigned key = i * 40503u + 1;
+			worst = std::max(worst, base.insert(key, i).nodesNotIn(base));
+			worst = std::max(worst, base.erase(i * 2654435761u).nodesNotIn(base));
+		}
+		REQUIRE(worst < 20 * base.numLayers());
+	}
+
+	TEST_CASE("PersistentReclaimTest", "[PersistentTests]")
+	{
+		REQUIRE(Tracked::live == 0);
+		{
+			PersistentSkipList<unsigned, Tracked> older;
+			{
+				PersistentSkipList<unsigned, Tracked> list;
+				for(unsigned i = 0; i < 1000; i++)
+				{
+					list = list.insert(i * 7, Tracked(i));
+					if(i == 500)
+					{
+						older = list;
+					}
+				}
+				for(unsigned i = 0; i < 1000; i += 2)
+				{
+					list = list.erase(i * 7);
+				}
+				REQUIRE(list.size() == 500);
+			}
+			// Only what the kept version reaches is left.
+			REQUIRE(older.size() == 501);
+			REQUIRE(older.find(3500).id == 500);
+			int kept = Tracked::live;
+			older = PersistentSkipList<unsigned, Tracked>();
+			REQUIRE(Tracked::live < kept);
+		}
+		REQUIRE(Tracked::live == 0);
+	}
+
+	TEST_CASE("PersistentDeepChainTest", "[PersistentTests]")
+	{
+		// Keys flipCoin never promotes form one long chain on S_0. Inserting
+		// them in decreasing order copies only the head each time, and
+		// freeing the chain must not recurse once per node.
+		std::vector<unsigned> keys;
+		for(unsigned k = 0; keys.size() < 300000; k++)
+		{
+			if(!flipCoin(k, 0))
+			{
+				keys.push_back(k);
+			}
+		}
+		{
+			PersistentSkipList<unsigned, unsigned> list;
+			for(size_t i = keys.size(); i-- > 0;)
+			{
+				list = list.insert(keys[i], 0);
+			}
+			REQUIRE(list.size() == keys.size());
+			REQUIRE(list.numLayers() == 2);
+			REQUIRE(list.allKeysInOrder() == keys);
+		}
+		SUCCEED();
+	}
+
+}
@@ -0,0 +1,142 @@
+#ifndef ___SET_ALGEBRA_HPP
+#define ___SET_ALGEBRA_HPP
+
+#include <utility>
+#include <vector>
+#include "SkipList.hpp"
+#include "SkipListBuilder.hpp"
+#include "ThreadPool.hpp"
+#include "runtimeexcept.hpp"
+
+// Set operations on the keys of two SkipLists. Each one walks its inputs
+// in order, collects the resulting pairs already sorted and hands them to
+// SkipListBuilder::buildSorted(), so the whole operation is O(n + m) with
+// the linking spread over the pool. Where a key is in both lists, its
+// value is taken from `a`. `out` must be empty; a RuntimeException is
+// thrown otherwise.
+//
+//   ThreadPool pool;
+//   SkipList<unsigned, unsigned> both;
+//   intersect(readers, writers, both, pool);
+
+/**
+ * @brief Fills out with every key of a or b.
+ */
+template<typename Key, typename Value>
+void merge(const SkipList<Key, Value> & a, const SkipList<Key, Value> & b, SkipList<Key, Value> & out, ThreadPool & pool)
+{
+	std::vector<std::pair<Key, Value>> items;
+	items.reserve(a.size() + b.size());
+	auto x = a.begin();
+	auto y = b.begin();
+	while(x != a.end() && y != b.end())
+	{
+		if(*y < *x)
+		{
+			items.emplace_back(*y, y.value());
+			++y;
+		}
+		else
+		{
+			if(!(*x < *y))
+			{
+				++y;
+			}
+			items.emplace_back(*x, x.value());
+			++x;
+		}
+	}
+	for(; x != a.end(); ++x)
+	{
+		items.emplace_back(*x, x.value());
+	}
+	for(; y != b.end(); ++y)
+	{
+		items.emplace_back(*y, y.value());
+	}
+	SkipListBuilder<Key, Value>(pool).buildSorted(std::move(items), out);
+}
+
+/**
+ * @brief Fills out with the keys in both a and b, by a linear merge.
+ * See gallopingIntersect() when one list is much smaller.
+ */
+template<typename Key, typename Value>
+void intersect(const SkipList<Key, Value> & a, const SkipList<Key, Value> & b, SkipList<Key, Value> & out, ThreadPool & pool)
+{
+	std::vector<std::pair<Key, Value>> items;
+	auto x = a.begin();
+	auto y = b.begin();
+	while(x != a.end() && y != b.end())
+	{
+		if(*x < *y)
+		{
+			++x;
+		}
+		else if(*y < *x)
+		{
+			++y;
+		}
+		else
+		{
+			items.emplace_back(*x, x.value());
+			++x;
+			++y;
+		}
+	}
+	SkipListBuilder<Key, Value>(pool).buildSorted(std::move(items), out);
+}
+
+/**
+ * @brief Fills out with the keys of a that are not in b.
+ */
+template<typename Key, typename Value>
+void difference(const SkipList<Key, Value> & a, const SkipList<Key, Value> & b, SkipList<Key, Value> & out, ThreadPool & pool)
+{
+	std::vector<std::pair<Key, Value>> items;
+	auto y = b.begin();
+	for(auto x = a.begin(); x != a.end(); ++x)
+	{
+		while(y != b.end() && *y < *x)
+		{
+			++y;
+		}
+		if(y == b.end() || *x < *y)
+		{
+			items.emplace_back(*x, x.value());
+		}
+	}
+	SkipListBuilder<Key, Value>(pool).buildSorted(std::move(items), out);
+}
+
+/**
+ * @brief Fills out with the keys in both a and b, walking the smaller list
+ * and finger-searching each of its keys in the larger one.
+ *
+ * Each lookup starts from where the previous one ended and climbs the
+ * larger list's upper layers to skip the keys in between (see
+ * SkipList::lowerBound with a hint), so m lookups spread over n keys cost
+ * O(m log(n / m)) expected instead of O(n + m). Worth it when the sizes
+ * differ by an order of magnitude or more; for similar sizes intersect()
+ * is faster. Values come from a, as with intersect().
+ */
+template<typename Key, typename Value>
+void gallopingIntersect(const SkipList<Key, Value> & a, const SkipList<Key, Value> & b, SkipList<Key, Value> & out, ThreadPool & pool)
+{
+	bool aIsSmaller = a.size() <= b.size();
+	const SkipList<Key, Value> & smaller = aIsSmaller ? a : b;
+	const SkipList<Key, Value> & larger = aIsSmaller ? b : a;
+	std::vector<std::pair<Key, Value>> items;
+	auto finger = larger.begin();
+	for(auto x = smaller.begin(); x != smaller.end() && finger != larger.end(); ++x)
+	{
+		finger = larger.lowerBound(*x, finger);
+		if(finger != larger.end() && !(*x < *finger))
+		{
+			items.emplace_back(*x, aIsSmaller ? x.value() : finger.value());
+		}
+	}
+	SkipListBuilder<Key, Value>(pool).buildSorted(std::move(items), out);
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "catch_amalgamated.hpp"
+#include "SetAlgebra.hpp"
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace{
+
+	using List = SkipList<unsigned, unsigned>;
+
+	// Fills list with keys drawn from [0, range), each valued key * 10 +
+	// tag so the tests can tell which list a value came from.
+	std::vector<unsigned> fill(List & list, std::mt19937 & rng, size_t count, unsigned range, unsigned tag)
+	{
+		std::set<unsigned> keys;
+		while(keys.size() < count)
+		{
+			keys.insert(rng() % range);
+		}
+		for(unsigned key : keys)
+		{
+			list.insert(key, key * 10 + tag);
+		}
+		return std::vector<unsigned>(keys.begin(), keys.end());
+	}
+
+	void requireValuesFrom(const List & list, unsigned tag)
+	{
+		for(auto it = list.begin(); it != list.end(); ++it)
+		{
+			REQUIRE(it.value() == *it * 10 + tag);
+		}
+	}
+
+	TEST_CASE("SetAlgebraMatchesStdTest", "[SetAlgebraTests]")
+	{
+		ThreadPool pool(4);
+		std::mt19937 rng(17);
+		const size_t sizes[][2] = {{0, 0}, {0, 50}, {50, 0}, {1, 1}, {300, 300}, {2000, 500}, {500, 2000}};
+		for(const auto & size : sizes)
+		{
+			List a;
+			List b;
+			std::vector<unsigned> aKeys = fill(a, rng, size[0], 4000, 1);
+			std::vector<unsigned> bKeys = fill(b, rng, size[1], 4000, 2);
+
+			std::vector<unsigned> expected;
+			std::set_union(aKeys.begin(), aKeys.end(), bKeys.begin(), bKeys.end(), std::back_inserter(expected));
+			List unionList;
+			merge(a, b, unionList, pool);
+			REQUIRE(unionList.allKeysInOrder() == expected);
+			REQUIRE(unionList.size() == expected.size());
+			for(auto it = unionList.begin(); it != unionList.end(); ++it)
+			{
+				REQUIRE(it.value() == *it * 10 + (std::binary_search(aKeys.begin(), aKeys.end(), *it) ? 1 : 2));
+			}
+
+			expected.clear();
+			std::set_intersection(aKeys.begin(), aKeys.end(), bKeys.begin(), bKeys.end(), std::back_inserter(expected));
+			List both;
+			intersect(a, b, both, pool);
+			REQUIRE(both.allKeysInOrder() == expected);
+			requireValuesFrom(both, 1);
+			List galloped;
+			gallopingIntersect(a, b, galloped, pool);
+			REQUIRE(galloped.allKeysInOrder() == expected);
+			requireValuesFrom(galloped, 1);
+
+			expected.clear();
+			std::set_difference(aKeys.begin(), aKeys.end(), bKeys.begin(), bKeys.end(), std::back_inserter(expected));
+			List onlyA;
+			difference(a, b, onlyA, pool);
+			REQUIRE(onlyA.allKeysInOrder() == expected);
+			requireValuesFrom(onlyA, 1);
+
+			List occupied;
+			occupied.insert(0, 0);
+			REQUIRE_THROWS_AS(merge(a, b, occupied, pool), RuntimeException);
+		}
+	}
+
+	TEST_CASE("SetAlgebraGallopingTest", "[SetAlgebraTests]")
+	{
+		// A handful of keys against a large list, with the smaller list on
+		// either side so values still come from the first argument.
+		ThreadPool pool(4);
+		std::mt19937 rng(23);
+		List large;
+		for(unsigned i = 0; i < 200000; i++)
+		{
+			large.insert(i * 3, i * 30 + 2);
+		}
+		List small;
+		std::vector<unsigned> expected;
+		for(unsigned i = 0; i < 100; i++)
+		{
+			unsigned key = rng() % 600000;
+			small.insert(key, key * 10 + 1);
+		}
+		for(unsigned key : small.allKeysInOrder())
+		{
+			if(key % 3 == 0)
+			{
+				expected.push_back(key);
+			}
+		}
+
+		List fromSmall;
+		gallopingIntersect(small, large, fromSmall, pool);
+		REQUIRE(fromSmall.allKeysInOrder() == expected);
+		requireValuesFrom(fromSmall, 1);
+		List fromLarge;
+		gallopingIntersect(large, small, fromLarge, pool);
+		REQUIRE(fromLarge.allKeysInOrder() == expected);
+		requireValuesFrom(fromLarge, 2);
+	}
+
+	TEST_CASE("HintedLowerBoundTest", "[SetAlgebraTests]")
+	{
+		List list;
+		std::mt19937 rng(29);
+		for(unsigned i = 0; i < 5000; i++)
+		{
+			list.insert(rng() % 100000, i);
+		}
+		REQUIRE(list.lowerBound(0, list.end()) == list.end());
+		auto hint = list.begin();
+		for(unsigned k = 0; k <= 100100; k += 1 + rng() % 200)
+		{
+			auto found = list.lowerBound(k, hint);
+			REQUIRE(found == list.lowerBound(k));
+			hint = found;
+		}
+		REQUIRE(hint == list.end());
+		// A hint already at or past k comes back unchanged.
+		auto third = list.atRank(2);
+		REQUIRE(list.lowerBound(*third, third) == third);
+		REQUIRE(list.lowerBound(0, third) == third);
+	}
+}
@@ -0,0 +1,377 @@
+#ifndef ___SHARDED_SKIP_LIST_HPP
+#define ___SHARDED_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief A SkipList split by key range into independent shards, each
+ * behind its own mutex.
+ *
+ * With split points s_0 < s_1 < ... < s_{n-2}, shard 0 holds the keys
+ * below s_0, shard i the keys in [s_{i-1}, s_i) and the last shard the
+ * keys from s_{n-2} up. Operations on keys in different shards never wait
+ * for each other, so writes scale with the number of shards the workload
+ * touches.
+ *
+ * Split points are either given explicitly or taken as quantiles of a
+ * sample of the expected keys (splitPointsFromSample). A poor split only costs
+ * contention; every key still lands in exactly one shard.
+ *
+ * Because shards cover disjoint ranges in order, ordered traversal is the
+ * concatenation of the shards: forEach() walks them one at a time, holding
+ * each shard's lock while it is visited. The iterators from begin()/end()
+ * take no locks and must only be used while no thread is writing.
+ */
+template<typename Key, typename Value>
+class ShardedSkipList
+{
+private:
+	// Padded so the locks of neighbouring shards do not share a cache line.
+	struct alignas(64) Shard
+	{
+		mutable std::mutex lock;
+		SkipList<Key, Value> list;
+	};
+
+	std::vector<Key> splits;
+	std::unique_ptr<Shard[]> shards;
+
+	// First shard after `index` holding any key, or shardCount(). Takes no
+	// locks: it serves the iterators, which require that no thread writes.
+	size_t nextNonEmptyShard(size_t index) const;
+
+public:
+	// Ordered traversal across all shards. Not safe against concurrent
+	// writers; see the class comment.
+	class const_iterator
+	{
+	private:
+		const ShardedSkipList * owner = nullptr;
+		size_t shard = 0;
+		typename SkipList<Key, Value>::const_iterator current;
+
+		friend class ShardedSkipList;
+		const_iterator(const ShardedSkipList * o, size_t s, typename SkipList<Key, Value>::const_iterator c)
+			: owner(o), shard(s), current(c)
+		{
+		}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Key;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Key *;
+		using reference = const Key &;
+
+		const_iterator() = default;
+
+		const Key & operator*() const { return *current; }
+		const Key * operator->() const { return &*current; }
+		const Value & value() const { return current.value(); }
+
+		const_iterator & operator++()
+		{
+			++current;
+			if(current == owner->shards[shard].list.end())
+			{
+				size_t following = owner->nextNonEmptyShard(shard);
+				if(following < owner->shardCount())
+				{
+					shard = following;
+					current = owner->shards[shard].list.begin();
+				}
+				else
+				{
+					*this = owner->end();
+				}
+			}
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator previous = *this;
+			++*this;
+			return previous;
+		}
+
+		bool operator==(const const_iterator & other) const { return current == other.current; }
+		bool operator!=(const const_iterator & other) const { return current != other.current; }
+	};
+
+	// Shards split at the given keys, which must be strictly increasing.
+	// No split points gives a single shard. Throws a RuntimeException if the
+	// split points are not strictly increasing.
+	explicit ShardedSkipList(const std::vector<Key> & splitPoints);
+
+	// `shardCount` shards whose split points are evenly spaced quantiles of
+	// `sample`. Duplicate quantiles are dropped, so fewer shards may result
+	// when the sample has few distinct keys.
+	static std::vector<Key> splitPointsFromSample(std::vector<Key> sample, size_t shardCount);
+
+	ShardedSkipList(const ShardedSkipList &) = delete;
+	ShardedSkipList & operator=(const ShardedSkipList &) = delete;
+
+	size_t shardCount() const noexcept;
+
+	// Index of the shard that owns k.
+	size_t shardOf(const Key & k) const;
+
+	// Keys in each shard, to check how well the split points fit the data.
+	std::vector<size_t> shardSizes() const;
+
+	// Total number of keys. Shards are counted one after the other, so the
+	// result is exact only when no writes are in flight.
+	size_t size() const;
+
+	bool isEmpty() const;
+
+	// Return true if the pair was inserted, false if the key already exists.
+	bool insert(const Key & k, const Value & v);
+
+	bool contains(const Key & k) const;
+
+	// Copies the value of k into out and returns true, or returns false if
+	// k is not present.
+	bool find(const Key & k, Value & out) const;
+
+	// The value of k. Throws a RuntimeException if k is not present.
+	Value find(const Key & k) const;
+
+	// The next larger key, possibly in a later shard. Throws a
+	// RuntimeException if k is not present or is the largest key.
+	Key nextKey(const Key & k) const;
+
+	// The next smaller key, possibly in an earlier shard. Throws a
+	// RuntimeException if k is not present or is the smallest key.
+	Key previousKey(const Key & k) const;
+
+	// Calls fn(key, value) for every pair in increasing key order. Each
+	// shard is locked while it is visited, so fn must not call back into
+	// this list.
+	template<typename Fn>
+	void forEach(Fn fn) const;
+
+	std::vector<Key> allKeysInOrder() const;
+
+	const_iterator begin() const;
+	const_iterator end() const;
+};
+
+template<typename Key, typename Value>
+ShardedSkipList<Key, Value>::ShardedSkipList(const std::vector<Key> & splitPoints)
+	: splits(splitPoints), shards(new Shard[splitPoints.size() + 1])
+{
+	for(size_t i = 1; i < splits.size(); i++)
+	{
+		if(!(splits[i - 1] < splits[i]))
+		{
+			throw RuntimeException("Split points must be strictly increasing");
+		}
+	}
+}
+
+template<typename Key, typename Value>
+std::vector<Key> ShardedSkipList<Key, Value>::splitPointsFromSample(std::vector<Key> sample, size_t shardCount)
+{
+	std::sort(sample.begin(), sample.end());
+	sample.erase(std::unique(sample.begin(), sample.end()), sample.end());
+	std::vector<Key> points;
+	for(size_t i = 1; i < shardCount && !sample.empty(); i++)
+	{
+		const Key & candidate = sample[i * sample.size() / shardCount];
+		if(points.empty() || points.back() < candidate)
+		{
+			points.push_back(candidate);
+		}
+	}
+	return points;
+}
+
+template<typename Key, typename Value>
+size_t ShardedSkipList<Key, Value>::shardCount() const noexcept
+{
+	return splits.size() + 1;
+}
+
+template<typename Key, typename Value>
+size_t ShardedSkipList<Key, Value>::shardOf(const Key & k) const
+{
+	return static_cast<size_t>(std::upper_bound(splits.begin(), splits.end(), k) - splits.begin());
+}
+
+template<typename Key, typename Value>
+size_t ShardedSkipList<Key, Value>::nextNonEmptyShard(size_t index) const
+{
+	for(index++; index < shardCount(); index++)
+	{
+		if(!shards[index].list.isEmpty())
+		{
+			break;
+		}
+	}
+	return index;
+}
+
+template<typename Key, typename Value>
+std::vector<size_t> ShardedSkipList<Key, Value>::shardSizes() const
+{
+	std::vector<size_t> sizes;
+	for(size_t i = 0; i < shardCount(); i++)
+	{
+		std::lock_guard<std::mutex> guard(shards[i].lock);
+		sizes.push_back(shards[i].list.size());
+	}
+	return sizes;
+}
+
+template<typename Key, typename Value>
+size_t ShardedSkipList<Key, Value>::size() const
+{
+	size_t total = 0;
+	for(size_t count : shardSizes())
+	{
+		total += count;
+	}
+	return total;
+}
+
+template<typename Key, typename Value>
+bool ShardedSkipList<Key, Value>::isEmpty() const
+{
+	return size() == 0;
+}
+
+template<typename Key, typename Value>
+bool ShardedSkipList<Key, Value>::insert(const Key & k, const Value & v)
+{
+	Shard & shard = shards[shardOf(k)];
+	std::lock_guard<std::mutex> guard(shard.lock);
+	return shard.list.insert(k, v);
+}
+
+template<typename Key, typename Value>
+bool ShardedSkipList<Key, Value>::contains(const Key & k) const
+{
+	Value ignored;
+	return find(k, ignored);
+}
+
+template<typename Key, typename Value>
+bool ShardedSkipList<Key, Value>::find(const Key & k, Value & out) const
+{
+	const Shard & shard = shards[shardOf(k)];
+	std::lock_guard<std::mutex> guard(shard.lock);
+	try
+	{
+		out = shard.list.find(k);
+		return true;
+	}
+	catch(RuntimeException &)
+	{
+		return false;
+	}
+}
+
+template<typename Key, typename Value>
+Value ShardedSkipList<Key, Value>::find(const Key & k) const
+{
+	const Shard & shard = shards[shardOf(k)];
+	std::lock_guard<std::mutex> guard(shard.lock);
+	return shard.list.find(k);
+}
+
+template<typename Key, typename Value>
+Key ShardedSkipList<Key, Value>::nextKey(const Key & k) const
+{
+	size_t index = shardOf(k);
+	{
+		const Shard & shard = shards[index];
+		std::lock_guard<std::mutex> guard(shard.lock);
+		if(!shard.list.isLargestKey(k))
+		{
+			return shard.list.nextKey(k);
+		}
+	}
+	for(index++; index < shardCount(); index++)
+	{
+		std::lock_guard<std::mutex> guard(shards[index].lock);
+		if(!shards[index].list.isEmpty())
+		{
+			return shards[index].list.smallestKey();
+		}
+	}
+	throw RuntimeException("No next key");
+}
+
+template<typename Key, typename Value>
+Key ShardedSkipList<Key, Value>::previousKey(const Key & k) const
+{
+	size_t index = shardOf(k);
+	{
+		const Shard & shard = shards[index];
+		std::lock_guard<std::mutex> guard(shard.lock);
+		if(!shard.list.isSmallestKey(k))
+		{
+			return shard.list.previousKey(k);
+		}
+	}
+	while(index-- > 0)
+	{
+		std::lock_guard<std::mutex> guard(shards[index].lock);
+		if(!shards[index].list.isEmpty())
+		{
+			return shards[index].list.largestKey();
+		}
+	}
+	throw RuntimeException("No previous key");
+}
+
+template<typename Key, typename Value>
+template<typename Fn>
+void ShardedSkipList<Key, Value>::forEach(Fn fn) const
+{
+	for(size_t i = 0; i < shardCount(); i++)
+	{
+		std::lock_guard<std::mutex> guard(shards[i].lock);
+		for(auto it = shards[i].list.begin(); it != shards[i].list.end(); ++it)
+		{
+			fn(*it, it.value());
+		}
+	}
+}
+
+template<typename Key, typename Value>
+std::vector<Key> ShardedSkipList<Key, Value>::allKeysInOrder() const
+{
+	std::vector<Key> keys;
+	forEach([&keys](const Key & k, const Value &) { keys.push_back(k); });
+	return keys;
+}
+
+template<typename Key, typename Value>
+typename ShardedSkipList<Key, Value>::const_iterator ShardedSkipList<Key, Value>::begin() const
+{
+	size_t first = shards[0].list.isEmpty() ? nextNonEmptyShard(0) : 0;
+	if(first == shardCount())
+	{
+		return end();
+	}
+	return const_iterator(this, first, shards[first].list.begin());
+}
+
+template<typename Key, typename Value>
+typename ShardedSkipList<Key, Value>::const_iterator ShardedSkipList<Key, Value>::end() const
+{
+	size_t last = shardCount() - 1;
+	return const_iterator(this, last, shards[last].list.end());
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "catch_amalgamated.hpp"
+#include "ShardedSkipList.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace{
+
+	TEST_CASE("ShardedRoutingTest", "[ShardedTests]")
+	{
+		ShardedSkipList<unsigned, unsigned> sharded({100, 200, 300});
+		REQUIRE(sharded.shardCount() == 4);
+		REQUIRE(sharded.shardOf(0) == 0);
+		REQUIRE(sharded.shardOf(99) == 0);
+		REQUIRE(sharded.shardOf(100) == 1);
+		REQUIRE(sharded.shardOf(299) == 2);
+		REQUIRE(sharded.shardOf(1000) == 3);
+
+		for(unsigned i = 0; i < 400; i += 3)
+		{
+			REQUIRE(sharded.insert(i, i * 2));
+		}
+		REQUIRE_FALSE(sharded.insert(99, 0));
+		std::vector<size_t> expectedSizes = {34, 33, 33, 34};
+		REQUIRE(sharded.shardSizes() == expectedSizes);
+		REQUIRE(sharded.size() == 134);
+		REQUIRE(sharded.find(201) == 402);
+		REQUIRE_THROWS_AS(sharded.find(200), RuntimeException);
+
+		// Neighbours across shard boundaries.
+		REQUIRE(sharded.nextKey(99) == 102);
+		REQUIRE(sharded.previousKey(102) == 99);
+		REQUIRE_THROWS_AS(sharded.nextKey(399), RuntimeException);
+		REQUIRE_THROWS_AS(sharded.previousKey(0), RuntimeException);
+		REQUIRE_THROWS_AS(sharded.nextKey(100), RuntimeException);
+	}
+
+	TEST_CASE("ShardedIterationTest", "[ShardedTests]")
+	{
+		// Shard 1 stays empty, so iteration has to skip over it.
+		ShardedSkipList<std::string, unsigned> sharded({"g", "n", "t"});
+		std::vector<std::string> keys = {"a", "c", "p", "s", "u", "z"};
+		for(unsigned i = 0; i < keys.size(); i++)
+		{
+			sharded.insert(keys[keys.size() - 1 - i], i);
+		}
+		REQUIRE(sharded.allKeysInOrder() == keys);
+		REQUIRE(std::vector<std::string>(sharded.begin(), sharded.end()) == keys);
+		REQUIRE(sharded.nextKey("c") == "p");
+		REQUIRE(sharded.previousKey("p") == "c");
+
+		unsigned visited = 0;
+		sharded.forEach([&](const std::string & k, unsigned v)
+		{
+			REQUIRE(k == keys[visited]);
+			REQUIRE(v == keys.size() - 1 - visited);
+			visited++;
+		});
+		REQUIRE(visited == keys.size());
+
+		ShardedSkipList<std::string, unsigned> empty({"m"});
+		REQUIRE(empty.begin() == empty.end());
+		REQUIRE(empty.isEmpty());
+	}
+
+	TEST_CASE("ShardedSplitPointsTest", "[ShardedTests]")
+	{
+		std::vector<unsigned> sample;
+		for(unsigned i = 0; i < 1000; i++)
+		{
+			sample.push_back(999 - i);
+		}
+		std::vector<unsigned> points = ShardedSkipList<unsigned, unsigned>::splitPointsFromSample(sample, 4);
+		std::vector<unsigned> expected = {250, 500, 750};
+		REQUIRE(points == expected);
+
+		// Few distinct keys give fewer, still increasing, split points.
+		std::vector<unsigned> repeated(100, 7);
+		repeated.push_back(9);
+		points = ShardedSkipList<unsigned, unsigned>::splitPointsFromSample(repeated, 8);
+		expected = {7, 9};
+		REQUIRE(points == expected);
+		REQUIRE_THROWS_AS((ShardedSkipList<unsigned, unsigned>({5, 5})), RuntimeException);
+	}
+
+	TEST_CASE("ShardedConcurrentInsertTest", "[ShardedTests]")
+	{
+		ShardedSkipList<unsigned, unsigned> sharded({1000, 2000, 3000});
+		std::vector<std::thread> workers;
+		for(unsigned t = 0; t < 4; t++)
+		{
+			workers.emplace_back([&sharded, t]()
+			{
+				for(unsigned i = t; i < 4000; i += 4)
+				{
+					sharded.insert(i, t);
+				}
+			});
+		}
+		for(std::thread & worker : workers)
+		{
+			worker.join();
+		}
+		REQUIRE(sharded.size() == 4000);
+		std::vector<unsigned> keys = sharded.allKeysInOrder();
+		for(unsigned i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(keys[i] == i);
+		}
+	}
+
+	TEST_CASE("ShardedConcurrentNextKeyTest", "[ShardedTests]")
+	{
+		// nextKey() from the last key of a shard looks into the later
+		// shards while another thread fills them.
+		ShardedSkipList<unsigned, unsigned> sharded({1000, 2000, 3000});
+		sharded.insert(999, 0);
+		sharded.insert(3999, 0);
+		std::thread writer([&sharded]()
+		{
+			for(unsigned i = 1000; i < 3000; i++)
+			{
+				sharded.insert(i, 0);
+			}
+		});
+		for(unsigned i = 0; i < 2000; i++)
+		{
+			unsigned next = sharded.nextKey(999);
+			REQUIRE(next >= 1000);
+			REQUIRE(next <= 3999);
+		}
+		writer.join();
+		REQUIRE(sharded.nextKey(999) == 1000);
+		REQUIRE(sharded.previousKey(1000) == 999);
+	}
+
+}
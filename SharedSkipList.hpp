@@ -0,0 +1,436 @@
+#ifndef ___SHARED_SKIP_LIST_HPP
+#define ___SHARED_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief A skip list that lives in a POSIX shared memory segment, so
+ * several processes can query one copy of it.
+ *
+ * One process create()s the named segment and fills it; any process,
+ * that one included, can open() it and read or insert. Everything inside
+ * the segment, the lock included, is position independent: links are
+ * byte offsets from the start of the segment rather than pointers, since
+ * each process may map it at a different address.
+ *
+ * Access is guarded by a process-shared reader/writer lock kept in the
+ * segment header: lookups and scans share it, insert() takes it
+ * exclusively. A process that dies while holding it leaves it held.
+ *
+ * Nodes come from a bump allocator over the segment, each one a node
+ * header followed by its tower of links, and are never freed; insert()
+ * throws a RuntimeException once the segment is full. Keys and values are
+ * copied into the segment byte for byte, so both must be trivially
+ * copyable: no std::string, no pointers.
+ *
+ *   // builder
+ *   auto index = SharedSkipList<unsigned, unsigned>::create("/index", 64 << 20);
+ *   index.insert(1, 10);
+ *   // every other process
+ *   auto view = SharedSkipList<unsigned, unsigned>::open("/index");
+ *   view.find(1);
+ */
+template<typename Key, typename Value>
+class SharedSkipList
+{
+	static_assert(std::is_trivially_copyable<Key>::value, "SharedSkipList keys must be trivially copyable");
+	static_assert(std::is_trivially_copyable<Value>::value, "SharedSkipList values must be trivially copyable");
+
+public:
+	// Layers available to towers, S_0 included.
+	static const unsigned maxLevel = 32;
+
+private:
+	using Offset = std::uint64_t;
+
+	// Tells a segment of this list type from anything else under the name.
+	static constexpr char magic[8] = {'S', 'L', 'S', 'H', 'M', 'E', 'M', '1'};
+
+	struct Header
+	{
+		char magic[8];
+		std::uint32_t keySize;
+		std::uint32_t valueSize;
+		Offset capacity;
+		// Bytes handed out so far, this header included.
+		Offset used;
+		Offset head;
+		std::uint64_t size;
+		// Layers holding any node; searches start at the highest of them.
+		std::uint32_t layers;
+		pthread_rwlock_t lock;
+	};
+
+	// The tower of links follows the node in the segment.
+	struct alignas(8) Node
+	{
+		Key key;
+		Value value;
+		std::uint32_t height;
+
+		Offset * next()
+		{
+			return reinterpret_cast<Offset *>(this + 1);
+		}
+	};
+
+	class ReadGuard
+	{
+		pthread_rwlock_t * lock;
+	public:
+		explicit ReadGuard(pthread_rwlock_t * l) : lock(l) { pthread_rwlock_rdlock(lock); }
+		~ReadGuard() { pthread_rwlock_unlock(lock); }
+	};
+
+	class WriteGuard
+	{
+		pthread_rwlock_t * lock;
+	public:
+		explicit WriteGuard(pthread_rwlock_t * l) : lock(l) { pthread_rwlock_wrlock(lock); }
+		~WriteGuard() { pthread_rwlock_unlock(lock); }
+	};
+
+	char * base;
+	size_t mappedBytes;
+
+	SharedSkipList(char * b, size_t bytes) : base(b), mappedBytes(bytes) {}
+
+	Header * header() const
+	{
+		return reinterpret_cast<Header *>(base);
+	}
+
+	Node * at(Offset offset) const
+	{
+		return reinterpret_cast<Node *>(base + offset);
+	}
+
+	static size_t nodeBytes(unsigned height)
+	{
+		return sizeof(Node) + height * sizeof(Offset);
+	}
+
+	static Offset roundUp(Offset bytes)
+	{
+		return (bytes + alignof(Node) - 1) / alignof(Node) * alignof(Node);
+	}
+
+	static std::string systemError(const std::string & what, const std::string & name)
+	{
+		return what + " " + name + ": " + std::strerror(errno);
+	}
+
+	// Carves a node out of the free space. The caller holds the write lock.
+	Offset allocate(const Key & k, const Value & v, unsigned height);
+
+	// Last node before k on the way down; null links are offset 0.
+	Node * findPredecessor(const Key & k) const;
+
+public:
+	// Creates the segment `name` (e.g. "/index") of `capacity` bytes, header
+	// included, and maps it. Throws a RuntimeException if it already exists
+	// or cannot be created.
+	static SharedSkipList create(const std::string & name, size_t capacity);
+
+	// Maps an existing segment made by create() for the same Key and Value.
+	static SharedSkipList open(const std::string & name);
+
+	// Removes the name; processes that have it mapped keep using it.
+	static void unlink(const std::string & name);
+
+	SharedSkipList(SharedSkipList && other) noexcept : base(other.base), mappedBytes(other.mappedBytes)
+	{
+		other.base = nullptr;
+	}
+
+	SharedSkipList(const SharedSkipList &) = delete;
+	SharedSkipList & operator=(const SharedSkipList &) = delete;
+	SharedSkipList & operator=(SharedSkipList &&) = delete;
+
+	// Unmaps the segment; the segment itself stays until unlink().
+	~SharedSkipList();
+
+	// Inserts k -> v if k is absent. Returns false if k was present. Throws
+	// a RuntimeException if the segment has no room for the node.
+	bool insert(const Key & k, const Value & v);
+
+	// Copies the value of k into out and returns true, or returns false.
+	bool find(const Key & k, Value & out) const;
+
+	// The value of k; throws a RuntimeException if k is absent.
+	Value find(const Key & k) const;
+
+	bool contains(const Key & k) const;
+
+	size_t size() const;
+
+	// Calls fn(key, value) for every key in increasing order, holding the
+	// read lock throughout.
+	template<typename Fn>
+	void forEach(Fn fn) const;
+
+	std::vector<Key> allKeysInOrder() const;
+
+	// Bytes of the segment in use, and in total.
+	size_t bytesUsed() const;
+	size_t capacity() const noexcept
+	{
+		return mappedBytes;
+	}
+};
+
+template<typename Key, typename Value>
+constexpr char SharedSkipList<Key, Value>::magic[8];
+
+template<typename Key, typename Value>
+SharedSkipList<Key, Value> SharedSkipList<Key, Value>::create(const std::string & name, size_t capacity)
+{
+	Offset headOffset = roundUp(sizeof(Header));
+	if(capacity < headOffset + nodeBytes(maxLevel))
+	{
+		throw RuntimeException("Shared segment too small for an empty list");
+	}
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0)
+	{
+		throw RuntimeException(systemError("Cannot create shared segment", name));
+	}
+	if(ftruncate(fd, static_cast<off_t>(capacity)) != 0)
+	{
+		std::string error = systemError("Cannot size shared segment", name);
+		close(fd);
+		shm_unlink(name.c_str());
+		throw RuntimeException(error);
+	}
+	void * memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(memory == MAP_FAILED)
+	{
+		std::string error = systemError("Cannot map shared segment", name);
+		shm_unlink(name.c_str());
+		throw RuntimeException(error);
+	}
+
+	SharedSkipList list(static_cast<char *>(memory), capacity);
+	Header * h = new(memory) Header();
+	h->keySize = sizeof(Key);
+	h->valueSize = sizeof(Value);
+	h->capacity = capacity;
+	h->used = headOffset;
+	h->size = 0;
+	h->layers = 1;
+	pthread_rwlockattr_t attributes;
+	pthread_rwlockattr_init(&attributes);
+	pthread_rwlockattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+	pthread_rwlock_init(&h->lock, &attributes);
+	pthread_rwlockattr_destroy(&attributes);
+	h->head = list.allocate(Key(), Value(), maxLevel);
+	// Written last: open() rejects the segment until it is set up.
+	std::memcpy(h->magic, magic, sizeof(magic));
+	return list;
+}
+
+template<typename Key, typename Value>
+SharedSkipList<Key, Value> SharedSkipList<Key, Value>::open(const std::string & name)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0)
+	{
+		throw RuntimeException(systemError("Cannot open shared segment", name));
+	}
+	struct stat status;
+	if(fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(Header))
+	{
+		close(fd);
+		throw RuntimeException("Not a shared skip list: " + name);
+	}
+	size_t bytes = static_cast<size_t>(status.st_size);
+	void * memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(memory == MAP_FAILED)
+	{
+		throw RuntimeException(systemError("Cannot map shared segment", name));
+	}
+	SharedSkipList list(static_cast<char *>(memory), bytes);
+	Header * h = list.header();
+	if(std::memcmp(h->magic, magic, sizeof(magic)) != 0 || h->capacity != bytes)
+	{
+		throw RuntimeException("Not a shared skip list: " + name);
+	}
+	if(h->keySize != sizeof(Key) || h->valueSize != sizeof(Value))
+	{
+		throw RuntimeException("Shared skip list " + name + " holds other key or value types");
+	}
+	return list;
+}
+
+template<typename Key, typename Value>
+void SharedSkipList<Key, Value>::unlink(const std::string & name)
+{
+	if(shm_unlink(name.c_str()) != 0)
+	{
+		throw RuntimeException(systemError("Cannot unlink shared segment", name));
+	}
+}
+
+template<typename Key, typename Value>
+SharedSkipList<Key, Value>::~SharedSkipList()
+{
+	if(base != nullptr)
+	{
+		munmap(base, mappedBytes);
+	}
+}
+
+template<typename Key, typename Value>
+typename SharedSkipList<Key, Value>::Offset SharedSkipList<Key, Value>::allocate(const Key & k, const Value & v, unsigned height)
+{
+	Header * h = header();
+	Offset bytes = roundUp(nodeBytes(height));
+	if(h->used + bytes > h->capacity)
+	{
+		throw RuntimeException("Shared segment is full");
+	}
+	Offset offset = h->used;
+	h->used += bytes;
+	Node * node = new(base + offset) Node();
+	node->key = k;
+	node->value = v;
+	node->height = height;
+	for(unsigned level = 0; level < height; level++)
+	{
+		node->next()[level] = 0;
+	}
+	return offset;
+}
+
+template<typename Key, typename Value>
+typename SharedSkipList<Key, Value>::Node * SharedSkipList<Key, Value>::findPredecessor(const Key & k) const
+{
+	Node * node = at(header()->head);
+	for(int level = header()->layers - 1; level >= 0; level--)
+	{
+		while(node->next()[level] != 0 && at(node->next()[level])->key < k)
+		{
+			node = at(node->next()[level]);
+		}
+	}
+	return node;
+}
+
+template<typename Key, typename Value>
+bool SharedSkipList<Key, Value>::insert(const Key & k, const Value & v)
+{
+	WriteGuard guard(&header()->lock);
+	Node * preds[maxLevel];
+	Node * node = at(header()->head);
+	for(unsigned level = header()->layers; level < maxLevel; level++)
+	{
+		preds[level] = node;
+	}
+	for(int level = header()->layers - 1; level >= 0; level--)
+	{
+		while(node->next()[level] != 0 && at(node->next()[level])->key < k)
+		{
+			node = at(node->next()[level]);
+		}
+		preds[level] = node;
+	}
+	Offset successor = preds[0]->next()[0];
+	if(successor != 0 && !(k < at(successor)->key))
+	{
+		return false;
+	}
+	unsigned height = towerHeight(k, maxLevel);
+	Offset offset = allocate(k, v, height);
+	Node * created = at(offset);
+	for(unsigned level = 0; level < height; level++)
+	{
+		created->next()[level] = preds[level]->next()[level];
+		preds[level]->next()[level] = offset;
+	}
+	header()->size++;
+	header()->layers = std::max<std::uint32_t>(header()->layers, height);
+	return true;
+}
+
+template<typename Key, typename Value>
+bool SharedSkipList<Key, Value>::find(const Key & k, Value & out) const
+{
+	ReadGuard guard(&header()->lock);
+	Offset candidate = findPredecessor(k)->next()[0];
+	if(candidate == 0 || k < at(candidate)->key)
+	{
+		return false;
+	}
+	out = at(candidate)->value;
+	return true;
+}
+
+template<typename Key, typename Value>
+Value SharedSkipList<Key, Value>::find(const Key & k) const
+{
+	Value value;
+	if(!find(k, value))
+	{
+		throw RuntimeException("Key not found");
+	}
+	return value;
+}
+
+template<typename Key, typename Value>
+bool SharedSkipList<Key, Value>::contains(const Key & k) const
+{
+	Value ignored;
+	return find(k, ignored);
+}
+
+template<typename Key, typename Value>
+size_t SharedSkipList<Key, Value>::size() const
+{
+	ReadGuard guard(&header()->lock);
+	return header()->size;
+}
+
+template<typename Key, typename Value>
+template<typename Fn>
+void SharedSkipList<Key, Value>::forEach(Fn fn) const
+{
+	ReadGuard guard(&header()->lock);
+	for(Offset current = at(header()->head)->next()[0]; current != 0; current = at(current)->next()[0])
+	{
+		fn(at(current)->key, at(current)->value);
+	}
+}
+
+template<typename Key, typename Value>
+std::vector<Key> SharedSkipList<Key, Value>::allKeysInOrder() const
+{
+	std::vector<Key> keys;
+	forEach([&keys](const Key & k, const Value &) { keys.push_back(k); });
+	return keys;
+}
+
+template<typename Key, typename Value>
+size_t SharedSkipList<Key, Value>::bytesUsed() const
+{
+	ReadGuard guard(&header()->lock);
+	return header()->used;
+}
+
+#endif
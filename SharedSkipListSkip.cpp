@@ -0,0 +1,176 @@
+#include "catch_amalgamated.hpp"
+#include "SharedSkipList.hpp"
+#include "SkipList.hpp"
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace{
+
+	// A segment name private to this test process, removed at scope exit.
+	struct SegmentName
+	{
+		std::string name;
+
+		explicit SegmentName(const std::string & test)
+			: name("/skiplist-test-" + test + "-" + std::to_string(getpid()))
+		{
+			shm_unlink(name.c_str());
+		}
+
+		~SegmentName()
+		{
+			shm_unlink(name.c_str());
+		}
+	};
+
+	struct Point
+	{
+		double x;
+		double y;
+	};
+
+	using PointList = SharedSkipList<unsigned, Point>;
+	using UnsignedList = SharedSkipList<unsigned, unsigned>;
+
+	// Runs fn in a child process; returns true if it exited with status 0.
+	template<typename Fn>
+	bool inChild(Fn fn)
+	{
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			_exit(fn() ? 0 : 1);
+		}
+		int status = 0;
+		waitpid(pid, &status, 0);
+		return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	TEST_CASE("SharedSingleProcessTest", "[SharedTests]")
+	{
+		SegmentName segment("single");
+		PointList list = PointList::create(segment.name, 1 << 20);
+		SkipList<unsigned, unsigned> sl;
+		for(unsigned i = 0; i < 1000; i++)
+		{
+			unsigned key = i * 7919 % 5000;
+			REQUIRE(list.insert(key, Point{double(i), -double(i)}) == sl.insert(key, i));
+		}
+		REQUIRE_FALSE(list.insert(0, Point{1, 1}));
+		REQUIRE(list.size() == sl.size());
+		REQUIRE(list.allKeysInOrder() == sl.allKeysInOrder());
+		for(unsigned key : sl.allKeysInOrder())
+		{
+			REQUIRE(list.find(key).x == sl.find(key));
+		}
+		Point p;
+		REQUIRE_FALSE(list.find(5001, p));
+		REQUIRE_FALSE(list.contains(1));
+		REQUIRE_THROWS_AS(list.find(5001), RuntimeException);
+		REQUIRE(list.bytesUsed() < list.capacity());
+
+		// The name is taken, and the segment is typed.
+		REQUIRE_THROWS_AS(PointList::create(segment.name, 1 << 20), RuntimeException);
+		REQUIRE_THROWS_AS(UnsignedList::open(segment.name), RuntimeException);
+		REQUIRE_THROWS_AS(PointList::open("/skiplist-test-missing"), RuntimeException);
+	}
+
+	TEST_CASE("SharedFullSegmentTest", "[SharedTests]")
+	{
+		SegmentName segment("full");
+		UnsignedList list = UnsignedList::create(segment.name, 8192);
+		unsigned inserted = 0;
+		REQUIRE_THROWS_AS([&]()
+		{
+			for(unsigned i = 0; i < 100000; i++)
+			{
+				list.insert(i, i);
+				inserted++;
+			}
+		}(), RuntimeException);
+		// A failed insert leaves the list as it was.
+		REQUIRE(list.size() == inserted);
+		REQUIRE(list.allKeysInOrder().size() == inserted);
+	}
+
+	TEST_CASE("SharedAcrossProcessesTest", "[SharedTests]")
+	{
+		SegmentName segment("procs");
+		UnsignedList builder = UnsignedList::create(segment.name, 4 << 20);
+		for(unsigned i = 0; i < 5000; i++)
+		{
+			builder.insert(i * 3, i);
+		}
+
+		// Readers in other processes see the same index without copying it.
+		REQUIRE(inChild([&]()
+		{
+			UnsignedList reader = UnsignedList::open(segment.name);
+			if(reader.size() != 5000)
+			{
+				return false;
+			}
+			for(unsigned i = 0; i < 5000; i++)
+			{
+				unsigned value = 0;
+				if(!reader.find(i * 3, value) || value != i || reader.contains(i * 3 + 1))
+				{
+					return false;
+				}
+			}
+			return true;
+		}));
+
+		// And their inserts are visible to the builder.
+		REQUIRE(inChild([&]()
+		{
+			UnsignedList writer = UnsignedList::open(segment.name);
+			for(unsigned i = 0; i < 5000; i++)
+			{
+				writer.insert(i * 3 + 1, i);
+			}
+			return writer.size() == 10000;
+		}));
+		REQUIRE(builder.size() == 10000);
+		REQUIRE(builder.find(7) == 2);
+
+		// Several processes reading while one inserts.
+		std::vector<pid_t> readers;
+		for(unsigned r = 0; r < 3; r++)
+		{
+			pid_t pid = fork();
+			if(pid == 0)
+			{
+				UnsignedList reader = UnsignedList::open(segment.name);
+				for(unsigned round = 0; round < 20; round++)
+				{
+					std::vector<unsigned> keys = reader.allKeysInOrder();
+					for(size_t i = 1; i < keys.size(); i++)
+					{
+						if(!(keys[i - 1] < keys[i]))
+						{
+							_exit(1);
+						}
+					}
+				}
+				_exit(0);
+			}
+			readers.push_back(pid);
+		}
+		for(unsigned i = 0; i < 5000; i++)
+		{
+			builder.insert(i * 3 + 2, i);
+		}
+		for(pid_t pid : readers)
+		{
+			int status = 0;
+			waitpid(pid, &status, 0);
+			REQUIRE(WIFEXITED(status));
+			REQUIRE(WEXITSTATUS(status) == 0);
+		}
+		REQUIRE(builder.size() == 15000);
+	}
+
+}
@@ -1,8 +1,14 @@
 #ifndef ___SKIP_LIST_HPP
 #define ___SKIP_LIST_HPP
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <iterator>
 #include <string>
+#include <utility>
 #include <vector>
 #include "runtimeexcept.hpp"
 
@@ -116,6 +122,205 @@ inline bool flipCoin(std::string key, unsigned previousFlips)
 	return ( c & (1 << previousFlips) ) != 0;	
 }
 
+/**
+ * @brief The height, between 1 and maxLevel, of a new tower for key k.
+ *
+ * LazySkipList, SharedSkipList, AugmentedSkipList, IntervalSkipList and
+ * SkipSequence keep each key in one node holding its whole tower of
+ * links, sized by this function; PersistentSkipList uses it for the
+ * number of layers a key reaches.
+ *
+ * The first eight tosses are flipCoin's, so those lists agree with
+ * SkipList on the layers most keys reach. flipCoin only has 8 bits to
+ * offer and repeats them on higher layers, though, so the 1 in 256 keys
+ * whose bits are all heads would otherwise climb to maxLevel and crowd
+ * the upper layers that every search walks. Past the first eight, the
+ * tosses come from std::hash<Key> of the key, rehashed every eight heads,
+ * which keeps each layer about half the size of the one below. Keys
+ * whose bytes all XOR to the same value still share their first eight
+ * tosses, and a structure holding only such keys loses its O(log n)
+ * bounds.
+ *
+ * @param k key of the new node; std::hash<Key> must be defined
+ * @param maxLevel the most layers a tower may occupy
+ */
+template<typename Key>
+unsigned towerHeight(const Key & k, unsigned maxLevel)
+{
+	unsigned height = 1;
+	while(height < maxLevel && height <= 8 && flipCoin(k, height - 1))
+	{
+		height++;
+	}
+	if(height <= 8)
+	{
+		return height;
+	}
+	unsigned seed = static_cast<unsigned>(std::hash<Key>()(k));
+	while(height < maxLevel)
+	{
+		seed = seed * 2654435761u + 1;
+		for(unsigned flip = 0; flip < 8 && height < maxLevel; flip++)
+		{
+			if(!flipCoin(seed, flip))
+			{
+				return height;
+			}
+			height++;
+		}
+	}
+	return height;
+}
+
+/**
+ * @brief Bytes a key or value owns on the heap, beyond sizeof itself.
+ *
+ * SkipList::memoryUsage() calls heapBytes on every key and value it
+ * stores. The default covers types that own nothing; overload it, the
+ * same way flipCoin is overloaded, for types that allocate. Overloads
+ * must be visible where SkipList is instantiated: declare them before
+ * including this header, or in the namespace of the type.
+ *
+ * @return 0 for types without heap storage
+ */
+template<typename T>
+inline size_t heapBytes(const T &)
+{
+	return 0;
+}
+
+/**
+ * @brief The characters of a string, when they do not fit in the
+ * string object itself (the short string optimization).
+ *
+ * @return capacity plus the terminator for heap strings, 0 for short ones
+ */
+inline size_t heapBytes(const std::string & s)
+{
+	const char * object = reinterpret_cast<const char *>(&s);
+	if(s.data() >= object && s.data() < object + sizeof(s))
+	{
+		return 0;
+	}
+	return s.capacity() + 1;
+}
+
+/**
+ * @brief Estimates the bytes the allocator really reserves for a request.
+ *
+ * Models glibc malloc on 64-bit targets, which rounds every request plus
+ * an 8-byte header up to 16 bytes with a 32-byte minimum chunk. Other
+ * allocators round differently, so treat the difference as an estimate.
+ *
+ * @param requested bytes passed to operator new
+ * @return usable bytes in the block the allocator hands back
+ */
+inline size_t allocationSize(size_t requested)
+{
+	size_t chunk = (requested + 8 + 15) & ~static_cast<size_t>(15);
+	return std::max<size_t>(chunk, 32) - 8;
+}
+
+// Define SKIPLIST_STATS before including this header to have every SkipList
+// count the work done by its searches and inserts. Without it the counters
+// below are never touched and the instrumentation compiles away.
+#ifdef SKIPLIST_STATS
+#define SKIPLIST_STAT(statement) statement
+#else
+#define SKIPLIST_STAT(statement)
+#endif
+
+// Counters returned by SkipList::stats(). All of them stay at zero unless
+// SKIPLIST_STATS is defined.
+struct SkipListStats
+{
+	// Lookups: find, height, nextKey, previousKey, isSmallestKey and isLargestKey.
+	size_t searches = 0;
+	size_t inserts = 0;
+	// Key comparisons made by lookups and inserts.
+	size_t comparisons = 0;
+	// Moves from one layer down to the layer below it.
+	size_t drops = 0;
+	// Nodes allocated by insert, including sentinels for new top layers.
+	size_t allocations = 0;
+	// Calls to flipCoin made by insert.
+	size_t coinFlips = 0;
+	// Horizontal moves, indexed by layer with S_0 first.
+	std::vector<size_t> nodesVisitedPerLevel;
+
+	void visit(unsigned level)
+	{
+		if(level >= nodesVisitedPerLevel.size())
+		{
+			nodesVisitedPerLevel.resize(level + 1, 0);
+		}
+		nodesVisitedPerLevel[level]++;
+	}
+};
+
+// Shape of a SkipList as measured by SkipList::structureReport().
+// Per-layer vectors are indexed with S_0 first.
+struct SkipListStructureReport
+{
+	size_t keys = 0;
+	unsigned layers = 0;
+	// Keys present on each layer, not counting the two sentinels.
+	std::vector<size_t> nodesPerLevel;
+	// heightHistogram[h] is the number of keys with height h; index 0 is unused.
+	std::vector<size_t> heightHistogram;
+	// Bytes of node storage on each layer, sentinels included.
+	std::vector<size_t> bytesPerLevel;
+	// Nodes touched (moves right plus moves down) when searching for a key,
+	// averaged over the sampled keys, and the worst case among them.
+	double averagePathLength = 0;
+	size_t maxPathLength = 0;
+	size_t sampledKeys = 0;
+	// What a skip list built with a fair coin would need: 2 log2(n) + 2.
+	double expectedPathLength = 0;
+	// Total variation distance between the observed heights and the
+	// geometric distribution P(h) = 2^-h. 0 is ideal; a list where no key
+	// was ever promoted scores 0.5.
+	double skewScore = 0;
+};
+
+// Memory held by a SkipList as measured by SkipList::memoryUsage().
+// Per-layer vectors are indexed with S_0 first.
+struct SkipListMemoryUsage
+{
+	// sizeof(Node) for every key node on each layer, sentinels excluded.
+	std::vector<size_t> nodeBytesPerLevel;
+	// The two sentinel nodes of every layer.
+	size_t sentinelBytes = 0;
+	// Heap storage owned by the keys and values in the nodes, as reported
+	// by heapBytes(). Every node keeps its own copy of the key and value,
+	// so a key of height h is counted h times.
+	size_t keyHeapBytes = 0;
+	size_t valueHeapBytes = 0;
+	// Bytes the allocator reserves beyond each request, estimated with
+	// allocationSize(), for nodes and heap payloads alike.
+	size_t allocatorSlackBytes = 0;
+
+	size_t nodeBytes() const
+	{
+		size_t total = 0;
+		for(size_t bytes : nodeBytesPerLevel)
+		{
+			total += bytes;
+		}
+		return total;
+	}
+
+	// Everything above: what the list costs the process, not counting the
+	// SkipList object itself.
+	size_t totalBytes() const
+	{
+		return nodeBytes() + sentinelBytes + keyHeapBytes + valueHeapBytes + allocatorSlackBytes;
+	}
+};
+
+template<typename Key, typename Value>
+class SkipListBuilder;
+
 template<typename Key, typename Value>
 class SkipList
 {
@@ -129,6 +334,9 @@ private:
 		Node * next;
 		Node * down;
 		Node * up;
+		// Keys on S_0 that `next` steps over, counting the one it lands on:
+		// always 1 on S_0. Summing widths along a search path gives ranks.
+		size_t width;
 		
 		Node(const Key & k, const Value & v, Node * n, Node * d, Node * u) 
 		{
@@ -137,6 +345,7 @@ private:
     		next = n;
     		down = d;
 			up = u;
+			width = 1;
 		}
 	};
 	Node * head;
@@ -148,6 +357,70 @@ private:
 	Node * bot_right;
 	unsigned layer_num = 0;
 	unsigned max_layer_num = 13;
+	mutable SkipListStats statistics;
+
+	// Values are read and written through the S_0 node of a key, so
+	// references handed out by find() survive rebalance().
+	static Node * bottomOf(Node * node)
+	{
+		while(node->down != nullptr)
+		{
+			node = node->down;
+		}
+		return node;
+	}
+
+	// Every key comparison and coin flip goes through these so that
+	// SKIPLIST_STATS builds can count them.
+	bool keyLess(const Key & a, const Key & b) const
+	{
+		SKIPLIST_STAT(statistics.comparisons++);
+		return a < b;
+	}
+
+	bool keyLessEqual(const Key & a, const Key & b) const
+	{
+		SKIPLIST_STAT(statistics.comparisons++);
+		return a <= b;
+	}
+
+	bool keyEqual(const Key & a, const Key & b) const
+	{
+		SKIPLIST_STAT(statistics.comparisons++);
+		return a == b;
+	}
+
+	bool flip(const Key & k, unsigned previousFlips) const
+	{
+		SKIPLIST_STAT(statistics.coinFlips++);
+		return flipCoin(k, previousFlips);
+	}
+
+	// Number of nodes a search for k touches, counting moves right and down.
+	size_t searchPathLength(const Key & k) const;
+
+	// Total variation distance between a height histogram and the
+	// geometric distribution; see SkipListStructureReport::skewScore.
+	static double geometricSkew(const std::vector<size_t> & histogram, size_t keys);
+
+	// The skew score of the list as it is now, without measuring paths.
+	double currentSkew() const;
+
+	// Skew score above which insert rebuilds the upper layers; 0 disables it.
+	double rebalance_threshold = 0;
+
+	// Links a new node for k after predecessors[0] and promotes it with
+	// flipCoin, linking each promotion after the matching predecessor.
+	// Leaves predecessors holding the new key's nodes on the layers it
+	// reached, and one entry per layer.
+	void linkAfter(const Key & k, const Value & v, std::vector<Node *> & predecessors);
+
+	// Sets the width of every node above S_0 from the layer below it.
+	// Runs in O(n); used after rebuilding the upper layers.
+	void computeWidths();
+
+	// Builds the node layers directly, in parallel.
+	friend class SkipListBuilder<Key, Value>;
 	
 
 
@@ -211,9 +484,100 @@ public:
 	// If the key already exists, do not insert one -- return false.
 	bool insert(const Key & k, const Value & v);
 
+	// Insert a batch of pairs, skipping keys already present (the first
+	// copy of a key within the batch wins). Returns how many were inserted.
+	// Each search resumes from the previous key's position instead of the
+	// top-left sentinel, so a batch sorted by key costs little more than a
+	// merge with the keys it passes. Unsorted batches are still inserted
+	// correctly, just without the speedup. With auto-rebalancing on, the
+	// skew is checked once after the whole batch.
+	size_t insertSorted(const std::vector<std::pair<Key, Value>> & items);
+
+	// Remove k and its value. Return true if it was removed, false if it
+	// was not in the Skip List. Layers left empty at the top are dropped,
+	// keeping a single empty top layer.
+	bool erase(const Key & k);
+
+	// The number of keys smaller than k, so the smallest key has rank 0.
+	// Sums node widths along the search path, so it costs one search.
+	// Throw a RuntimeException if k is not in the Skip List.
+	size_t rank(const Key & k) const;
+
 	// Return a vector containing all inserted keys in increasing order.
 	std::vector<Key> allKeysInOrder() const;
 
+	// Forward iterator over the keys in increasing order, walking S_0.
+	// *it is a key and it.value() its value. Keys never move once inserted,
+	// so iterators stay valid across insert() and rebalance(), and across
+	// erase() of any other key.
+	class const_iterator
+	{
+	private:
+		const Node * node = nullptr;
+
+		friend class SkipList;
+		explicit const_iterator(const Node * n) : node(n) {}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Key;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Key *;
+		using reference = const Key &;
+
+		const_iterator() = default;
+
+		const Key & operator*() const { return node->key; }
+		const Key * operator->() const { return &node->key; }
+		const Value & value() const { return node->value; }
+
+		const_iterator & operator++()
+		{
+			node = node->next;
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator previous = *this;
+			node = node->next;
+			return previous;
+		}
+
+		bool operator==(const const_iterator & other) const { return node == other.node; }
+		bool operator!=(const const_iterator & other) const { return node != other.node; }
+	};
+
+	// The smallest key, or end() if the list is empty.
+	const_iterator begin() const;
+
+	const_iterator end() const;
+
+	// The first key not less than k, or end() if every key is less.
+	const_iterator lowerBound(const Key & k) const;
+
+	// The same, searching forward from hint instead of from the top-left
+	// sentinel: a finger search that climbs the towers it meets while the
+	// keys ahead are still less than k, then searches down as usual. It
+	// costs O(log d) expected for a result d keys past hint, so a sweep of
+	// ascending lookups can skip through a much larger list. hint must not
+	// be past the result; if *hint is not less than k, hint is returned.
+	const_iterator lowerBound(const Key & k, const_iterator hint) const;
+
+	// The key of rank `index` (the inverse of rank()), or end() if index is
+	// not below size(). Follows node widths down from the top, so it costs
+	// one search rather than a walk along S_0.
+	const_iterator atRank(size_t index) const;
+
+	// Split S_0 into at most `parts` segments of roughly equal size, so they
+	// can be scanned in parallel. The split points are evenly spaced nodes
+	// of the highest layer holding at least 8 * parts keys; each of its
+	// nodes stands for about the same number of S_0 keys, so S_0 itself is
+	// not walked.
+	// Returns the boundaries, begin() first and end() last: segment i runs
+	// from boundaries[i] up to boundaries[i + 1].
+	std::vector<const_iterator> partition(size_t parts) const;
+
 	// Is this the smallest key in the SkipList? Throw a RuntimeException
 	// if the key *k* does not exist in the Skip List. 
 	bool isSmallestKey(const Key & k) const;
@@ -222,7 +586,41 @@ public:
 	// if the key *k* does not exist in the Skip List. 
 	bool isLargestKey(const Key & k) const;
 
-	void print();
+	// The smallest and largest keys. Throw a RuntimeException if the
+	// Skip List is empty.
+	Key smallestKey() const;
+	Key largestKey() const;
+
+	void print() const;
+
+	// Counters for the work done since construction or the last resetStats().
+	// Only collected when SKIPLIST_STATS is defined; otherwise all zero.
+	const SkipListStats & stats() const noexcept;
+
+	void resetStats() noexcept;
+
+	// Measure the shape of the list: nodes and bytes per layer, the height
+	// histogram, search path lengths and how far the heights are from the
+	// ideal geometric distribution.
+	// Path lengths are measured for every key when sampleLimit is 0 or at
+	// least size(), and for sampleLimit evenly spaced keys otherwise.
+	SkipListStructureReport structureReport(size_t sampleLimit = 0) const;
+
+	// Bytes used by the list: node storage per layer, sentinels, the heap
+	// payloads of keys and values (see heapBytes) and allocator slack.
+	// Walks every node, so it runs in O(n).
+	SkipListMemoryUsage memoryUsage() const;
+
+	// Rebuild every layer above S_0 so the i-th smallest key has height
+	// 1 + (number of trailing zero bits of i): a perfectly balanced list,
+	// whatever flipCoin made of these keys. Runs in O(n). S_0 is not touched,
+	// so references returned by find() stay valid.
+	void rebalance();
+
+	// When skewThreshold is above zero, insert checks the skew score each
+	// time size() reaches a power of two (from 64 on) and calls rebalance()
+	// if the score exceeds skewThreshold. Zero, the default, disables it.
+	void setAutoRebalance(double skewThreshold) noexcept;
 	
 };
 
@@ -285,17 +683,19 @@ unsigned SkipList<Key, Value>::numLayers() const noexcept
 template<typename Key, typename Value>
 unsigned SkipList<Key, Value>::height(const Key & k) const 
 {
+	SKIPLIST_STAT(statistics.searches++);
 	Node * currentNode = top_left;
 	unsigned height = 0;
 	for(int i = layer_num - 1; i >= 0; i--)
 	{
-		while(currentNode->next->next != nullptr && currentNode->next->key <= k)
+		while(currentNode->next->next != nullptr && keyLessEqual(currentNode->next->key, k))
 		{
-			if(currentNode->next->key == k)
+			if(keyEqual(currentNode->next->key, k))
 			{
 				height = i + 1;
 				break;
 			}
+			SKIPLIST_STAT(statistics.visit(i));
 			currentNode = currentNode->next;
 		}
 		if(height)
@@ -304,6 +704,7 @@ unsigned SkipList<Key, Value>::height(const Key & k) const
 		}
 		if(i != 0) 
 		{
+            SKIPLIST_STAT(statistics.drops++);
             currentNode = currentNode->down;
         }
 	}
@@ -318,25 +719,30 @@ unsigned SkipList<Key, Value>::height(const Key & k) const
 template<typename Key, typename Value>
 Key SkipList<Key, Value>::nextKey(const Key & k) const 
 {
+	SKIPLIST_STAT(statistics.searches++);
 	Node * currentNode = top_left;
 	Node * currentLayer_left = top_left;
 	for(int i = layer_num - 1; i >= 0; i--)
 	{
-		while(currentNode->next->next != nullptr && currentNode->next->key <= k)
+		while(currentNode->next->next != nullptr && keyLessEqual(currentNode->next->key, k))
 		{
-			if(currentNode->next->key == k)
+			if(keyEqual(currentNode->next->key, k))
 			{
+				SKIPLIST_STAT(statistics.visit(i));
 				currentNode = currentNode->next;
 				for(int j = i - 1; j >= 0; j--)
 				{
+					SKIPLIST_STAT(statistics.drops++);
 					currentNode = currentNode->down;
 				}
 				return currentNode->next->key;
 			}
+			SKIPLIST_STAT(statistics.visit(i));
 			currentNode = currentNode->next;
 		}
 		if(i != 0)
 		{
+			SKIPLIST_STAT(statistics.drops++);
 			currentNode = currentNode->down;
 			currentLayer_left = currentLayer_left->down;
 		}
@@ -355,15 +761,18 @@ Key SkipList<Key, Value>::nextKey(const Key & k) const
 template<typename Key, typename Value>
 Key SkipList<Key, Value>::previousKey(const Key & k) const 
 {
+	SKIPLIST_STAT(statistics.searches++);
 	Node * currentNode = top_left;
 	for(int i = layer_num - 1; i >= 0; i--)
 	{
-		while(currentNode->next->next != nullptr && currentNode->next->key < k)
+		while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
 		{
+			SKIPLIST_STAT(statistics.visit(i));
 			currentNode = currentNode->next;
 		}
 		if(i != 0)
 		{
+			SKIPLIST_STAT(statistics.drops++);
 			currentNode = currentNode->down;
 		}
 	}
@@ -381,23 +790,26 @@ Key SkipList<Key, Value>::previousKey(const Key & k) const
 template<typename Key, typename Value>
 const Value & SkipList<Key, Value>::find(Key k) const 
 {
+	SKIPLIST_STAT(statistics.searches++);
 	Node * currentNode = top_left;
 	Node * currentLayer_left = top_left;
 	for(int i = layer_num - 1; i >= 0; i--)
 	{
-		while(currentNode->next->next != nullptr && currentNode->next->key <= k)
+		while(currentNode->next->next != nullptr && keyLessEqual(currentNode->next->key, k))
 		{
-			if(currentNode->next->key == k)
+			if(keyEqual(currentNode->next->key, k))
 			{
-				return currentNode->next->value;
+				return bottomOf(currentNode->next)->value;
 			}
 			else
 			{
+				SKIPLIST_STAT(statistics.visit(i));
 				currentNode = currentNode->next;
 			}
 		}
 		if(i != 0) 
 		{
+            SKIPLIST_STAT(statistics.drops++);
             currentNode = currentNode->down;
 			currentLayer_left = currentLayer_left->down;
         }
@@ -409,23 +821,26 @@ const Value & SkipList<Key, Value>::find(Key k) const
 template<typename Key, typename Value>
 Value & SkipList<Key, Value>::find(const Key & k) 
 {
+	SKIPLIST_STAT(statistics.searches++);
 	Node * currentNode = top_left;
 	Node * currentLayer_left = top_left;
 	for(int i = layer_num - 1; i >= 0; i--)
 	{
-		while(currentNode->next->next != nullptr && currentNode->next->key <= k)
+		while(currentNode->next->next != nullptr && keyLessEqual(currentNode->next->key, k))
 		{
-			if(currentNode->next->key == k)
+			if(keyEqual(currentNode->next->key, k))
 			{
-				return currentNode->next->value;
+				return bottomOf(currentNode->next)->value;
 			}
 			else
 			{
+				SKIPLIST_STAT(statistics.visit(i));
 				currentNode = currentNode->next;
 			}
 		}
 		if(i != 0) 
 		{
+            SKIPLIST_STAT(statistics.drops++);
             currentNode = currentNode->down;
 			currentLayer_left = currentLayer_left->down;
         }
@@ -437,27 +852,47 @@ Value & SkipList<Key, Value>::find(const Key & k)
 template<typename Key, typename Value>
 bool SkipList<Key, Value>::insert(const Key & k, const Value & v) 
 {
+	SKIPLIST_STAT(statistics.inserts++);
 	Node * currentNode = top_left;
-	Node * currentLayer_left = top_left;
+	// Remember the rightmost node visited on every layer so promotions
+	// can link in place instead of rescanning the layer from its sentinel.
+	std::vector<Node *> predecessors(layer_num);
 	for(int i = layer_num - 1; i >= 0; i--)
 	{
-		while(currentNode->next->next != nullptr && currentNode->next->key < k)
+		while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
 		{
+			SKIPLIST_STAT(statistics.visit(i));
 			currentNode = currentNode->next;
 		}
+		predecessors[i] = currentNode;
 		if(i != 0) 
 		{
+            SKIPLIST_STAT(statistics.drops++);
             currentNode = currentNode->down;
-			currentLayer_left = currentLayer_left->down;
         }
 	}
-	if(currentNode->next->next != nullptr and currentNode->next->key == k)
+	if(currentNode->next->next != nullptr and keyEqual(currentNode->next->key, k))
 	{
 		return false;
 	}
-	
+	linkAfter(k, v, predecessors);
+
+	if(rebalance_threshold > 0 && listSize >= 64 && (listSize & (listSize - 1)) == 0
+		&& currentSkew() > rebalance_threshold)
+	{
+		rebalance();
+	}
+	return true;
+}
+
+template<typename Key, typename Value>
+void SkipList<Key, Value>::linkAfter(const Key & k, const Value & v, std::vector<Node *> & predecessors)
+{
+	Node * currentNode = predecessors[0];
 	Node * new_element = new Node(k, v, currentNode->next, nullptr, nullptr);
+	SKIPLIST_STAT(statistics.allocations++);
 	currentNode->next = new_element;
+	predecessors[0] = new_element;
 	listSize++;
 
 	Node * current_up_layer_left = bot_left->up;
@@ -468,26 +903,50 @@ bool SkipList<Key, Value>::insert(const Key & k, const Value & v)
 	{
 		max_layer_num = 3 * std::ceil(std::log2(listSize)) + 1;
 	}
+	// Cap the height of this key at max_layer_num - 1 so the empty top layer
+	// fits. Capping on the current number of layers instead would stop every
+	// later key from being promoted once one tall key had filled them.
 	unsigned previousFlip = 0;
-	while(flipCoin(k, previousFlip) && layer_num < max_layer_num)
+	while(flip(k, previousFlip) && previousFlip + 2 < max_layer_num)
 	{
 		previousFlip++;
 
-		Node * current_Node = current_up_layer_left;
-		while(current_Node->next->next != nullptr && current_Node->next->key < k)
+		Node * current_Node = previousFlip < predecessors.size() ? predecessors[previousFlip] : current_up_layer_left;
+		while(current_Node->next->next != nullptr && keyLess(current_Node->next->key, k))
 		{
 			current_Node = current_Node->next;
 		}
 
+		// Split the predecessor's width at the new node; the layer below
+		// already counts the new key.
+		size_t distance = 0;
+		for(Node * lower = current_Node->down; lower != below_element; lower = lower->next)
+		{
+			distance += lower->width;
+		}
 		Node * up_element = new Node(k, v, current_Node->next, below_element, nullptr);
+		SKIPLIST_STAT(statistics.allocations++);
+		up_element->width = current_Node->width + 1 - distance;
+		current_Node->width = distance;
 		current_Node->next = up_element;
 		below_element->up = up_element;
+		if(previousFlip < predecessors.size())
+		{
+			predecessors[previousFlip] = up_element;
+		}
+		else
+		{
+			predecessors.push_back(up_element);
+		}
 
 		if((layer_num - 1) == previousFlip)
 		{
 			Node * new_top_left = new Node(Key(), Value(), nullptr, current_up_layer_left, nullptr);
 			Node * new_top_right = new Node(Key(), Value(), nullptr, current_up_layer_right, nullptr);
+			SKIPLIST_STAT(statistics.allocations += 2);
 			new_top_left->next = new_top_right;
+			// Widths on layers above the tower are bumped after the loop.
+			new_top_left->width = listSize;
 			top_left->up = new_top_left;
 			top_right->up = new_top_right;
 			top_left = new_top_left;
@@ -498,9 +957,154 @@ bool SkipList<Key, Value>::insert(const Key & k, const Value & v)
 		current_up_layer_left = current_up_layer_left -> up;
 		current_up_layer_right = current_up_layer_right -> up;
     }
+	if(predecessors.size() < layer_num)
+	{
+		predecessors.push_back(top_left);
+	}
+	// Above the tower the new key falls inside the predecessor's span.
+	for(size_t level = previousFlip + 1; level < predecessors.size(); level++)
+	{
+		predecessors[level]->width++;
+	}
+}
+
+template<typename Key, typename Value>
+size_t SkipList<Key, Value>::insertSorted(const std::vector<std::pair<Key, Value>> & items)
+{
+	size_t inserted = 0;
+	// The predecessors of the previous key on every layer. When keys
+	// arrive in increasing order they are the best place to resume from;
+	// a search only uses one if it lies before the key being inserted.
+	std::vector<Node *> fingers;
+	for(const std::pair<Key, Value> & item : items)
+	{
+		const Key & k = item.first;
+		SKIPLIST_STAT(statistics.inserts++);
+		fingers.resize(layer_num, nullptr);
+		Node * currentNode = top_left;
+		Node * currentLayer_left = top_left;
+		for(int i = layer_num - 1; i >= 0; i--)
+		{
+			Node * finger = fingers[i];
+			if(finger != nullptr && finger != currentLayer_left && keyLess(finger->key, k)
+				&& (currentNode == currentLayer_left || keyLess(currentNode->key, finger->key)))
+			{
+				currentNode = finger;
+			}
+			while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
+			{
+				SKIPLIST_STAT(statistics.visit(i));
+				currentNode = currentNode->next;
+			}
+			fingers[i] = currentNode;
+			if(i != 0)
+			{
+				SKIPLIST_STAT(statistics.drops++);
+				currentNode = currentNode->down;
+				currentLayer_left = currentLayer_left->down;
+			}
+		}
+		if(currentNode->next->next != nullptr && keyEqual(currentNode->next->key, k))
+		{
+			continue;
+		}
+		linkAfter(k, item.second, fingers);
+		inserted++;
+	}
+
+	if(rebalance_threshold > 0 && inserted != 0 && listSize >= 64 && currentSkew() > rebalance_threshold)
+	{
+		rebalance();
+	}
+	return inserted;
+}
+
+template<typename Key, typename Value>
+bool SkipList<Key, Value>::erase(const Key & k)
+{
+	Node * currentNode = top_left;
+	std::vector<Node *> predecessors(layer_num);
+	for(int i = layer_num - 1; i >= 0; i--)
+	{
+		while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
+		{
+			SKIPLIST_STAT(statistics.visit(i));
+			currentNode = currentNode->next;
+		}
+		predecessors[i] = currentNode;
+		if(i != 0)
+		{
+			SKIPLIST_STAT(statistics.drops++);
+			currentNode = currentNode->down;
+		}
+	}
+	if(currentNode->next->next == nullptr || !keyEqual(currentNode->next->key, k))
+	{
+		return false;
+	}
+
+	// Unlink the tower bottom-up; above it the predecessors just lose a key.
+	for(unsigned level = 0; level < layer_num; level++)
+	{
+		Node * predecessor = predecessors[level];
+		Node * victim = predecessor->next;
+		if(victim->next != nullptr && keyEqual(victim->key, k))
+		{
+			predecessor->width += victim->width - 1;
+			predecessor->next = victim->next;
+			delete victim;
+		}
+		else
+		{
+			predecessor->width--;
+		}
+	}
+	listSize--;
+
+	// Keep one empty layer on top, as insert does.
+	while(layer_num > 2 && top_left->down->next == top_right->down)
+	{
+		Node * old_top_left = top_left;
+		Node * old_top_right = top_right;
+		top_left = top_left->down;
+		top_right = top_right->down;
+		top_left->up = nullptr;
+		top_right->up = nullptr;
+		delete old_top_left;
+		delete old_top_right;
+		layer_num--;
+	}
 	return true;
 }
 
+template<typename Key, typename Value>
+size_t SkipList<Key, Value>::rank(const Key & k) const
+{
+	SKIPLIST_STAT(statistics.searches++);
+	Node * currentNode = top_left;
+	// Position of currentNode on S_0, with the left sentinel at 0.
+	size_t position = 0;
+	for(int i = layer_num - 1; i >= 0; i--)
+	{
+		while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
+		{
+			SKIPLIST_STAT(statistics.visit(i));
+			position += currentNode->width;
+			currentNode = currentNode->next;
+		}
+		if(i != 0)
+		{
+			SKIPLIST_STAT(statistics.drops++);
+			currentNode = currentNode->down;
+		}
+	}
+	if(currentNode->next->next == nullptr || !keyEqual(currentNode->next->key, k))
+	{
+		throw RuntimeException("The key does not exist in the skip list.");
+	}
+	return position;
+}
+
 template<typename Key, typename Value>
 std::vector<Key> SkipList<Key, Value>::allKeysInOrder() const 
 {
@@ -517,19 +1121,199 @@ std::vector<Key> SkipList<Key, Value>::allKeysInOrder() const
     return keys;
 }
 
+template<typename Key, typename Value>
+Key SkipList<Key, Value>::smallestKey() const
+{
+	if(listSize == 0)
+	{
+		throw RuntimeException("Skip list is empty");
+	}
+	return bot_left->next->key;
+}
+
+template<typename Key, typename Value>
+Key SkipList<Key, Value>::largestKey() const
+{
+	if(listSize == 0)
+	{
+		throw RuntimeException("Skip list is empty");
+	}
+	Node * currentNode = top_left;
+	while(true)
+	{
+		while(currentNode->next->next != nullptr)
+		{
+			currentNode = currentNode->next;
+		}
+		if(currentNode->down == nullptr)
+		{
+			return currentNode->key;
+		}
+		currentNode = currentNode->down;
+	}
+}
+
+template<typename Key, typename Value>
+typename SkipList<Key, Value>::const_iterator SkipList<Key, Value>::begin() const
+{
+	return const_iterator(bot_left->next);
+}
+
+template<typename Key, typename Value>
+typename SkipList<Key, Value>::const_iterator SkipList<Key, Value>::end() const
+{
+	return const_iterator(bot_right);
+}
+
+template<typename Key, typename Value>
+typename SkipList<Key, Value>::const_iterator SkipList<Key, Value>::lowerBound(const Key & k) const
+{
+	SKIPLIST_STAT(statistics.searches++);
+	Node * currentNode = top_left;
+	for(int i = layer_num - 1; i >= 0; i--)
+	{
+		while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
+		{
+			SKIPLIST_STAT(statistics.visit(i));
+			currentNode = currentNode->next;
+		}
+		if(i != 0)
+		{
+			SKIPLIST_STAT(statistics.drops++);
+			currentNode = currentNode->down;
+		}
+	}
+	return const_iterator(currentNode->next);
+}
+
+template<typename Key, typename Value>
+typename SkipList<Key, Value>::const_iterator SkipList<Key, Value>::lowerBound(const Key & k, const_iterator hint) const
+{
+	SKIPLIST_STAT(statistics.searches++);
+	Node * currentNode = const_cast<Node *>(hint.node);
+	if(currentNode->next == nullptr || !keyLess(currentNode->key, k))
+	{
+		return hint;
+	}
+	// Climb while there is still ground to cover on the current layer,
+	// taking the tower up where there is one and moving right otherwise.
+	unsigned level = 0;
+	while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
+	{
+		if(currentNode->up != nullptr)
+		{
+			currentNode = currentNode->up;
+			level++;
+		}
+		else
+		{
+			SKIPLIST_STAT(statistics.visit(level));
+			currentNode = currentNode->next;
+		}
+	}
+	// The key wanted lies before currentNode->next; search down to it.
+	while(true)
+	{
+		while(currentNode->next->next != nullptr && keyLess(currentNode->next->key, k))
+		{
+			SKIPLIST_STAT(statistics.visit(level));
+			currentNode = currentNode->next;
+		}
+		if(currentNode->down == nullptr)
+		{
+			return const_iterator(currentNode->next);
+		}
+		SKIPLIST_STAT(statistics.drops++);
+		currentNode = currentNode->down;
+		level--;
+	}
+}
+
+template<typename Key, typename Value>
+typename SkipList<Key, Value>::const_iterator SkipList<Key, Value>::atRank(size_t index) const
+{
+	if(index >= listSize)
+	{
+		return end();
+	}
+	SKIPLIST_STAT(statistics.searches++);
+	Node * currentNode = top_left;
+	// Position of currentNode on S_0, with the left sentinel at 0; the key
+	// wanted sits at index + 1.
+	size_t position = 0;
+	for(int i = layer_num - 1; i >= 0; i--)
+	{
+		while(currentNode->next->next != nullptr && position + currentNode->width <= index + 1)
+		{
+			SKIPLIST_STAT(statistics.visit(i));
+			position += currentNode->width;
+			currentNode = currentNode->next;
+		}
+		if(i != 0)
+		{
+			SKIPLIST_STAT(statistics.drops++);
+			currentNode = currentNode->down;
+		}
+	}
+	return const_iterator(currentNode);
+}
+
+template<typename Key, typename Value>
+std::vector<typename SkipList<Key, Value>::const_iterator> SkipList<Key, Value>::partition(size_t parts) const
+{
+	std::vector<const_iterator> boundaries;
+	boundaries.push_back(begin());
+	if(parts > 1 && listSize > 1)
+	{
+		// Walk down from the top until a layer holds enough keys to split on.
+		// A few times more nodes than parts evens out the random gaps
+		// between neighbouring towers.
+		Node * layerLeft = top_left;
+		std::vector<Node *> layer;
+		while(true)
+		{
+			layer.clear();
+			for(Node * currentNode = layerLeft->next; currentNode->next != nullptr; currentNode = currentNode->next)
+			{
+				layer.push_back(currentNode);
+			}
+			if(layer.size() >= 8 * parts || layerLeft->down == nullptr)
+			{
+				break;
+			}
+			layerLeft = layerLeft->down;
+		}
+		for(size_t i = 1; i < parts; i++)
+		{
+			const_iterator split(bottomOf(layer[i * layer.size() / parts]));
+			if(split != boundaries.back())
+			{
+				boundaries.push_back(split);
+			}
+		}
+	}
+	if(boundaries.back() != end())
+	{
+		boundaries.push_back(end());
+	}
+	return boundaries;
+}
+
 template<typename Key, typename Value>
 bool SkipList<Key, Value>::isSmallestKey(const Key & k) const 
 {
+	SKIPLIST_STAT(statistics.searches++);
 	Node * currentNode = top_left;
 	bool keyExists = false;
 	for(int i = layer_num - 1; i >= 0; i--) {
-        while(currentNode->next->next != nullptr && currentNode->next->key <= k) 
+        while(currentNode->next->next != nullptr && keyLessEqual(currentNode->next->key, k)) 
 		{
-            if(currentNode->next->key == k) 
+            if(keyEqual(currentNode->next->key, k)) 
 			{
                 keyExists = true;
                 break;
             }
+            SKIPLIST_STAT(statistics.visit(i));
             currentNode = currentNode->next;
         }
 
@@ -540,6 +1324,7 @@ bool SkipList<Key, Value>::isSmallestKey(const Key & k) const
 
         if(i != 0) 
 		{
+            SKIPLIST_STAT(statistics.drops++);
             currentNode = currentNode->down;
         }
     }
@@ -555,16 +1340,18 @@ bool SkipList<Key, Value>::isSmallestKey(const Key & k) const
 template<typename Key, typename Value>
 bool SkipList<Key, Value>::isLargestKey(const Key & k) const 
 {
+	SKIPLIST_STAT(statistics.searches++);
     Node* currentNode = top_left;
     bool keyExists = false;
 
     for(int i = layer_num - 1; i >= 0; i--) {
-        while(currentNode->next->next != nullptr && currentNode->next->key <= k) 
+        while(currentNode->next->next != nullptr && keyLessEqual(currentNode->next->key, k)) 
 		{
-            if(currentNode->next->key == k) {
+            if(keyEqual(currentNode->next->key, k)) {
                 keyExists = true;
                 break;
             }
+            SKIPLIST_STAT(statistics.visit(i));
             currentNode = currentNode->next;
         }
 
@@ -575,6 +1362,7 @@ bool SkipList<Key, Value>::isLargestKey(const Key & k) const
 
         if(i != 0) 
 		{
+            SKIPLIST_STAT(statistics.drops++);
             currentNode = currentNode->down;
         }
     }
@@ -585,10 +1373,12 @@ bool SkipList<Key, Value>::isLargestKey(const Key & k) const
     }
 
     while(currentNode->down != nullptr) {
+        SKIPLIST_STAT(statistics.drops++);
         currentNode = currentNode->down;
     }
 
     while(currentNode->next->next != nullptr) {
+        SKIPLIST_STAT(statistics.visit(0));
         currentNode = currentNode->next;
     }
 
@@ -596,6 +1386,270 @@ bool SkipList<Key, Value>::isLargestKey(const Key & k) const
 }
 
 
+template<typename Key, typename Value>
+const SkipListStats & SkipList<Key, Value>::stats() const noexcept
+{
+	return statistics;
+}
+
+template<typename Key, typename Value>
+void SkipList<Key, Value>::resetStats() noexcept
+{
+	statistics = SkipListStats();
+}
+
+template<typename Key, typename Value>
+double SkipList<Key, Value>::geometricSkew(const std::vector<size_t> & histogram, size_t keys)
+{
+	if(keys == 0)
+	{
+		return 0;
+	}
+	// Heights beyond the last layer have zero observed mass, so whatever the
+	// geometric distribution puts there counts fully towards the distance.
+	double distance = 0;
+	double expectedMass = 0;
+	for(unsigned h = 1; h < histogram.size(); h++)
+	{
+		double expected = std::ldexp(1.0, -static_cast<int>(h));
+		double observed = static_cast<double>(histogram[h]) / keys;
+		distance += std::fabs(observed - expected);
+		expectedMass += expected;
+	}
+	distance += 1.0 - expectedMass;
+	return distance / 2;
+}
+
+template<typename Key, typename Value>
+double SkipList<Key, Value>::currentSkew() const
+{
+	std::vector<size_t> histogram(layer_num + 1, 0);
+	for(Node * currentNode = bot_left->next; currentNode->next != nullptr; currentNode = currentNode->next)
+	{
+		unsigned height = 1;
+		for(Node * above = currentNode->up; above != nullptr; above = above->up)
+		{
+			height++;
+		}
+		histogram[height]++;
+	}
+	return geometricSkew(histogram, listSize);
+}
+
+template<typename Key, typename Value>
+void SkipList<Key, Value>::setAutoRebalance(double skewThreshold) noexcept
+{
+	rebalance_threshold = skewThreshold;
+}
+
+template<typename Key, typename Value>
+void SkipList<Key, Value>::rebalance()
+{
+	// Drop every layer above S_0, sentinels included.
+	Node * current_layer_left = top_left;
+	while(current_layer_left != bot_left)
+	{
+		Node * currentNode = current_layer_left;
+		Node * nextLayer = current_layer_left->down;
+		while(currentNode != nullptr)
+		{
+			Node * temp = currentNode;
+			currentNode = currentNode->next;
+			delete temp;
+		}
+		current_layer_left = nextLayer;
+	}
+	for(Node * currentNode = bot_left; currentNode != nullptr; currentNode = currentNode->next)
+	{
+		currentNode->up = nullptr;
+	}
+
+	// Layers S_1 .. S_{keyLayers - 1} hold keys; S_{keyLayers} is the empty top.
+	unsigned keyLayers = 1;
+	while((static_cast<size_t>(1) << keyLayers) <= listSize && keyLayers + 1 < max_layer_num)
+	{
+		keyLayers++;
+	}
+
+	std::vector<Node *> lefts(keyLayers + 1);
+	std::vector<Node *> rights(keyLayers + 1);
+	std::vector<Node *> lasts(keyLayers + 1);
+	lefts[0] = bot_left;
+	rights[0] = bot_right;
+	for(unsigned level = 1; level <= keyLayers; level++)
+	{
+		lefts[level] = new Node(Key(), Value(), nullptr, lefts[level - 1], nullptr);
+		rights[level] = new Node(Key(), Value(), nullptr, rights[level - 1], nullptr);
+		lefts[level - 1]->up = lefts[level];
+		rights[level - 1]->up = rights[level];
+		lasts[level] = lefts[level];
+	}
+
+	// The i-th smallest key gets height 1 + (trailing zero bits of i), so
+	// every layer holds exactly every other key of the layer below it.
+	size_t rank = 1;
+	for(Node * currentNode = bot_left->next; currentNode->next != nullptr; currentNode = currentNode->next, rank++)
+	{
+		Node * below_element = currentNode;
+		for(unsigned level = 1; level < keyLayers && (rank & ((static_cast<size_t>(1) << level) - 1)) == 0; level++)
+		{
+			Node * up_element = new Node(currentNode->key, currentNode->value, nullptr, below_element, nullptr);
+			below_element->up = up_element;
+			lasts[level]->next = up_element;
+			lasts[level] = up_element;
+			below_element = up_element;
+		}
+	}
+	for(unsigned level = 1; level <= keyLayers; level++)
+	{
+		lasts[level]->next = rights[level];
+	}
+
+	top_left = lefts[keyLayers];
+	top_right = rights[keyLayers];
+	layer_num = keyLayers + 1;
+	computeWidths();
+}
+
+template<typename Key, typename Value>
+void SkipList<Key, Value>::computeWidths()
+{
+	for(Node * layerLeft = bot_left->up; layerLeft != nullptr; layerLeft = layerLeft->up)
+	{
+		for(Node * currentNode = layerLeft; currentNode->next != nullptr; currentNode = currentNode->next)
+		{
+			size_t width = 0;
+			for(Node * lower = currentNode->down; lower != currentNode->next->down; lower = lower->next)
+			{
+				width += lower->width;
+			}
+			currentNode->width = width;
+		}
+	}
+}
+
+template<typename Key, typename Value>
+size_t SkipList<Key, Value>::searchPathLength(const Key & k) const
+{
+	Node * currentNode = top_left;
+	size_t length = 0;
+	for(int i = layer_num - 1; i >= 0; i--)
+	{
+		while(currentNode->next->next != nullptr && currentNode->next->key <= k)
+		{
+			currentNode = currentNode->next;
+			length++;
+			if(currentNode->key == k)
+			{
+				return length;
+			}
+		}
+		if(i != 0)
+		{
+			currentNode = currentNode->down;
+			length++;
+		}
+	}
+	return length;
+}
+
+template<typename Key, typename Value>
+SkipListStructureReport SkipList<Key, Value>::structureReport(size_t sampleLimit) const
+{
+	SkipListStructureReport report;
+	report.keys = listSize;
+	report.layers = layer_num;
+	report.nodesPerLevel.assign(layer_num, 0);
+	report.heightHistogram.assign(layer_num + 1, 0);
+
+	size_t stride = 1;
+	if(sampleLimit != 0 && sampleLimit < listSize)
+	{
+		stride = listSize / sampleLimit;
+	}
+
+	size_t index = 0;
+	size_t totalPath = 0;
+	for(Node * currentNode = bot_left->next; currentNode->next != nullptr; currentNode = currentNode->next, index++)
+	{
+		unsigned height = 1;
+		for(Node * above = currentNode->up; above != nullptr; above = above->up)
+		{
+			height++;
+		}
+		report.heightHistogram[height]++;
+		for(unsigned level = 0; level < height; level++)
+		{
+			report.nodesPerLevel[level]++;
+		}
+
+		if(index % stride == 0 && report.sampledKeys < (sampleLimit ? sampleLimit : listSize))
+		{
+			size_t path = searchPathLength(currentNode->key);
+			totalPath += path;
+			report.maxPathLength = std::max(report.maxPathLength, path);
+			report.sampledKeys++;
+		}
+	}
+
+	for(unsigned level = 0; level < layer_num; level++)
+	{
+		report.bytesPerLevel.push_back((report.nodesPerLevel[level] + 2) * sizeof(Node));
+	}
+
+	if(listSize == 0)
+	{
+		return report;
+	}
+
+	report.averagePathLength = static_cast<double>(totalPath) / report.sampledKeys;
+	report.expectedPathLength = 2 * std::log2(static_cast<double>(listSize)) + 2;
+
+	report.skewScore = geometricSkew(report.heightHistogram, listSize);
+	return report;
+}
+
+template<typename Key, typename Value>
+SkipListMemoryUsage SkipList<Key, Value>::memoryUsage() const
+{
+	SkipListMemoryUsage usage;
+	usage.nodeBytesPerLevel.assign(layer_num, 0);
+	size_t nodeSlack = allocationSize(sizeof(Node)) - sizeof(Node);
+
+	unsigned level = layer_num;
+	for(Node * layerLeft = top_left; layerLeft != nullptr; layerLeft = layerLeft->down)
+	{
+		level--;
+		for(Node * currentNode = layerLeft; currentNode != nullptr; currentNode = currentNode->next)
+		{
+			bool sentinel = currentNode == layerLeft || currentNode->next == nullptr;
+			if(sentinel)
+			{
+				usage.sentinelBytes += sizeof(Node);
+			}
+			else
+			{
+				usage.nodeBytesPerLevel[level] += sizeof(Node);
+			}
+			usage.allocatorSlackBytes += nodeSlack;
+
+			size_t keyBytes = heapBytes(currentNode->key);
+			size_t valueBytes = heapBytes(currentNode->value);
+			usage.keyHeapBytes += keyBytes;
+			usage.valueHeapBytes += valueBytes;
+			if(keyBytes != 0)
+			{
+				usage.allocatorSlackBytes += allocationSize(keyBytes) - keyBytes;
+			}
+			if(valueBytes != 0)
+			{
+				usage.allocatorSlackBytes += allocationSize(valueBytes) - valueBytes;
+			}
+		}
+	}
+	return usage;
+}
+
 template<typename Key, typename Value>
 void SkipList<Key, Value>::print() const 
 {
@@ -0,0 +1,269 @@
+#ifndef ___SKIP_LIST_BUILDER_HPP
+#define ___SKIP_LIST_BUILDER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "SkipList.hpp"
+#include "ThreadPool.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief Builds a SkipList from unsorted key/value pairs using every
+ * thread of a ThreadPool.
+ *
+ * Loading n keys with insert() costs n searches. The builder instead
+ *   1. sorts the input: each thread stable-sorts one chunk, then pairs of
+ *      sorted runs are merged in parallel, halving the run count per round;
+ *   2. computes every tower height with flipCoin, in parallel;
+ *   3. links one layer at a time: each thread creates the nodes of its
+ *      chunk that reach the layer and links them to each other, then the
+ *      chunk ends are stitched together in a short sequential pass.
+ *
+ * The result is the list insert() would build from the same pairs: keys
+ * get the same heights (capped for the final size, which only matters for
+ * keys flipCoin would promote forever) and, as with insert(), the first
+ * occurrence of a duplicated key wins.
+ *
+ *   ThreadPool pool;
+ *   SkipList<unsigned, unsigned> list;
+ *   SkipListBuilder<unsigned, unsigned>(pool).build(std::move(pairs), list);
+ */
+template<typename Key, typename Value>
+class SkipListBuilder
+{
+private:
+	using Node = typename SkipList<Key, Value>::Node;
+	using Item = std::pair<Key, Value>;
+
+	ThreadPool & pool;
+
+	static bool keyLess(const Item & a, const Item & b)
+	{
+		return a.first < b.first;
+	}
+
+	// Sorts by key, keeping items with equal keys in input order.
+	void parallelSort(std::vector<Item> & items);
+
+public:
+	explicit SkipListBuilder(ThreadPool & threads) : pool(threads) {}
+
+	// Fills `list` with `items`. Throws a RuntimeException if `list` is not
+	// empty.
+	void build(std::vector<Item> items, SkipList<Key, Value> & list);
+
+	// Like build(), for items already sorted by key, which skips the sort:
+	// O(n) work split over the pool. Throws a RuntimeException if `list` is
+	// not empty or the items are out of order.
+	void buildSorted(std::vector<Item> items, SkipList<Key, Value> & list);
+};
+
+template<typename Key, typename Value>
+void SkipListBuilder<Key, Value>::parallelSort(std::vector<Item> & items)
+{
+	std::vector<size_t> runStarts(pool.size() + 1, items.size());
+	pool.parallelFor(0, items.size(), [&](size_t chunk, size_t begin, size_t end)
+	{
+		runStarts[chunk] = begin;
+		std::stable_sort(items.begin() + begin, items.begin() + end, keyLess);
+	});
+
+	// runStarts[i]..runStarts[i + 1] is a sorted run; merge neighbours
+	// until one run is left.
+	while(runStarts.size() > 2)
+	{
+		size_t runs = runStarts.size() - 1;
+		size_t pairs = runs / 2;
+		pool.parallelFor(0, pairs, [&](size_t, size_t begin, size_t end)
+		{
+			for(size_t pair = begin; pair < end; pair++)
+			{
+				std::inplace_merge(items.begin() + runStarts[2 * pair],
+					items.begin() + runStarts[2 * pair + 1],
+					items.begin() + runStarts[2 * pair + 2], keyLess);
+			}
+		});
+		std::vector<size_t> merged;
+		for(size_t i = 0; i < runs; i += 2)
+		{
+			merged.push_back(runStarts[i]);
+		}
+		merged.push_back(items.size());
+		runStarts.swap(merged);
+	}
+}
+
+template<typename Key, typename Value>
+void SkipListBuilder<Key, Value>::build(std::vector<Item> items, SkipList<Key, Value> & list)
+{
+	if(!list.isEmpty())
+	{
+		throw RuntimeException("SkipListBuilder needs an empty list");
+	}
+	if(items.empty())
+	{
+		return;
+	}
+	parallelSort(items);
+	buildSorted(std::move(items), list);
+}
+
+template<typename Key, typename Value>
+void SkipListBuilder<Key, Value>::buildSorted(std::vector<Item> items, SkipList<Key, Value> & list)
+{
+	if(!list.isEmpty())
+	{
+		throw RuntimeException("SkipListBuilder needs an empty list");
+	}
+	if(items.empty())
+	{
+		return;
+	}
+
+	size_t n = items.size();
+	unsigned chunks = pool.size();
+
+	// Count distinct keys first: the height cap depends on the final size.
+	std::vector<size_t> distinctPerChunk(chunks, 0);
+	pool.parallelFor(0, n, [&](size_t chunk, size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; i++)
+		{
+			if(i == 0 || items[i - 1].first < items[i].first)
+			{
+				distinctPerChunk[chunk]++;
+			}
+			else if(items[i].first < items[i - 1].first)
+			{
+				throw RuntimeException("SkipListBuilder::buildSorted needs items sorted by key");
+			}
+		}
+	});
+	// S_0 position of the last key before each chunk, for node widths.
+	std::vector<size_t> positionBefore(chunks, 0);
+	size_t distinct = 0;
+	for(unsigned chunk = 0; chunk < chunks; chunk++)
+	{
+		positionBefore[chunk] = distinct;
+		distinct += distinctPerChunk[chunk];
+	}
+	unsigned maxLayers = list.max_layer_num;
+	if(distinct > 16)
+	{
+		maxLayers = 3 * std::ceil(std::log2(distinct)) + 1;
+	}
+
+	// Heights as insert() computes them; 0 marks a duplicate to skip.
+	std::vector<unsigned char> heights(n, 0);
+	std::vector<unsigned> tallestPerChunk(chunks, 1);
+	pool.parallelFor(0, n, [&](size_t chunk, size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; i++)
+		{
+			if(i != 0 && !(items[i - 1].first < items[i].first))
+			{
+				continue;
+			}
+			unsigned previousFlips = 0;
+			while(flipCoin(items[i].first, previousFlips) && previousFlips + 2 < maxLayers)
+			{
+				previousFlips++;
+			}
+			heights[i] = static_cast<unsigned char>(previousFlips + 1);
+			tallestPerChunk[chunk] = std::max(tallestPerChunk[chunk], previousFlips + 1);
+		}
+	});
+	unsigned tallest = *std::max_element(tallestPerChunk.begin(), tallestPerChunk.end());
+
+	// Sentinels: S_0 and S_1 come with the empty list, the rest are new.
+	// S_tallest stays empty, like the top layer of any SkipList.
+	std::vector<Node *> lefts(tallest + 1);
+	std::vector<Node *> rights(tallest + 1);
+	lefts[0] = list.bot_left;
+	rights[0] = list.bot_right;
+	lefts[1] = list.top_left;
+	rights[1] = list.top_right;
+	for(unsigned level = 2; level <= tallest; level++)
+	{
+		lefts[level] = new Node(Key(), Value(), nullptr, lefts[level - 1], nullptr);
+		rights[level] = new Node(Key(), Value(), nullptr, rights[level - 1], nullptr);
+		lefts[level - 1]->up = lefts[level];
+		rights[level - 1]->up = rights[level];
+		lefts[level]->next = rights[level];
+	}
+
+	// below[i] is the node of key i on the layer under the one being built.
+	std::vector<Node *> below(n, nullptr);
+	std::vector<Node *> firsts(chunks);
+	std::vector<Node *> lasts(chunks);
+	// S_0 positions of firsts and lasts, the left sentinel being 0.
+	std::vector<size_t> firstPositions(chunks);
+	std::vector<size_t> lastPositions(chunks);
+	for(unsigned level = 0; level < tallest; level++)
+	{
+		pool.parallelFor(0, n, [&](size_t chunk, size_t begin, size_t end)
+		{
+			Node * first = nullptr;
+			Node * last = nullptr;
+			size_t position = positionBefore[chunk];
+			for(size_t i = begin; i < end; i++)
+			{
+				if(heights[i] == 0)
+				{
+					continue;
+				}
+				position++;
+				if(heights[i] <= level)
+				{
+					continue;
+				}
+				Node * node = new Node(items[i].first, items[i].second, nullptr, below[i], nullptr);
+				if(below[i] != nullptr)
+				{
+					below[i]->up = node;
+				}
+				if(last != nullptr)
+				{
+					last->width = position - lastPositions[chunk];
+					last->next = node;
+				}
+				else
+				{
+					first = node;
+					firstPositions[chunk] = position;
+				}
+				last = node;
+				lastPositions[chunk] = position;
+				below[i] = node;
+			}
+			firsts[chunk] = first;
+			lasts[chunk] = last;
+		});
+
+		Node * previous = lefts[level];
+		size_t previousPosition = 0;
+		for(unsigned chunk = 0; chunk < chunks; chunk++)
+		{
+			if(firsts[chunk] != nullptr)
+			{
+				previous->next = firsts[chunk];
+				previous->width = firstPositions[chunk] - previousPosition;
+				previous = lasts[chunk];
+				previousPosition = lastPositions[chunk];
+			}
+		}
+		previous->next = rights[level];
+		previous->width = distinct + 1 - previousPosition;
+	}
+	lefts[tallest]->width = distinct + 1;
+
+	list.top_left = lefts[tallest];
+	list.top_right = rights[tallest];
+	list.layer_num = std::max(tallest + 1, 2u);
+	list.max_layer_num = maxLayers;
+	list.listSize = distinct;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "catch_amalgamated.hpp"
+#include "SkipListBuilder.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace{
+
+	template<typename Key>
+	void requireSameList(SkipList<Key, unsigned> & built, SkipList<Key, unsigned> & inserted)
+	{
+		// insert() capped early keys at height 12, while the list was small;
+		// the builder caps for the final size. Below that they must agree.
+		const unsigned earlyCap = 12;
+		REQUIRE(built.size() == inserted.size());
+		REQUIRE(built.numLayers() >= inserted.numLayers());
+		REQUIRE(built.allKeysInOrder() == inserted.allKeysInOrder());
+		for(const Key & k : inserted.allKeysInOrder())
+		{
+			if(inserted.height(k) < earlyCap)
+			{
+				REQUIRE(built.height(k) == inserted.height(k));
+			}
+			else
+			{
+				REQUIRE(built.height(k) >= inserted.height(k));
+			}
+			REQUIRE(built.find(k) == inserted.find(k));
+		}
+		SkipListStructureReport a = built.structureReport();
+		SkipListStructureReport b = inserted.structureReport();
+		for(unsigned level = 0; level < earlyCap && level < b.nodesPerLevel.size(); level++)
+		{
+			REQUIRE(a.nodesPerLevel[level] == b.nodesPerLevel[level]);
+		}
+	}
+
+	TEST_CASE("BuilderMatchesInsertTest", "[BuilderTests]")
+	{
+		std::mt19937 rng(3);
+		std::vector<std::pair<unsigned, unsigned>> items;
+		for(unsigned i = 0; i < 5000; i++)
+		{
+			// About one key in five is a duplicate; the first copy must win.
+			items.emplace_back(rng() % 20000, i);
+		}
+		SkipList<unsigned, unsigned> inserted;
+		for(const auto & item : items)
+		{
+			inserted.insert(item.first, item.second);
+		}
+
+		ThreadPool pool(4);
+		SkipList<unsigned, unsigned> built;
+		SkipListBuilder<unsigned, unsigned>(pool).build(items, built);
+		requireSameList(built, inserted);
+
+		// The built list keeps working like any other.
+		REQUIRE(built.insert(20001, 7));
+		REQUIRE(built.find(20001) == 7);
+		REQUIRE(built.isLargestKey(20001));
+		std::vector<unsigned> keys = built.allKeysInOrder();
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(built.rank(keys[i]) == i);
+		}
+	}
+
+	TEST_CASE("BuilderStringTest", "[BuilderTests]")
+	{
+		std::vector<std::pair<std::string, unsigned>> items;
+		for(unsigned i = 0; i < 500; i++)
+		{
+			items.emplace_back("key" + std::to_string((i * 7) % 499), i);
+		}
+		SkipList<std::string, unsigned> inserted;
+		for(const auto & item : items)
+		{
+			inserted.insert(item.first, item.second);
+		}
+		ThreadPool pool(3);
+		SkipList<std::string, unsigned> built;
+		SkipListBuilder<std::string, unsigned>(pool).build(items, built);
+		requireSameList(built, inserted);
+	}
+
+	TEST_CASE("BuilderEdgeCasesTest", "[BuilderTests]")
+	{
+		ThreadPool pool(4);
+		SkipListBuilder<unsigned, unsigned> builder(pool);
+
+		SkipList<unsigned, unsigned> empty;
+		builder.build({}, empty);
+		REQUIRE(empty.isEmpty());
+		REQUIRE(empty.numLayers() == 2);
+
+		// Fewer items than threads.
+		SkipList<unsigned, unsigned> small;
+		builder.build({{3, 30}, {1, 10}}, small);
+		REQUIRE(small.allKeysInOrder() == std::vector<unsigned>{1, 3});
+		REQUIRE(small.height(3) == 3);
+
+		REQUIRE_THROWS_AS(builder.build({{5, 5}}, small), RuntimeException);
+
+		// buildSorted() takes sorted items as they are and rejects the rest.
+		SkipList<unsigned, unsigned> sorted;
+		builder.buildSorted({{1, 10}, {1, 11}, {2, 20}, {7, 70}}, sorted);
+		REQUIRE(sorted.allKeysInOrder() == std::vector<unsigned>{1, 2, 7});
+		REQUIRE(sorted.find(1) == 10);
+		SkipList<unsigned, unsigned> unsorted;
+		REQUIRE_THROWS_AS(builder.buildSorted({{1, 10}, {7, 70}, {2, 20}}, unsorted), RuntimeException);
+	}
+
+	TEST_CASE("ThreadPoolTest", "[BuilderTests]")
+	{
+		ThreadPool pool(4);
+		REQUIRE(pool.size() == 4);
+		std::vector<unsigned> seen(1000, 0);
+		std::atomic<unsigned> calls{0};
+		pool.parallelFor(0, seen.size(), [&](size_t, size_t begin, size_t end)
+		{
+			calls++;
+			for(size_t i = begin; i < end; i++)
+			{
+				seen[i]++;
+			}
+		});
+		REQUIRE(calls.load() == 4);
+		REQUIRE(std::count(seen.begin(), seen.end(), 1u) == 1000);
+
+		REQUIRE_THROWS_AS(pool.parallelFor(0, 8, [](size_t chunk, size_t, size_t)
+		{
+			if(chunk == 2)
+			{
+				throw RuntimeException("chunk failed");
+			}
+		}), RuntimeException);
+	}
+
+}
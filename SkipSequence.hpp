@@ -0,0 +1,376 @@
+#ifndef ___SKIP_SEQUENCE_HPP
+#define ___SKIP_SEQUENCE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <vector>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief A sequence indexed by position, with insert, erase and access at
+ * any index in O(log n) expected: a skip list ordered by position instead
+ * of by key.
+ *
+ * Nothing stores an element's index. Like SkipList's node widths, every
+ * link records how many elements it steps over, counting the one it lands
+ * on; a link to the end counts up to one past the last element. A search
+ * for index i walks right while the widths it sums stay at or below i + 1
+ * and drops a layer otherwise, and an insert or erase adjusts the widths
+ * along that one search path, so nothing after the change is shifted.
+ *
+ * Elements have no key to hand towerHeight(), so a counter that advances
+ * with every insert stands in for one (see nextHeight()). Not
+ * thread-safe.
+ *
+ *   SkipSequence<std::string> playlist;
+ *   playlist.pushBack("intro");
+ *   playlist.pushBack("outro");
+ *   playlist.insert(1, "track 1");     // intro, track 1, outro
+ */
+template<typename T>
+class SkipSequence
+{
+public:
+	// Layers available to towers, S_0 included.
+	static const unsigned maxLevel = 32;
+
+private:
+	struct Node;
+
+	struct Link
+	{
+		Node * next = nullptr;
+		size_t width = 1;
+	};
+
+	// The tower of links is allocated right behind the node.
+	struct Node
+	{
+		T value;
+		unsigned height;
+
+		Node(const T & v, unsigned h) : value(v), height(h)
+		{
+		}
+
+		static size_t linksOffset()
+		{
+			return (sizeof(Node) + alignof(Link) - 1) / alignof(Link) * alignof(Link);
+		}
+
+		Link * links()
+		{
+			return reinterpret_cast<Link *>(reinterpret_cast<char *>(this) + linksOffset());
+		}
+
+		const Link * links() const
+		{
+			return reinterpret_cast<const Link *>(reinterpret_cast<const char *>(this) + linksOffset());
+		}
+
+		static Node * create(const T & v, unsigned height)
+		{
+			void * memory = ::operator new(linksOffset() + height * sizeof(Link));
+			Node * node = new(memory) Node(v, height);
+			for(unsigned level = 0; level < height; level++)
+			{
+				new(&node->links()[level]) Link();
+			}
+			return node;
+		}
+
+		static void destroy(Node * node)
+		{
+			node->~Node();
+			::operator delete(node);
+		}
+	};
+
+	// Sentinel at position 0, before the first element, with a full tower.
+	Node * head;
+	// Layers holding at least one element, at least 1.
+	unsigned levels = 1;
+	size_t listSize = 0;
+	// Passed to towerHeight() in place of a key, one value per insert.
+	unsigned serial = 0;
+
+	unsigned nextHeight()
+	{
+		return towerHeight(serial++, maxLevel);
+	}
+
+	// Fills preds with the last node before position `target` (the head is
+	// position 0, element i is position i + 1) on every layer in use, and
+	// positions with their positions. Returns the node at `target`.
+	Node * search(size_t target, Node ** preds, size_t * positions) const;
+
+	static void outOfRange()
+	{
+		throw RuntimeException("Sequence index out of range");
+	}
+
+public:
+	// Forward iterator over the elements in order. *it is the element.
+	// Stays valid across insert() and erase() of other elements.
+	class const_iterator
+	{
+	private:
+		const Node * node = nullptr;
+
+		friend class SkipSequence;
+		explicit const_iterator(const Node * n) : node(n) {}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const T *;
+		using reference = const T &;
+
+		const_iterator() = default;
+
+		const T & operator*() const { return node->value; }
+		const T * operator->() const { return &node->value; }
+
+		const_iterator & operator++()
+		{
+			node = node->links()[0].next;
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator previous = *this;
+			++*this;
+			return previous;
+		}
+
+		bool operator==(const const_iterator & other) const { return node == other.node; }
+		bool operator!=(const const_iterator & other) const { return node != other.node; }
+	};
+
+	SkipSequence();
+
+	~SkipSequence();
+
+	SkipSequence(const SkipSequence &) = delete;
+	SkipSequence & operator=(const SkipSequence &) = delete;
+
+	size_t size() const noexcept
+	{
+		return listSize;
+	}
+
+	bool isEmpty() const noexcept
+	{
+		return listSize == 0;
+	}
+
+	// The element at index i. Throw a RuntimeException if i >= size().
+	T & at(size_t i);
+	const T & at(size_t i) const;
+
+	// Inserts v so that it becomes element i; the elements from i on move
+	// up by one. i == size() appends. Throws a RuntimeException if
+	// i > size().
+	void insert(size_t i, const T & v);
+
+	void pushBack(const T & v)
+	{
+		insert(listSize, v);
+	}
+
+	void pushFront(const T & v)
+	{
+		insert(0, v);
+	}
+
+	// Removes element i; the elements after it move down by one. Throws a
+	// RuntimeException if i >= size().
+	void erase(size_t i);
+
+	// An iterator at element i, or end() if i >= size(), found in one
+	// search; walking on from it reads a slice in O(log n + length).
+	const_iterator iteratorAt(size_t i) const;
+
+	const_iterator begin() const;
+
+	const_iterator end() const;
+
+	std::vector<T> toVector() const;
+};
+
+template<typename T>
+SkipSequence<T>::SkipSequence()
+	: head(Node::create(T(), maxLevel))
+{
+}
+
+template<typename T>
+SkipSequence<T>::~SkipSequence()
+{
+	Node * node = head;
+	while(node != nullptr)
+	{
+		Node * next = node->links()[0].next;
+		Node::destroy(node);
+		node = next;
+	}
+}
+
+template<typename T>
+typename SkipSequence<T>::Node * SkipSequence<T>::search(size_t target, Node ** preds, size_t * positions) const
+{
+	Node * node = head;
+	size_t position = 0;
+	for(int level = static_cast<int>(levels) - 1; level >= 0; level--)
+	{
+		const Link * link = &node->links()[level];
+		while(link->next != nullptr && position + link->width < target)
+		{
+			position += link->width;
+			node = link->next;
+			link = &node->links()[level];
+		}
+		preds[level] = node;
+		positions[level] = position;
+	}
+	return node->links()[0].next;
+}
+
+template<typename T>
+T & SkipSequence<T>::at(size_t i)
+{
+	if(i >= listSize)
+	{
+		outOfRange();
+	}
+	Node * preds[maxLevel];
+	size_t positions[maxLevel];
+	return search(i + 1, preds, positions)->value;
+}
+
+template<typename T>
+const T & SkipSequence<T>::at(size_t i) const
+{
+	if(i >= listSize)
+	{
+		outOfRange();
+	}
+	Node * preds[maxLevel];
+	size_t positions[maxLevel];
+	return search(i + 1, preds, positions)->value;
+}
+
+template<typename T>
+void SkipSequence<T>::insert(size_t i, const T & v)
+{
+	if(i > listSize)
+	{
+		outOfRange();
+	}
+	unsigned height = nextHeight();
+	// A layer coming into use starts as one link from the head to the end.
+	for(unsigned level = levels; level < height; level++)
+	{
+		head->links()[level].next = nullptr;
+		head->links()[level].width = listSize + 1;
+	}
+	levels = std::max(levels, height);
+
+	Node * preds[maxLevel];
+	size_t positions[maxLevel];
+	search(i + 1, preds, positions);
+	Node * node = Node::create(v, height);
+	for(unsigned level = 0; level < levels; level++)
+	{
+		Link & predLink = preds[level]->links()[level];
+		if(level < height)
+		{
+			// The old link landed at positions[level] + width, one further
+			// along now; the new node sits at i + 1 and takes over the rest.
+			Link & link = node->links()[level];
+			link.next = predLink.next;
+			link.width = positions[level] + predLink.width - i;
+			predLink.next = node;
+			predLink.width = i + 1 - positions[level];
+		}
+		else
+		{
+			predLink.width++;
+		}
+	}
+	listSize++;
+}
+
+template<typename T>
+void SkipSequence<T>::erase(size_t i)
+{
+	if(i >= listSize)
+	{
+		outOfRange();
+	}
+	Node * preds[maxLevel];
+	size_t positions[maxLevel];
+	Node * node = search(i + 1, preds, positions);
+	for(unsigned level = 0; level < levels; level++)
+	{
+		Link & predLink = preds[level]->links()[level];
+		if(level < node->height)
+		{
+			predLink.width += node->links()[level].width - 1;
+			predLink.next = node->links()[level].next;
+		}
+		else
+		{
+			predLink.width--;
+		}
+	}
+	Node::destroy(node);
+	listSize--;
+	while(levels > 1 && head->links()[levels - 1].next == nullptr)
+	{
+		levels--;
+	}
+}
+
+template<typename T>
+typename SkipSequence<T>::const_iterator SkipSequence<T>::iteratorAt(size_t i) const
+{
+	if(i >= listSize)
+	{
+		return end();
+	}
+	Node * preds[maxLevel];
+	size_t positions[maxLevel];
+	return const_iterator(search(i + 1, preds, positions));
+}
+
+template<typename T>
+typename SkipSequence<T>::const_iterator SkipSequence<T>::begin() const
+{
+	return const_iterator(head->links()[0].next);
+}
+
+template<typename T>
+typename SkipSequence<T>::const_iterator SkipSequence<T>::end() const
+{
+	return const_iterator(nullptr);
+}
+
+template<typename T>
+std::vector<T> SkipSequence<T>::toVector() const
+{
+	std::vector<T> out;
+	out.reserve(listSize);
+	for(const T & v : *this)
+	{
+		out.push_back(v);
+	}
+	return out;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "catch_amalgamated.hpp"
+#include "SkipSequence.hpp"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace{
+
+	TEST_CASE("SequenceBasicTest", "[SequenceTests]")
+	{
+		SkipSequence<std::string> playlist;
+		REQUIRE(playlist.isEmpty());
+		REQUIRE(playlist.begin() == playlist.end());
+		playlist.pushBack("intro");
+		playlist.pushBack("outro");
+		playlist.insert(1, "track 1");
+		playlist.insert(2, "track 2");
+		playlist.pushFront("warmup");
+		REQUIRE(playlist.size() == 5);
+		REQUIRE(playlist.toVector() == std::vector<std::string>{"warmup", "intro", "track 1", "track 2", "outro"});
+		REQUIRE(playlist.at(2) == "track 1");
+		playlist.at(2) = "track one";
+		REQUIRE(*playlist.iteratorAt(2) == "track one");
+		REQUIRE(playlist.iteratorAt(5) == playlist.end());
+
+		playlist.erase(0);
+		playlist.erase(3);
+		REQUIRE(playlist.toVector() == std::vector<std::string>{"intro", "track one", "track 2"});
+		REQUIRE_THROWS_AS(playlist.at(3), RuntimeException);
+		REQUIRE_THROWS_AS(playlist.erase(3), RuntimeException);
+		REQUIRE_THROWS_AS(playlist.insert(4, "late"), RuntimeException);
+		REQUIRE(playlist.size() == 3);
+	}
+
+	TEST_CASE("SequenceMatchesVectorTest", "[SequenceTests]")
+	{
+		SkipSequence<unsigned> sequence;
+		std::vector<unsigned> model;
+		std::mt19937 rng(23);
+		for(unsigned step = 0; step < 30000; step++)
+		{
+			unsigned choice = rng() % 10;
+			if(model.empty() || choice < 5)
+			{
+				size_t i = rng() % (model.size() + 1);
+				sequence.insert(i, step);
+				model.insert(model.begin() + i, step);
+			}
+			else if(choice < 8)
+			{
+				size_t i = rng() % model.size();
+				sequence.erase(i);
+				model.erase(model.begin() + i);
+			}
+			else
+			{
+				size_t i = rng() % model.size();
+				REQUIRE(sequence.at(i) == model[i]);
+			}
+		}
+		REQUIRE(sequence.size() == model.size());
+		REQUIRE(sequence.toVector() == model);
+		for(size_t i = 0; i < model.size(); i += 17)
+		{
+			REQUIRE(sequence.at(i) == model[i]);
+		}
+
+		// A slice read from one search.
+		size_t first = model.size() / 3;
+		auto it = sequence.iteratorAt(first);
+		for(size_t i = first; i < first + 100 && i < model.size(); i++, ++it)
+		{
+			REQUIRE(*it == model[i]);
+		}
+
+		while(!model.empty())
+		{
+			size_t i = model.size() / 2;
+			sequence.erase(i);
+			model.erase(model.begin() + i);
+		}
+		REQUIRE(sequence.isEmpty());
+		sequence.pushBack(7);
+		REQUIRE(sequence.at(0) == 7);
+	}
+
+	TEST_CASE("SequenceMiddleInsertTest", "[SequenceTests]")
+	{
+		// Always inserting in the middle: element i ends up at a known place.
+		SkipSequence<unsigned> sequence;
+		const unsigned n = 100000;
+		for(unsigned i = 0; i < n; i++)
+		{
+			sequence.insert(sequence.size() / 2, i);
+		}
+		REQUIRE(sequence.size() == n);
+		std::vector<unsigned> values = sequence.toVector();
+		// Odd values fill the front in increasing order, even values the back
+		// in decreasing order.
+		REQUIRE(values.front() == 1);
+		REQUIRE(values[n / 2 - 1] == n - 1);
+		REQUIRE(values[n / 2] == n - 2);
+		REQUIRE(values.back() == 0);
+		for(size_t i = 0; i < n; i += 997)
+		{
+			REQUIRE(sequence.at(i) == values[i]);
+		}
+	}
+}
@@ -0,0 +1,286 @@
+#ifndef ___SORTED_SET_HPP
+#define ___SORTED_SET_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+// An entry of a SortedSet, ordered by score and then by member, as Redis
+// orders the members of a sorted set.
+struct ScoredMember
+{
+	double score = 0;
+	std::string member;
+
+	ScoredMember() = default;
+	ScoredMember(double s, const std::string & m) : score(s), member(m) {}
+};
+
+inline bool operator<(const ScoredMember & a, const ScoredMember & b)
+{
+	return a.score < b.score || (a.score == b.score && a.member < b.member);
+}
+
+inline bool operator==(const ScoredMember & a, const ScoredMember & b)
+{
+	return a.score == b.score && a.member == b.member;
+}
+
+inline bool operator!=(const ScoredMember & a, const ScoredMember & b)
+{
+	return !(a == b);
+}
+
+inline bool operator<=(const ScoredMember & a, const ScoredMember & b)
+{
+	return !(b < a);
+}
+
+/**
+ * @brief XORs the characters of the member with the bytes of the score,
+ * then flips the coin like the string version.
+ *
+ * Members are unique within a set, so the member alone would already tell
+ * entries apart; the score is mixed in so that sets whose members XOR
+ * alike, such as "a1" and "b2", still get varied heights.
+ *
+ * @param key entry that will be inserted into the skip list
+ * @param previousFlips number of previous flips for this key
+ * @return true simulates a "heads" from a coin flip
+ * @return false simulates a "tails" from a coin flip
+ */
+inline bool flipCoin(const ScoredMember & key, unsigned previousFlips)
+{
+	unsigned char bytes[sizeof(double)];
+	std::memcpy(bytes, &key.score, sizeof(bytes));
+	char c = 0;
+	for(unsigned char b : bytes)
+	{
+		c = c ^ static_cast<char>(b);
+	}
+	for(char m : key.member)
+	{
+		c = c ^ m;
+	}
+	previousFlips = previousFlips % 8;
+	return ( c & (1 << previousFlips) ) != 0;
+}
+
+/**
+ * @brief The characters of the member, for SkipList::memoryUsage().
+ */
+inline size_t heapBytes(const ScoredMember & entry)
+{
+	return heapBytes(entry.member);
+}
+
+/**
+ * @brief A Redis-style sorted set: unique string members, each with a
+ * score, kept in (score, member) order.
+ *
+ * Entries live in a SkipList keyed by ScoredMember, whose node widths give
+ * ranks and positional lookups in one search, and a hash map from member
+ * to score finds an entry's key in the list. Both are updated together by
+ * every call, so they never disagree. The commands map onto:
+ *
+ *   ZADD           add()            O(log n)
+ *   ZREM           remove()         O(log n)
+ *   ZSCORE         score()          O(1)
+ *   ZRANK          rank()           O(log n)
+ *   ZRANGE         range()          O(log n + m) for m entries returned
+ *   ZRANGEBYSCORE  rangeByScore()   O(log n + m)
+ *   ZINCRBY        incrementBy()    O(log n)
+ *
+ * A score change moves the entry: its old key is erased from the list and
+ * the new one inserted. Scores must not be NaN; -inf and inf are allowed.
+ * Not thread-safe.
+ */
+class SortedSet
+{
+private:
+	// The list is used as a set: the value is unused.
+	SkipList<ScoredMember, bool> entries;
+	std::unordered_map<std::string, double> scores;
+
+	static void checkScore(double score)
+	{
+		if(std::isnan(score))
+		{
+			throw RuntimeException("Score is not a number");
+		}
+	}
+
+public:
+	// Sets the score of member, adding it if absent. Returns true if the
+	// member was added, false if it was already present. Throws a
+	// RuntimeException if score is NaN.
+	bool add(const std::string & member, double score);
+
+	// Returns true if member was removed, false if it was absent.
+	bool remove(const std::string & member);
+
+	bool contains(const std::string & member) const;
+
+	// Copies the score of member into out and returns true, or returns false.
+	bool score(const std::string & member, double & out) const;
+
+	// The score of member; throws a RuntimeException if it is absent.
+	double score(const std::string & member) const;
+
+	// The number of entries ordered before member, so the lowest scored
+	// member has rank 0. Throws a RuntimeException if member is absent.
+	size_t rank(const std::string & member) const;
+
+	// The entries from rank start to rank stop, both included. As in Redis,
+	// negative indexes count from the end (-1 is the highest scored entry),
+	// and out-of-range indexes are clamped; an empty range returns nothing.
+	std::vector<ScoredMember> range(long long start, long long stop) const;
+
+	// The entries with min <= score <= max, in order, at most limit of them.
+	std::vector<ScoredMember> rangeByScore(double min, double max, size_t limit = static_cast<size_t>(-1)) const;
+
+	// Adds delta to the score of member, adding the member with score delta
+	// if it is absent. Returns the new score. Throws a RuntimeException,
+	// leaving the set unchanged, if the new score would be NaN.
+	double incrementBy(const std::string & member, double delta);
+
+	size_t size() const noexcept
+	{
+		return scores.size();
+	}
+
+	bool isEmpty() const noexcept
+	{
+		return scores.empty();
+	}
+
+	// The list holding the entries, for iteration and inspection.
+	const SkipList<ScoredMember, bool> & list() const noexcept
+	{
+		return entries;
+	}
+};
+
+inline bool SortedSet::add(const std::string & member, double score)
+{
+	checkScore(score);
+	auto found = scores.find(member);
+	if(found == scores.end())
+	{
+		entries.insert(ScoredMember(score, member), true);
+		scores.emplace(member, score);
+		return true;
+	}
+	if(found->second != score)
+	{
+		entries.erase(ScoredMember(found->second, member));
+		entries.insert(ScoredMember(score, member), true);
+		found->second = score;
+	}
+	return false;
+}
+
+inline bool SortedSet::remove(const std::string & member)
+{
+	auto found = scores.find(member);
+	if(found == scores.end())
+	{
+		return false;
+	}
+	entries.erase(ScoredMember(found->second, member));
+	scores.erase(found);
+	return true;
+}
+
+inline bool SortedSet::contains(const std::string & member) const
+{
+	return scores.count(member) != 0;
+}
+
+inline bool SortedSet::score(const std::string & member, double & out) const
+{
+	auto found = scores.find(member);
+	if(found == scores.end())
+	{
+		return false;
+	}
+	out = found->second;
+	return true;
+}
+
+inline double SortedSet::score(const std::string & member) const
+{
+	double out;
+	if(!score(member, out))
+	{
+		throw RuntimeException("Member not found: " + member);
+	}
+	return out;
+}
+
+inline size_t SortedSet::rank(const std::string & member) const
+{
+	return entries.rank(ScoredMember(score(member), member));
+}
+
+inline std::vector<ScoredMember> SortedSet::range(long long start, long long stop) const
+{
+	long long count = static_cast<long long>(size());
+	if(start < 0)
+	{
+		start += count;
+	}
+	if(stop < 0)
+	{
+		stop += count;
+	}
+	if(start < 0)
+	{
+		start = 0;
+	}
+	if(stop >= count)
+	{
+		stop = count - 1;
+	}
+	std::vector<ScoredMember> out;
+	if(start > stop)
+	{
+		return out;
+	}
+	out.reserve(static_cast<size_t>(stop - start + 1));
+	auto it = entries.atRank(static_cast<size_t>(start));
+	for(long long i = start; i <= stop; i++, ++it)
+	{
+		out.push_back(*it);
+	}
+	return out;
+}
+
+inline std::vector<ScoredMember> SortedSet::rangeByScore(double min, double max, size_t limit) const
+{
+	checkScore(min);
+	checkScore(max);
+	std::vector<ScoredMember> out;
+	// The empty member orders first among entries with the same score.
+	for(auto it = entries.lowerBound(ScoredMember(min, "")); it != entries.end() && it->score <= max && out.size() < limit; ++it)
+	{
+		out.push_back(*it);
+	}
+	return out;
+}
+
+inline double SortedSet::incrementBy(const std::string & member, double delta)
+{
+	double current = 0;
+	score(member, current);
+	double updated = current + delta;
+	add(member, updated);
+	return updated;
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include "catch_amalgamated.hpp"
+#include "SortedSet.hpp"
+#include <cmath>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace{
+
+	std::vector<ScoredMember> contentsOf(const SortedSet & set)
+	{
+		std::vector<ScoredMember> out;
+		for(auto it = set.list().begin(); it != set.list().end(); ++it)
+		{
+			out.push_back(*it);
+		}
+		return out;
+	}
+
+	TEST_CASE("SortedSetBasicTest", "[SortedSetTests]")
+	{
+		SortedSet set;
+		REQUIRE(set.add("carol", 3));
+		REQUIRE(set.add("alice", 1));
+		REQUIRE(set.add("bob", 2));
+		REQUIRE(set.add("dave", 2));
+		REQUIRE_FALSE(set.add("alice", 1));
+		REQUIRE(set.size() == 4);
+
+		// Ties on score are ordered by member.
+		std::vector<ScoredMember> all = set.range(0, -1);
+		REQUIRE(all.size() == 4);
+		REQUIRE(all[0].member == "alice");
+		REQUIRE(all[1].member == "bob");
+		REQUIRE(all[2].member == "dave");
+		REQUIRE(all[3].member == "carol");
+		REQUIRE(set.rank("dave") == 2);
+
+		// A new score moves the member.
+		REQUIRE_FALSE(set.add("alice", 5));
+		REQUIRE(set.score("alice") == 5);
+		REQUIRE(set.rank("alice") == 3);
+		REQUIRE(set.rank("bob") == 0);
+		REQUIRE(set.list().size() == 4);
+
+		REQUIRE(set.remove("bob"));
+		REQUIRE_FALSE(set.remove("bob"));
+		REQUIRE_FALSE(set.contains("bob"));
+		double ignored;
+		REQUIRE_FALSE(set.score("bob", ignored));
+		REQUIRE_THROWS_AS(set.score("bob"), RuntimeException);
+		REQUIRE_THROWS_AS(set.rank("bob"), RuntimeException);
+		REQUIRE(set.size() == 3);
+		REQUIRE(set.list().size() == 3);
+	}
+
+	TEST_CASE("SortedSetRangeTest", "[SortedSetTests]")
+	{
+		SortedSet set;
+		for(int i = 0; i < 10; i++)
+		{
+			set.add("m" + std::to_string(i), i * 10);
+		}
+		REQUIRE(set.range(0, 2).size() == 3);
+		REQUIRE(set.range(0, 2)[2].member == "m2");
+		REQUIRE(set.range(-2, -1).size() == 2);
+		REQUIRE(set.range(-2, -1)[0].member == "m8");
+		REQUIRE(set.range(-100, 100).size() == 10);
+		REQUIRE(set.range(5, 3).empty());
+		REQUIRE(set.range(10, 20).empty());
+		REQUIRE(set.range(-1, -2).empty());
+		REQUIRE(SortedSet().range(0, -1).empty());
+
+		std::vector<ScoredMember> scored = set.rangeByScore(15, 40);
+		REQUIRE(scored.size() == 3);
+		REQUIRE(scored[0].member == "m2");
+		REQUIRE(scored[2].member == "m4");
+		REQUIRE(set.rangeByScore(20, 20).size() == 1);
+		REQUIRE(set.rangeByScore(-INFINITY, INFINITY).size() == 10);
+		REQUIRE(set.rangeByScore(0, 90, 4).size() == 4);
+		REQUIRE(set.rangeByScore(41, 49).empty());
+		REQUIRE(set.rangeByScore(50, 10).empty());
+	}
+
+	TEST_CASE("SortedSetIncrementTest", "[SortedSetTests]")
+	{
+		SortedSet set;
+		REQUIRE(set.incrementBy("x", 2.5) == 2.5);
+		REQUIRE(set.incrementBy("x", -1) == 1.5);
+		set.add("y", 2);
+		REQUIRE(set.rank("x") == 0);
+		REQUIRE(set.incrementBy("x", 1) == 2.5);
+		REQUIRE(set.rank("x") == 1);
+		REQUIRE(set.list().size() == 2);
+
+		// Scores must stay numbers.
+		REQUIRE_THROWS_AS(set.add("z", NAN), RuntimeException);
+		set.add("inf", INFINITY);
+		REQUIRE_THROWS_AS(set.incrementBy("inf", -INFINITY), RuntimeException);
+		REQUIRE(set.score("inf") == INFINITY);
+		REQUIRE(set.size() == 3);
+		REQUIRE_FALSE(set.contains("z"));
+	}
+
+	TEST_CASE("SortedSetMatchesModelTest", "[SortedSetTests]")
+	{
+		SortedSet set;
+		std::map<std::string, double> model;
+		std::mt19937 rng(17);
+		for(int step = 0; step < 20000; step++)
+		{
+			std::string member = "user:" + std::to_string(rng() % 500);
+			double score = static_cast<double>(rng() % 100);
+			switch(rng() % 4)
+			{
+				case 0:
+				case 1:
+					REQUIRE(set.add(member, score) == (model.count(member) == 0));
+					model[member] = score;
+					break;
+				case 2:
+					REQUIRE(set.remove(member) == (model.erase(member) != 0));
+					break;
+				case 3:
+					model[member] += score;
+					REQUIRE(set.incrementBy(member, score) == model[member]);
+					break;
+			}
+		}
+
+		std::set<std::pair<double, std::string>> ordered;
+		for(const auto & entry : model)
+		{
+			ordered.emplace(entry.second, entry.first);
+		}
+		std::vector<ScoredMember> contents = contentsOf(set);
+		REQUIRE(contents.size() == ordered.size());
+		REQUIRE(set.size() == ordered.size());
+		size_t i = 0;
+		for(const auto & entry : ordered)
+		{
+			REQUIRE(contents[i].score == entry.first);
+			REQUIRE(contents[i].member == entry.second);
+			REQUIRE(set.rank(entry.second) == i);
+			REQUIRE(set.range(i, i)[0].member == entry.second);
+			i++;
+		}
+
+		std::vector<ScoredMember> scored = set.rangeByScore(100, 200);
+		auto first = ordered.lower_bound(std::make_pair(100.0, std::string()));
+		auto last = ordered.upper_bound(std::make_pair(200.0, std::string(1, '\xff')));
+		REQUIRE(scored.size() == static_cast<size_t>(std::distance(first, last)));
+		for(const ScoredMember & entry : scored)
+		{
+			REQUIRE(entry.score == first->first);
+			REQUIRE(entry.member == first->second);
+			++first;
+		}
+	}
+}
@@ -0,0 +1,157 @@
+#ifndef ___THREAD_POOL_HPP
+#define ___THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads for fork-join loops.
+ *
+ * The pool is meant for data-parallel phases such as bulk construction:
+ * parallelFor() splits a range into one contiguous chunk per thread, runs
+ * the chunks on the workers and the calling thread, and returns once all
+ * of them have finished. An exception thrown by any chunk is rethrown from
+ * parallelFor() after the others complete. Chunks must not call
+ * parallelFor() on the same pool: the workers they would wait for may all
+ * be busy running chunks of the outer loop.
+ *
+ *   ThreadPool pool;                        // one thread per core
+ *   pool.parallelFor(0, n, [&](size_t chunk, size_t begin, size_t end)
+ *   {
+ *       for(size_t i = begin; i < end; i++) { ... }
+ *   });
+ */
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void workerLoop()
+	{
+		while(true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [this]() { return stopping || !tasks.empty(); });
+				if(tasks.empty())
+				{
+					return;
+				}
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+public:
+	// A pool that runs `threads` chunks at once: the caller of parallelFor()
+	// plus threads - 1 workers. Zero picks std::thread::hardware_concurrency().
+	explicit ThreadPool(unsigned threads = 0)
+	{
+		if(threads == 0)
+		{
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for(unsigned i = 1; i < threads; i++)
+		{
+			workers.emplace_back([this]() { workerLoop(); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(std::thread & worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+
+	// Chunks parallelFor() splits a range into, at most.
+	unsigned size() const noexcept
+	{
+		return static_cast<unsigned>(workers.size() + 1);
+	}
+
+	// Calls fn(chunk, chunkBegin, chunkEnd) for size() contiguous chunks
+	// covering [begin, end) in order, and waits for all of them. Chunk
+	// numbers run from 0; ranges shorter than size() give empty chunks,
+	// which are still called, so per-chunk results can be indexed by chunk.
+	template<typename Fn>
+	void parallelFor(size_t begin, size_t end, Fn fn)
+	{
+		size_t chunks = size();
+		size_t length = end > begin ? end - begin : 0;
+		auto bounds = [&](size_t chunk) { return begin + length * chunk / chunks; };
+
+		std::mutex doneLock;
+		std::condition_variable doneWake;
+		size_t pending = chunks - 1;
+		std::exception_ptr failure;
+
+		auto runChunk = [&](size_t chunk)
+		{
+			try
+			{
+				fn(chunk, bounds(chunk), bounds(chunk + 1));
+			}
+			catch(...)
+			{
+				std::lock_guard<std::mutex> guard(doneLock);
+				if(!failure)
+				{
+					failure = std::current_exception();
+				}
+			}
+		};
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for(size_t chunk = 1; chunk < chunks; chunk++)
+			{
+				tasks.emplace_back([&, chunk]()
+				{
+					runChunk(chunk);
+					std::lock_guard<std::mutex> guard(doneLock);
+					if(--pending == 0)
+					{
+						doneWake.notify_one();
+					}
+				});
+			}
+		}
+		wake.notify_all();
+
+		runChunk(0);
+		{
+			std::unique_lock<std::mutex> guard(doneLock);
+			doneWake.wait(guard, [&]() { return pending == 0; });
+		}
+		if(failure)
+		{
+			std::rethrow_exception(failure);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef ___TRACE_HPP
+#define ___TRACE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "runtimeexcept.hpp"
+
+// Operation traces: a compact binary log of the operations a program issued
+// against a SkipList, which the benchmark can replay later.
+//
+// File layout:
+//   8 bytes    magic "SLTRACE1"
+//   1 byte     key type, see TraceKeyCodec<Key>::tag
+//   records    until the end of the file, each one
+//              1 byte     operation (TraceOp)
+//              key        unsigned: LEB128 varint
+//                         std::string: varint length, then the bytes
+//
+// Small keys take one or two bytes, so a trace is usually a few bytes per
+// operation.
+enum class TraceOp : std::uint8_t
+{
+	Insert = 0,
+	Find = 1,
+	Next = 2,
+	Prev = 3
+};
+
+inline std::string traceOpName(TraceOp op)
+{
+	switch(op)
+	{
+		case TraceOp::Insert: return "insert";
+		case TraceOp::Find:   return "find";
+		case TraceOp::Next:   return "next";
+		case TraceOp::Prev:   return "prev";
+	}
+	return "unknown";
+}
+
+template<typename Key>
+struct TraceRecord
+{
+	TraceOp op;
+	Key key;
+};
+
+namespace trace_detail
+{
+	inline void writeVarint(std::ostream & out, std::uint64_t value)
+	{
+		while(value >= 0x80)
+		{
+			out.put(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		out.put(static_cast<char>(value));
+	}
+
+	// False at a clean end of input; throws on a varint cut short.
+	inline bool readVarint(std::istream & in, std::uint64_t & value)
+	{
+		value = 0;
+		for(unsigned shift = 0; shift < 64; shift += 7)
+		{
+			int c = in.get();
+			if(c == std::char_traits<char>::eof())
+			{
+				if(shift == 0)
+				{
+					return false;
+				}
+				throw RuntimeException("Truncated trace record");
+			}
+			value |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+			if((c & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+		throw RuntimeException("Malformed varint in trace");
+	}
+
+	inline void readVarintOrThrow(std::istream & in, std::uint64_t & value)
+	{
+		if(!readVarint(in, value))
+		{
+			throw RuntimeException("Truncated trace record");
+		}
+	}
+
+	// Longest string key a reader accepts from a stream it cannot measure.
+	const std::uint64_t maxKeyBytes = std::uint64_t(1) << 24;
+
+	// Throws unless `length` more bytes can follow in `in`, so a corrupt
+	// length is rejected before anything is allocated for it.
+	inline void checkLength(std::istream & in, std::uint64_t length)
+	{
+		std::istream::pos_type here = in.tellg();
+		if(here == std::istream::pos_type(-1))
+		{
+			if(length > maxKeyBytes)
+			{
+				throw RuntimeException("Trace key length out of range");
+			}
+			return;
+		}
+		in.seekg(0, std::ios::end);
+		std::istream::pos_type end = in.tellg();
+		in.seekg(here);
+		if(end == std::istream::pos_type(-1) || static_cast<std::uint64_t>(end - here) < length)
+		{
+			throw RuntimeException("Truncated trace record");
+		}
+	}
+
+	const char magic[8] = {'S', 'L', 'T', 'R', 'A', 'C', 'E', '1'};
+}
+
+// How keys of one type are stored in a trace. Specialize it to trace a
+// new key type: pick an unused tag and write/read the key.
+template<typename Key>
+struct TraceKeyCodec;
+
+template<>
+struct TraceKeyCodec<unsigned>
+{
+	static const std::uint8_t tag = 0;
+
+	static void write(std::ostream & out, unsigned k)
+	{
+		trace_detail::writeVarint(out, k);
+	}
+
+	static void read(std::istream & in, unsigned & k)
+	{
+		std::uint64_t value;
+		trace_detail::readVarintOrThrow(in, value);
+		k = static_cast<unsigned>(value);
+	}
+};
+
+template<>
+struct TraceKeyCodec<std::string>
+{
+	static const std::uint8_t tag = 1;
+
+	static void write(std::ostream & out, const std::string & k)
+	{
+		trace_detail::writeVarint(out, k.size());
+		out.write(k.data(), static_cast<std::streamsize>(k.size()));
+	}
+
+	static void read(std::istream & in, std::string & k)
+	{
+		std::uint64_t length;
+		trace_detail::readVarintOrThrow(in, length);
+		trace_detail::checkLength(in, length);
+		k.resize(length);
+		if(!in.read(&k[0], static_cast<std::streamsize>(length)))
+		{
+			throw RuntimeException("Truncated trace record");
+		}
+	}
+};
+
+/**
+ * @brief Appends operations to a trace file.
+ *
+ * Call record() next to each SkipList operation worth capturing. Output
+ * is buffered by the stream; it is flushed when the writer is destroyed
+ * or flush() is called.
+ */
+template<typename Key>
+class TraceWriter
+{
+private:
+	std::ofstream out;
+	std::uint64_t written = 0;
+
+public:
+	// Creates (or truncates) the file and writes the header.
+	// Throws a RuntimeException if it cannot be opened.
+	explicit TraceWriter(const std::string & path)
+		: out(path, std::ios::binary | std::ios::trunc)
+	{
+		if(!out)
+		{
+			throw RuntimeException("Cannot open trace file " + path);
+		}
+		out.write(trace_detail::magic, sizeof(trace_detail::magic));
+		out.put(static_cast<char>(TraceKeyCodec<Key>::tag));
+	}
+
+	void record(TraceOp op, const Key & k)
+	{
+		out.put(static_cast<char>(op));
+		TraceKeyCodec<Key>::write(out, k);
+		written++;
+	}
+
+	void flush()
+	{
+		out.flush();
+	}
+
+	std::uint64_t size() const noexcept
+	{
+		return written;
+	}
+};
+
+/**
+ * @brief Reads a trace file written by TraceWriter<Key>.
+ *
+ * Throws a RuntimeException if the file cannot be opened, is not a trace,
+ * holds keys of another type, or ends in the middle of a record.
+ */
+template<typename Key>
+class TraceReader
+{
+private:
+	std::ifstream in;
+
+public:
+	explicit TraceReader(const std::string & path)
+		: in(path, std::ios::binary)
+	{
+		if(!in)
+		{
+			throw RuntimeException("Cannot open trace file " + path);
+		}
+		char header[sizeof(trace_detail::magic)];
+		if(!in.read(header, sizeof(header)) || !std::equal(header, header + sizeof(header), trace_detail::magic))
+		{
+			throw RuntimeException(path + " is not a SkipList trace");
+		}
+		int tag = in.get();
+		if(tag != TraceKeyCodec<Key>::tag)
+		{
+			throw RuntimeException(path + " holds keys of another type");
+		}
+	}
+
+	// Reads the next record; false once the trace is exhausted.
+	bool next(TraceRecord<Key> & record)
+	{
+		int op = in.get();
+		if(op == std::char_traits<char>::eof())
+		{
+			return false;
+		}
+		if(op > static_cast<int>(TraceOp::Prev))
+		{
+			throw RuntimeException("Unknown operation in trace");
+		}
+		record.op = static_cast<TraceOp>(op);
+		TraceKeyCodec<Key>::read(in, record.key);
+		return true;
+	}
+
+	// Reads every remaining record, so a replay does no I/O while timed.
+	std::vector<TraceRecord<Key>> readAll()
+	{
+		std::vector<TraceRecord<Key>> records;
+		TraceRecord<Key> record;
+		while(next(record))
+		{
+			records.push_back(record);
+		}
+		return records;
+	}
+};
+
+// Reads the key-type tag of a trace without checking the rest, so a
+// replay can pick the matching TraceReader. Throws like TraceReader does.
+inline std::uint8_t traceKeyTag(const std::string & path)
+{
+	std::ifstream in(path, std::ios::binary);
+	char header[sizeof(trace_detail::magic)];
+	if(!in || !in.read(header, sizeof(header)) || !std::equal(header, header + sizeof(header), trace_detail::magic))
+	{
+		throw RuntimeException(path + " is not a SkipList trace");
+	}
+	int tag = in.get();
+	if(tag == std::char_traits<char>::eof())
+	{
+		throw RuntimeException(path + " is not a SkipList trace");
+	}
+	return static_cast<std::uint8_t>(tag);
+}
+
+#endif
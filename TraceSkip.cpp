@@ -0,0 +1,124 @@
+#include "catch_amalgamated.hpp"
+#include "Trace.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace{
+
+	// Per process, so concurrent test runs do not share files.
+	std::string tracePath(const std::string & name)
+	{
+		return "/tmp/skiplist_" + name + "_" + std::to_string(getpid()) + ".trace";
+	}
+
+	TEST_CASE("TraceRoundTripUnsignedTest", "[TraceTests]")
+	{
+		std::string path = tracePath("unsigned");
+		std::vector<unsigned> keys = {0, 1, 127, 128, 300, 65535, 0xFFFFFFFFu};
+		{
+			TraceWriter<unsigned> writer(path);
+			for(unsigned k : keys)
+			{
+				writer.record(TraceOp::Insert, k);
+				writer.record(TraceOp::Find, k);
+			}
+			writer.record(TraceOp::Next, 127);
+			writer.record(TraceOp::Prev, 128);
+			REQUIRE(writer.size() == 2 * keys.size() + 2);
+		}
+		REQUIRE(traceKeyTag(path) == TraceKeyCodec<unsigned>::tag);
+
+		TraceReader<unsigned> reader(path);
+		std::vector<TraceRecord<unsigned>> records = reader.readAll();
+		REQUIRE(records.size() == 2 * keys.size() + 2);
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE(records[2 * i].op == TraceOp::Insert);
+			REQUIRE(records[2 * i].key == keys[i]);
+			REQUIRE(records[2 * i + 1].op == TraceOp::Find);
+			REQUIRE(records[2 * i + 1].key == keys[i]);
+		}
+		REQUIRE(records[records.size() - 2].op == TraceOp::Next);
+		REQUIRE(records.back().op == TraceOp::Prev);
+		REQUIRE(records.back().key == 128);
+		std::remove(path.c_str());
+	}
+
+	TEST_CASE("TraceRoundTripStringTest", "[TraceTests]")
+	{
+		std::string path = tracePath("string");
+		std::vector<std::string> keys = {"", "a", std::string(200, 'x'), std::string("nul\0byte", 8)};
+		{
+			TraceWriter<std::string> writer(path);
+			for(const std::string & k : keys)
+			{
+				writer.record(TraceOp::Find, k);
+			}
+		}
+		TraceReader<std::string> reader(path);
+		TraceRecord<std::string> record;
+		for(const std::string & k : keys)
+		{
+			REQUIRE(reader.next(record));
+			REQUIRE(record.op == TraceOp::Find);
+			REQUIRE(record.key == k);
+		}
+		REQUIRE_FALSE(reader.next(record));
+		std::remove(path.c_str());
+	}
+
+	TEST_CASE("TraceRejectsBadFilesTest", "[TraceTests]")
+	{
+		std::string path = tracePath("bad");
+		{
+			TraceWriter<unsigned> writer(path);
+			writer.record(TraceOp::Insert, 5);
+		}
+		// Wrong key type.
+		REQUIRE_THROWS_AS(TraceReader<std::string>(path), RuntimeException);
+
+		// Not a trace at all.
+		{
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			out << "hello world";
+		}
+		REQUIRE_THROWS_AS(TraceReader<unsigned>(path), RuntimeException);
+		REQUIRE_THROWS_AS(traceKeyTag(path), RuntimeException);
+
+		// A string record cut off in the middle of its bytes.
+		{
+			TraceWriter<std::string> writer(path);
+			writer.record(TraceOp::Insert, "abcdef");
+		}
+		{
+			std::ifstream in(path, std::ios::binary);
+			std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 2));
+		}
+		TraceReader<std::string> reader(path);
+		TraceRecord<std::string> record;
+		REQUIRE_THROWS_AS(reader.next(record), RuntimeException);
+
+		// A corrupt length far past the end of the file is rejected before
+		// anything is allocated for it.
+		{
+			TraceWriter<std::string> writer(path);
+			writer.flush();
+		}
+		{
+			std::ofstream out(path, std::ios::binary | std::ios::app);
+			out.put(static_cast<char>(TraceOp::Insert));
+			const unsigned char length[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F};
+			out.write(reinterpret_cast<const char *>(length), sizeof(length));
+			out << "abc";
+		}
+		TraceReader<std::string> corrupt(path);
+		REQUIRE_THROWS_AS(corrupt.next(record), RuntimeException);
+		std::remove(path.c_str());
+	}
+
+}
@@ -0,0 +1,170 @@
+#ifndef ___WRITE_BATCH_HPP
+#define ___WRITE_BATCH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Trace.hpp"
+#include "runtimeexcept.hpp"
+
+/**
+ * @brief A group of puts and erases applied as one unit.
+ *
+ * A batch only records writes; MvccSkipList::apply() commits all of them
+ * under a single commit timestamp, so every snapshot sees either the whole
+ * batch or none of it. When a batch writes a key more than once, the last
+ * write wins.
+ *
+ * encode() turns a batch into one write-ahead log record, and decode()
+ * reads it back:
+ *   varint     number of writes
+ *   writes     each one
+ *              1 byte     0 = put, 1 = erase
+ *              key        as TraceKeyCodec<Key> writes it
+ *              value      puts only, as TraceKeyCodec<Value> writes it
+ *
+ *   WriteBatch<unsigned, unsigned> batch;
+ *   batch.put(1, 10);
+ *   batch.erase(2);
+ *   map.apply(batch);
+ */
+template<typename Key, typename Value>
+class WriteBatch
+{
+public:
+	enum class Kind : std::uint8_t
+	{
+		Put = 0,
+		Erase = 1
+	};
+
+	struct Write
+	{
+		Kind kind;
+		Key key;
+		Value value;
+	};
+
+private:
+	std::vector<Write> writes;
+
+public:
+	void put(const Key & k, const Value & v)
+	{
+		writes.push_back(Write{Kind::Put, k, v});
+	}
+
+	void erase(const Key & k)
+	{
+		writes.push_back(Write{Kind::Erase, k, Value()});
+	}
+
+	size_t size() const noexcept
+	{
+		return writes.size();
+	}
+
+	bool empty() const noexcept
+	{
+		return writes.empty();
+	}
+
+	void clear() noexcept
+	{
+		writes.clear();
+	}
+
+	// The writes in the order they were added.
+	const std::vector<Write> & operations() const noexcept
+	{
+		return writes;
+	}
+
+	// The writes sorted by key, keeping only the last write to each key.
+	// This is the order a batch is applied in.
+	std::vector<Write> sortedLastWrites() const;
+
+	// The batch as a single log record.
+	std::string encode() const;
+
+	// Reads back a record made by encode(). Throws a RuntimeException if
+	// the record is malformed.
+	static WriteBatch decode(const std::string & record);
+};
+
+template<typename Key, typename Value>
+std::vector<typename WriteBatch<Key, Value>::Write> WriteBatch<Key, Value>::sortedLastWrites() const
+{
+	std::vector<Write> sorted(writes);
+	std::stable_sort(sorted.begin(), sorted.end(),
+		[](const Write & a, const Write & b) { return a.key < b.key; });
+	// Of each run of equal keys keep the last, which stable_sort left last.
+	std::vector<Write> last;
+	last.reserve(sorted.size());
+	for(size_t i = 0; i < sorted.size(); i++)
+	{
+		if(i + 1 == sorted.size() || sorted[i].key < sorted[i + 1].key)
+		{
+			last.push_back(std::move(sorted[i]));
+		}
+	}
+	return last;
+}
+
+template<typename Key, typename Value>
+std::string WriteBatch<Key, Value>::encode() const
+{
+	std::ostringstream out;
+	trace_detail::writeVarint(out, writes.size());
+	for(const Write & write : writes)
+	{
+		out.put(static_cast<char>(write.kind));
+		TraceKeyCodec<Key>::write(out, write.key);
+		if(write.kind == Kind::Put)
+		{
+			TraceKeyCodec<Value>::write(out, write.value);
+		}
+	}
+	return out.str();
+}
+
+template<typename Key, typename Value>
+WriteBatch<Key, Value> WriteBatch<Key, Value>::decode(const std::string & record)
+{
+	std::istringstream in(record);
+	WriteBatch batch;
+	try
+	{
+		std::uint64_t count;
+		trace_detail::readVarintOrThrow(in, count);
+		for(std::uint64_t i = 0; i < count; i++)
+		{
+			int kind = in.get();
+			if(kind != static_cast<int>(Kind::Put) && kind != static_cast<int>(Kind::Erase))
+			{
+				throw RuntimeException("Unknown write kind");
+			}
+			Write write{static_cast<Kind>(kind), Key(), Value()};
+			TraceKeyCodec<Key>::read(in, write.key);
+			if(write.kind == Kind::Put)
+			{
+				TraceKeyCodec<Value>::read(in, write.value);
+			}
+			batch.writes.push_back(std::move(write));
+		}
+	}
+	catch(RuntimeException &)
+	{
+		throw RuntimeException("Malformed write batch record");
+	}
+	if(in.peek() != std::char_traits<char>::eof())
+	{
+		throw RuntimeException("Malformed write batch record");
+	}
+	return batch;
+}
+
+#endif
@@ -0,0 +1,256 @@
+#include "catch_amalgamated.hpp"
+#include "MvccSkipList.hpp"
+#include "WriteBatch.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace{
+
+	using Batch = WriteBatch<unsigned, unsigned>;
+
+	// A value whose copies start throwing after copiesLeft more of them;
+	// -1 never throws.
+	struct Bomb
+	{
+		static int copiesLeft;
+		unsigned v = 0;
+
+		Bomb() = default;
+		explicit Bomb(unsigned x) : v(x) {}
+		Bomb(const Bomb & other) : v(other.v)
+		{
+			tick();
+		}
+		Bomb & operator=(const Bomb & other)
+		{
+			tick();
+			v = other.v;
+			return *this;
+		}
+
+		static void tick()
+		{
+			if(copiesLeft == 0)
+			{
+				throw RuntimeException("copy failed");
+			}
+			if(copiesLeft > 0)
+			{
+				copiesLeft--;
+			}
+		}
+	};
+
+	int Bomb::copiesLeft = -1;
+
+	TEST_CASE("WriteBatchEncodeTest", "[WriteBatchTests]")
+	{
+		Batch batch;
+		REQUIRE(batch.empty());
+		batch.put(5, 50);
+		batch.erase(300);
+		batch.put(70000, 7);
+		std::string record = batch.encode();
+		// Count, then kind + key (+ value): 1 + (1+1+1) + (1+2) + (1+3+1).
+		REQUIRE(record.size() == 12);
+
+		Batch decoded = Batch::decode(record);
+		REQUIRE(decoded.size() == 3);
+		const std::vector<Batch::Write> & writes = decoded.operations();
+		REQUIRE(writes[0].kind == Batch::Kind::Put);
+		REQUIRE(writes[0].key == 5);
+		REQUIRE(writes[0].value == 50);
+		REQUIRE(writes[1].kind == Batch::Kind::Erase);
+		REQUIRE(writes[1].key == 300);
+		REQUIRE(writes[2].key == 70000);
+		REQUIRE(writes[2].value == 7);
+
+		WriteBatch<std::string, std::string> strings;
+		strings.put("apple", "red");
+		strings.erase("");
+		strings.put("kiwi", std::string(200, 'g'));
+		WriteBatch<std::string, std::string> back =
+			WriteBatch<std::string, std::string>::decode(strings.encode());
+		REQUIRE(back.size() == 3);
+		REQUIRE(back.operations()[0].value == "red");
+		REQUIRE(back.operations()[1].key == "");
+		REQUIRE(back.operations()[2].value == std::string(200, 'g'));
+
+		REQUIRE(Batch::decode(Batch().encode()).empty());
+		REQUIRE_THROWS_AS(Batch::decode(record.substr(0, 11)), RuntimeException);
+		REQUIRE_THROWS_AS(Batch::decode(record + "x"), RuntimeException);
+		std::string badKind = record;
+		badKind[1] = 9;
+		REQUIRE_THROWS_AS(Batch::decode(badKind), RuntimeException);
+		REQUIRE_THROWS_AS(Batch::decode(""), RuntimeException);
+	}
+
+	TEST_CASE("WriteBatchSortedTest", "[WriteBatchTests]")
+	{
+		Batch batch;
+		batch.put(3, 1);
+		batch.put(1, 1);
+		batch.erase(3);
+		batch.put(2, 1);
+		batch.put(1, 2);
+		std::vector<Batch::Write> sorted = batch.sortedLastWrites();
+		REQUIRE(sorted.size() == 3);
+		REQUIRE(sorted[0].key == 1);
+		REQUIRE(sorted[0].value == 2);
+		REQUIRE(sorted[1].key == 2);
+		REQUIRE(sorted[2].key == 3);
+		REQUIRE(sorted[2].kind == Batch::Kind::Erase);
+		batch.clear();
+		REQUIRE(batch.sortedLastWrites().empty());
+	}
+
+	TEST_CASE("WriteBatchApplyTest", "[WriteBatchTests]")
+	{
+		MvccSkipList<unsigned, unsigned> mvcc;
+		mvcc.put(1, 1);
+		mvcc.put(2, 2);
+		MvccSkipList<unsigned, unsigned>::Snapshot before = mvcc.snapshot();
+
+		Batch batch;
+		batch.put(3, 3);
+		batch.erase(1);
+		batch.erase(9);
+		batch.put(2, 20);
+		batch.put(2, 21);
+		REQUIRE(mvcc.apply(batch) == 3);
+		REQUIRE(mvcc.lastCommitted() == 3);
+		REQUIRE(mvcc.apply(Batch()) == 3);
+
+		unsigned value = 0;
+		REQUIRE_FALSE(mvcc.get(1, value));
+		REQUIRE_FALSE(mvcc.get(9, value));
+		REQUIRE(mvcc.get(2, value));
+		REQUIRE(value == 21);
+		REQUIRE(mvcc.get(3, value));
+		REQUIRE(value == 3);
+		REQUIRE(mvcc.snapshot().allKeysInOrder() == std::vector<unsigned>{2, 3});
+		REQUIRE(before.allKeysInOrder() == std::vector<unsigned>{1, 2});
+	}
+
+	TEST_CASE("WriteBatchAtomicTest", "[WriteBatchTests]")
+	{
+		// Each batch moves one unit between two of the accounts, so every
+		// committed state sums to the same total even though no single put
+		// would keep it.
+		MvccSkipList<unsigned, long> mvcc;
+		const unsigned accounts = 32;
+		WriteBatch<unsigned, long> initial;
+		for(unsigned i = 0; i < accounts; i++)
+		{
+			initial.put(i, 100);
+		}
+		mvcc.apply(initial);
+
+		std::atomic<bool> done{false};
+		std::atomic<unsigned> inconsistent{0};
+		std::atomic<unsigned> scans{0};
+		std::vector<std::thread> readers;
+		for(unsigned t = 0; t < 3; t++)
+		{
+			readers.emplace_back([&]()
+			{
+				while(!done.load())
+				{
+					long total = 0;
+					mvcc.snapshot().forEach([&total](const unsigned &, const long & v) { total += v; });
+					if(total != 100 * static_cast<long>(accounts))
+					{
+						inconsistent++;
+					}
+					scans++;
+				}
+			});
+		}
+
+		unsigned seed = 7;
+		for(unsigned transfer = 0; transfer < 3000; transfer++)
+		{
+			seed = seed * 1103515245 + 12345;
+			unsigned from = (seed >> 8) % accounts;
+			unsigned to = (seed >> 20) % accounts;
+			if(from == to)
+			{
+				continue;
+			}
+			long fromBalance = 0;
+			long toBalance = 0;
+			mvcc.get(from, fromBalance);
+			mvcc.get(to, toBalance);
+			WriteBatch<unsigned, long> batch;
+			batch.put(from, fromBalance - 1);
+			batch.put(to, toBalance + 1);
+			mvcc.apply(batch);
+		}
+		while(scans.load() == 0)
+		{
+			std::this_thread::yield();
+		}
+		done = true;
+		for(std::thread & reader : readers)
+		{
+			reader.join();
+		}
+		REQUIRE(inconsistent.load() == 0);
+	}
+
+	TEST_CASE("WriteBatchThrowingValueTest", "[WriteBatchTests]")
+	{
+		// Fail the batch at every copy it makes in turn: whatever was staged
+		// before the throw must never become visible, not even once a later
+		// commit moves the clock past it.
+		MvccSkipList<unsigned, Bomb> mvcc;
+		for(unsigned i = 1; i <= 3; i++)
+		{
+			mvcc.put(i, Bomb(i));
+		}
+		WriteBatch<unsigned, Bomb> batch;
+		batch.put(0, Bomb(500));
+		batch.put(1, Bomb(100));
+		batch.erase(2);
+		batch.put(3, Bomb(300));
+
+		Bomb value;
+		unsigned failures = 0;
+		for(int copies = 0; ; copies++)
+		{
+			std::uint64_t before = mvcc.lastCommitted();
+			Bomb::copiesLeft = copies;
+			try
+			{
+				mvcc.apply(batch);
+				Bomb::copiesLeft = -1;
+				break;
+			}
+			catch(RuntimeException &)
+			{
+				Bomb::copiesLeft = -1;
+				failures++;
+			}
+			REQUIRE(mvcc.lastCommitted() == before);
+			mvcc.put(9, Bomb(copies));
+			REQUIRE_FALSE(mvcc.get(0, value));
+			for(unsigned i = 1; i <= 3; i++)
+			{
+				REQUIRE(mvcc.get(i, value));
+				REQUIRE(value.v == i);
+			}
+			REQUIRE(mvcc.keyCount() == 4);
+		}
+		REQUIRE(failures > 3);
+		REQUIRE(mvcc.get(0, value));
+		REQUIRE(value.v == 500);
+		REQUIRE(mvcc.get(1, value));
+		REQUIRE(value.v == 100);
+		REQUIRE_FALSE(mvcc.get(2, value));
+		REQUIRE(mvcc.get(3, value));
+		REQUIRE(value.v == 300);
+	}
+
+}
@@ -0,0 +1,220 @@
+#ifndef ___YCSB_HPP
+#define ___YCSB_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include "Benchmark.hpp"
+#include "runtimeexcept.hpp"
+
+// The operations a YCSB workload mixes.
+enum class YcsbOp
+{
+	Read,
+	Update,
+	Insert,
+	Scan,
+	ReadModifyWrite
+};
+
+inline std::string ycsbOpName(YcsbOp op)
+{
+	switch(op)
+	{
+		case YcsbOp::Read:            return "read";
+		case YcsbOp::Update:          return "update";
+		case YcsbOp::Insert:          return "insert";
+		case YcsbOp::Scan:            return "scan";
+		case YcsbOp::ReadModifyWrite: return "read_modify_write";
+	}
+	return "unknown";
+}
+
+// How the keys of reads, updates and scans are chosen.
+//
+// Zipfian: a few hot records chosen far more often, scattered over the key space.
+// Latest:  the most recently inserted records are the most popular.
+// Uniform: every record equally likely.
+enum class YcsbDistribution
+{
+	Zipfian,
+	Latest,
+	Uniform
+};
+
+inline std::string ycsbDistributionName(YcsbDistribution d)
+{
+	switch(d)
+	{
+		case YcsbDistribution::Zipfian: return "zipfian";
+		case YcsbDistribution::Latest:  return "latest";
+		case YcsbDistribution::Uniform: return "uniform";
+	}
+	return "unknown";
+}
+
+// Operation proportions of one workload. They should add up to one.
+struct YcsbWorkload
+{
+	char name = 'A';
+	double read = 0;
+	double update = 0;
+	double insert = 0;
+	double scan = 0;
+	double readModifyWrite = 0;
+	YcsbDistribution distribution = YcsbDistribution::Zipfian;
+	// Scans visit between 1 and this many records, uniformly.
+	size_t maxScanLength = 100;
+
+	// The core workloads as shipped with YCSB:
+	//   A  update heavy       50% read, 50% update
+	//   B  read mostly        95% read, 5% update
+	//   C  read only          100% read
+	//   D  read latest        95% read, 5% insert, latest distribution
+	//   E  short ranges       95% scan, 5% insert
+	//   F  read-modify-write  50% read, 50% read-modify-write
+	// Throws a RuntimeException for any other letter.
+	static YcsbWorkload standard(char letter)
+	{
+		YcsbWorkload w;
+		w.name = letter;
+		switch(letter)
+		{
+			case 'A': w.read = 0.5;  w.update = 0.5; break;
+			case 'B': w.read = 0.95; w.update = 0.05; break;
+			case 'C': w.read = 1.0; break;
+			case 'D': w.read = 0.95; w.insert = 0.05; w.distribution = YcsbDistribution::Latest; break;
+			case 'E': w.scan = 0.95; w.insert = 0.05; break;
+			case 'F': w.read = 0.5;  w.readModifyWrite = 0.5; break;
+			default: throw RuntimeException(std::string("Unknown YCSB workload ") + letter);
+		}
+		return w;
+	}
+};
+
+struct YcsbConfig
+{
+	// Records loaded before the run phase.
+	size_t recordCount = 100000;
+	// Operations issued in the run phase.
+	size_t operationCount = 100000;
+	// Length of every key, including the "user" prefix. At least 5.
+	size_t keySize = 24;
+	// Length of every value.
+	size_t valueSize = 100;
+	std::uint64_t seed = 1;
+};
+
+/**
+ * @brief Produces the keys, values and operation stream of a YCSB workload.
+ *
+ * Record i is stored under "user" followed by the digits of a hash of i,
+ * as YCSB does, so insertion order and key order are unrelated. Inserts in
+ * the run phase continue numbering from recordCount.
+ */
+class YcsbGenerator
+{
+private:
+	YcsbWorkload workload;
+	YcsbConfig config;
+	std::mt19937_64 rng;
+	std::uniform_real_distribution<double> unit{0.0, 1.0};
+	ZipfianGenerator zipf;
+	std::uint64_t inserted;
+
+	static std::uint64_t fnv1a(std::uint64_t value)
+	{
+		std::uint64_t hash = 0xCBF29CE484222325ull;
+		for(int i = 0; i < 8; i++)
+		{
+			hash ^= value & 0xFF;
+			hash *= 0x100000001B3ull;
+			value >>= 8;
+		}
+		return hash;
+	}
+
+public:
+	YcsbGenerator(const YcsbWorkload & w, const YcsbConfig & c)
+		: workload(w), config(c), rng(c.seed), zipf(c.recordCount, 0.99, c.seed + 1), inserted(c.recordCount)
+	{
+		if(config.keySize < 5)
+		{
+			config.keySize = 5;
+		}
+	}
+
+	// The key of record i. Keys shorter than 24 characters keep only the
+	// low digits of the hash, so a few records may then share a key.
+	std::string key(std::uint64_t i) const
+	{
+		char digits[24];
+		std::snprintf(digits, sizeof(digits), "%020llu", static_cast<unsigned long long>(fnv1a(i)));
+		std::string suffix(digits);
+		size_t width = config.keySize - 4;
+		if(suffix.size() > width)
+		{
+			suffix = suffix.substr(suffix.size() - width);
+		}
+		else
+		{
+			suffix = std::string(width - suffix.size(), '0') + suffix;
+		}
+		return "user" + suffix;
+	}
+
+	// A value of the configured size; the content varies with `salt`.
+	std::string value(std::uint64_t salt) const
+	{
+		std::string v(config.valueSize, 'a');
+		for(size_t i = 0; i < v.size(); i++)
+		{
+			v[i] = static_cast<char>('a' + (salt + i * 7) % 26);
+		}
+		return v;
+	}
+
+	std::uint64_t recordCount() const { return inserted; }
+
+	YcsbOp nextOp()
+	{
+		double r = unit(rng);
+		if((r -= workload.read) < 0) return YcsbOp::Read;
+		if((r -= workload.update) < 0) return YcsbOp::Update;
+		if((r -= workload.insert) < 0) return YcsbOp::Insert;
+		if((r -= workload.scan) < 0) return YcsbOp::Scan;
+		return YcsbOp::ReadModifyWrite;
+	}
+
+	// Index of an existing record, following the request distribution.
+	std::uint64_t nextRecord()
+	{
+		switch(workload.distribution)
+		{
+			case YcsbDistribution::Latest:
+			{
+				std::uint64_t back = zipf.next();
+				return back < inserted ? inserted - 1 - back : 0;
+			}
+			case YcsbDistribution::Uniform:
+				return std::uniform_int_distribution<std::uint64_t>(0, inserted - 1)(rng);
+			default:
+				// Scrambled, so the hot records are spread over the key space.
+				return fnv1a(zipf.next()) % inserted;
+		}
+	}
+
+	// Index of the next record to insert.
+	std::uint64_t nextInsert()
+	{
+		return inserted++;
+	}
+
+	size_t nextScanLength()
+	{
+		return std::uniform_int_distribution<size_t>(1, workload.maxScanLength)(rng);
+	}
+};
+
+#endif
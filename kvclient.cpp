@@ -0,0 +1,272 @@
+#include "Benchmark.hpp"
+#include "KvClient.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Command line options for the key-value load generator.
+//
+//   --socket PATH               server socket (default /tmp/skiplist-kv.sock)
+//   --keys N                    keys PUT during the load phase
+//   --ops N                     requests sent during the run phase
+//   --pipeline N                requests sent before waiting for responses
+//   --read-ratio R              fraction of run-phase requests that are GETs
+//   --scan-ratio R              fraction that are SCANs of --scan-length keys
+//   --rank-ratio R              fraction that are RANKs; the rest are PUTs
+//   --scan-length N             keys per SCAN
+//   --value-size N              value length
+//   --out FILE                  write the JSON report to FILE instead of stdout
+//
+// Keys are drawn uniformly from those loaded. The latency of a request runs
+// from the flush of its pipeline batch to the arrival of its response, so
+// deeper pipelines trade latency for throughput. The report has one row
+// per phase and request type, in the format of main.cpp's.
+struct Options
+{
+	std::string socketPath = "/tmp/skiplist-kv.sock";
+	size_t keys = 100000;
+	size_t ops = 100000;
+	size_t pipeline = 16;
+	double readRatio = 0.8;
+	double scanRatio = 0.05;
+	double rankRatio = 0.05;
+	std::uint32_t scanLength = 10;
+	size_t valueSize = 100;
+	std::string outPath;
+};
+
+bool parseOptions(int argc, char ** argv, Options & opt)
+{
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if(i + 1 >= argc)
+		{
+			std::cerr << "missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--socket")
+		{
+			opt.socketPath = value;
+		}
+		else if(arg == "--keys")
+		{
+			opt.keys = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if(arg == "--ops")
+		{
+			opt.ops = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if(arg == "--pipeline")
+		{
+			opt.pipeline = std::strtoull(value.c_str(), nullptr, 10);
+			if(opt.pipeline == 0)
+			{
+				opt.pipeline = 1;
+			}
+		}
+		else if(arg == "--read-ratio")
+		{
+			opt.readRatio = std::strtod(value.c_str(), nullptr);
+		}
+		else if(arg == "--scan-ratio")
+		{
+			opt.scanRatio = std::strtod(value.c_str(), nullptr);
+		}
+		else if(arg == "--rank-ratio")
+		{
+			opt.rankRatio = std::strtod(value.c_str(), nullptr);
+		}
+		else if(arg == "--scan-length")
+		{
+			opt.scanLength = static_cast<std::uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+		}
+		else if(arg == "--value-size")
+		{
+			opt.valueSize = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if(arg == "--out")
+		{
+			opt.outPath = value;
+		}
+		else
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Latencies of one request type within a phase.
+struct OpStats
+{
+	std::string name;
+	LatencyHistogram latencies;
+	size_t notFound = 0;
+};
+
+size_t statsIndex(KvOp op)
+{
+	return static_cast<size_t>(op) - static_cast<size_t>(KvOp::Get);
+}
+
+// Sends the requests `pipeline` at a time and records each one's latency
+// under its opcode. Returns the wall-clock time of the whole phase.
+template<typename NextRequest>
+double runPhase(KvClient & client, size_t count, size_t pipeline, NextRequest nextRequest, std::vector<OpStats> & stats)
+{
+	std::vector<KvOp> ops;
+	Stopwatch wall;
+	for(size_t done = 0; done < count;)
+	{
+		size_t batch = std::min(pipeline, count - done);
+		ops.clear();
+		for(size_t i = 0; i < batch; i++)
+		{
+			KvRequest request = nextRequest();
+			ops.push_back(request.op);
+			client.send(request);
+		}
+		Stopwatch sent;
+		client.flush();
+		for(size_t i = 0; i < batch; i++)
+		{
+			KvResponse response = client.receive();
+			OpStats & s = stats[statsIndex(ops[i])];
+			s.latencies.record(static_cast<std::uint64_t>(sent.elapsedNs()));
+			if(response.status == KvStatus::NotFound)
+			{
+				s.notFound++;
+			}
+			else if(response.status == KvStatus::Error)
+			{
+				throw RuntimeException("Server error: " + response.value);
+			}
+		}
+		done += batch;
+	}
+	return wall.elapsedNs();
+}
+
+std::vector<OpStats> makeStats()
+{
+	std::vector<OpStats> stats(5);
+	stats[statsIndex(KvOp::Get)].name = "get";
+	stats[statsIndex(KvOp::Put)].name = "put";
+	stats[statsIndex(KvOp::Del)].name = "del";
+	stats[statsIndex(KvOp::Scan)].name = "scan";
+	stats[statsIndex(KvOp::Rank)].name = "rank";
+	return stats;
+}
+
+void addRows(const Options & opt, const std::string & phase, const std::vector<OpStats> & stats,
+	double wallNs, std::vector<BenchResult> & results)
+{
+	for(const OpStats & s : stats)
+	{
+		if(s.latencies.count() == 0)
+		{
+			continue;
+		}
+		BenchResult r;
+		r.structure = "kv_server";
+		r.operation = phase + "_" + s.name;
+		r.keyType = KeyMaker<std::string>::typeName();
+		r.distribution = distributionName(Distribution::Uniform);
+		r.size = opt.keys;
+		finishHistogramResult(r, s.latencies, wallNs);
+		r.metrics.emplace_back("pipeline", static_cast<double>(opt.pipeline));
+		r.metrics.emplace_back("not_found", static_cast<double>(s.notFound));
+		results.push_back(r);
+	}
+}
+
+void runLoad(const Options & opt, std::vector<BenchResult> & results)
+{
+	KvClient client(opt.socketPath);
+	std::string value(opt.valueSize, 'v');
+
+	std::vector<OpStats> stats = makeStats();
+	size_t next = 0;
+	double wallNs = runPhase(client, opt.keys, opt.pipeline, [&]()
+	{
+		KvRequest request;
+		request.op = KvOp::Put;
+		request.key = KeyMaker<std::string>::make(Distribution::Uniform, next++);
+		request.value = value;
+		return request;
+	}, stats);
+	addRows(opt, "load", stats, wallNs, results);
+
+	std::mt19937_64 rng(42);
+	std::uniform_int_distribution<std::uint64_t> pickKey(0, opt.keys ? opt.keys - 1 : 0);
+	std::uniform_real_distribution<double> pickOp(0, 1);
+	stats = makeStats();
+	wallNs = runPhase(client, opt.keys ? opt.ops : 0, opt.pipeline, [&]()
+	{
+		KvRequest request;
+		request.key = KeyMaker<std::string>::make(Distribution::Uniform, pickKey(rng));
+		double draw = pickOp(rng);
+		if(draw < opt.readRatio)
+		{
+			request.op = KvOp::Get;
+		}
+		else if(draw < opt.readRatio + opt.scanRatio)
+		{
+			request.op = KvOp::Scan;
+			request.limit = opt.scanLength;
+		}
+		else if(draw < opt.readRatio + opt.scanRatio + opt.rankRatio)
+		{
+			request.op = KvOp::Rank;
+		}
+		else
+		{
+			request.op = KvOp::Put;
+			request.value = value;
+		}
+		return request;
+	}, stats);
+	addRows(opt, "run", stats, wallNs, results);
+}
+
+}
+
+
+int main(int argc, char ** argv)
+{
+	Options opt;
+	if(!parseOptions(argc, argv, opt))
+	{
+		return 1;
+	}
+
+	std::vector<BenchResult> results;
+	try
+	{
+		runLoad(opt, results);
+	}
+	catch(RuntimeException & e)
+	{
+		std::cerr << e << std::endl;
+		return 1;
+	}
+
+	if(opt.outPath.empty())
+	{
+		writeJson(std::cout, results);
+	}
+	else
+	{
+		std::ofstream out(opt.outPath);
+		writeJson(out, results);
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include "KvServer.hpp"
+#include <csignal>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// Command line options for the key-value server.
+//
+//   --socket PATH               Unix socket to listen on (default /tmp/skiplist-kv.sock)
+//
+// The server runs until SIGINT or SIGTERM, then prints its counters to
+// stderr. See KvProtocol.hpp for the protocol and kvclient.cpp for a load
+// generator.
+struct Options
+{
+	std::string socketPath = "/tmp/skiplist-kv.sock";
+};
+
+bool parseOptions(int argc, char ** argv, Options & opt)
+{
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if(i + 1 >= argc)
+		{
+			std::cerr << "missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--socket")
+		{
+			opt.socketPath = value;
+		}
+		else
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+KvServer * runningServer = nullptr;
+
+void stopServer(int)
+{
+	if(runningServer != nullptr)
+	{
+		runningServer->stop();
+	}
+}
+
+}
+
+
+int main(int argc, char ** argv)
+{
+	Options opt;
+	if(!parseOptions(argc, argv, opt))
+	{
+		return 1;
+	}
+	try
+	{
+		KvServer server(opt.socketPath);
+		runningServer = &server;
+		std::signal(SIGINT, stopServer);
+		std::signal(SIGTERM, stopServer);
+		std::cerr << "listening on " << opt.socketPath << std::endl;
+		server.run();
+		runningServer = nullptr;
+
+		const KvServerStats & stats = server.stats();
+		std::cerr << "connections=" << stats.connections
+			<< " requests=" << stats.requests
+			<< " batches=" << stats.batches
+			<< " protocol_errors=" << stats.protocolErrors
+			<< " keys=" << server.list().size() << std::endl;
+	}
+	catch(RuntimeException & e)
+	{
+		std::cerr << e << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -1,8 +1,1074 @@
+#include "BenchAdapters.hpp"
+#include "BufferedSkipList.hpp"
+#include "Benchmark.hpp"
+#include "ParallelScan.hpp"
+#include "PerfCounters.hpp"
 #include "SkipList.hpp"
+#include "SkipListBuilder.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+#include "Ycsb.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <malloc.h>
+#include <memory>
+#include <new>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 
-int main()
+// Counting global allocator, so memory per key can be reported for every
+// container without touching their allocators. Sizes come from
+// malloc_usable_size, so allocator rounding is included in the totals.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void * operator new(size_t bytes)
+{
+	void * p = std::malloc(bytes ? bytes : 1);
+	if(p == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	liveHeapBytes() += static_cast<long long>(malloc_usable_size(p));
+	return p;
+}
+
+void operator delete(void * p) noexcept
+{
+	if(p != nullptr)
+	{
+		liveHeapBytes() -= static_cast<long long>(malloc_usable_size(p));
+		std::free(p);
+	}
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+namespace {
+
+// Command line options for the benchmark suite.
+//
+//   --mode ops|compare|mixed|ycsb|replay
+//                               ops: every SkipList operation (default)
+//                               compare: SkipList against std::map,
+//                               std::unordered_map and a sorted std::vector
+//                               mixed: concurrent reads and inserts on one
+//                               shared structure, with latency histograms:
+//                               SkipList and std::map behind a mutex, the
+//                               lock-per-node LazySkipList, and a
+//                               ShardedSkipList of 16 range shards; then
+//                               insert-only ingest, per-insert mutex against
+//                               BufferedSkipList producers
+//                               ycsb: YCSB core workloads on a
+//                               SkipList<std::string, std::string>; --sizes
+//                               are record counts and --ops the run length
+//                               replay: replays the operations in --trace
+//                               against a SkipList of the trace's key type
+//   --trace FILE                trace to replay (see Trace.hpp)
+//   --record-trace FILE         in ycsb mode, also write the load and run
+//                               phases of the last workload run to FILE
+//   --workload ABCDEF           YCSB workloads to run
+//   --key-size N                YCSB key length
+//   --value-size N              YCSB value length
+//   --threads N                 threads in mixed mode and for the
+//                               bulk_build and parallel_collect rows
+//   --read-ratio R              fraction of mixed-mode operations that are reads
+//   --sizes 1000,10000,...      key counts to build (1K up to 100M)
+//   --ops N                     probes timed per operation
+//   --adversarial-limit N       largest size run with adversarial keys
+//   --dist sequential,...       distributions to run
+//   --keys unsigned,string      key types to run
+//   --auto-rebalance SKEW       let lists rebuild their upper layers when the
+//                               skew score passes SKEW (see SkipList::setAutoRebalance)
+//   --out FILE                  write the JSON report to FILE instead of stdout
+//   --perf                      add hardware counters per operation to ops-mode
+//                               rows (Linux perf_event_open; skipped if unavailable)
+//
+// Build with -DSKIPLIST_STATS to add the SkipList's own counters
+// (comparisons, drops, nodes visited per layer, ...) to every ops-mode row.
+struct Options
+{
+	std::string mode = "ops";
+	std::vector<size_t> sizes = {1000, 10000, 100000};
+	size_t ops = 100000;
+	size_t adversarialLimit = 10000;
+	double autoRebalance = 0;
+	bool perf = false;
+	unsigned threads = 1;
+	double readRatio = 0.9;
+	std::string workloads = "ABCDEF";
+	size_t keySize = 24;
+	size_t valueSize = 100;
+	std::string tracePath;
+	std::string recordTracePath;
+	std::vector<Distribution> distributions = {
+		Distribution::Sequential, Distribution::Uniform,
+		Distribution::Zipfian, Distribution::Adversarial};
+	bool runUnsigned = true;
+	bool runString = true;
+	std::string outPath;
+};
+
+std::vector<std::string> splitList(const std::string & s)
+{
+	std::vector<std::string> parts;
+	std::stringstream in(s);
+	std::string part;
+	while(std::getline(in, part, ','))
+	{
+		if(!part.empty())
+		{
+			parts.push_back(part);
+		}
+	}
+	return parts;
+}
+
+bool parseDistribution(const std::string & name, Distribution & d)
+{
+	for(Distribution candidate : {Distribution::Sequential, Distribution::Uniform,
+		Distribution::Zipfian, Distribution::Adversarial})
+	{
+		if(distributionName(candidate) == name)
+		{
+			d = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool parseOptions(int argc, char ** argv, Options & opt)
+{
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if(arg == "--perf")
+		{
+			opt.perf = true;
+			continue;
+		}
+		if(i + 1 >= argc)
+		{
+			std::cerr << "missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--mode")
+		{
+			opt.mode = value;
+		}
+		else if(arg == "--sizes")
+		{
+			opt.sizes.clear();
+			for(const std::string & part : splitList(value))
+			{
+				opt.sizes.push_back(std::strtoull(part.c_str(), nullptr, 10));
+			}
+		}
+		else if(arg == "--ops")
+		{
+			opt.ops = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if(arg == "--adversarial-limit")
+		{
+			opt.adversarialLimit = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if(arg == "--dist")
+		{
+			opt.distributions.clear();
+			for(const std::string & part : splitList(value))
+			{
+				Distribution d;
+				if(!parseDistribution(part, d))
+				{
+					std::cerr << "unknown distribution " << part << std::endl;
+					return false;
+				}
+				opt.distributions.push_back(d);
+			}
+		}
+		else if(arg == "--keys")
+		{
+			opt.runUnsigned = value.find("unsigned") != std::string::npos;
+			opt.runString = value.find("string") != std::string::npos;
+		}
+		else if(arg == "--threads")
+		{
+			opt.threads = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+			if(opt.threads == 0)
+			{
+				opt.threads = 1;
+			}
+		}
+		else if(arg == "--read-ratio")
+		{
+			opt.readRatio = std::strtod(value.c_str(), nullptr);
+		}
+		else if(arg == "--workload")
+		{
+			opt.workloads = value;
+		}
+		else if(arg == "--key-size")
+		{
+			opt.keySize = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if(arg == "--value-size")
+		{
+			opt.valueSize = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if(arg == "--trace")
+		{
+			opt.tracePath = value;
+		}
+		else if(arg == "--record-trace")
+		{
+			opt.recordTracePath = value;
+		}
+		else if(arg == "--auto-rebalance")
+		{
+			opt.autoRebalance = std::strtod(value.c_str(), nullptr);
+		}
+		else if(arg == "--out")
+		{
+			opt.outPath = value;
+		}
+		else
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Hardware counters wrapped around each timed loop; null unless --perf was
+// given and at least one counter could be opened.
+PerfCounters * hardwareCounters = nullptr;
+
+void startCounters()
+{
+	if(hardwareCounters != nullptr)
+	{
+		hardwareCounters->start();
+	}
+}
+
+void stopCounters(BenchResult & r, size_t ops)
 {
-    return 0;
+	if(hardwareCounters == nullptr || ops == 0)
+	{
+		return;
+	}
+	hardwareCounters->stop();
+	for(const auto & counter : hardwareCounters->read())
+	{
+		r.metrics.emplace_back(counter.first + "_per_op", static_cast<double>(counter.second) / ops);
+	}
 }
 
+// Times one operation over a list of probe keys and appends the row.
+template<typename Key, typename Op>
+void timeProbes(const std::string & operation, const std::vector<Key> & probes, Op op,
+	BenchResult row, std::vector<BenchResult> & results)
+{
+	row.operation = operation;
+	startCounters();
+	Stopwatch watch;
+	for(const Key & k : probes)
+	{
+		doNotOptimize(op(k));
+	}
+	double elapsed = watch.elapsedNs();
+	stopCounters(row, probes.size());
+	finishResult(row, probes.size(), elapsed);
+	results.push_back(row);
+}
+
+// The key set and probe lists shared by every structure measured for one
+// (key type, distribution, size) combination.
+template<typename Key>
+struct Workload
+{
+	std::vector<Key> keys;
+	std::vector<Key> hits;
+	std::vector<Key> misses;
+	std::vector<Key> notLargest;
+	std::vector<Key> notSmallest;
+
+	Workload(const Options & opt, Distribution d, size_t n)
+	{
+		typedef KeyMaker<Key> Maker;
+		keys.reserve(n);
+		for(size_t i = 0; i < n; i++)
+		{
+			keys.push_back(Maker::make(d, i));
+		}
+
+		// Adversarial lists are linear, so keep the probe count proportional to n.
+		size_t probeCount = d == Distribution::Adversarial ? std::min(opt.ops, n) : opt.ops;
+		std::vector<std::uint64_t> indices = sampleIndices(d, n, probeCount);
+		hits.reserve(probeCount);
+		misses.reserve(probeCount);
+		for(size_t i = 0; i < probeCount; i++)
+		{
+			hits.push_back(keys[indices[i]]);
+			misses.push_back(Maker::make(d, n + indices[i]));
+		}
+
+		// nextKey and previousKey throw on the largest and smallest key.
+		Key smallest = *std::min_element(keys.begin(), keys.end());
+		Key largest = *std::max_element(keys.begin(), keys.end());
+		for(const Key & k : hits)
+		{
+			if(k != largest)
+			{
+				notLargest.push_back(k);
+			}
+			if(k != smallest)
+			{
+				notSmallest.push_back(k);
+			}
+		}
+	}
+};
+
+// In SKIPLIST_STATS builds, attaches the counters gathered during the last
+// timed operation to its row and resets them for the next one.
+template<typename Key>
+void addStatsMetrics(SkipList<Key, unsigned> & sl, [[maybe_unused]] BenchResult & r)
+{
+#ifdef SKIPLIST_STATS
+	const SkipListStats & st = sl.stats();
+	double ops = static_cast<double>(st.searches + st.inserts);
+	if(ops > 0)
+	{
+		r.metrics.emplace_back("comparisons_per_op", st.comparisons / ops);
+		r.metrics.emplace_back("drops_per_op", st.drops / ops);
+		for(size_t level = 0; level < st.nodesVisitedPerLevel.size(); level++)
+		{
+			r.metrics.emplace_back("visited_S" + std::to_string(level) + "_per_op",
+				st.nodesVisitedPerLevel[level] / ops);
+		}
+	}
+	if(st.inserts > 0)
+	{
+		r.metrics.emplace_back("allocations_per_insert", static_cast<double>(st.allocations) / st.inserts);
+		r.metrics.emplace_back("coin_flips_per_insert", static_cast<double>(st.coinFlips) / st.inserts);
+	}
+#endif
+	sl.resetStats();
+}
+
+template<typename Key>
+void benchSkipList(const Options & opt, const Workload<Key> & w, BenchResult row, std::vector<BenchResult> & results)
+{
+	size_t n = w.keys.size();
+	row.structure = "SkipList";
+
+	long long heapBefore = liveHeapBytes();
+	SkipList<Key, unsigned> sl;
+	sl.setAutoRebalance(opt.autoRebalance);
+	row.operation = "insert";
+	startCounters();
+	Stopwatch watch;
+	for(size_t i = 0; i < n; i++)
+	{
+		sl.insert(w.keys[i], static_cast<unsigned>(i));
+	}
+	double elapsed = watch.elapsedNs();
+	stopCounters(row, n);
+	finishResult(row, n, elapsed);
+	results.push_back(row);
+	addStatsMetrics(sl, results.back());
+
+	// The shape of the list explains most of the differences between rows.
+	SkipListStructureReport shape = sl.structureReport(10000);
+	results.back().metrics.emplace_back("layers", shape.layers);
+	results.back().metrics.emplace_back("skew_score", shape.skewScore);
+	results.back().metrics.emplace_back("avg_path_length", shape.averagePathLength);
+	results.back().metrics.emplace_back("max_path_length", static_cast<double>(shape.maxPathLength));
+	results.back().metrics.emplace_back("expected_path_length", shape.expectedPathLength);
+
+	// memoryUsage() next to what the counting allocator saw, which
+	// validates its slack estimate on this platform.
+	SkipListMemoryUsage memory = sl.memoryUsage();
+	results.back().metrics.emplace_back("memory_bytes", static_cast<double>(memory.totalBytes()));
+	results.back().metrics.emplace_back("memory_bytes_per_key", n ? static_cast<double>(memory.totalBytes()) / n : 0);
+	results.back().metrics.emplace_back("allocator_slack_bytes", static_cast<double>(memory.allocatorSlackBytes));
+	results.back().metrics.emplace_back("measured_heap_bytes", static_cast<double>(liveHeapBytes() - heapBefore));
+
+	// The same keys loaded by SkipListBuilder on --threads threads.
+	{
+		std::vector<std::pair<Key, unsigned>> items;
+		items.reserve(n);
+		for(size_t i = 0; i < n; i++)
+		{
+			items.emplace_back(w.keys[i], static_cast<unsigned>(i));
+		}
+		ThreadPool pool(opt.threads);
+		SkipList<Key, unsigned> built;
+		BenchResult bulk = row;
+		bulk.operation = "bulk_build";
+		watch.reset();
+		SkipListBuilder<Key, unsigned>(pool).build(std::move(items), built);
+		finishResult(bulk, n, watch.elapsedNs());
+		bulk.metrics.emplace_back("threads", opt.threads);
+		results.push_back(bulk);
+	}
+
+	timeProbes("find_hit", w.hits, [&](const Key & k) { return sl.find(k); }, row, results);
+	addStatsMetrics(sl, results.back());
+	timeProbes("find_miss", w.misses, [&](const Key & k)
+	{
+		try
+		{
+			return sl.find(k);
+		}
+		catch(RuntimeException &)
+		{
+			return 0u;
+		}
+	}, row, results);
+	addStatsMetrics(sl, results.back());
+	timeProbes("nextKey", w.notLargest, [&](const Key & k) { return sl.nextKey(k); }, row, results);
+	addStatsMetrics(sl, results.back());
+	timeProbes("previousKey", w.notSmallest, [&](const Key & k) { return sl.previousKey(k); }, row, results);
+	addStatsMetrics(sl, results.back());
+	timeProbes("height", w.hits, [&](const Key & k) { return sl.height(k); }, row, results);
+	addStatsMetrics(sl, results.back());
+	timeProbes("isLargestKey", w.hits, [&](const Key & k) { return sl.isLargestKey(k); }, row, results);
+	addStatsMetrics(sl, results.back());
+
+	row.operation = "allKeysInOrder";
+	watch.reset();
+	std::vector<Key> all = sl.allKeysInOrder();
+	doNotOptimize(all.data());
+	// Reported per key visited, so it is comparable across sizes.
+	finishResult(row, all.size(), watch.elapsedNs());
+	results.push_back(row);
+
+	// The same traversal split over --threads threads, values included.
+	ThreadPool pool(opt.threads);
+	row.operation = "parallel_collect";
+	watch.reset();
+	std::vector<std::pair<Key, unsigned>> pairs = parallelCollect(sl, pool);
+	doNotOptimize(pairs.data());
+	finishResult(row, pairs.size(), watch.elapsedNs());
+	row.metrics.emplace_back("threads", opt.threads);
+	results.push_back(row);
+}
+
+// Times every probe individually and appends a row with latency percentiles.
+template<typename Key, typename Op>
+void timeLatencies(const std::string & operation, const std::vector<Key> & probes, Op op,
+	BenchResult row, std::vector<BenchResult> & results)
+{
+	row.operation = operation;
+	std::vector<double> latencies;
+	latencies.reserve(probes.size());
+	for(const Key & k : probes)
+	{
+		Stopwatch watch;
+		doNotOptimize(op(k));
+		latencies.push_back(watch.elapsedNs());
+	}
+	finishLatencyResult(row, latencies);
+	results.push_back(row);
+}
+
+// Runs the same workload against one container through its adapter.
+template<typename Adapter, typename Key>
+void benchCompare(const Workload<Key> & w, BenchResult row, std::vector<BenchResult> & results)
+{
+	row.structure = Adapter::name();
+
+	long long before = liveHeapBytes();
+	Stopwatch watch;
+	Adapter * container = new Adapter();
+	container->build(w.keys);
+	row.operation = "build";
+	finishResult(row, w.keys.size(), watch.elapsedNs());
+	long long bytes = liveHeapBytes() - before;
+	row.metrics.emplace_back("bytes_per_key", w.keys.empty() ? 0.0 : static_cast<double>(bytes) / w.keys.size());
+	results.push_back(row);
+	row.metrics.clear();
+
+	timeLatencies("find_hit", w.hits, [&](const Key & k)
+	{
+		unsigned v = 0;
+		container->find(k, v);
+		return v;
+	}, row, results);
+	timeLatencies("find_miss", w.misses, [&](const Key & k)
+	{
+		unsigned v = 0;
+		return container->find(k, v);
+	}, row, results);
+	if(Adapter::ordered)
+	{
+		timeLatencies("next", w.notLargest, [&](const Key & k)
+		{
+			Key out = k;
+			container->next(k, out);
+			return out;
+		}, row, results);
+		timeLatencies("prev", w.notSmallest, [&](const Key & k)
+		{
+			Key out = k;
+			container->prev(k, out);
+			return out;
+		}, row, results);
+
+		row.operation = "scan";
+		watch.reset();
+		size_t visited = container->scan();
+		finishResult(row, visited, watch.elapsedNs());
+		results.push_back(row);
+	}
+
+	// Inserting the miss keys grows the container past n, so it runs last.
+	std::vector<Key> fresh(w.misses.begin(), w.misses.begin() + std::min(w.misses.size(), w.keys.size()));
+	timeLatencies("insert", fresh, [&](const Key & k)
+	{
+		return container->insert(k, 0);
+	}, row, results);
+
+	delete container;
+}
+
+// One operation of the mixed workload.
+template<typename Key>
+struct MixedOp
+{
+	bool read;
+	Key key;
+};
+
+// Runs reads and inserts from opt.threads threads against one shared
+// container loaded with the workload's keys. Each thread performs opt.ops
+// operations; opt.readRatio of them look up existing keys drawn from the
+// distribution and the rest insert keys no other thread inserts.
+// Every operation is timed into a per-thread histogram.
+template<typename Adapter, typename Key>
+void benchMixed(const Options & opt, Distribution d, const Workload<Key> & w, BenchResult row,
+	std::vector<BenchResult> & results)
+{
+	row.structure = Adapter::name();
+	size_t n = w.keys.size();
+	unsigned threads = opt.threads;
+
+	Adapter * container = new Adapter();
+	container->build(w.keys);
+
+	// Plan every thread's operations up front so generation is not timed.
+	std::vector<std::vector<MixedOp<Key>>> plans(threads);
+	for(unsigned t = 0; t < threads; t++)
+	{
+		std::vector<std::uint64_t> picks = sampleIndices(d, n, opt.ops, 100 + t);
+		std::mt19937_64 rng(200 + t);
+		std::uniform_real_distribution<double> coin(0.0, 1.0);
+		size_t fresh = 0;
+		for(size_t i = 0; i < opt.ops; i++)
+		{
+			if(coin(rng) < opt.readRatio)
+			{
+				plans[t].push_back(MixedOp<Key>{true, w.keys[picks[i]]});
+			}
+			else
+			{
+				plans[t].push_back(MixedOp<Key>{false, KeyMaker<Key>::make(d, n + t + threads * fresh++)});
+			}
+		}
+	}
+
+	std::vector<LatencyHistogram> reads(threads);
+	std::vector<LatencyHistogram> inserts(threads);
+	std::atomic<unsigned> ready{0};
+	std::atomic<bool> go{false};
+
+	std::vector<std::thread> workers;
+	for(unsigned t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&, t]()
+		{
+			ready++;
+			while(!go.load())
+			{
+				std::this_thread::yield();
+			}
+			for(const MixedOp<Key> & op : plans[t])
+			{
+				Stopwatch watch;
+				if(op.read)
+				{
+					unsigned v = 0;
+					container->find(op.key, v);
+					doNotOptimize(v);
+					reads[t].record(static_cast<std::uint64_t>(watch.elapsedNs()));
+				}
+				else
+				{
+					doNotOptimize(container->insert(op.key, 0));
+					inserts[t].record(static_cast<std::uint64_t>(watch.elapsedNs()));
+				}
+			}
+		});
+	}
+	while(ready.load() < threads)
+	{
+		std::this_thread::yield();
+	}
+	Stopwatch wall;
+	go = true;
+	for(std::thread & worker : workers)
+	{
+		worker.join();
+	}
+	double wallNs = wall.elapsedNs();
+	delete container;
+
+	LatencyHistogram allReads;
+	LatencyHistogram allInserts;
+	for(unsigned t = 0; t < threads; t++)
+	{
+		allReads.merge(reads[t]);
+		allInserts.merge(inserts[t]);
+	}
+	LatencyHistogram all;
+	all.merge(allReads);
+	all.merge(allInserts);
+
+	row.metrics.emplace_back("threads", threads);
+	row.metrics.emplace_back("read_ratio", opt.readRatio);
+	const LatencyHistogram * histograms[] = {&allReads, &allInserts, &all};
+	const char * names[] = {"read", "insert", "all"};
+	for(int i = 0; i < 3; i++)
+	{
+		BenchResult r = row;
+		r.operation = names[i];
+		finishHistogramResult(r, *histograms[i], wallNs);
+		results.push_back(r);
+	}
+}
+
+// Many-producer ingest: opt.threads threads each insert opt.ops keys no
+// other thread inserts into one SkipList preloaded with the workload's keys,
+// first with a mutex taken per insert, then through BufferedSkipList
+// producers that merge sorted batches of `capacity` keys.
+template<typename Key>
+void benchIngest(const Options & opt, Distribution d, const Workload<Key> & w, BenchResult row,
+	std::vector<BenchResult> & results)
+{
+	const size_t capacity = 4096;
+	size_t n = w.keys.size();
+	unsigned threads = opt.threads;
+	std::vector<std::vector<Key>> fresh(threads);
+	for(unsigned t = 0; t < threads; t++)
+	{
+		for(size_t i = 0; i < opt.ops; i++)
+		{
+			fresh[t].push_back(KeyMaker<Key>::make(d, n + t + threads * i));
+		}
+	}
+	row.operation = "ingest";
+	row.metrics.emplace_back("threads", threads);
+
+	auto run = [&](std::function<void(unsigned)> produce)
+	{
+		std::vector<std::thread> workers;
+		Stopwatch watch;
+		for(unsigned t = 0; t < threads; t++)
+		{
+			workers.emplace_back(produce, t);
+		}
+		for(std::thread & worker : workers)
+		{
+			worker.join();
+		}
+		return watch.elapsedNs();
+	};
+
+	{
+		LockedAdapter<SkipListAdapter<Key>> locked;
+		locked.build(w.keys);
+		double elapsed = run([&](unsigned t)
+		{
+			for(const Key & k : fresh[t])
+			{
+				locked.insert(k, 0);
+			}
+		});
+		BenchResult r = row;
+		r.structure = locked.name();
+		finishResult(r, threads * opt.ops, elapsed);
+		results.push_back(r);
+	}
+	{
+		BufferedSkipList<Key, unsigned> buffered;
+		{
+			typename BufferedSkipList<Key, unsigned>::Producer loader = buffered.producer(n);
+			for(size_t i = 0; i < n; i++)
+			{
+				loader.insert(w.keys[i], static_cast<unsigned>(i));
+			}
+		}
+		double elapsed = run([&](unsigned t)
+		{
+			typename BufferedSkipList<Key, unsigned>::Producer producer = buffered.producer(capacity);
+			for(const Key & k : fresh[t])
+			{
+				producer.insert(k, 0);
+			}
+		});
+		BenchResult r = row;
+		r.structure = "BufferedSkipList";
+		finishResult(r, threads * opt.ops, elapsed);
+		r.metrics.emplace_back("buffer_capacity", static_cast<double>(capacity));
+		results.push_back(r);
+	}
+}
+
+// Loads `records` records into a SkipList<std::string, std::string> and
+// runs opt.ops operations of one YCSB core workload against it, timing
+// every operation. Updates write through the reference find() returns;
+// scans walk forward from a random record with nextKey.
+void benchYcsb(const Options & opt, size_t records, char letter, std::vector<BenchResult> & results)
+{
+	YcsbWorkload workload = YcsbWorkload::standard(letter);
+	YcsbConfig config;
+	config.recordCount = records;
+	config.operationCount = opt.ops;
+	config.keySize = opt.keySize;
+	config.valueSize = opt.valueSize;
+	YcsbGenerator generator(workload, config);
+
+	BenchResult row;
+	row.structure = "SkipList";
+	row.keyType = "string";
+	row.distribution = ycsbDistributionName(workload.distribution);
+	row.size = records;
+	row.metrics.emplace_back("key_size", static_cast<double>(config.keySize));
+	row.metrics.emplace_back("value_size", static_cast<double>(config.valueSize));
+	std::string prefix = std::string("ycsb_") + letter + "_";
+
+	// The trace covers the load phase too, so replaying it rebuilds the
+	// same list before the run-phase operations arrive.
+	std::unique_ptr<TraceWriter<std::string>> trace;
+	if(!opt.recordTracePath.empty())
+	{
+		trace.reset(new TraceWriter<std::string>(opt.recordTracePath));
+		for(size_t i = 0; i < records; i++)
+		{
+			trace->record(TraceOp::Insert, generator.key(i));
+		}
+	}
+
+	SkipList<std::string, std::string> store;
+	store.setAutoRebalance(opt.autoRebalance);
+	Stopwatch watch;
+	for(size_t i = 0; i < records; i++)
+	{
+		store.insert(generator.key(i), generator.value(i));
+	}
+	BenchResult load = row;
+	load.operation = prefix + "load";
+	finishResult(load, records, watch.elapsedNs());
+	results.push_back(load);
+
+	const YcsbOp kinds[] = {YcsbOp::Read, YcsbOp::Update, YcsbOp::Insert, YcsbOp::Scan, YcsbOp::ReadModifyWrite};
+	std::vector<LatencyHistogram> histograms(5);
+	LatencyHistogram all;
+	Stopwatch wall;
+	for(size_t i = 0; i < opt.ops; i++)
+	{
+		YcsbOp op = generator.nextOp();
+		std::string key = op == YcsbOp::Insert
+			? generator.key(generator.nextInsert())
+			: generator.key(generator.nextRecord());
+		std::string value = generator.value(i);
+		size_t scanLength = op == YcsbOp::Scan ? generator.nextScanLength() : 0;
+		if(trace)
+		{
+			// Updates and read-modify-writes reach the list as lookups.
+			trace->record(op == YcsbOp::Insert ? TraceOp::Insert : TraceOp::Find, key);
+		}
+
+		Stopwatch timer;
+		try
+		{
+			switch(op)
+			{
+				case YcsbOp::Read:
+					doNotOptimize(store.find(key).size());
+					break;
+				case YcsbOp::Update:
+					store.find(key) = value;
+					break;
+				case YcsbOp::Insert:
+					store.insert(key, value);
+					break;
+				case YcsbOp::Scan:
+					doNotOptimize(store.find(key).size());
+					for(size_t j = 1; j < scanLength; j++)
+					{
+						if(trace)
+						{
+							trace->record(TraceOp::Next, key);
+						}
+						key = store.nextKey(key);
+					}
+					break;
+				case YcsbOp::ReadModifyWrite:
+				{
+					std::string & stored = store.find(key);
+					value[0] = stored.empty() ? 'a' : stored[0];
+					stored = value;
+					break;
+				}
+			}
+		}
+		catch(RuntimeException &)
+		{
+			// A scan ran off the end of the list, or a short key collided.
+		}
+		std::uint64_t ns = static_cast<std::uint64_t>(timer.elapsedNs());
+		histograms[static_cast<size_t>(op)].record(ns);
+		all.record(ns);
+	}
+	double wallNs = wall.elapsedNs();
+
+	for(size_t i = 0; i < 5; i++)
+	{
+		if(histograms[i].count() == 0)
+		{
+			continue;
+		}
+		BenchResult r = row;
+		r.operation = prefix + ycsbOpName(kinds[i]);
+		finishHistogramResult(r, histograms[i], wallNs);
+		// The run is single threaded, so the time per operation of one
+		// kind is its mean latency; throughput stays relative to the run.
+		r.nsPerOp = histograms[i].mean();
+		results.push_back(r);
+	}
+	BenchResult total = row;
+	total.operation = prefix + "all";
+	finishHistogramResult(total, all, wallNs);
+	results.push_back(total);
+}
+
+// Replays the trace at opt.tracePath against an empty SkipList<Key, unsigned>.
+// The trace is read into memory first and the replay is timed as a whole,
+// so the row measures the list and not the file. Inserts store the record
+// index as the value; lookups of missing keys and duplicate inserts are
+// counted as misses.
+template<typename Key>
+void benchReplay(const Options & opt, std::vector<BenchResult> & results)
+{
+	TraceReader<Key> reader(opt.tracePath);
+	std::vector<TraceRecord<Key>> records = reader.readAll();
+
+	SkipList<Key, unsigned> list;
+	list.setAutoRebalance(opt.autoRebalance);
+	size_t counts[4] = {0, 0, 0, 0};
+	size_t misses = 0;
+
+	BenchResult row;
+	row.structure = "SkipList";
+	row.operation = "replay";
+	row.keyType = KeyMaker<Key>::typeName();
+	row.distribution = "trace";
+	startCounters();
+	Stopwatch watch;
+	for(size_t i = 0; i < records.size(); i++)
+	{
+		const TraceRecord<Key> & r = records[i];
+		counts[static_cast<size_t>(r.op)]++;
+		try
+		{
+			switch(r.op)
+			{
+				case TraceOp::Insert:
+					if(!list.insert(r.key, static_cast<unsigned>(i)))
+					{
+						misses++;
+					}
+					break;
+				case TraceOp::Find:
+					doNotOptimize(list.find(r.key));
+					break;
+				case TraceOp::Next:
+					doNotOptimize(list.nextKey(r.key));
+					break;
+				case TraceOp::Prev:
+					doNotOptimize(list.previousKey(r.key));
+					break;
+			}
+		}
+		catch(RuntimeException &)
+		{
+			misses++;
+		}
+	}
+	double elapsed = watch.elapsedNs();
+	stopCounters(row, records.size());
+	finishResult(row, records.size(), elapsed);
+	row.size = list.size();
+	for(TraceOp op : {TraceOp::Insert, TraceOp::Find, TraceOp::Next, TraceOp::Prev})
+	{
+		row.metrics.emplace_back(traceOpName(op) + "s", static_cast<double>(counts[static_cast<size_t>(op)]));
+	}
+	row.metrics.emplace_back("misses", static_cast<double>(misses));
+	row.metrics.emplace_back("layers", static_cast<double>(list.numLayers()));
+	results.push_back(row);
+}
+
+template<typename Key>
+void runSuite(const Options & opt, std::vector<BenchResult> & results)
+{
+	for(Distribution d : opt.distributions)
+	{
+		for(size_t n : opt.sizes)
+		{
+			if(n == 0 || (d == Distribution::Adversarial && n > opt.adversarialLimit))
+			{
+				continue;
+			}
+			std::cerr << "running " << KeyMaker<Key>::typeName() << " "
+				<< distributionName(d) << " n=" << n << std::endl;
+
+			Workload<Key> w(opt, d, n);
+			BenchResult row;
+			row.keyType = KeyMaker<Key>::typeName();
+			row.distribution = distributionName(d);
+			row.size = n;
+
+			if(opt.mode == "compare")
+			{
+				benchCompare<SkipListAdapter<Key>>(w, row, results);
+				benchCompare<MapAdapter<Key>>(w, row, results);
+				benchCompare<UnorderedMapAdapter<Key>>(w, row, results);
+				benchCompare<SortedVectorAdapter<Key>>(w, row, results);
+			}
+			else if(opt.mode == "mixed")
+			{
+				benchMixed<LockedAdapter<SkipListAdapter<Key>>>(opt, d, w, row, results);
+				benchMixed<LockedAdapter<MapAdapter<Key>>>(opt, d, w, row, results);
+				benchMixed<LazySkipListAdapter<Key>>(opt, d, w, row, results);
+				benchMixed<ShardedSkipListAdapter<Key>>(opt, d, w, row, results);
+				benchIngest<Key>(opt, d, w, row, results);
+			}
+			else
+			{
+				benchSkipList<Key>(opt, w, row, results);
+			}
+		}
+	}
+}
+
+}
+
+
+int main(int argc, char ** argv)
+{
+	Options opt;
+	if(!parseOptions(argc, argv, opt))
+	{
+		return 1;
+	}
+	if(opt.mode != "ops" && opt.mode != "compare" && opt.mode != "mixed" && opt.mode != "ycsb" && opt.mode != "replay")
+	{
+		std::cerr << "unknown mode " << opt.mode << std::endl;
+		return 1;
+	}
+
+	PerfCounters counters;
+	if(opt.perf)
+	{
+		if(counters.available())
+		{
+			hardwareCounters = &counters;
+		}
+		else
+		{
+			std::cerr << "hardware counters unavailable, reporting timings only" << std::endl;
+		}
+	}
+
+	std::vector<BenchResult> results;
+	if(opt.mode == "replay")
+	{
+		try
+		{
+			if(traceKeyTag(opt.tracePath) == TraceKeyCodec<unsigned>::tag)
+			{
+				benchReplay<unsigned>(opt, results);
+			}
+			else
+			{
+				benchReplay<std::string>(opt, results);
+			}
+		}
+		catch(RuntimeException & e)
+		{
+			std::cerr << e << std::endl;
+			return 1;
+		}
+	}
+	else if(opt.mode == "ycsb")
+	{
+		for(size_t records : opt.sizes)
+		{
+			for(char letter : opt.workloads)
+			{
+				if(records == 0)
+				{
+					continue;
+				}
+				std::cerr << "running YCSB " << letter << " records=" << records << std::endl;
+				try
+				{
+					benchYcsb(opt, records, letter, results);
+				}
+				catch(RuntimeException & e)
+				{
+					std::cerr << e << std::endl;
+					return 1;
+				}
+			}
+		}
+	}
+	else
+	{
+		if(opt.runUnsigned)
+		{
+			runSuite<unsigned>(opt, results);
+		}
+		if(opt.runString)
+		{
+			runSuite<std::string>(opt, results);
+		}
+	}
+
+	if(opt.outPath.empty())
+	{
+		writeJson(std::cout, results);
+	}
+	else
+	{
+		std::ofstream out(opt.outPath);
+		writeJson(out, results);
+	}
+	return 0;
+}